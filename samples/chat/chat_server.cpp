@@ -5,8 +5,6 @@
 
 #include "chat_message.h"
 
-#include <map>
-
 using namespace cyclone;
 using namespace std::placeholders;
 
@@ -25,11 +23,9 @@ class ChatServer
 public:
 	void startAndJoin(uint16_t server_port)
 	{
-		m_clients_lock = sys_api::mutex_create();
-
 		TcpServer server("chat_server", nullptr);
-		server.m_listener.onConnected = std::bind(&ChatServer::onClientConnected, this, _3);
-		server.m_listener.onMessage = std::bind(&ChatServer::onClientMessage, this, _3);
+		server.m_listener.onConnected = std::bind(&ChatServer::onClientConnected, this, _1, _3);
+		server.m_listener.onMessage = std::bind(&ChatServer::onClientMessage, this, _1, _3);
 		server.m_listener.onClose = std::bind(&ChatServer::onClientClose, this, _3);
 
 		if (!server.bind(Address(server_port, false), false)) return;
@@ -37,16 +33,19 @@ public:
 		if (!(server.start(sys_api::get_cpu_counts()))) return;
 
 		server.join();
-
-		sys_api::mutex_destroy(m_clients_lock);
 	}
 private:
+	//all clients are in one chat room
+	enum { kChatRoom = 1 };
+
 	//-------------------------------------------------------------------------------------
-	void onClientConnected(ConnectionPtr conn)
+	void onClientConnected(TcpServer* server, ConnectionPtr conn)
 	{
-		//new connection
-		sys_api::auto_mutex lock(m_clients_lock);
-		m_clients.insert({ conn->get_id(),{ conn->get_id(), conn } });
+		//the chat messages sent in one loop step will be flushed together
+		conn->set_auto_cork(true);
+
+		//new connection, the members are kept by its work thread, no lock is needed
+		server->join_group(conn, kChatRoom);
 
 		CY_LOG(L_DEBUG, "new connection accept, from %s:%d to %s:%d",
 			conn->get_peer_addr().get_ip(),
@@ -56,44 +55,28 @@ private:
 	}
 
 	//-------------------------------------------------------------------------------------
-	void onClientMessage(ConnectionPtr conn)
+	void onClientMessage(TcpServer* server, ConnectionPtr conn)
 	{
 		RingBuf& buf = conn->get_input_buf();
 
-		for (;;)
+		//the packet is read from the input buf directly, without copy
+		PacketView packet;
+		while (packet.parse(PACKET_HEAD_SIZE, buf))
 		{
-			Packet packet;
-			if (!packet.build(PACKET_HEAD_SIZE, buf)) return;
-
-			{
-				sys_api::auto_mutex lock(m_clients_lock);
-
-				for (auto client : m_clients) {
-					client.second.connection->send(packet.get_memory_buf(), packet.get_memory_size());
-				}
-			}
+			//one message to every work thread, they send it to their own clients
+			server->publish(kChatRoom, packet.get_memory_buf(), packet.get_memory_size());
+			packet.consume();
 		}
 	}
 
 	//-------------------------------------------------------------------------------------
 	void onClientClose(ConnectionPtr conn)
 	{
-		sys_api::auto_mutex lock(m_clients_lock);
-
-		m_clients.erase(conn->get_id());
+		//the connection leaves the chat room automatically
 		CY_LOG(L_DEBUG, "connection %s:%d closed",
 			conn->get_peer_addr().get_ip(),
 			conn->get_peer_addr().get_port());
 	}
-
-private:
-	struct Client
-	{
-		int32_t agent_id;
-		ConnectionPtr connection;
-	};
-	std::map< int32_t, Client > m_clients;
-	sys_api::mutex_t m_clients_lock;
 };
 
 //-------------------------------------------------------------------------------------
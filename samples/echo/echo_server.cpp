@@ -9,10 +9,11 @@ using namespace cyclone;
 
 #define MAX_ECHO_LENGTH (255)
 
-enum { OPT_PORT, OPT_HELP };
+enum { OPT_PORT, OPT_ACCEPT_MODE, OPT_HELP };
 
 CSimpleOptA::SOption g_rgOptions[] = {
 	{ OPT_PORT, "-p",     SO_REQ_SEP }, // "-p LISTEN_PORT"
+	{ OPT_ACCEPT_MODE, "-m", SO_REQ_SEP }, // "-m ACCEPT_MODE"
 	{ OPT_HELP, "-?",     SO_NONE },	// "-?"
 	{ OPT_HELP, "--help", SO_NONE },	// "--help"
 	SO_END_OF_OPTIONS                   // END
@@ -74,7 +75,8 @@ void onPeerClose(TcpServer* server, int32_t thread_index, ConnectionPtr conn)
 static void printUsage(const char* moduleName)
 {
 	printf("===== Echo Server(Powerd by Cyclone) =====\n");
-	printf("Usage: %s [-p LISTEN_PORT] [-?] [--help]\n", moduleName);
+	printf("Usage: %s [-p LISTEN_PORT] [-m ACCEPT_MODE] [-?] [--help]\n", moduleName);
+	printf("\t-m ACCEPT_MODE\t0: accept thread(default), 1: reuse port per work thread, 2: shared listener\n");
 }
 
 //-------------------------------------------------------------------------------------
@@ -82,6 +84,7 @@ int main(int argc, char* argv[])
 {
 	CSimpleOptA args(argc, argv, g_rgOptions);
 	uint16_t server_port = 1978;
+	int32_t accept_mode = TcpServer::kAcceptThread;
 
 	while (args.Next()) {
 		if (args.LastError() == SO_SUCCESS) {
@@ -92,6 +95,9 @@ int main(int argc, char* argv[])
 			else if (args.OptionId() == OPT_PORT) {
 				server_port = (uint16_t)atoi(args.OptionArg());
 			}
+			else if (args.OptionId() == OPT_ACCEPT_MODE) {
+				accept_mode = atoi(args.OptionArg());
+			}
 
 		}
 		else {
@@ -108,6 +114,11 @@ int main(int argc, char* argv[])
 	server.m_listener.onClose = onPeerClose;
 	server.m_listener.onMessage = onPeerMessage;
 
+	if (!server.set_accept_mode((TcpServer::AcceptMode)accept_mode)) {
+		printf("Invalid accept mode: %d\n", accept_mode);
+		return 1;
+	}
+
 	server.bind(Address(server_port, false), true);
 
 	if (!server.start(sys_api::get_cpu_counts()))
@@ -94,7 +94,7 @@ private:
 		newSessionMsg.id = conn->get_id();
 
 		Packet packet;
-		packet.build((size_t)RELAY_PACKET_HEADSIZE, (uint16_t)RelayNewSessionMsg::ID, sizeof(newSessionMsg), (const char*)&newSessionMsg);
+		packet.build_wide((size_t)RELAY_PACKET_HEADSIZE, (uint16_t)RelayNewSessionMsg::ID, sizeof(newSessionMsg), (const char*)&newSessionMsg);
 		m_upClient->send(packet.get_memory_buf(), packet.get_memory_size());
 
 		CY_LOG(L_TRACE, "[%d]CLIENT connected, send new session msg to UP", conn->get_id());
@@ -109,7 +109,7 @@ private:
 		RingBuf& ringBuf = conn->get_input_buf();
 
 		while (!ringBuf.empty()) {
-			size_t msgSize = (ringBuf.size() < 0xFF00u) ? ringBuf.size() : 0xFF00u;
+			size_t msgSize = (ringBuf.size() < (size_t)RELAY_FORWARD_MAX_SIZE) ? ringBuf.size() : (size_t)RELAY_FORWARD_MAX_SIZE;
 
 			RelayForwardMsg forwardMsg;
 			forwardMsg.id = conn->get_id();
@@ -117,7 +117,7 @@ private:
 
 			size_t buf_round_size = m_encryptMode ? _round16(msgSize) : msgSize;
 			Packet packet;
-			packet.build((size_t)RELAY_PACKET_HEADSIZE, (uint16_t)RelayForwardMsg::ID, (uint16_t)(sizeof(RelayForwardMsg) + buf_round_size), nullptr);
+			packet.build_wide((size_t)RELAY_PACKET_HEADSIZE, (uint16_t)RelayForwardMsg::ID, (uint32_t)(sizeof(RelayForwardMsg) + buf_round_size), nullptr);
 
 			memcpy(packet.get_packet_content(), &forwardMsg, sizeof(forwardMsg));
 			ringBuf.memcpy_out(packet.get_packet_content() + sizeof(forwardMsg), msgSize);
@@ -146,7 +146,7 @@ private:
             closeSessionMsg.id = conn->get_id();
 
             Packet packet;
-            packet.build((size_t)RELAY_PACKET_HEADSIZE, (uint16_t)RelayCloseSessionMsg::ID, sizeof(closeSessionMsg), (const char*)&closeSessionMsg);
+            packet.build_wide((size_t)RELAY_PACKET_HEADSIZE, (uint16_t)RelayCloseSessionMsg::ID, sizeof(closeSessionMsg), (const char*)&closeSessionMsg);
             m_upClient->send(packet.get_memory_buf(), packet.get_memory_size());
 
             CY_LOG(L_TRACE, "[%d]down client closed!, send close session message to up server", conn->get_id());
@@ -162,13 +162,15 @@ private:
 		if (success) {
 			//set tcp nodelay
 			socket_api::set_nodelay(conn->get_socket(), true);
+			//all sessions share this connection, flush the forward messages once per loop step
+			conn->set_auto_cork(true);
 
 			//send handshake message
 			RelayHandshakeMsg handshake;
 			handshake.dh_key = m_publicKey;
 
 			Packet packet;
-			packet.build((size_t)RELAY_PACKET_HEADSIZE, (uint16_t)RelayHandshakeMsg::ID, sizeof(handshake), (const char*)&handshake);
+			packet.build_wide((size_t)RELAY_PACKET_HEADSIZE, (uint16_t)RelayHandshakeMsg::ID, sizeof(handshake), (const char*)&handshake);
 			m_upClient->send(packet.get_memory_buf(), packet.get_memory_size());
 
 			//update state
@@ -186,10 +188,18 @@ private:
 	{
 		for (;;) {
 			if (m_upState == kHandshaking) {
-				//peed message id
+				//peek message id and size
 				uint16_t packetID;
-				if (sizeof(packetID) != conn->get_input_buf().peek(2, &packetID, sizeof(packetID))) return;
-				packetID = socket_api::ntoh_16(packetID);
+				uint32_t packetSize;
+				if (!Packet::peek_head(Packet::kWideHead, conn->get_input_buf(), packetID, packetSize)) return;
+
+				//never wait a packet larger than the biggest forward message
+				if (packetSize > RELAY_PACKET_MAX_SIZE) {
+					CY_LOG(L_ERROR, "receive too large packet(%d), size=%u", packetID, packetSize);
+					client->disconnect();
+					m_upState = kDisConnected;
+					return;
+				}
 
 				//must be handshake message
 				if (packetID != (uint16_t)RELAY_HANDSHAKE_ID) {
@@ -200,7 +210,7 @@ private:
 
 				//get handshake message
 				Packet handshakePacket;
-				if (!handshakePacket.build(RELAY_PACKET_HEADSIZE, conn->get_input_buf())) return;
+				if (!handshakePacket.build_wide(RELAY_PACKET_HEADSIZE, conn->get_input_buf())) return;
 
 				//check size
 				if (handshakePacket.get_packet_size() != sizeof(RelayHandshakeMsg)) {
@@ -244,20 +254,37 @@ private:
 				memset(m_secretKey.bytes, 0, Rijndael::BLOCK_SIZE);
 			}
 			else if (m_upState == kHandshaked) {
-				//peed message id
+				//peek message id and size
 				uint16_t packetID;
-				if (sizeof(packetID) != conn->get_input_buf().peek(2, &packetID, sizeof(packetID))) return;
-				packetID = socket_api::ntoh_16(packetID);
+				uint32_t packetSize;
+				if (!Packet::peek_head(Packet::kWideHead, conn->get_input_buf(), packetID, packetSize)) return;
 
+				//never wait a packet larger than the biggest forward message
+				if (packetSize > RELAY_PACKET_MAX_SIZE) {
+					CY_LOG(L_ERROR, "receive too large packet(%d), size=%u", packetID, packetSize);
+					client->disconnect();
+					m_upState = kDisConnected;
+					return;
+				}
+
+				//the packet is read from the input buf directly, and consumed after handled
+				PacketView packet;
 				switch (packetID) {
 				case RELAY_FORWARD:
 				{
 					//get packet
-					Packet packet;
-					if (!packet.build(RELAY_PACKET_HEADSIZE, conn->get_input_buf())) return;
+					if (!packet.parse_wide(RELAY_PACKET_HEADSIZE, conn->get_input_buf())) return;
 
+					//the data size in message must be inside the packet
 					RelayForwardMsg forwardMsg;
-					memcpy(&forwardMsg, packet.get_packet_content(), sizeof(RelayForwardMsg));
+					if (packet.get_packet_size() < sizeof(forwardMsg)) forwardMsg.size = -1;
+					else memcpy(&forwardMsg, packet.get_packet_content(), sizeof(forwardMsg));
+					if (forwardMsg.size < 0 || (size_t)forwardMsg.size > packet.get_packet_size() - sizeof(forwardMsg)) {
+						CY_LOG(L_ERROR, "receive invalid forward packet, size=%u", packet.get_packet_size());
+						client->disconnect();
+						m_upState = kDisConnected;
+						return;
+					}
 
 					//decrypt
 					if (m_encryptMode)
@@ -273,7 +300,7 @@ private:
 						closeSessionMsg.id = forwardMsg.id;
 
 						Packet packetCloseSession;
-						packetCloseSession.build((size_t)RELAY_PACKET_HEADSIZE, (uint16_t)RelayCloseSessionMsg::ID, sizeof(closeSessionMsg), (const char*)&closeSessionMsg);
+						packetCloseSession.build_wide((size_t)RELAY_PACKET_HEADSIZE, (uint16_t)RelayCloseSessionMsg::ID, sizeof(closeSessionMsg), (const char*)&closeSessionMsg);
 						m_upClient->send(packetCloseSession.get_memory_buf(), packetCloseSession.get_memory_size());
 						break;
 					}
@@ -287,8 +314,7 @@ private:
 				case RELAY_CLOSE_SESSION:
 				{
 					//get packet
-					Packet packet;
-					if (!packet.build(RELAY_PACKET_HEADSIZE, conn->get_input_buf())) return;
+					if (!packet.parse_wide(RELAY_PACKET_HEADSIZE, conn->get_input_buf())) return;
 
 					RelayCloseSessionMsg closeSessionMsg;
 					memcpy(&closeSessionMsg, packet.get_packet_content(), sizeof(closeSessionMsg));
@@ -306,6 +332,7 @@ private:
 				break;
 
 				}
+				packet.consume();
 			}
 		}
 	}
@@ -33,33 +33,11 @@ public:
         socket_api::set_nodelay(m_port1->get_socket(), true);
         socket_api::set_nodelay(m_port2->get_socket(), true);
         
-        //check cache
-        forward1To2();
-        forward2To1();
+        //forward in kernel, the data cached in input buf will be sent first
+        m_port1->forward_to(m_port2);
+        m_port2->forward_to(m_port1);
     }
     
-public:
-    //-------------------------------------------------------------------------------------
-    void forward1To2(void)
-    {
-        RingBuf& ringBuf = m_port1->get_input_buf();
-        if(ringBuf.empty()) return;
-        
-        CY_LOG(L_TRACE, "Forward1To2: %zd", ringBuf.size());
-        m_port2->send((const char*)ringBuf.normalize(), ringBuf.size());
-        ringBuf.reset();
-    }
-    
-    //-------------------------------------------------------------------------------------
-    void forward2To1(void)
-    {
-        RingBuf& ringBuf = m_port2->get_input_buf();
-        if(ringBuf.empty()) return;
-        
-        CY_LOG(L_TRACE, "Forward2To1: %zd", ringBuf.size());
-        m_port1->send((const char*)ringBuf.normalize(), ringBuf.size());
-        ringBuf.reset();
-    }
 private:
     ConnectionPtr m_port1, m_port2;
 };
@@ -74,7 +52,6 @@ public:
 	{
 		TcpServer server("rp", nullptr);
 		server.m_listener.onConnected = std::bind(&RelayPipe_DoubleIn::onConnected, this, _1, _3);
-		server.m_listener.onMessage = std::bind(&RelayPipe_DoubleIn::onMessage, this, _3);
 		server.m_listener.onClose = std::bind(&RelayPipe_DoubleIn::onClose, this, _1);
 
 		server.bind(Address(m_port1=listen_port1, false), true);
@@ -118,19 +95,6 @@ private:
 		}
 	}
 
-	//-------------------------------------------------------------------------------------
-	void onMessage(ConnectionPtr conn)
-	{
-		if (!m_pipe) return;
-
-		if (conn == m_conn1) {
-            m_pipe->forward1To2();
-		}
-		else {
-            m_pipe->forward2To1();
-        }
-	}
-
 	//-------------------------------------------------------------------------------------
 	void onClose(TcpServer* server)
 	{
@@ -172,12 +136,10 @@ private:
 
         TcpClientPtr client1 = std::make_shared<TcpClient>(m_looper, nullptr);
 		client1->m_listener.onConnected = std::bind(&RelayPipe_DoubleOut::onConnected, this, _1, _2, _3, 1);
-		client1->m_listener.onMessage = std::bind(&RelayPipe_DoubleOut::onMessage, this, _1, _2);
 		client1->m_listener.onClose = std::bind(&RelayPipe_DoubleOut::onClose, this, _1);
 
 		TcpClientPtr client2 = std::make_shared<TcpClient>(m_looper, nullptr);
 		client2->m_listener.onConnected = std::bind(&RelayPipe_DoubleOut::onConnected, this, _1, _2, _3, 2);
-		client2->m_listener.onMessage = std::bind(&RelayPipe_DoubleOut::onMessage, this, _1, _2);
 		client2->m_listener.onClose = std::bind(&RelayPipe_DoubleOut::onClose, this, _1);
 
         CY_LOG(L_INFO, "Connect to port1 %s:%d", m_address1.get_ip(), m_address1.get_port());
@@ -217,19 +179,6 @@ private:
 		return 0;
 	}
 
-	//-------------------------------------------------------------------------------------
-	void onMessage(TcpClientPtr client, ConnectionPtr conn)
-	{
-        if(!m_pipe) return;
-        
-		if (client == m_client1) {
-            m_pipe->forward1To2();
-        }
-		else {
-            m_pipe->forward2To1();
-        }
-	}
-
 	//-------------------------------------------------------------------------------------
 	void onClose(TcpClientPtr client)
 	{
@@ -281,7 +230,6 @@ public:
         TcpServer server("rp", nullptr);
         server.m_listener.onWorkThreadStart = std::bind(&RelayPipe_InOut::onWorkthreadStart, this, _1, _3);
         server.m_listener.onConnected = std::bind(&RelayPipe_InOut::onConnectedIn, this, _1, _3);
-        server.m_listener.onMessage = std::bind(&RelayPipe_InOut::onMessageIn, this, _3);
         server.m_listener.onClose = std::bind(&RelayPipe_InOut::onCloseIn, this);
         
         server.bind(Address(m_bindPort=bindPort, false), true);
@@ -302,7 +250,6 @@ private:
         
         m_client = std::make_shared<TcpClient>(m_looper, this);
         m_client->m_listener.onConnected = std::bind(&RelayPipe_InOut::onConnectedOut, this, _2, _3);
-        m_client->m_listener.onMessage = std::bind(&RelayPipe_InOut::onMessageOut, this, _1, _2);
         m_client->m_listener.onClose = std::bind(&RelayPipe_InOut::onCloseOut, this);
         
         m_client->connect(m_addrToConnect);
@@ -324,12 +271,6 @@ private:
         }
     }
     
-    //-------------------------------------------------------------------------------------
-    void onMessageIn(ConnectionPtr conn)
-    {
-        if(m_pipe)
-            m_pipe->forward1To2();
-    }
     //-------------------------------------------------------------------------------------
     void onCloseIn(void)
     {
@@ -356,12 +297,6 @@ private:
         return 0;
     }
     
-    //-------------------------------------------------------------------------------------
-    void onMessageOut(TcpClientPtr client, ConnectionPtr conn)
-    {
-        if(m_pipe) 
-			m_pipe->forward2To1();
-    }
     //-------------------------------------------------------------------------------------
     void onCloseOut(void)
     {
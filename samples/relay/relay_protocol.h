@@ -2,8 +2,11 @@
 
 #include <cy_crypt.h>
 
+//relay packet use wide head(32bit size + 16bit id)
 enum {
-	RELAY_PACKET_HEADSIZE = 4
+	RELAY_PACKET_HEADSIZE = 6,
+	RELAY_PACKET_ID_OFFSET = 4,
+	RELAY_FORWARD_MAX_SIZE = 0x40000
 };
 
 enum {
@@ -39,4 +42,7 @@ struct RelayForwardMsg
 
 	int32_t id;
 	int32_t size;
-};
\ No newline at end of file
+};
+
+//the largest packet is the forward message with the max size data, the larger one is refused
+const uint32_t RELAY_PACKET_MAX_SIZE = (uint32_t)sizeof(RelayForwardMsg) + RELAY_FORWARD_MAX_SIZE;
\ No newline at end of file
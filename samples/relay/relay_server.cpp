@@ -97,16 +97,26 @@ private:
 		m_downConnection = conn;
 
 		socket_api::set_nodelay(conn->get_socket(), true);
+		//all sessions share this connection, flush the forward messages once per loop step
+		conn->set_auto_cork(true);
 	}
 	//-------------------------------------------------------------------------------------
 	void onDownMessage(TcpServer* server, ConnectionPtr conn)
 	{
 		for(;;) {
 		if (m_downState == kWaitHandshaking) {
-			//peed message id
+			//peek message id and size
 			uint16_t packetID;
-			if (sizeof(packetID) != conn->get_input_buf().peek(2, &packetID, sizeof(packetID))) return;
-			packetID = socket_api::ntoh_16(packetID);
+			uint32_t packetSize;
+			if (!Packet::peek_head(Packet::kWideHead, conn->get_input_buf(), packetID, packetSize)) return;
+
+			//never wait a packet larger than the biggest forward message
+			if (packetSize > RELAY_PACKET_MAX_SIZE) {
+				CY_LOG(L_ERROR, "receive too large packet(%d), size=%u", packetID, packetSize);
+				server->shutdown_connection(conn);
+				m_downState = kWaitConnecting;
+				return;
+			}
 
 			//must be handshake message
 			if (packetID != (uint16_t)RELAY_HANDSHAKE_ID) {
@@ -117,7 +127,7 @@ private:
 
 			//get handshake message
 			Packet handshakePacket;
-			if (!handshakePacket.build(RELAY_PACKET_HEADSIZE, conn->get_input_buf())) return;
+			if (!handshakePacket.build_wide(RELAY_PACKET_HEADSIZE, conn->get_input_buf())) return;
 
 			//check size
 			if (handshakePacket.get_packet_size() != sizeof(RelayHandshakeMsg)) {
@@ -154,7 +164,7 @@ private:
 
 			//reply my public key
 			handshake.dh_key = m_publicKey;
-			handshakePacket.build((size_t)RELAY_PACKET_HEADSIZE, (uint16_t)RelayHandshakeMsg::ID, sizeof(handshake), (const char*)&handshake);
+			handshakePacket.build_wide((size_t)RELAY_PACKET_HEADSIZE, (uint16_t)RelayHandshakeMsg::ID, sizeof(handshake), (const char*)&handshake);
 			conn->send(handshakePacket.get_memory_buf(), handshakePacket.get_memory_size());
 
 			//update state
@@ -165,18 +175,27 @@ private:
 			CY_LOG(L_DEBUG, "Down client handshaked(%s:%d)", conn->get_peer_addr().get_ip(), conn->get_peer_addr().get_port());
 		}
 		else if (m_downState == kHandshaked) {
-			//peed message id
+			//peek message id and size
 			uint16_t packetID;
-			if (sizeof(packetID) != conn->get_input_buf().peek(2, &packetID, sizeof(packetID))) return;
-			packetID = socket_api::ntoh_16(packetID);
+			uint32_t packetSize;
+			if (!Packet::peek_head(Packet::kWideHead, conn->get_input_buf(), packetID, packetSize)) return;
 
+			//never wait a packet larger than the biggest forward message
+			if (packetSize > RELAY_PACKET_MAX_SIZE) {
+				CY_LOG(L_ERROR, "receive too large packet(%d), size=%u", packetID, packetSize);
+				server->shutdown_connection(conn);
+				m_downState = kWaitConnecting;
+				return;
+			}
+
+			//the packet is read from the input buf directly, and consumed after handled
+			PacketView packet;
 			switch (packetID)
 			{
 			case RELAY_NEW_SESSION:
 			{
 				//get packet 
-				Packet packet;
-				if (!packet.build(RELAY_PACKET_HEADSIZE, conn->get_input_buf())) return;
+				if (!packet.parse_wide(RELAY_PACKET_HEADSIZE, conn->get_input_buf())) return;
 
 				RelayNewSessionMsg newSessionMsg;
 				memcpy(&newSessionMsg, packet.get_packet_content(), sizeof(newSessionMsg));
@@ -202,8 +221,7 @@ private:
 			case RELAY_CLOSE_SESSION:
 			{
 				//get packet 
-				Packet packet;
-				if (!packet.build(RELAY_PACKET_HEADSIZE, conn->get_input_buf())) return;
+				if (!packet.parse_wide(RELAY_PACKET_HEADSIZE, conn->get_input_buf())) return;
 
 				RelayCloseSessionMsg closeSessionMsg;
 				memcpy(&closeSessionMsg, packet.get_packet_content(), sizeof(closeSessionMsg));
@@ -224,11 +242,18 @@ private:
 			case RELAY_FORWARD:
 			{
 				//get packet 
-				Packet packet;
-				if (!packet.build(RELAY_PACKET_HEADSIZE, conn->get_input_buf())) return;
+				if (!packet.parse_wide(RELAY_PACKET_HEADSIZE, conn->get_input_buf())) return;
 
+				//the data size in message must be inside the packet
 				RelayForwardMsg forwardMsg;
-				memcpy(&forwardMsg, packet.get_packet_content(), sizeof(forwardMsg));
+				if (packet.get_packet_size() < sizeof(forwardMsg)) forwardMsg.size = -1;
+				else memcpy(&forwardMsg, packet.get_packet_content(), sizeof(forwardMsg));
+				if (forwardMsg.size < 0 || (size_t)forwardMsg.size > packet.get_packet_size() - sizeof(forwardMsg)) {
+					CY_LOG(L_ERROR, "receive invalid forward packet, size=%u", packet.get_packet_size());
+					server->shutdown_connection(conn);
+					m_downState = kWaitConnecting;
+					return;
+				}
 
 				int32_t id = forwardMsg.id;
 				auto it = m_relaySessionMap.find(id);
@@ -263,6 +288,7 @@ private:
 				server->shutdown_connection(conn);
 				break;
 			}
+			packet.consume();
 		}
 		}
 	}
@@ -327,7 +353,7 @@ private:
 			msg.id = session->m_id;
 
 			Packet packet;
-			packet.build(RELAY_PACKET_HEADSIZE, RelayCloseSessionMsg::ID, (uint16_t)(sizeof(RelayCloseSessionMsg)), (const char*)&msg);
+			packet.build_wide(RELAY_PACKET_HEADSIZE, RelayCloseSessionMsg::ID, (uint32_t)(sizeof(RelayCloseSessionMsg)), (const char*)&msg);
 
 			//send to down client
 			m_downConnection->send((const char*)packet.get_memory_buf(), packet.get_memory_size());
@@ -354,7 +380,7 @@ private:
 		RingBuf& ringBuf = conn->get_input_buf();
 
 		while (!ringBuf.empty()) {
-			size_t msgSize = (ringBuf.size() < 0xFF00u) ? ringBuf.size() : 0xFF00u;
+			size_t msgSize = (ringBuf.size() < (size_t)RELAY_FORWARD_MAX_SIZE) ? ringBuf.size() : (size_t)RELAY_FORWARD_MAX_SIZE;
 
 			RelayForwardMsg msg;
 			msg.id = session->m_id;
@@ -364,7 +390,7 @@ private:
 			CY_LOG(L_TRACE, "[%d]receive from UP(%zd/%zd), send to DOWN after encrypt", msg.id, (size_t)msg.size, buf_round_size);
 
 			Packet packet;
-			packet.build(RELAY_PACKET_HEADSIZE, RelayForwardMsg::ID, (uint16_t)(sizeof(RelayForwardMsg) + buf_round_size), nullptr);
+			packet.build_wide(RELAY_PACKET_HEADSIZE, RelayForwardMsg::ID, (uint32_t)(sizeof(RelayForwardMsg) + buf_round_size), nullptr);
 			memcpy(packet.get_packet_content(), &msg, sizeof(RelayForwardMsg));
 			ringBuf.memcpy_out(packet.get_packet_content() + sizeof(RelayForwardMsg), msgSize);
 
@@ -410,7 +436,7 @@ private:
 		msg.id = session_id;
 
 		Packet packet;
-		packet.build(RELAY_PACKET_HEADSIZE, RelayCloseSessionMsg::ID, (uint16_t)(sizeof(RelayCloseSessionMsg)), (const char*)&msg);
+		packet.build_wide(RELAY_PACKET_HEADSIZE, RelayCloseSessionMsg::ID, (uint32_t)(sizeof(RelayCloseSessionMsg)), (const char*)&msg);
 
 		//send to down client
 		m_downConnection->send((const char*)packet.get_memory_buf(), packet.get_memory_size());
@@ -25,9 +25,12 @@ CSimpleOptA::SOption g_rgOptions[] = {
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////
+#define S5_CONNECT_TIMEOUT	(10*1000)
+
 enum S5State {
 	S5_OPENING = 0,
 	S5_OPENED,
+	S5_RESOLVING,
 	S5_CONNECTING,
 	S5_CONNECTED,
 	S5_DISCONNECTED,
@@ -40,19 +43,14 @@ public:
 	void set_state(S5State state) { m_state = state; }
 	S5State get_state(void) const { return m_state; }
 
-	void connect(const Address& address){
-		m_address = address;
+	void connect(const std::vector<Address>& candidates){
+		m_address = candidates[0];
         m_remoteConnection = std::make_shared<TcpClient>(m_looper, this);
 		m_remoteConnection->m_listener.onConnected = std::bind(&S5Tunnel::onServerConnected, this, _2, _3);
-		m_remoteConnection->m_listener.onMessage = std::bind(&S5Tunnel::onServerMessage, this, _2);
 		m_remoteConnection->m_listener.onClose = std::bind(&S5Tunnel::onServerClose, this);
 
-		m_remoteConnection->connect(address);
-	}
-
-	void forword_up(RingBuf& inputBuf) {
-		m_remoteConnection->send((const char*)inputBuf.normalize(), inputBuf.size());
-		inputBuf.reset();
+		//race the candidates, and don't wait the kernel syn retries
+		m_remoteConnection->connect(candidates, S5_CONNECT_TIMEOUT);
 	}
 
 	void disconnect(void) {
@@ -65,6 +63,9 @@ private:
 		assert(get_state()== S5_CONNECTING);
 		RingBuf outputBuf;
 
+		//the winner of candidates
+		if (success) m_address = m_remoteConnection->get_server_address();
+
 		//send act to client
 		s5_build_connect_act(outputBuf, success ? 0 : 0X04, m_address);
 		m_localConnection->send((const char*)outputBuf.normalize(), outputBuf.size());
@@ -75,6 +76,10 @@ private:
 			socket_api::set_nodelay(conn->get_socket(), true);
 
 			m_state = S5_CONNECTED;
+
+			//forward both directions in kernel
+			m_localConnection->forward_to(conn);
+			conn->forward_to(m_localConnection);
 			CY_LOG(L_INFO, "tunnel[%d]: connect to \"%s:%d\" OK",
 				m_localConnection->get_id(), m_address.get_ip(), m_address.get_port());
 		}
@@ -87,13 +92,6 @@ private:
 		return 0;
 	}
 
-	void onServerMessage(ConnectionPtr conn) 
-	{
-		RingBuf& buf = conn->get_input_buf();
-		m_localConnection->send((const char*)buf.normalize(), buf.size());
-		buf.reset();
-	}
-
 	void onServerClose(void) 
 	{
 		m_state = S5_DISCONNECTED;
@@ -133,6 +131,7 @@ public:
 		m_looper = looper;
 		m_localServer = localServer;
 	}
+	Looper* get_looper(void) { return m_looper; }
 	void add_new_tunnel(ConnectionPtr conn) {
 		m_tunnelMap.insert({ conn->get_id(), S5Tunnel(m_localServer, m_looper, conn)});
 	}
@@ -248,6 +247,15 @@ private:
 			Address address;
 			std::string domain;
 			int32_t s5_ret = s5_get_connect_request(inputBuf, address, domain);
+			if (s5_ret == S5ERR_NEED_RESOLVE) {
+				CY_LOG(L_INFO, "tunnel[%d]: begin resolve \"%s\"", conn->get_id(), domain.c_str());
+
+				//resolve in dns threads, don't block other tunnels in this work thread
+				tunnel->set_state(S5_RESOLVING);
+				m_resolver.resolve(threadContext.get_looper(), domain, address.get_port(),
+					std::bind(&S5Server::onResolved, this, server, thread_index, conn, domain, _1, _2));
+				return;
+			}
 			if (s5_ret != S5ERR_SUCCESS) {
 				CY_LOG(L_WARN, "get connect request error, code=%d", s5_ret);
 				server->shutdown_connection(conn);
@@ -258,19 +266,45 @@ private:
 
 			//begin connect to client
 			tunnel->set_state(S5_CONNECTING);
-			tunnel->connect(address);
+			tunnel->connect(std::vector<Address>(1, address));
 		}
 		break;
 
 		case S5_CONNECTED:
 		default:
-		{
-			//forword
-			tunnel->forword_up(inputBuf);
+			//the data is forwarded by connection directly
+			break;
+
 		}
-		break;
+	}
+
+	//-------------------------------------------------------------------------------------
+	void onResolved(TcpServer* server, int32_t thread_index, ConnectionPtr conn, const std::string& domain,
+		bool success, const std::vector<Address>& addresses)
+	{
+		S5ThreadContext& threadContext = m_threadContext[(size_t)thread_index];
+
+		//the tunnel may be closed
+		S5Tunnel* tunnel = threadContext.get_tunnel(conn->get_id());
+		if (tunnel == nullptr || tunnel->get_state() != S5_RESOLVING) return;
 
+		//the act only support ipv4 address
+		std::vector<Address> candidates;
+		for (auto& addr : addresses) {
+			if (addr.get_family() == AF_INET) candidates.push_back(addr);
 		}
+
+		if (!success || candidates.empty()) {
+			CY_LOG(L_WARN, "tunnel[%d]: resolve \"%s\" failed, code=%d", conn->get_id(), domain.c_str(), S5ERR_DNS_FAILED);
+			server->shutdown_connection(conn);
+			return;
+		}
+
+		CY_LOG(L_INFO, "tunnel[%d]: begin connect to \"%s:%d\", %d candidate(s)", conn->get_id(), domain.c_str(),
+			candidates[0].get_port(), (int32_t)candidates.size());
+
+		tunnel->set_state(S5_CONNECTING);
+		tunnel->connect(candidates);
 	}
 
 	//-------------------------------------------------------------------------------------
@@ -288,6 +322,7 @@ private:
 private:
 	typedef std::vector<S5ThreadContext> ThreadContextVec;
 	ThreadContextVec m_threadContext;
+	DnsResolver m_resolver;
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////
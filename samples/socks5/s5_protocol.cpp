@@ -94,19 +94,15 @@ int32_t s5_get_connect_request(RingBuf& inputBuf, Address& address, std::string&
 
 		char domain_name[260] = { 0 };
 		inputBuf.memcpy_out(domain_name, domain_length);
-		
-		sockaddr_in addr;
-		memset(&addr, 0, sizeof(addr));
 
-		addr.sin_family = AF_INET;
-		inputBuf.memcpy_out(&(addr.sin_port), 2);
+		uint16_t port;
+		inputBuf.memcpy_out(&port, 2);
 
-		//resolve
-		if (!socket_api::resolve_hostname(domain_name, addr)) return S5ERR_DNS_FAILED;
-		address = Address(addr);
+		//the domain name should be resolved by caller
+		address = Address((uint16_t)socket_api::ntoh_16(port), false);
 		domain = domain_name;
+		return S5ERR_NEED_RESOLVE;
 	}
-	break;
 
 	default:	//IP V6 address: X'04'(not supported)
 		return S5ERR_NOTSUPPORT;
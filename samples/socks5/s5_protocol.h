@@ -13,6 +13,7 @@ using namespace cyclone;
 #define S5ERR_PROTOCOL_ERR		(-4)
 #define S5ERR_NOTSUPPORT		(-5)
 #define S5ERR_DNS_FAILED		(-6)
+#define S5ERR_NEED_RESOLVE		(1)
 
 //supported version
 #define S5_VERSION				(0x05)
@@ -66,6 +67,8 @@ void s5_build_handshake_act(RingBuf& outputBuf);
 *      -EAGAIN, expects more bytes in buffer
 *      -1, other error
 * 	 0, success
+*	 S5ERR_NEED_RESOLVE, DOMAINNAME request, the domain should be resolved by caller,
+*	   only the port of address is valid
 *
 * From RFC1928:
 * The SOCKS request is formed as follows:
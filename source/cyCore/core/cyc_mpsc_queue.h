@@ -0,0 +1,67 @@
+/*
+Copyright(C) thecodeway.com
+*/
+
+#ifndef _CYCLONE_CORE_MPSC_QUEUE_H_
+#define _CYCLONE_CORE_MPSC_QUEUE_H_
+
+#include <cyclone_config.h>
+
+#include "cyc_atomic.h"
+
+namespace cyclone
+{
+
+//
+// Intrusive multi-producer single-consumer queue
+// Producers push node into a lock-free stack(Treiber stack), the consumer takes all
+// nodes at once and reverses them to FIFO order, so there is no ABA problem
+//
+
+struct MpscNode
+{
+	MpscNode* next;
+};
+
+class MpscQueue : noncopyable
+{
+public:
+	//push a node into the queue(thread safe), returns true if the queue was empty before push
+	bool push(MpscNode* node) {
+		MpscNode* head = m_head.load(std::memory_order_relaxed);
+		do {
+			node->next = head;
+		} while (!m_head.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+		return head == nullptr;
+	}
+
+	//take all nodes in the queue in FIFO order, returns nullptr if the queue is empty
+	//(only one consumer thread can call this function)
+	MpscNode* pop_all(void) {
+		MpscNode* head = m_head.exchange(nullptr, std::memory_order_acquire);
+
+		//reverse the stack
+		MpscNode* first = nullptr;
+		while (head) {
+			MpscNode* next = head->next;
+			head->next = first;
+			first = head;
+			head = next;
+		}
+		return first;
+	}
+
+	//is the queue empty(the result may be out of date in busy environments)
+	bool empty(void) const { return m_head.load() == nullptr; }
+
+private:
+	std::atomic<MpscNode*> m_head;
+
+public:
+	MpscQueue() : m_head(nullptr) {}
+	~MpscQueue() {}
+};
+
+}
+
+#endif
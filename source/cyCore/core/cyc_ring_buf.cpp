@@ -16,11 +16,92 @@ Copyright(C) thecodeway.com
 namespace cyclone
 {
 
+//-------------------------------------------------------------------------------------
+// every thread keeps some free blocks of default size, so the buf of idle connection can 
+// be released and allocated again cheaply, and one spill buf used by read_socket
+//-------------------------------------------------------------------------------------
+struct block_cache_s
+{
+	enum { kBlockSize = RingBuf::kDefaultCapacity + 1, kMaxFreeBlocks = 256, kSpillBufSize = 0xFFFF };
+
+	uint8_t* free_list;		//the first bytes of free block is the point of next one
+	int32_t free_counts;
+	uint8_t* spill_buf;
+};
+
+//the pointer is reset when the thread exits, POD thread_local is still accessable after that
+static thread_local block_cache_s* s_block_cache = nullptr;
+static thread_local bool s_block_cache_released = false;
+
+//-------------------------------------------------------------------------------------
+struct block_cache_guard_s
+{
+	~block_cache_guard_s() {
+		block_cache_s* cache = s_block_cache;
+		if (cache == nullptr) return;
+
+		while (cache->free_list) {
+			uint8_t* next = *((uint8_t**)cache->free_list);
+			CY_FREE(cache->free_list);
+			cache->free_list = next;
+		}
+		CY_FREE(cache->spill_buf);
+		delete cache;
+
+		s_block_cache = nullptr;
+		s_block_cache_released = true;
+	}
+};
+
+//-------------------------------------------------------------------------------------
+static block_cache_s* _get_block_cache(void)
+{
+	if (s_block_cache == nullptr && !s_block_cache_released) {
+		//release the cache when thread exit
+		static thread_local block_cache_guard_s guard;
+		(void)guard;
+
+		s_block_cache = new block_cache_s();
+		s_block_cache->free_list = nullptr;
+		s_block_cache->free_counts = 0;
+		s_block_cache->spill_buf = nullptr;
+	}
+	return s_block_cache;
+}
+
+//-------------------------------------------------------------------------------------
+static uint8_t* _alloc_block(size_t size)
+{
+	block_cache_s* cache = (size == block_cache_s::kBlockSize) ? _get_block_cache() : nullptr;
+	if (cache == nullptr || cache->free_list == nullptr) return (uint8_t*)CY_MALLOC(size);
+
+	uint8_t* block = cache->free_list;
+	cache->free_list = *((uint8_t**)block);
+	cache->free_counts--;
+	return block;
+}
+
+//-------------------------------------------------------------------------------------
+static void _free_block(uint8_t* block, size_t size)
+{
+	if (block == nullptr) return;
+
+	block_cache_s* cache = (size == block_cache_s::kBlockSize) ? _get_block_cache() : nullptr;
+	if (cache == nullptr || cache->free_counts >= block_cache_s::kMaxFreeBlocks) {
+		CY_FREE(block);
+		return;
+	}
+
+	*((uint8_t**)block) = cache->free_list;
+	cache->free_list = block;
+	cache->free_counts++;
+}
+
 //-------------------------------------------------------------------------------------
 RingBuf::RingBuf(size_t _capacity)
 {
 	/* One byte is used for detecting the full condition. */
-	m_buf = (uint8_t*)CY_MALLOC(_capacity + 1);
+	m_buf = (_capacity == 0) ? nullptr : _alloc_block(_capacity + 1);
 	m_end = _capacity + 1;
 	reset();
 }
@@ -28,23 +109,29 @@ RingBuf::RingBuf(size_t _capacity)
 //-------------------------------------------------------------------------------------
 RingBuf::~RingBuf()
 {
-	CY_FREE(this->m_buf);
+	_free_block(m_buf, m_end);
 }
 
 //-------------------------------------------------------------------------------------
 void RingBuf::_auto_resize(size_t need_size)
 {
-	//auto inc size
-	size_t new_size = 2;
+	//auto inc size, the buf without memory start from default size
+	size_t new_size = (m_buf == nullptr) ? (size_t)block_cache_s::kBlockSize : 2;
 	while (new_size < need_size) new_size *= 2;
 
+	_resize(new_size);
+}
+
+//-------------------------------------------------------------------------------------
+void RingBuf::_resize(size_t new_size)
+{
 	//copy old data
 	size_t old_size = size();
-	uint8_t* buf = (uint8_t*)CY_MALLOC(new_size);
+	uint8_t* buf = _alloc_block(new_size);
 	this->memcpy_out(buf, old_size);
 
 	//free old buf
-	CY_FREE(m_buf);
+	_free_block(m_buf, m_end);
 
 	//reset
 	m_buf = buf;
@@ -53,6 +140,22 @@ void RingBuf::_auto_resize(size_t need_size)
 	m_write = old_size;
 }
 
+//-------------------------------------------------------------------------------------
+void RingBuf::shrink(void)
+{
+	if (empty()) {
+		_free_block(m_buf, m_end);
+		m_buf = nullptr;
+		m_end = 1;
+		reset();
+		return;
+	}
+
+	size_t new_size = block_cache_s::kBlockSize;
+	while (new_size < size() + 1) new_size *= 2;
+	if (new_size < m_end) _resize(new_size);
+}
+
 //-------------------------------------------------------------------------------------
 void RingBuf::memcpy_into(const void *src, size_t count)
 {
@@ -147,6 +250,13 @@ size_t RingBuf::peek(size_t off, void* dst, size_t count) const
 	return count;
 }
 
+//-------------------------------------------------------------------------------------
+size_t RingBuf::get_readable_block(const uint8_t** block) const
+{
+	*block = m_buf + m_read;
+	return (m_write >= m_read) ? (m_write - m_read) : (m_end - m_read);
+}
+
 //-------------------------------------------------------------------------------------
 size_t RingBuf::discard(size_t count)
 {
@@ -164,15 +274,40 @@ size_t RingBuf::discard(size_t count)
 }
 
 //-------------------------------------------------------------------------------------
-ssize_t RingBuf::read_socket(socket_t fd, bool extra_buf)
+ssize_t RingBuf::read_socket(socket_t fd, bool extra_buf, size_t max_count)
 {
-	const size_t STACK_BUF_SIZE = 0xFFFF;
-	char stack_buf[STACK_BUF_SIZE];
+	assert(max_count > 0);
+
+	//the extra data is read into the spill buf of this thread, and copied into ringbuf later
+	const size_t SPILL_BUF_SIZE = block_cache_s::kSpillBufSize;
+	char* spill_buf = nullptr;
+	char* temp_buf = nullptr;
+	if (extra_buf) {
+		block_cache_s* cache = _get_block_cache();
+		if (cache == nullptr) {
+			//the thread is exiting
+			spill_buf = temp_buf = (char*)CY_MALLOC(SPILL_BUF_SIZE);
+		}
+		else {
+			if (cache->spill_buf == nullptr) cache->spill_buf = (uint8_t*)CY_MALLOC(SPILL_BUF_SIZE);
+			spill_buf = (char*)cache->spill_buf;
+		}
+	}
+	ssize_t ret = _read_socket(fd, spill_buf, max_count);
+
+	if (temp_buf) CY_FREE(temp_buf);
+	return ret;
+}
+
+//-------------------------------------------------------------------------------------
+ssize_t RingBuf::_read_socket(socket_t fd, char* spill_buf, size_t max_count)
+{
+	size_t count = MIN(get_free_size(), max_count);
+	const size_t SPILL_BUF_SIZE = MIN((size_t)block_cache_s::kSpillBufSize, max_count - count);
+	bool extra_buf = (spill_buf != nullptr && SPILL_BUF_SIZE > 0);
 
 #ifndef CY_HAVE_READWRITE_V
 	//TODO: it is not correct to call read() more than once in on event call!
-	size_t count = get_free_size();
-
 	//in windows call read three times maxmium
 	ssize_t nwritten = 0;
 	while (nwritten != (ssize_t)count)	{
@@ -193,10 +328,10 @@ ssize_t RingBuf::read_socket(socket_t fd, bool extra_buf)
 
 	//need read more data
 	if (extra_buf) {
-		ssize_t len = socket_api::read(fd, stack_buf, STACK_BUF_SIZE);
+		ssize_t len = socket_api::read(fd, spill_buf, SPILL_BUF_SIZE);
 		if (len == 0) return nwritten; //EOF
 		if (len < 0) return socket_api::is_lasterror_WOULDBLOCK() ? nwritten : len;
-		memcpy_into(stack_buf, len);
+		memcpy_into(spill_buf, len);
 		return nwritten + len;
 	}
 	return nwritten;
@@ -204,7 +339,6 @@ ssize_t RingBuf::read_socket(socket_t fd, bool extra_buf)
 	//use vector read functon
 	struct iovec vec[3];
 	int32_t vec_counts = 0;
-	size_t count = get_free_size();
 
 	size_t nwritten = 0;
 	size_t write_off = m_write;
@@ -223,8 +357,8 @@ ssize_t RingBuf::read_socket(socket_t fd, bool extra_buf)
 
 	//add extra buff
 	if (extra_buf) {
-		vec[vec_counts].iov_base = stack_buf;
-		vec[vec_counts].iov_len = STACK_BUF_SIZE;
+		vec[vec_counts].iov_base = spill_buf;
+		vec[vec_counts].iov_len = SPILL_BUF_SIZE;
 		vec_counts++;
 	}
 
@@ -248,7 +382,7 @@ ssize_t RingBuf::read_socket(socket_t fd, bool extra_buf)
 	//append extra data
 	if (nwritten < (size_t)read_counts) {
 		assert(extra_buf);
-		memcpy_into(stack_buf, (size_t)read_counts - nwritten);
+		memcpy_into(spill_buf, (size_t)read_counts - nwritten);
 	}
 
 	return read_counts;
@@ -256,12 +390,12 @@ ssize_t RingBuf::read_socket(socket_t fd, bool extra_buf)
 }
 
 //-------------------------------------------------------------------------------------
-ssize_t RingBuf::write_socket(socket_t fd)
+ssize_t RingBuf::write_socket(socket_t fd, size_t max_count)
 {
-	assert(!empty());
+	assert(!empty() && max_count > 0);
 
 #ifndef CY_HAVE_READWRITE_V
-	size_t count = size();
+	size_t count = MIN(size(), max_count);
 
 	size_t nsended = 0;
 	while (nsended != count) {
@@ -294,7 +428,7 @@ ssize_t RingBuf::write_socket(socket_t fd)
 #else
 	struct iovec vec[2];
 	int32_t vec_counts = 0;
-	size_t count = size();
+	size_t count = MIN(size(), max_count);
 
 	size_t nsended = 0;
 	size_t read_off = m_read;
@@ -59,9 +59,9 @@ public:
 		return (m_write == m_read);
 	}
 
-	/// return is full
+	/// return is full(the buf without memory is not full)
 	bool full(void) const {
-		return get_free_size() == 0;
+		return m_buf != nullptr && get_free_size() == 0;
 	}
 
 	////  copy n bytes from a contiguous memory area into the ring buffer
@@ -77,18 +77,22 @@ public:
 	//// do not change current buf
 	size_t peek(size_t off, void* dst, size_t count) const;
 
+	//// get the first contiguous readable memory block without copy, return the 
+	//// size of the block (0 if empty). the data is valid until the buf is changed
+	size_t get_readable_block(const uint8_t** block) const;
+
 	//// just discard at least n bytes data, return size that abandon actually
 	size_t discard(size_t count);
 
 	//// call read on the socket descriptor(fd), using the ring buffer rb as the 
 	//// destination buffer for the read, and read as more data as impossible data.
-	//// set extra_read to false if you don't want expand this ringbuf
-	ssize_t read_socket(socket_t fd, bool extra_read=true);
+	//// set extra_read to false if you don't want expand this ringbuf, no more than max_count bytes will be read
+	ssize_t read_socket(socket_t fd, bool extra_read=true, size_t max_count = SIZE_MAX);
 
 	//// call write on the socket descriptor(fd), using the ring buffer rb as the 
 	//// source buffer for writing, In Linux platform, it will only call writev
-	//// once, and may return a short count.
-	ssize_t write_socket(socket_t fd);
+	//// once, and may return a short count. no more than max_count bytes will be written
+	ssize_t write_socket(socket_t fd, size_t max_count = SIZE_MAX);
 
 	//// caculate the checksum(adler32) of data from off to off+len
 	//// if off greater than size() or off+count greater than size() 
@@ -98,7 +102,12 @@ public:
 	//// move all data to a flat memory block and return point
 	const uint8_t* normalize(void);
 
+	//// reduce the capacity to fit the data(not less than default capacity), 
+	//// if the buf is empty, all memory will be released until new data coming
+	void shrink(void);
+
 public:
+	/// if capacity is 0, the memory will not be allocated until the first write
 	RingBuf(size_t capacity = kDefaultCapacity);
 	~RingBuf();
 
@@ -110,6 +119,8 @@ private:
 
 private:
 	void _auto_resize(size_t need_size);
+	void _resize(size_t new_size);
+	ssize_t _read_socket(socket_t fd, char* spill_buf, size_t max_count);
 };
 
 }
@@ -0,0 +1,165 @@
+/*
+Copyright(C) thecodeway.com
+*/
+
+#ifndef _CYCLONE_CORE_SLOT_MAP_H_
+#define _CYCLONE_CORE_SLOT_MAP_H_
+
+#include <cyclone_config.h>
+
+namespace cyclone
+{
+
+//
+// Generational slot map, the key is created by the map when a value is inserted
+//
+//    key(31 bits): | generation(6) | tag(5) | slot(20) |
+//
+// The slot indexes the slot array, which points to the value in a dense array, so the lookup
+// is two array accesses without hashing, and the iteration is a linear scan of the values.
+// The generation of a slot is increased when the value is erased, so a stale key doesn't find
+// the new value in the same slot. The generation has only 6 bits, so the freed slots are reused
+// in FIFO order and only when kMinFreeSlots slots are free(or the slot array is full), a slot
+// comes back after kMinFreeSlots other inserts at least, and a stale key matches again only
+// after 64 * kMinFreeSlots inserts.
+// The tag is a constant of the map, different maps with different tags never share a key.
+//
+template<typename T>
+class SlotMap : noncopyable
+{
+public:
+	enum { kSlotBits = 20, kTagBits = 5, kGenerationBits = 6 };
+	enum { kMaxSlots = 1 << kSlotBits, kMaxTags = 1 << kTagBits, kMinFreeSlots = 4096 };
+
+	typedef typename std::vector<T>::iterator iterator;
+	typedef typename std::vector<T>::const_iterator const_iterator;
+
+public:
+	//// insert a value, return the key, or -1 if the map is full
+	int32_t insert(const T& value) {
+		uint32_t slot;
+		if (m_free_head != kInvalidIndex && (m_free_counts >= (uint32_t)kMinFreeSlots || m_slots.size() >= (size_t)kMaxSlots)) {
+			slot = m_free_head;
+			m_free_head = m_slots[slot].index;
+			if (m_free_head == kInvalidIndex) m_free_tail = kInvalidIndex;
+			m_free_counts--;
+		}
+		else {
+			if (m_slots.size() >= (size_t)kMaxSlots) return -1;
+
+			slot = (uint32_t)m_slots.size();
+			slot_s s = { 0, kInvalidIndex, false };
+			m_slots.push_back(s);
+		}
+
+		slot_s& s = m_slots[slot];
+		s.index = (uint32_t)m_values.size();
+		s.used = true;
+
+		int32_t key = _make_key(slot, s.generation);
+		m_values.push_back(value);
+		m_keys.push_back(key);
+		return key;
+	}
+
+	//// find the value of the key, return nullptr if the key is not exist(or erased already)
+	T* find(int32_t key) {
+		slot_s* s = _find_slot(key);
+		return s ? &(m_values[s->index]) : nullptr;
+	}
+	const T* find(int32_t key) const {
+		return const_cast<SlotMap*>(this)->find(key);
+	}
+
+	//// erase the value of the key, the last value is moved to the hole
+	bool erase(int32_t key) {
+		slot_s* s = _find_slot(key);
+		if (s == nullptr) return false;
+
+		uint32_t index = s->index;
+		uint32_t last = (uint32_t)m_values.size() - 1;
+		if (index != last) {
+			m_values[index] = std::move(m_values[last]);
+			m_keys[index] = m_keys[last];
+			m_slots[(uint32_t)m_keys[index] & kSlotMask].index = index;
+		}
+		m_values.pop_back();
+		m_keys.pop_back();
+
+		//append to the free list
+		uint32_t slot = (uint32_t)key & kSlotMask;
+		s->used = false;
+		s->generation++;
+		s->index = kInvalidIndex;
+		if (m_free_tail == kInvalidIndex) m_free_head = slot;
+		else m_slots[m_free_tail].index = slot;
+		m_free_tail = slot;
+		m_free_counts++;
+		return true;
+	}
+
+	//// erase all values
+	void clear(void) {
+		while (!m_keys.empty()) erase(m_keys.back());
+	}
+
+	size_t size(void) const { return m_values.size(); }
+	bool empty(void) const { return m_values.empty(); }
+	int32_t get_tag(void) const { return m_tag; }
+
+	//// the values in dense array, the order is changed by erase
+	iterator begin(void) { return m_values.begin(); }
+	iterator end(void) { return m_values.end(); }
+	const_iterator begin(void) const { return m_values.begin(); }
+	const_iterator end(void) const { return m_values.end(); }
+
+	//// the key of the value at the position of dense array
+	int32_t get_key(size_t index) const { return m_keys[index]; }
+
+private:
+	enum : uint32_t { kInvalidIndex = 0xFFFFFFFFu, kSlotMask = (1u << kSlotBits) - 1, kGenerationMask = (1u << kGenerationBits) - 1 };
+
+	struct slot_s
+	{
+		uint32_t generation;
+		uint32_t index;		//index of dense array, or the next free slot
+		bool used;
+	};
+
+	std::vector<slot_s> m_slots;
+	std::vector<T> m_values;
+	std::vector<int32_t> m_keys;	//key of the value at same position
+	uint32_t m_free_head;
+	uint32_t m_free_tail;
+	uint32_t m_free_counts;
+	const int32_t m_tag;
+
+private:
+	int32_t _make_key(uint32_t slot, uint32_t generation) const {
+		return (int32_t)(((generation & kGenerationMask) << (kSlotBits + kTagBits)) | ((uint32_t)m_tag << kSlotBits) | slot);
+	}
+
+	slot_s* _find_slot(int32_t key) {
+		if (key < 0) return nullptr;
+
+		uint32_t slot = (uint32_t)key & kSlotMask;
+		if (slot >= m_slots.size()) return nullptr;
+
+		slot_s& s = m_slots[slot];
+		if (!s.used || _make_key(slot, s.generation) != key) return nullptr;
+		return &s;
+	}
+
+public:
+	explicit SlotMap(int32_t tag = 0)
+		: m_free_head(kInvalidIndex)
+		, m_free_tail(kInvalidIndex)
+		, m_free_counts(0)
+		, m_tag(tag & (kMaxTags - 1))
+	{
+	}
+};
+
+}
+
+#endif
@@ -10,6 +10,9 @@ Copyright(C) thecodeway.com
 #include <netdb.h>
 #include <netinet/tcp.h>
 #endif
+#ifdef CY_HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
 #include <fcntl.h>
 
 //
@@ -49,12 +52,18 @@ void global_init(void)
 
 //-------------------------------------------------------------------------------------
 socket_t create_socket(void)
+{
+	return create_socket(AF_INET);
+}
+
+//-------------------------------------------------------------------------------------
+socket_t create_socket(int family)
 {
 #ifdef CY_SYS_WINDOWS
 	AUTO_INIT_WIN_SOCKET();
 #endif
 
-	socket_t sockfd = ::socket(AF_INET, SOCK_STREAM, 0);
+	socket_t sockfd = ::socket(family, SOCK_STREAM, 0);
 	if (sockfd == INVALID_SOCKET)
 	{
 		CY_LOG(L_FATAL, "socket_api::create_socket, err=%d", get_lasterror());
@@ -63,6 +72,22 @@ socket_t create_socket(void)
 	return sockfd;
 }
 
+//-------------------------------------------------------------------------------------
+socket_t create_udp_socket(int family)
+{
+#ifdef CY_SYS_WINDOWS
+	AUTO_INIT_WIN_SOCKET();
+#endif
+
+	socket_t sockfd = ::socket(family, SOCK_DGRAM, 0);
+	if (sockfd == INVALID_SOCKET)
+	{
+		CY_LOG(L_FATAL, "socket_api::create_udp_socket, err=%d", get_lasterror());
+	}
+
+	return sockfd;
+}
+
 //-------------------------------------------------------------------------------------
 void close_socket(socket_t s)
 {
@@ -119,7 +144,13 @@ bool set_close_onexec(socket_t s, bool enable)
 //-------------------------------------------------------------------------------------
 bool bind(socket_t s, const struct sockaddr_in& addr)
 {
-	if (SOCKET_ERROR == ::bind(s, (const sockaddr*)(&addr), static_cast<socklen_t>(sizeof addr)))
+	return socket_api::bind(s, (const sockaddr*)(&addr), static_cast<socklen_t>(sizeof addr));
+}
+
+//-------------------------------------------------------------------------------------
+bool bind(socket_t s, const struct sockaddr* addr, socklen_t addrlen)
+{
+	if (SOCKET_ERROR == ::bind(s, addr, addrlen))
 	{
 		CY_LOG(L_FATAL, "socket_api::bind, err=%d", get_lasterror());
 		return false;
@@ -128,9 +159,9 @@ bool bind(socket_t s, const struct sockaddr_in& addr)
 }
 
 //-------------------------------------------------------------------------------------
-bool listen(socket_t s)
+bool listen(socket_t s, int backlog)
 {
-	if(SOCKET_ERROR == ::listen(s, SOMAXCONN))
+	if(SOCKET_ERROR == ::listen(s, backlog))
 	{
 		CY_LOG(L_FATAL, "socket_api::listen, err=%d", get_lasterror());
 		return false;
@@ -141,7 +172,13 @@ bool listen(socket_t s)
 //-------------------------------------------------------------------------------------
 bool connect(socket_t s, const struct sockaddr_in& addr)
 {
-	if (::connect(s, (const sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR)
+	return socket_api::connect(s, (const sockaddr*)&addr, static_cast<socklen_t>(sizeof(addr)));
+}
+
+//-------------------------------------------------------------------------------------
+bool connect(socket_t s, const struct sockaddr* addr, socklen_t addrlen)
+{
+	if (::connect(s, addr, addrlen) == SOCKET_ERROR)
 	{
 		int lasterr = get_lasterror();
 #ifdef CY_SYS_WINDOWS
@@ -217,6 +254,68 @@ ssize_t read(socket_t s, void *buf, size_t len)
 	return _len;
 }
 
+//-------------------------------------------------------------------------------------
+ssize_t sendto(socket_t s, const char* buf, size_t len, const struct sockaddr* addr, socklen_t addrlen)
+{
+#ifdef CY_SYS_WINDOWS
+	return (ssize_t)::sendto(s, buf, (int32_t)len, 0, addr, addrlen);
+#else
+	return (ssize_t)::sendto(s, buf, len, 0, addr, addrlen);
+#endif
+}
+
+//-------------------------------------------------------------------------------------
+ssize_t recvfrom(socket_t s, char* buf, size_t len, struct sockaddr_storage* addr, socklen_t* addrlen)
+{
+	socklen_t _addrlen = static_cast<socklen_t>(sizeof(struct sockaddr_storage));
+#ifdef CY_SYS_WINDOWS
+	ssize_t _len = (ssize_t)::recvfrom(s, buf, (int32_t)len, 0, (struct sockaddr*)addr, addr ? &_addrlen : 0);
+#else
+	ssize_t _len = (ssize_t)::recvfrom(s, buf, len, 0, (struct sockaddr*)addr, addr ? &_addrlen : 0);
+#endif
+	if (addrlen) *addrlen = (_len < 0) ? 0 : _addrlen;
+	return _len;
+}
+
+//-------------------------------------------------------------------------------------
+ssize_t splice(socket_t fd_in, socket_t fd_out, size_t len)
+{
+#ifdef CY_HAVE_SPLICE
+	return ::splice(fd_in, nullptr, fd_out, nullptr, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#else
+	(void)fd_in; (void)fd_out; (void)len;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+//-------------------------------------------------------------------------------------
+ssize_t send_file(socket_t s, int fd, int64_t& offset, size_t count)
+{
+#ifdef CY_HAVE_SYS_SENDFILE_H
+	off_t off = (off_t)offset;
+	ssize_t _len = ::sendfile(s, fd, &off, count);
+	if (_len > 0) offset = (int64_t)off;
+	return _len;
+#else
+	//read to a temporary buffer and write to socket
+	char temp[16 * 1024];
+	size_t n = (count < sizeof(temp)) ? count : sizeof(temp);
+
+#ifdef CY_SYS_WINDOWS
+	if (::_lseeki64(fd, offset, SEEK_SET) < 0) return -1;
+	ssize_t read_len = (ssize_t)::_read(fd, temp, (unsigned int)n);
+#else
+	ssize_t read_len = ::pread(fd, temp, n, (off_t)offset);
+#endif
+	if (read_len <= 0) return read_len;
+
+	ssize_t _len = write(s, temp, (size_t)read_len);
+	if (_len > 0) offset += _len;
+	return _len;
+#endif
+}
+
 //-------------------------------------------------------------------------------------
 bool shutdown(socket_t s)
 {
@@ -237,7 +336,7 @@ bool setsockopt(socket_t s, int level, int optname, const void *optval, size_t o
 {
 	if (SOCKET_ERROR == ::setsockopt(s, level, optname, (const char*)optval, (socklen_t)optlen))
 	{
-		CY_LOG(L_ERROR, "socket_api::setsockopt, level=%d, optname=%d, err=%d", get_lasterror());
+		CY_LOG(L_ERROR, "socket_api::setsockopt, level=%d, optname=%d, err=%d", level, optname, get_lasterror());
 		return false;
 	}
 	return true;
@@ -275,8 +374,10 @@ bool set_keep_alive(socket_t s, bool on)
 //-------------------------------------------------------------------------------------
 bool set_nodelay(socket_t s, bool on)
 {
+	//IPPROTO_TCP is an enumerator of global namespace on some platforms, the unqualified call
+	//may choose ::setsockopt by argument dependent lookup
 	int optval = on ? 1 : 0;
-	return setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &optval, static_cast<socklen_t>(sizeof optval));
+	return socket_api::setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &optval, static_cast<socklen_t>(sizeof optval));
 }
 
 //-------------------------------------------------------------------------------------
@@ -290,6 +391,119 @@ bool set_linger(socket_t s, bool on, uint16_t linger_time)
 	return setsockopt(s, SOL_SOCKET, SO_LINGER, &linger_, sizeof(linger_));
 }
 
+//-------------------------------------------------------------------------------------
+bool set_send_buf_size(socket_t s, int32_t size)
+{
+	int optval = (int)size;
+	return setsockopt(s, SOL_SOCKET, SO_SNDBUF, &optval, static_cast<socklen_t>(sizeof optval));
+}
+
+//-------------------------------------------------------------------------------------
+bool set_recv_buf_size(socket_t s, int32_t size)
+{
+	int optval = (int)size;
+	return setsockopt(s, SOL_SOCKET, SO_RCVBUF, &optval, static_cast<socklen_t>(sizeof optval));
+}
+
+//-------------------------------------------------------------------------------------
+bool set_defer_accept(socket_t s, uint32_t seconds)
+{
+#ifdef TCP_DEFER_ACCEPT
+	int optval = (int)seconds;
+	return socket_api::setsockopt(s, IPPROTO_TCP, TCP_DEFER_ACCEPT, &optval, static_cast<socklen_t>(sizeof optval));
+#else
+	(void)s;
+	(void)seconds;
+	return false;
+#endif
+}
+
+//-------------------------------------------------------------------------------------
+bool set_fast_open(socket_t s, int32_t queue_len)
+{
+#ifdef TCP_FASTOPEN
+	int optval = (int)queue_len;
+	return socket_api::setsockopt(s, IPPROTO_TCP, TCP_FASTOPEN, &optval, static_cast<socklen_t>(sizeof optval));
+#else
+	(void)s;
+	(void)queue_len;
+	return false;
+#endif
+}
+
+//-------------------------------------------------------------------------------------
+bool set_fast_open_connect(socket_t s, bool on)
+{
+#ifdef TCP_FASTOPEN_CONNECT
+	int optval = on ? 1 : 0;
+	return socket_api::setsockopt(s, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &optval, static_cast<socklen_t>(sizeof optval));
+#else
+	(void)s;
+	(void)on;
+	return false;
+#endif
+}
+
+//-------------------------------------------------------------------------------------
+bool set_notsent_lowat(socket_t s, uint32_t bytes)
+{
+#ifdef TCP_NOTSENT_LOWAT
+	int optval = (int)bytes;
+	return socket_api::setsockopt(s, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &optval, static_cast<socklen_t>(sizeof optval));
+#else
+	(void)s;
+	(void)bytes;
+	return false;
+#endif
+}
+
+//-------------------------------------------------------------------------------------
+bool set_quick_ack(socket_t s, bool on)
+{
+#ifdef TCP_QUICKACK
+	int optval = on ? 1 : 0;
+	return socket_api::setsockopt(s, IPPROTO_TCP, TCP_QUICKACK, &optval, static_cast<socklen_t>(sizeof optval));
+#else
+	(void)s;
+	(void)on;
+	return false;
+#endif
+}
+
+//-------------------------------------------------------------------------------------
+bool inet_pton(const char* ip, struct in6_addr& a)
+{
+#ifdef CY_SYS_WINDOWS
+	AUTO_INIT_WIN_SOCKET();
+	if (::InetPton(AF_INET6, ip, &a) != 1)
+#else
+	if (::inet_pton(AF_INET6, ip, &a) != 1)
+#endif
+	{
+		CY_LOG(L_FATAL, "socket_api::inet_pton, err=%d", get_lasterror());
+		return false;
+	}
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+bool inet_ntop(const struct in6_addr& a, char *dst, socklen_t size)
+{
+#ifdef CY_SYS_WINDOWS
+	AUTO_INIT_WIN_SOCKET();
+	in6_addr t;
+	memcpy(&t, &a, sizeof(t));
+	if (::InetNtop(AF_INET6, &t, dst, size) == 0)
+#else
+	if (::inet_ntop(AF_INET6, &a, dst, size) == 0)
+#endif
+	{
+		CY_LOG(L_FATAL, "socket_api::inet_ntop, err=%d", get_lasterror());
+		return false;
+	}
+	return true;
+}
+
 //-------------------------------------------------------------------------------------
 int get_socket_error(socket_t sockfd)
 {
@@ -312,13 +526,81 @@ socket_t accept(socket_t s, struct sockaddr_in* addr)
 	socklen_t addrlen = static_cast<socklen_t>(sizeof(sockaddr_in));
 	socket_t connfd = ::accept(s, (struct sockaddr *)addr, addr ? (&addrlen) : 0);
 
-	if (connfd == INVALID_SOCKET)
+	//nonblock listen socket may be waked up without pending connection
+	if (connfd == INVALID_SOCKET && !is_lasterror_WOULDBLOCK())
 	{
 		CY_LOG(L_FATAL, "socket_api::accept, err=%d", get_lasterror());
 	}
 	return connfd;
 }
 
+//-------------------------------------------------------------------------------------
+socket_t accept_nonblock(socket_t s, struct sockaddr_in* addr)
+{
+#ifdef CY_HAVE_ACCEPT4
+	socklen_t addrlen = static_cast<socklen_t>(sizeof(sockaddr_in));
+	socket_t connfd = ::accept4(s, (struct sockaddr *)addr, addr ? (&addrlen) : 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+	if (connfd == INVALID_SOCKET && !is_lasterror_WOULDBLOCK())
+	{
+		CY_LOG(L_FATAL, "socket_api::accept4, err=%d", get_lasterror());
+	}
+	return connfd;
+#else
+	socket_t connfd = accept(s, addr);
+	if (connfd != INVALID_SOCKET) {
+		set_nonblock(connfd, true);
+		set_close_onexec(connfd, true);
+	}
+	return connfd;
+#endif
+}
+
+//-------------------------------------------------------------------------------------
+socket_t accept_nonblock(socket_t s, struct sockaddr_storage* addr, socklen_t* addrlen)
+{
+	socklen_t len = static_cast<socklen_t>(sizeof(sockaddr_storage));
+#ifdef CY_HAVE_ACCEPT4
+	socket_t connfd = ::accept4(s, (struct sockaddr *)addr, addr ? (&len) : 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+	socket_t connfd = ::accept(s, (struct sockaddr *)addr, addr ? (&len) : 0);
+	if (connfd != INVALID_SOCKET) {
+		set_nonblock(connfd, true);
+		set_close_onexec(connfd, true);
+	}
+#endif
+
+	if (connfd == INVALID_SOCKET && !is_lasterror_WOULDBLOCK())
+	{
+		CY_LOG(L_FATAL, "socket_api::accept_nonblock, err=%d", get_lasterror());
+	}
+	if (addrlen) *addrlen = (connfd == INVALID_SOCKET) ? 0 : len;
+	return connfd;
+}
+
+//-------------------------------------------------------------------------------------
+bool get_accept_queue_len(socket_t s, uint32_t& queue_len, uint32_t& max_len)
+{
+#ifdef CY_SYS_LINUX
+	//for listen socket, tcpi_unacked is the current length of accept queue, and
+	//tcpi_sacked is the max length(backlog)
+	struct tcp_info info;
+	socklen_t optlen = static_cast<socklen_t>(sizeof(info));
+	memset(&info, 0, sizeof(info));
+
+	if (SOCKET_ERROR == ::getsockopt(s, IPPROTO_TCP, TCP_INFO, &info, &optlen)) {
+		return false;
+	}
+	queue_len = info.tcpi_unacked;
+	max_len = info.tcpi_sacked;
+	return true;
+#else
+	(void)s;
+	queue_len = max_len = 0;
+	return false;
+#endif
+}
+
 //-------------------------------------------------------------------------------------
 bool getsockname(socket_t s, struct sockaddr_in& addr)
 {
@@ -347,6 +629,36 @@ bool getpeername(socket_t s, struct sockaddr_in& addr)
 	return true;
 }
 
+//-------------------------------------------------------------------------------------
+bool getsockname(socket_t s, struct sockaddr_storage& addr, socklen_t& addrlen)
+{
+	addrlen = static_cast<socklen_t>(sizeof addr);
+	memset(&addr, 0, sizeof addr);
+
+	if (SOCKET_ERROR == ::getsockname(s, (struct sockaddr*)(&addr), &addrlen))
+	{
+		CY_LOG(L_FATAL, "socket_api::getsockname, err=%d", get_lasterror());
+		addrlen = 0;
+		return false;
+	}
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+bool getpeername(socket_t s, struct sockaddr_storage& addr, socklen_t& addrlen)
+{
+	addrlen = static_cast<socklen_t>(sizeof addr);
+	memset(&addr, 0, sizeof addr);
+
+	if (SOCKET_ERROR == ::getpeername(s, (struct sockaddr*)(&addr), &addrlen))
+	{
+		CY_LOG(L_FATAL, "socket_api::getpeername, err=%d", get_lasterror());
+		addrlen = 0;
+		return false;
+	}
+	return true;
+}
+
 //-------------------------------------------------------------------------------------
 bool resolve_hostname(const char* hostname, struct sockaddr_in& addr)
 {
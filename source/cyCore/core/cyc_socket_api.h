@@ -17,6 +17,12 @@ void global_init(void);
 /// Creates a blocking socket file descriptor, return INVALID_SOCKET if failed
 socket_t create_socket(void);
 
+/// Creates a blocking stream socket of the address family(AF_INET, AF_INET6 or AF_UNIX)
+socket_t create_socket(int family);
+
+/// Creates a blocking datagram socket of the address family(AF_INET or AF_INET6)
+socket_t create_udp_socket(int family);
+
 /// Close socket
 void close_socket(socket_t s);
 
@@ -28,15 +34,24 @@ bool set_close_onexec(socket_t s, bool enable);
 
 /// bind a local name to a socket
 bool bind(socket_t s, const struct sockaddr_in& addr);
+bool bind(socket_t s, const struct sockaddr* addr, socklen_t addrlen);
 
 /// listen for connection
-bool listen(socket_t s);
+bool listen(socket_t s, int backlog = SOMAXCONN);
 
 /// accept a connection on a socket, return INVALID_SOCKET if failed
 socket_t accept(socket_t s, struct sockaddr_in* addr);
 
+/// accept a connection on a socket and set the new socket to non-block and close-onexec mode
+/// (accept4 if possible), return INVALID_SOCKET if failed
+socket_t accept_nonblock(socket_t s, struct sockaddr_in* addr);
+
+/// accept a connection in any address family, addrlen returns the actual length of peer address
+socket_t accept_nonblock(socket_t s, struct sockaddr_storage* addr, socklen_t* addrlen);
+
 /// initiate a connection on a socket
 bool connect(socket_t s, const struct sockaddr_in& addr);
+bool connect(socket_t s, const struct sockaddr* addr, socklen_t addrlen);
 
 /// write to socket file desc
 ssize_t write(socket_t s, const char* buf, size_t len);
@@ -44,6 +59,20 @@ ssize_t write(socket_t s, const char* buf, size_t len);
 /// read from a socket file desc
 ssize_t read(socket_t s, void *buf, size_t len);
 
+/// send a datagram to the address
+ssize_t sendto(socket_t s, const char* buf, size_t len, const struct sockaddr* addr, socklen_t addrlen);
+
+/// receive a datagram, addrlen returns the actual length of peer address
+ssize_t recvfrom(socket_t s, char* buf, size_t len, struct sockaddr_storage* addr, socklen_t* addrlen);
+
+/// move len bytes from fd_in to fd_out in kernel(splice), one of them must be a pipe, 
+/// return -1 if not supported
+ssize_t splice(socket_t fd_in, socket_t fd_out, size_t len);
+
+/// send count bytes of file(fd) from offset to socket, the offset will be moved forward, 
+/// use sendfile(zero copy) if possible, return 0 if the end of file reached
+ssize_t send_file(socket_t s, int fd, int64_t& offset, size_t count);
+
 /// shutdown read and write part of a socket connection
 bool shutdown(socket_t s);
 
@@ -53,6 +82,12 @@ bool inet_pton(const char* ip, struct in_addr& a);
 /// convert in_addr to ip address
 bool inet_ntop(const struct in_addr& a, char *dst, socklen_t size);
 
+/// convert ipv6 address (like "::1") to in6_addr
+bool inet_pton(const char* ip, struct in6_addr& a);
+
+/// convert in6_addr to ipv6 address
+bool inet_ntop(const struct in6_addr& a, char *dst, socklen_t size);
+
 /// socket operation
 bool setsockopt(socket_t s, int level, int optname, const void *optval, size_t optlen);
 
@@ -71,15 +106,41 @@ bool set_nodelay(socket_t s, bool on);
 /// Set socket SO_LINGER
 bool set_linger(socket_t s, bool on, uint16_t linger_time);
 
+/// Set SO_SNDBUF/SO_RCVBUF, the kernel may double or limit the size
+bool set_send_buf_size(socket_t s, int32_t size);
+bool set_recv_buf_size(socket_t s, int32_t size);
+
+/// Set TCP_DEFER_ACCEPT on listen socket, the connection is accepted after data arrives(or timeout in seconds), return false if not supported
+bool set_defer_accept(socket_t s, uint32_t seconds);
+
+/// Set TCP_FASTOPEN on listen socket, the queue_len is max counts of pending fast open requests, return false if not supported
+bool set_fast_open(socket_t s, int32_t queue_len);
+
+/// Enable/disable TCP_FASTOPEN_CONNECT before connect, the first data is sent with SYN, return false if not supported
+bool set_fast_open_connect(socket_t s, bool on);
+
+/// Set TCP_NOTSENT_LOWAT, the socket is writable only when the unsent data in kernel is less than it, return false if not supported
+bool set_notsent_lowat(socket_t s, uint32_t bytes);
+
+/// Enable/disable TCP_QUICKACK, it's not permanent, the kernel may switch to delayed ack later, return false if not supported
+bool set_quick_ack(socket_t s, bool on);
+
 /// get socket error
 int get_socket_error(socket_t sockfd);
 
+/// get accept queue length and max length(backlog) of a listen socket, return false if not supported
+bool get_accept_queue_len(socket_t s, uint32_t& queue_len, uint32_t& max_len);
+
 /// get local name of socket
 bool getsockname(socket_t s, struct sockaddr_in& addr);
 
 /// get peer name of socket
 bool getpeername(socket_t s, struct sockaddr_in& addr);
 
+/// get local/peer name of socket in any address family
+bool getsockname(socket_t s, struct sockaddr_storage& addr, socklen_t& addrlen);
+bool getpeername(socket_t s, struct sockaddr_storage& addr, socklen_t& addrlen);
+
 ///resolve hostname to IP address, not changing port or sin_family
 bool resolve_hostname(const char* hostname, struct sockaddr_in& addr);
 
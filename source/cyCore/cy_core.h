@@ -12,6 +12,8 @@ Copyright(C) thecodeway.com
 #include <core/cyc_ring_buf.h>
 #include <core/cyc_atomic.h>
 #include <core/cyc_lf_queue.h>
+#include <core/cyc_mpsc_queue.h>
+#include <core/cyc_slot_map.h>
 #include <core/cyc_debug_interface.h>
 
 #endif
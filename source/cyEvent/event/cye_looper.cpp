@@ -22,6 +22,8 @@ Looper::Looper()
 	: m_free_head(INVALID_EVENT_ID)
 	, m_active_channel_counts(0)
 	, m_loop_counts(0)
+	, m_loop_time(sys_api::utc_time_now())
+	, m_busy_time(0)
 	, m_current_thread(sys_api::thread_get_current_id())
 	, m_inner_pipe(0)
 	, m_inner_pipe_touched(0)
@@ -33,6 +35,14 @@ Looper::Looper()
 //-------------------------------------------------------------------------------------
 Looper::~Looper()
 {
+	//drop the tasks not run
+	MpscNode* node = m_posted_tasks.pop_all();
+	while (node) {
+		task_node* task = (task_node*)node;
+		node = node->next;
+		delete task;
+	}
+
 	sys_api::mutex_destroy(m_lock);
 }
 
@@ -56,6 +66,7 @@ Looper::event_id_t Looper::register_event(socket_t sockfd,
 	channel.param = param;
 	channel.active = false;
 	channel.timer = false;
+	channel.exclusive = (event & kExclusive) != 0;
 	channel.on_read = _on_read;
 	channel.on_write = _on_write;
 
@@ -90,6 +101,7 @@ Looper::event_id_t Looper::register_timer_event(uint32_t milliSeconds,
 	channel.param = timer;
 	channel.active = false;
 	channel.timer = true;
+	channel.exclusive = false;
 	channel.on_read = _on_timer_event_callback;
 	channel.on_write = 0;
 
@@ -256,6 +268,9 @@ void Looper::loop(void)
 	m_inner_pipe = &inner_pipe;
 	Looper::event_id_t inner_event_id = register_event(m_inner_pipe->get_read_port(), kRead, this, _on_inner_pipe_touched, 0);
 
+	//some tasks posted before loop begin
+	if (!m_posted_tasks.empty()) _touch_inner_pipe();
+
 	channel_list readList;
 	channel_list writeList;
 
@@ -267,6 +282,7 @@ void Looper::loop(void)
 		//wait in kernel...
 		_poll(readList, writeList, true);
 		m_loop_counts++;
+		_on_step_begin();
 
 		if (is_quit_pending()) break;
 
@@ -294,8 +310,15 @@ void Looper::loop(void)
 		}
 
 		if (is_quit_pending()) break;
+
+		_run_deferred_tasks();
+		_on_step_end();
+		if (is_quit_pending()) break;
 	}
 
+	//the tasks deferred in the last step(flush the corked data...) are not dropped
+	_run_deferred_tasks();
+
 	//it's the time to shutdown everything...
 	disable_all(inner_event_id);
 	delete_event(inner_event_id);
@@ -315,6 +338,7 @@ void Looper::step(void)
 	//wait in kernel...
 	_poll(readList, writeList, false);
 	m_loop_counts++;
+	_on_step_begin();
 
 	if (is_quit_pending()) return;
 
@@ -338,6 +362,59 @@ void Looper::step(void)
 
 		if (is_quit_pending()) return;
 	}
+
+	//no inner pipe in step mode, run the posted tasks directly
+	_run_posted_tasks();
+	_run_deferred_tasks();
+	_on_step_end();
+}
+
+//-------------------------------------------------------------------------------------
+void Looper::post(task_callback task)
+{
+	task_node* node = new task_node();
+	node->task = task;
+
+	//the first task of the batch wake up the looper
+	if (m_posted_tasks.push(node)) {
+		_touch_inner_pipe();
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void Looper::_run_posted_tasks(void)
+{
+	assert(sys_api::thread_get_current_id() == m_current_thread);
+
+	MpscNode* node = m_posted_tasks.pop_all();
+	while (node) {
+		task_node* task = (task_node*)node;
+		node = node->next;
+
+		task->task();
+		delete task;
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void Looper::defer(task_callback task)
+{
+	assert(sys_api::thread_get_current_id() == m_current_thread);
+	m_deferred_tasks.push_back(task);
+}
+
+//-------------------------------------------------------------------------------------
+void Looper::_run_deferred_tasks(void)
+{
+	//the deferred task may defer another task, which will be run in this step too
+	while (!m_deferred_tasks.empty()) {
+		m_running_tasks.swap(m_deferred_tasks);
+
+		for (size_t i = 0; i < m_running_tasks.size(); i++) {
+			m_running_tasks[i]();
+		}
+		m_running_tasks.clear();
+	}
 }
 
 //-------------------------------------------------------------------------------------
@@ -428,6 +505,7 @@ void Looper::_on_inner_pipe_touched(event_id_t , socket_t fd, event_t , void* pa
 	socket_api::read(fd, &touch, sizeof(touch));
 
 	((Looper*)param)->m_inner_pipe_touched = 0;
+	((Looper*)param)->_run_posted_tasks();
 }
 
 //-------------------------------------------------------------------------------------
@@ -442,6 +520,9 @@ void Looper::debug(DebugInterface* debuger, const char* name)
 
 	std::snprintf(key_temp, 256, "Looper:%s:active_channel_size", name);
 	debuger->updateDebugValue(key_temp, m_active_channel_counts);
+
+	std::snprintf(key_temp, 256, "Looper:%s:busy_time_ms", name);
+	debuger->updateDebugValue(key_temp, (int32_t)(m_busy_time.load() / 1000));
 }
 
 }
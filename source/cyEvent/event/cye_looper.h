@@ -23,10 +23,15 @@ public:
 		kNone = 0,
 		kRead	= 1,
 		kWrite	= 1<<1,
+
+		//only used in register_event with kRead, wake up only one of the loopers 
+		//which wait on the same fd (EPOLLEXCLUSIVE), ignored by other poll tech
+		kExclusive = 1<<2,
 	};
 
 	typedef std::function<void(event_id_t id, socket_t fd, event_t event, void* param)> event_callback;
 	typedef std::function<void(event_id_t id, void* param)> timer_callback;
+	typedef std::function<void(void)> task_callback;
 
 public:
 	//----------------------
@@ -56,6 +61,12 @@ public:
 	void push_stop_request(void);
 	//// is quit cmd active
 	bool is_quit_pending(void) const { return m_quit_cmd.load() != 0; }
+	//// post a task to run in the looper thread, the looper will be waked up 
+	//// only once for a batch of tasks (thread safe)
+	void post(task_callback task);
+	//// run a task at the end of current loop step, after all events have been dispatched
+	//// (NOT thread safe, call it in the looper thread)
+	void defer(task_callback task);
 
 	//// update event
 	void disable_read(event_id_t id);
@@ -73,6 +84,10 @@ public:
 	//----------------------
 	thread_id_t get_thread_id(void) const { return m_current_thread; }
 	uint64_t get_loop_counts(void) const { return m_loop_counts; }
+	//// get the time when current loop step waked up from poll(utc time in microseconds)
+	int64_t get_loop_time(void) const { return m_loop_time; }
+	//// get total time spent on dispatch events, in microseconds(thread safe)
+	uint64_t get_busy_time(void) const { return m_busy_time.load(); }
 
 	void debug(DebugInterface* debuger, const char* name);
 
@@ -98,6 +113,7 @@ protected:
 		void *param;
 		bool active;
 		bool timer;
+		bool exclusive;
 
 		event_callback on_read;
 		event_callback on_write;
@@ -112,6 +128,8 @@ protected:
 	event_id_t m_free_head;			//free list head in event buf
 	int32_t m_active_channel_counts;
 	uint64_t m_loop_counts;
+	int64_t m_loop_time;
+	atomic_uint64_t m_busy_time;
 
 	thread_id_t m_current_thread;
 
@@ -150,6 +168,24 @@ protected:
 	static void __stdcall _on_windows_timer(PVOID param, BOOLEAN timer_or_wait_fired);
 #endif
 
+	//begin and end of one reactor step
+	void _on_step_begin(void) { m_loop_time = sys_api::utc_time_now(); }
+	void _on_step_end(void) { m_busy_time += (uint64_t)(sys_api::utc_time_now() - m_loop_time); }
+
+	//posted tasks
+	struct task_node : public MpscNode
+	{
+		task_callback task;
+	};
+	MpscQueue m_posted_tasks;
+	void _run_posted_tasks(void);
+
+	//deferred tasks
+	typedef std::vector< task_callback > task_list;
+	task_list m_deferred_tasks;
+	task_list m_running_tasks;
+	void _run_deferred_tasks(void);
+
 	//inner pipe functions
 	void _touch_inner_pipe(void);
 	static void _on_inner_pipe_touched(event_id_t id, socket_t fd, event_t event, void* param);
@@ -27,7 +27,7 @@ Packet* Packet::alloc_packet(const Packet* other)
 	Packet* p = new Packet();
 
 	if (other && other->m_memory_size > 0) {
-		p->_resize(other->m_head_size, other->get_packet_size());
+		p->_resize(other->m_head_format, other->m_head_size, other->get_packet_size());
 		memcpy(p->m_memory_buf, other->m_memory_buf, other->m_memory_size);
 	}
 
@@ -42,7 +42,8 @@ void Packet::free_packet(Packet* p)
 
 //-------------------------------------------------------------------------------------
 Packet::Packet()
-	: m_head_size(0)
+	: m_head_format(kNarrowHead)
+	, m_head_size(0)
 	, m_memory_buf(nullptr)
 	, m_memory_size(0)
 	, m_packet_size(0)
@@ -61,6 +62,7 @@ Packet::~Packet()
 //-------------------------------------------------------------------------------------
 void Packet::clean(void)
 {
+	m_head_format = kNarrowHead;
 	m_head_size = 0;
 
 	if (m_memory_buf && m_memory_buf != m_static_buf)
@@ -75,22 +77,38 @@ void Packet::clean(void)
 }
 
 //-------------------------------------------------------------------------------------
-uint16_t Packet::get_packet_size(void) const
+uint32_t Packet::get_packet_size(void) const
 {
-	return m_packet_size ? socket_api::ntoh_16(*m_packet_size) : (uint16_t)0;
+	if (m_packet_size == nullptr) return 0;
+
+	if (m_head_format == kWideHead) {
+		uint32_t packet_size;
+		memcpy(&packet_size, m_packet_size, sizeof(packet_size));
+		return socket_api::ntoh_32(packet_size);
+	}
+	else {
+		uint16_t packet_size;
+		memcpy(&packet_size, m_packet_size, sizeof(packet_size));
+		return socket_api::ntoh_16(packet_size);
+	}
 }
 
 //-------------------------------------------------------------------------------------
 uint16_t Packet::get_packet_id(void) const
 {
-	return m_packet_id ? socket_api::ntoh_16(*m_packet_id) : (uint16_t)0;
+	if (m_packet_id == nullptr) return 0;
+
+	uint16_t packet_id;
+	memcpy(&packet_id, m_packet_id, sizeof(packet_id));
+	return socket_api::ntoh_16(packet_id);
 }
 
 //-------------------------------------------------------------------------------------
-void Packet::_resize(size_t head_size, size_t packet_size)
+void Packet::_resize(HeadFormat format, size_t head_size, size_t packet_size)
 {
-	assert(head_size >= 2 * sizeof(uint16_t));
+	assert(head_size >= (size_t)(format == kWideHead ? WIDE_HEAD_MIN_SIZE : NARROW_HEAD_MIN_SIZE));
 
+	m_head_format = format;
 	m_head_size = head_size;
 	m_memory_size = head_size + packet_size;
 	size_t need_memory_size = m_memory_size + MEMORY_SAFE_TAIL_SIZE;
@@ -101,8 +119,8 @@ void Packet::_resize(size_t head_size, size_t packet_size)
 		m_memory_buf = (char*)CY_MALLOC(need_memory_size);
 	memset(m_memory_buf, 0xCE, need_memory_size);	//fill memory with 0xCE (CyclonE)
 
-	m_packet_size = (uint16_t*)m_memory_buf;
-	m_packet_id = (uint16_t*)(m_memory_buf+sizeof(uint16_t));
+	m_packet_size = m_memory_buf;
+	m_packet_id = m_memory_buf + (format == kWideHead ? sizeof(uint32_t) : sizeof(uint16_t));
 	m_content = packet_size>0 ? (char*)(m_memory_buf + head_size) : nullptr;
 }
 
@@ -112,10 +130,12 @@ void Packet::build(size_t head_size, uint16_t packet_id, uint16_t packet_size, c
 	clean();
 
 	//prepare memory
-	_resize(head_size, packet_size);
+	_resize(kNarrowHead, head_size, packet_size);
 
-	*m_packet_size = socket_api::ntoh_16(packet_size);
-	*m_packet_id = socket_api::ntoh_16(packet_id);
+	uint16_t size_be = socket_api::ntoh_16(packet_size);
+	uint16_t id_be = socket_api::ntoh_16(packet_id);
+	memcpy(m_packet_size, &size_be, sizeof(size_be));
+	memcpy(m_packet_id, &id_be, sizeof(id_be));
 
 	if (m_content && packet_content)
 		memcpy(m_content, packet_content, packet_size);
@@ -135,8 +155,8 @@ bool Packet::build(size_t head_size, Pipe& pipe)
 	}
 
 	//prepare memory
-	_resize(head_size, (size_t)socket_api::ntoh_16(packet_size));
-	*m_packet_size = packet_size;
+	_resize(kNarrowHead, head_size, (size_t)socket_api::ntoh_16(packet_size));
+	memcpy(m_packet_size, &packet_size, sizeof(packet_size));
 
 	//read other
 	size_t remain = head_size + get_packet_size() - sizeof(uint16_t);
@@ -150,21 +170,237 @@ bool Packet::build(size_t head_size, Pipe& pipe)
 
 //-------------------------------------------------------------------------------------
 bool Packet::build(size_t head_size, RingBuf& ring_buf)
+{
+	return _build(kNarrowHead, head_size, ring_buf, UINT16_MAX);
+}
+
+//-------------------------------------------------------------------------------------
+void Packet::build_wide(size_t head_size, uint16_t packet_id, uint32_t packet_size, const char* packet_content)
 {
 	clean();
 
-	size_t buf_len = ring_buf.size();
+	//prepare memory
+	_resize(kWideHead, head_size, packet_size);
 
-	uint16_t packet_size;
-	if (sizeof(packet_size) != ring_buf.peek(0, &packet_size, sizeof(packet_size))) return false;
-	packet_size = socket_api::ntoh_16(packet_size);
+	uint32_t size_be = socket_api::ntoh_32(packet_size);
+	uint16_t id_be = socket_api::ntoh_16(packet_id);
+	memcpy(m_packet_size, &size_be, sizeof(size_be));
+	memcpy(m_packet_id, &id_be, sizeof(id_be));
+
+	if (m_content && packet_content)
+		memcpy(m_content, packet_content, packet_size);
+	else if (m_content)
+		memset(m_content, 0, packet_size);
+}
+
+//-------------------------------------------------------------------------------------
+bool Packet::build_wide(size_t head_size, RingBuf& ring_buf, uint32_t max_packet_size)
+{
+	return _build(kWideHead, head_size, ring_buf, max_packet_size);
+}
+
+//-------------------------------------------------------------------------------------
+bool Packet::peek_head(HeadFormat format, const RingBuf& ring_buf, uint16_t& packet_id, uint32_t& packet_size)
+{
+	uint8_t head[WIDE_HEAD_MIN_SIZE];
+	size_t head_len = (format == kWideHead) ? (size_t)WIDE_HEAD_MIN_SIZE : (size_t)NARROW_HEAD_MIN_SIZE;
+	if (head_len != ring_buf.peek(0, head, head_len)) return false;
+
+	decode_head(format, head, packet_id, packet_size);
+	return true;
+}
 
-	if (buf_len < head_size + (size_t)packet_size) return false;
+//-------------------------------------------------------------------------------------
+void Packet::decode_head(HeadFormat format, const uint8_t* head, uint16_t& packet_id, uint32_t& packet_size)
+{
+	if (format == kWideHead) {
+		packet_size = ((uint32_t)head[0] << 24) | ((uint32_t)head[1] << 16) | ((uint32_t)head[2] << 8) | (uint32_t)head[3];
+		packet_id = (uint16_t)(((uint32_t)head[4] << 8) | (uint32_t)head[5]);
+	}
+	else {
+		packet_size = ((uint32_t)head[0] << 8) | (uint32_t)head[1];
+		packet_id = (uint16_t)(((uint32_t)head[2] << 8) | (uint32_t)head[3]);
+	}
+}
 
-	_resize(head_size, packet_size);
+//-------------------------------------------------------------------------------------
+bool Packet::_build(HeadFormat format, size_t head_size, RingBuf& ring_buf, uint32_t max_packet_size)
+{
+	clean();
+
+	uint16_t packet_id;
+	uint32_t packet_size;
+	if (!peek_head(format, ring_buf, packet_id, packet_size)) return false;
+	if (packet_size > max_packet_size) return false;
+
+	if (ring_buf.size() < head_size + (size_t)packet_size) return false;
+
+	_resize(format, head_size, packet_size);
 
 	return (m_memory_size==ring_buf.memcpy_out(m_memory_buf, m_memory_size));
 }
 
+//-------------------------------------------------------------------------------------
+PacketReader::PacketReader(size_t head_size, uint32_t max_packet_size, HeadCallback onHead, ContentCallback onContent, CompleteCallback onComplete)
+	: m_head_size(head_size)
+	, m_max_packet_size(max_packet_size)
+	, m_head(head_size)
+	, m_reading_content(false)
+	, m_packet_id(0)
+	, m_packet_size(0)
+	, m_offset(0)
+	, m_onHead(onHead)
+	, m_onContent(onContent)
+	, m_onComplete(onComplete)
+{
+	assert(head_size >= Packet::WIDE_HEAD_MIN_SIZE);
+}
+
+//-------------------------------------------------------------------------------------
+PacketReader::~PacketReader()
+{
+}
+
+//-------------------------------------------------------------------------------------
+void PacketReader::reset(void)
+{
+	m_reading_content = false;
+	m_packet_id = 0;
+	m_packet_size = 0;
+	m_offset = 0;
+}
+
+//-------------------------------------------------------------------------------------
+bool PacketReader::read(RingBuf& ring_buf)
+{
+	for (;;) {
+		if (!m_reading_content) {
+			//wait the whole head
+			if (ring_buf.size() < m_head_size) return true;
+
+			if (!Packet::peek_head(Packet::kWideHead, ring_buf, m_packet_id, m_packet_size)) return true;
+			if (m_packet_size > m_max_packet_size) {
+				CY_LOG(L_ERROR, "packet too large, id=%d, size=%u, max=%u", m_packet_id, m_packet_size, m_max_packet_size);
+				return false;
+			}
+
+			ring_buf.memcpy_out(&(m_head[0]), m_head_size);
+			m_reading_content = true;
+			m_offset = 0;
+
+			if (m_onHead) m_onHead(m_packet_id, m_packet_size, &(m_head[0]));
+		}
+
+		//deliver content chunks, straight from the ring buf memory
+		while (m_offset < m_packet_size) {
+			const uint8_t* block = nullptr;
+			size_t block_size = ring_buf.get_readable_block(&block);
+			if (block_size == 0) return true;
+
+			size_t chunk_size = std::min(block_size, (size_t)(m_packet_size - m_offset));
+			if (m_onContent) m_onContent(m_packet_id, (const char*)block, chunk_size, m_offset);
+
+			ring_buf.discard(chunk_size);
+			m_offset += (uint32_t)chunk_size;
+		}
+
+		uint16_t packet_id = m_packet_id;
+		reset();
+		if (m_onComplete) m_onComplete(packet_id);
+	}
+}
+
+//-------------------------------------------------------------------------------------
+PacketView::PacketView()
+	: m_ring_buf(nullptr)
+	, m_head_format(Packet::kNarrowHead)
+	, m_head_size(0)
+	, m_packet_id(0)
+	, m_packet_size(0)
+	, m_memory_buf(nullptr)
+	, m_oversize(false)
+	, m_copy_buf(nullptr)
+	, m_copy_buf_size(0)
+{
+}
+
+//-------------------------------------------------------------------------------------
+PacketView::~PacketView()
+{
+	if (m_copy_buf) {
+		CY_FREE(m_copy_buf);
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void PacketView::reset(void)
+{
+	m_ring_buf = nullptr;
+	m_head_size = 0;
+	m_packet_id = 0;
+	m_packet_size = 0;
+	m_memory_buf = nullptr;
+	m_oversize = false;
+}
+
+//-------------------------------------------------------------------------------------
+void PacketView::consume(void)
+{
+	if (m_ring_buf && m_memory_buf) {
+		m_ring_buf->discard(get_memory_size());
+	}
+	reset();
 }
 
+//-------------------------------------------------------------------------------------
+bool PacketView::_parse(Packet::HeadFormat format, size_t head_size, RingBuf& ring_buf, uint32_t max_packet_size)
+{
+	assert(head_size >= (size_t)(format == Packet::kWideHead ? Packet::WIDE_HEAD_MIN_SIZE : Packet::NARROW_HEAD_MIN_SIZE));
+	reset();
+
+	const uint8_t* block = nullptr;
+	size_t block_size = ring_buf.get_readable_block(&block);
+
+	//the head is in the first block in most cases
+	uint16_t packet_id;
+	uint32_t packet_size;
+	if (block_size >= head_size) {
+		Packet::decode_head(format, block, packet_id, packet_size);
+	}
+	else if (!Packet::peek_head(format, ring_buf, packet_id, packet_size)) {
+		return false;
+	}
+
+	//never wait a packet which is too large
+	if (packet_size > max_packet_size) {
+		m_oversize = true;
+		return false;
+	}
+
+	size_t memory_size = head_size + (size_t)packet_size;
+	if (ring_buf.size() < memory_size) return false;
+
+	if (block_size >= memory_size) {
+		//the packet is contiguous, no copy
+		m_memory_buf = (char*)block;
+	}
+	else {
+		//wrapped, copy it
+		if (m_copy_buf_size < memory_size) {
+			if (m_copy_buf) CY_FREE(m_copy_buf);
+			m_copy_buf = (char*)CY_MALLOC(memory_size);
+			m_copy_buf_size = memory_size;
+		}
+		ring_buf.peek(0, m_copy_buf, memory_size);
+		m_memory_buf = m_copy_buf;
+	}
+
+	m_ring_buf = &ring_buf;
+	m_head_format = format;
+	m_head_size = head_size;
+	m_packet_id = packet_id;
+	m_packet_size = packet_size;
+	return true;
+}
+
+}
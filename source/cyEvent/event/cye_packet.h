@@ -24,6 +24,14 @@ MEMORY_SAFE_TAIL_SIZE   |         Safe Tail        |
 *MemorySize = HeadSize+PacketSize
 *PacketID and PacketSize is big endain 16bit ingeter
 
+Wide head(build_wide), for the packet larger than 64KB
+                        +--------------------------+------------+
+                     /  |   PacketSize(32bit)      |  PacketID  |
+             HeadSize   +--------------------------+------------+
+                     \  |          (User Define Head)           |
+                        +---------------------------------------+
+*PacketSize is big endain 32bit ingeter, PacketID is big endain 16bit ingeter
+
 */
 namespace cyclone
 {
@@ -31,26 +39,43 @@ namespace cyclone
 class Packet : noncopyable
 {
 public:
+	enum HeadFormat { kNarrowHead = 0, kWideHead };
+	enum { NARROW_HEAD_MIN_SIZE = 4, WIDE_HEAD_MIN_SIZE = 6 };
+
 	void clean(void);
 
 	void build(size_t head_size, uint16_t packet_id, uint16_t packet_size, const char* packet_content);
 	bool build(size_t head_size, Pipe& pipe);
 	bool build(size_t head_size, RingBuf& ring_buf);
 
+	//// build packet with wide head(32bit packet size), the packet from ring buf is refused(return false) 
+	//// if it's larger than max_packet_size, call peek_head to know the reason
+	void build_wide(size_t head_size, uint16_t packet_id, uint32_t packet_size, const char* packet_content);
+	bool build_wide(size_t head_size, RingBuf& ring_buf, uint32_t max_packet_size = UINT32_MAX);
+
 public:
 	char* get_memory_buf(void) { return m_memory_buf; }
 	const char* get_memory_buf(void) const { return m_memory_buf; }
 	size_t get_memory_size(void) const { return m_memory_size; }
 
-	uint16_t get_packet_size(void) const;
+	HeadFormat get_head_format(void) const { return m_head_format; }
+	uint32_t get_packet_size(void) const;
 	uint16_t get_packet_id(void) const;
 	char* get_packet_content(void) { return m_content; }
 	const char* get_packet_content(void) const { return m_content; }
 
+	//// peek packet id and size from the head in ring buf, return false if the head is not complete
+	static bool peek_head(HeadFormat format, const RingBuf& ring_buf, uint16_t& packet_id, uint32_t& packet_size);
+
+	//// decode packet id and size from the head memory(min head size at least)
+	static void decode_head(HeadFormat format, const uint8_t* head, uint16_t& packet_id, uint32_t& packet_size);
+
 private:
-	void _resize(size_t head_size, size_t packet_size);
+	void _resize(HeadFormat format, size_t head_size, size_t packet_size);
+	bool _build(HeadFormat format, size_t head_size, RingBuf& ring_buf, uint32_t max_packet_size);
 
 private:
+	HeadFormat m_head_format;
 	size_t m_head_size;
 
 	enum { STATIC_MEMORY_LENGTH = 1024 };
@@ -60,8 +85,8 @@ private:
 	char*	m_memory_buf;
 	size_t	m_memory_size;
 
-	uint16_t *m_packet_size;
-	uint16_t *m_packet_id;
+	char	 *m_packet_size;
+	char	 *m_packet_id;
 	char	 *m_content;
 
 public:
@@ -75,6 +100,105 @@ public:
 	static void free_packet(Packet*);
 };
 
+/// Incremental reader of wide head packet, the packet content is delivered to 
+/// the handler in chunks as soon as they arrive, so a large packet never be 
+/// buffered in the RingBuf completely
+class PacketReader : noncopyable
+{
+public:
+	typedef std::function<void(uint16_t packet_id, uint32_t packet_size, const char* head)> HeadCallback;
+	typedef std::function<void(uint16_t packet_id, const char* chunk, size_t chunk_size, uint32_t offset)> ContentCallback;
+	typedef std::function<void(uint16_t packet_id)> CompleteCallback;
+
+	//// consume all data in the ring buf, return false if a packet larger than max_packet_size is found
+	bool read(RingBuf& ring_buf);
+
+	//// is reading the content of a packet
+	bool is_reading_content(void) const { return m_reading_content; }
+
+	//// reset to initial state(waiting packet head)
+	void reset(void);
+
+private:
+	size_t m_head_size;
+	uint32_t m_max_packet_size;
+	std::vector<char> m_head;
+
+	bool m_reading_content;
+	uint16_t m_packet_id;
+	uint32_t m_packet_size;
+	uint32_t m_offset;
+
+	HeadCallback m_onHead;
+	ContentCallback m_onContent;
+	CompleteCallback m_onComplete;
+
+public:
+	PacketReader(size_t head_size, uint32_t max_packet_size, HeadCallback onHead, ContentCallback onContent, CompleteCallback onComplete);
+	~PacketReader();
+};
+
+/// Zero copy view of the packet at the front of RingBuf, the head and content point to the 
+/// memory of ring buf directly, the packet is copied to the view only when it wraps around 
+/// the end of ring buf. the view is valid until the ring buf is changed
+class PacketView : noncopyable
+{
+public:
+	//// parse the packet at the front of ring buf, return false if the packet is not complete or it's 
+	//// larger than max_packet_size(is_oversize), the ring buf is not changed until consume
+	bool parse(size_t head_size, RingBuf& ring_buf) { return _parse(Packet::kNarrowHead, head_size, ring_buf, UINT16_MAX); }
+	bool parse_wide(size_t head_size, RingBuf& ring_buf, uint32_t max_packet_size = UINT32_MAX) { 
+		return _parse(Packet::kWideHead, head_size, ring_buf, max_packet_size); 
+	}
+
+	//// the last parse found a packet larger than max_packet_size, the connection should be closed
+	bool is_oversize(void) const { return m_oversize; }
+
+	//// discard the packet from ring buf, the view is empty after that
+	void consume(void);
+
+	//// reset to empty, the ring buf is not changed
+	void reset(void);
+
+public:
+	bool empty(void) const { return m_memory_buf == nullptr; }
+	Packet::HeadFormat get_head_format(void) const { return m_head_format; }
+	size_t get_head_size(void) const { return m_head_size; }
+	uint16_t get_packet_id(void) const { return m_packet_id; }
+	uint32_t get_packet_size(void) const { return m_packet_size; }
+
+	//// the whole packet(head and content), as the memory buf of Packet
+	const char* get_memory_buf(void) const { return m_memory_buf; }
+	size_t get_memory_size(void) const { return m_head_size + m_packet_size; }
+
+	//// the content can be changed in place(decrypt...) before consume
+	char* get_packet_content(void) { return m_packet_size > 0 ? m_memory_buf + m_head_size : nullptr; }
+	const char* get_packet_content(void) const { return m_packet_size > 0 ? m_memory_buf + m_head_size : nullptr; }
+
+	//// the packet wraps in ring buf, and is copied to the view
+	bool is_copied(void) const { return m_memory_buf != nullptr && m_memory_buf == m_copy_buf; }
+
+private:
+	bool _parse(Packet::HeadFormat format, size_t head_size, RingBuf& ring_buf, uint32_t max_packet_size);
+
+private:
+	RingBuf* m_ring_buf;
+	Packet::HeadFormat m_head_format;
+	size_t m_head_size;
+	uint16_t m_packet_id;
+	uint32_t m_packet_size;
+	char* m_memory_buf;
+	bool m_oversize;
+
+	//the wrapped packet is copied here, reused by the next one
+	char* m_copy_buf;
+	size_t m_copy_buf_size;
+
+public:
+	PacketView();
+	~PacketView();
+};
+
 }
 
 #endif
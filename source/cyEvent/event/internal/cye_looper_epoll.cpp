@@ -126,6 +126,14 @@ void Looper_epoll::_update_channel_add_event(channel_s& channel, event_t event)
 
 	int operation = channel.active ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
 
+#ifdef EPOLLEXCLUSIVE
+	//EPOLLEXCLUSIVE can only be set with EPOLL_CTL_ADD, and not work with EPOLLRDHUP
+	if (channel.exclusive && operation == EPOLL_CTL_ADD) {
+		event_to_set &= ~((uint32_t)EPOLLRDHUP);
+		event_to_set |= EPOLLEXCLUSIVE;
+	}
+#endif
+
 	if (_set_event(channel, operation, event_to_set))
 	{
 		if(!channel.active) m_active_channel_counts++;
@@ -7,8 +7,15 @@ Copyright(C) thecodeway.com
 #include <cyclone_config.h>
 
 #include <network/cyn_address.h>
+#include <network/cyn_socket_options.h>
+#include <network/cyn_rate_limit.h>
 #include <network/cyn_tcp_server.h>
 #include <network/cyn_connection.h>
 #include <network/cyn_tcp_client.h>
+#include <network/cyn_tcp_client_pool.h>
+#include <network/cyn_dns_resolver.h>
+#include <network/cyn_udp_socket.h>
+#include <network/cyn_udp_server.h>
+#include <network/cyn_metrics_exporter.h>
 
 #endif
@@ -12,65 +12,188 @@ namespace cyclone
 Address::Address(uint16_t port, bool loopbackOnly)
 {
 	memset(&m_address, 0, sizeof m_address);
-	m_address.sin_family = AF_INET;
-	m_address.sin_addr.s_addr = loopbackOnly ? htonl(INADDR_LOOPBACK) : INADDR_ANY;
-	m_address.sin_port = htons(port);
+	struct sockaddr_in& addr = *((struct sockaddr_in*)&m_address);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = loopbackOnly ? htonl(INADDR_LOOPBACK) : INADDR_ANY;
+	addr.sin_port = htons(port);
+	m_length = (socklen_t)sizeof(struct sockaddr_in);
 
-	socket_api::inet_ntop(m_address.sin_addr, m_ip_string, IP_ADDRESS_LEN);
+	m_ip_string[0] = 0;
 }
 
 //-------------------------------------------------------------------------------------
 Address::Address(const char* ip, uint16_t port)
 {
 	memset(&m_address, 0, sizeof m_address);
-	m_address.sin_family = AF_INET;
-	m_address.sin_port = htons(port);
-	socket_api::inet_pton(ip, m_address.sin_addr);
 
-	socket_api::inet_ntop(m_address.sin_addr, m_ip_string, IP_ADDRESS_LEN);
+	if (strchr(ip, ':') != nullptr) {
+		//ipv6
+		struct sockaddr_in6& addr = *((struct sockaddr_in6*)&m_address);
+		addr.sin6_family = AF_INET6;
+		addr.sin6_port = htons(port);
+		socket_api::inet_pton(ip, addr.sin6_addr);
+		m_length = (socklen_t)sizeof(struct sockaddr_in6);
+	}
+	else {
+		struct sockaddr_in& addr = *((struct sockaddr_in*)&m_address);
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		socket_api::inet_pton(ip, addr.sin_addr);
+		m_length = (socklen_t)sizeof(struct sockaddr_in);
+	}
+
+	m_ip_string[0] = 0;
 }
 
 //-------------------------------------------------------------------------------------
 Address::Address(const struct sockaddr_in& addr)
-	: m_address(addr)
-{ 
-	socket_api::inet_ntop(m_address.sin_addr, m_ip_string, IP_ADDRESS_LEN);
+{
+	memset(&m_address, 0, sizeof m_address);
+	memcpy(&m_address, &addr, sizeof(addr));
+	m_length = (socklen_t)sizeof(addr);
+
+	m_ip_string[0] = 0;
+}
+
+//-------------------------------------------------------------------------------------
+Address::Address(const struct sockaddr* addr, socklen_t len)
+{
+	memset(&m_address, 0, sizeof m_address);
+	if (len > (socklen_t)sizeof(m_address)) len = (socklen_t)sizeof(m_address);
+	memcpy(&m_address, addr, (size_t)len);
+	m_length = len;
+
+	m_ip_string[0] = 0;
 }
 
 //-------------------------------------------------------------------------------------
 Address::Address(const Address& other)
 {
 	memcpy(&m_address, &(other.m_address), sizeof(m_address));
+	m_length = other.m_length;
+	memcpy(&m_ip_string, other.m_ip_string, IP_ADDRESS_LEN);
+}
+
+//-------------------------------------------------------------------------------------
+Address& Address::operator=(const Address& other)
+{
+	if (this == &other) return *this;
+
+	memcpy(&m_address, &(other.m_address), sizeof(m_address));
+	m_length = other.m_length;
 	memcpy(&m_ip_string, other.m_ip_string, IP_ADDRESS_LEN);
+	return *this;
 }
 
 //-------------------------------------------------------------------------------------
 Address::Address(bool peer, socket_t sfd)
 {
 	if (peer)
-		socket_api::getpeername(sfd, m_address);
+		socket_api::getpeername(sfd, m_address, m_length);
 	else
-		socket_api::getsockname(sfd, m_address);
-	socket_api::inet_ntop(m_address.sin_addr, m_ip_string, IP_ADDRESS_LEN);
+		socket_api::getsockname(sfd, m_address, m_length);
+	m_ip_string[0] = 0;
 }
 
 //-------------------------------------------------------------------------------------
 Address::Address()
 {
 	memset(&m_address, 0, sizeof m_address);
+	m_address.ss_family = AF_INET;
+	m_length = (socklen_t)sizeof(struct sockaddr_in);
 	memset(m_ip_string, 0, IP_ADDRESS_LEN);
 }
 
+//-------------------------------------------------------------------------------------
+Address Address::unix_domain(const char* path)
+{
+	Address address;
+	memset(&address.m_address, 0, sizeof(address.m_address));
+
+#ifdef CY_HAVE_SYS_UN_H
+	struct sockaddr_un& addr = *((struct sockaddr_un*)&(address.m_address));
+	addr.sun_family = AF_UNIX;
+
+	size_t path_len = strlen(path);
+	if (path_len >= sizeof(addr.sun_path)) {
+		CY_LOG(L_ERROR, "unix domain socket path is too long, %s", path);
+		path_len = sizeof(addr.sun_path) - 1;
+	}
+	memcpy(addr.sun_path, path, path_len);
+
+	//abstract socket, the name is not null-terminated
+	if (path[0] == '@') addr.sun_path[0] = 0;
+	address.m_length = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + path_len + (path[0] == '@' ? 0 : 1));
+#else
+	CY_LOG(L_ERROR, "unix domain socket is not supported in this platform, %s", path);
+	address.m_address.ss_family = AF_UNSPEC;
+	address.m_length = 0;
+#endif
+	return address;
+}
+
+//-------------------------------------------------------------------------------------
+bool Address::is_unix(void) const
+{
+#ifdef CY_HAVE_SYS_UN_H
+	return m_address.ss_family == AF_UNIX;
+#else
+	return false;
+#endif
+}
+
 //-------------------------------------------------------------------------------------
 const char* Address::get_ip(void) const
 {
+	//inet_ntop is expensive, only format it when it's used
+	if (m_ip_string[0] != 0) return m_ip_string;
+
+	switch (m_address.ss_family) {
+	case AF_INET:
+		socket_api::inet_ntop(((const struct sockaddr_in*)&m_address)->sin_addr, m_ip_string, IP_ADDRESS_LEN);
+		break;
+
+	case AF_INET6:
+		socket_api::inet_ntop(((const struct sockaddr_in6*)&m_address)->sin6_addr, m_ip_string, IP_ADDRESS_LEN);
+		break;
+
+#ifdef CY_HAVE_SYS_UN_H
+	case AF_UNIX:
+	{
+		const struct sockaddr_un* addr = (const struct sockaddr_un*)&m_address;
+		//the path is null-terminated always, the storage is larger than sockaddr_un
+		if (addr->sun_path[0] != 0) return addr->sun_path;
+
+		//unnamed or abstract socket
+		size_t name_len = (m_length > (socklen_t)offsetof(struct sockaddr_un, sun_path) + 1) ?
+			((size_t)m_length - offsetof(struct sockaddr_un, sun_path) - 1) : 0;
+		if (name_len == 0) return m_ip_string;
+
+		name_len = std::min(name_len, (size_t)IP_ADDRESS_LEN - 2);
+		m_ip_string[0] = '@';
+		memcpy(m_ip_string + 1, addr->sun_path + 1, name_len);
+		m_ip_string[name_len + 1] = 0;
+	}
+	break;
+#endif
+
+	default:
+		break;
+	}
 	return m_ip_string;
 }
 
 //-------------------------------------------------------------------------------------
 uint16_t Address::get_port(void) const
 {
-	return socket_api::ntoh_16(m_address.sin_port);
+	switch (m_address.ss_family) {
+	case AF_INET:
+		return socket_api::ntoh_16(((const struct sockaddr_in*)&m_address)->sin_port);
+	case AF_INET6:
+		return socket_api::ntoh_16(((const struct sockaddr_in6*)&m_address)->sin6_port);
+	default:
+		return 0;
+	}
 }
 
 }
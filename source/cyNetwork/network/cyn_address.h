@@ -12,11 +12,22 @@ namespace cyclone
 class Address
 {
 public:
-	//// get native address 
-	const struct sockaddr_in& get_sockaddr_in() const { return m_address; }
+	//// get native address(AF_INET only, for other families the content is undefined)
+	const struct sockaddr_in& get_sockaddr_in() const { return *((const struct sockaddr_in*)&m_address); }
 
-	//// get ip address like "123.123.123.123"
+	//// get native address and length of any family, used by bind/connect
+	const struct sockaddr* get_sockaddr(void) const { return (const struct sockaddr*)&m_address; }
+	socklen_t get_sockaddr_len(void) const { return m_length; }
+
+	//// get address family, AF_INET, AF_INET6 or AF_UNIX
+	int get_family(void) const { return m_address.ss_family; }
+	bool is_ipv6(void) const { return m_address.ss_family == AF_INET6; }
+	bool is_unix(void) const;
+
+	//// get ip address like "123.123.123.123" or "::1", the path of unix domain socket
+	//// (the string is formatted on the first call, NOT thread safe for the first call)
 	const char*	get_ip(void) const;
+	//// get port(0 for unix domain socket)
 	uint16_t	get_port(void) const;
 
 public:
@@ -26,25 +37,34 @@ public:
 	explicit Address(uint16_t port, bool loopbackOnly);
 
 	/// Constructs an endpoint with given ip and port.
-	/// @c ip should be "123.123.123.123"
+	/// @c ip should be "123.123.123.123", or ipv6 address like "::1"
 	Address(const char* ip, uint16_t port);
 
 	/// Constructs an endpoint with given struct @c sockaddr_in
 	/// Mostly used when accepting new connections
 	Address(const struct sockaddr_in& addr);
 
-	/// Constructs current address to which the socket sfd is bound 
+	/// Constructs an endpoint with native address of any family
+	Address(const struct sockaddr* addr, socklen_t len);
+
+	/// Constructs current address to which the socket sfd is bound
 	/// @param peer constructs the peer address of active socket
 	Address(bool peer, socket_t sfd);
 
+	/// Constructs an unix domain socket endpoint, the path begin with '@' means an
+	/// abstract socket(linux only)
+	static Address unix_domain(const char* path);
+
 	Address(const Address& other);
+	Address& operator=(const Address& other);
 	Address();
 
 private:
-	struct sockaddr_in m_address;
+	struct sockaddr_storage m_address;
+	socklen_t m_length;
 
-	enum { IP_ADDRESS_LEN=32 };
-	char m_ip_string[IP_ADDRESS_LEN];
+	enum { IP_ADDRESS_LEN=48 };	//INET6_ADDRSTRLEN
+	mutable char m_ip_string[IP_ADDRESS_LEN];	//empty until get_ip() is called
 };
 
 }
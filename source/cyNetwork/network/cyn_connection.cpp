@@ -6,43 +6,155 @@ Copyright(C) thecodeway.com
 #include <cy_network.h>
 #include "cyn_connection.h"
 
+#ifdef CY_SYS_WINDOWS
+#include <io.h>
+#else
+#include <fcntl.h>
+#endif
+
 namespace cyclone
 {
 
 //-------------------------------------------------------------------------------------
-Connection::Connection(int32_t id, socket_t sfd, Looper* looper, void* param)
+static int _dup_file(int fd)
+{
+#ifdef CY_SYS_WINDOWS
+	return ::_dup(fd);
+#else
+	return ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+#endif
+}
+
+//-------------------------------------------------------------------------------------
+static void _close_file(int fd)
+{
+#ifdef CY_SYS_WINDOWS
+	::_close(fd);
+#else
+	::close(fd);
+#endif
+}
+
+#ifdef CY_HAVE_SPLICE
+//-------------------------------------------------------------------------------------
+// the pipes for splice, reused by all connections
+class SplicePipePool : noncopyable
+{
+public:
+	Pipe* acquire(void) {
+		sys_api::auto_mutex lock(m_lock);
+		if (m_pipes.empty()) return new Pipe();
+
+		Pipe* pipe = m_pipes.back();
+		m_pipes.pop_back();
+		return pipe;
+	}
+
+	//the pipe must be empty
+	void release(Pipe* pipe) {
+		sys_api::auto_mutex lock(m_lock);
+		if (m_pipes.size() >= kMaxPoolSize) {
+			delete pipe;
+			return;
+		}
+		m_pipes.push_back(pipe);
+	}
+
+private:
+	enum { kMaxPoolSize = 64 };
+	std::vector<Pipe*> m_pipes;
+	sys_api::mutex_t m_lock;
+
+public:
+	SplicePipePool() : m_lock(sys_api::mutex_create()) {}
+	~SplicePipePool() {
+		for (Pipe* pipe : m_pipes) delete pipe;
+		sys_api::mutex_destroy(m_lock);
+	}
+};
+
+//-------------------------------------------------------------------------------------
+static SplicePipePool& _splice_pipe_pool(void)
+{
+	static SplicePipePool s_pool;
+	return s_pool;
+}
+#endif
+
+//-------------------------------------------------------------------------------------
+// the connections throttled by rate limit in one looper, all of them are checked by one timer
+// of the looper, the timer is removed when the list is empty
+struct throttle_list_s
+{
+	Looper::event_id_t timer_id;
+	std::vector< std::weak_ptr<Connection> > connections;
+
+	throttle_list_s() : timer_id(Looper::INVALID_EVENT_ID) {}
+};
+typedef std::map<Looper*, throttle_list_s> ThrottleListMap;
+
+//the loopers run in this thread, only one in most cases
+static ThrottleListMap& _throttle_lists(void)
+{
+	static thread_local ThrottleListMap s_lists;
+	return s_lists;
+}
+
+//check period of throttled connections, milliseconds
+static const uint32_t kThrottleCheckPeriod = 10;
+
+//-------------------------------------------------------------------------------------
+void ConnectionStats::add(const ConnectionStats& other)
+{
+	read_bytes += other.read_bytes;
+	write_bytes += other.write_bytes;
+	read_calls += other.read_calls;
+	write_calls += other.write_calls;
+	short_writes += other.short_writes;
+	would_blocks += other.would_blocks;
+	write_blocked_time += other.write_blocked_time;
+	if (other.max_output_size > max_output_size) max_output_size = other.max_output_size;
+}
+
+//-------------------------------------------------------------------------------------
+Connection::Connection(int32_t id, socket_t sfd, Looper* looper, void* param, const Address* peer_addr)
 	: m_id(id)
 	, m_socket(sfd)
 	, m_state(kConnected)
+	, m_local_addr_ready(false)
 	, m_looper(looper)
 	, m_event_id(Looper::INVALID_EVENT_ID)
 	, m_param(param)
-	, m_readBuf(kDefaultReadBufSize)
-	, m_writeBuf(kDefaultWriteBufSize)
-	, m_writeBufLock(nullptr)
-	, m_max_sendbuf_len(0)
+	, m_close_requested(false)
+	, m_write_wait_begin(0)
+	, m_last_read_time(looper->get_loop_time())
+	, m_last_write_time(looper->get_loop_time())
+	, m_timeout_seq(0)
+	, m_readBuf(0)
+	, m_writeBuf(0)
+	, m_file_buf_before(0)
+	, m_splice_pipe(nullptr)
+	, m_splice_pipe_size(0)
+	, m_high_watermark(0)
+	, m_low_watermark(0)
+	, m_above_high_watermark(false)
+	, m_linked_sinks(0)
+	, m_read_pause_flags(0)
+	, m_write_throttled(false)
+	, m_in_throttle_list(false)
+	, m_auto_cork(false)
+	, m_cork_pending(false)
 	, m_debuger(nullptr)
+	, m_listen_index(-1)
 {
-	//set socket to non-block and close-onexec
-	socket_api::set_nonblock(sfd, true);
-	socket_api::set_close_onexec(sfd, true);
-	//set other socket option
-	socket_api::set_keep_alive(sfd, true);
-	socket_api::set_linger(sfd, false, 0);
-
-	//init write buf lock
-	m_writeBufLock = sys_api::mutex_create();
+	//the socket should be non-block and close-onexec mode already(accept_nonblock),
+	//and the other options are set by creator(SocketOptions)
 
-	m_local_addr = Address(false, m_socket); //create local address
-	m_peer_addr = Address(true, m_socket); //create peer address
-
-	//set default debug name
-	char temp[MAX_PATH] = { 0 };
-	std::snprintf(temp, MAX_PATH, "connection_%d", id);
-	m_name = temp;
+	//the peer address is known after accept/connect usually, the local address will be queried when it's used
+	m_peer_addr = peer_addr ? *peer_addr : Address(true, m_socket);
 
 	//register socket event
-	m_event_id = m_looper->register_event(m_socket,
+	m_event_id = looper->register_event(m_socket,
 		Looper::kRead,			//care read event only
 		this,
 		std::bind(&Connection::_on_socket_read, this),
@@ -58,7 +170,10 @@ Connection::~Connection()
 	assert(get_state()==kDisconnected);
 	assert(m_socket == INVALID_SOCKET);
 	assert(m_event_id == Looper::INVALID_EVENT_ID);
-	assert(m_writeBufLock == nullptr);
+
+	//some data may be sent after the connection closed
+	_clean_send_queue();
+	_clean_output();
 }
 
 //-------------------------------------------------------------------------------------
@@ -72,7 +187,8 @@ void Connection::send(const char* buf, size_t len)
 {
 	if (buf == nullptr || len == 0) return;
 
-	if (sys_api::thread_get_current_id() == m_looper->get_thread_id())
+	Looper* looper = m_looper.load();
+	if (looper && sys_api::thread_get_current_id() == looper->get_thread_id())
 	{
 		_send(buf, len);
 	}
@@ -85,29 +201,413 @@ void Connection::send(const char* buf, size_t len)
 			return;
 		}
 
-		//write to output buf
-		sys_api::auto_mutex lock(m_writeBufLock);
+		//push to send queue
+		send_node* node = (send_node*)CY_MALLOC(offsetof(send_node, data) + len);
+		node->file_fd = -1;
+		node->file_offset = 0;
+		node->len = len;
+		memcpy(node->data, buf, len);
 
-		//write to write buffer
-		m_writeBuf.memcpy_into(buf, len);
+		//the first sender of the batch wake up the work thread
+		if (m_sendQueue.push(&(node->node))) {
+			_post_flush_send_queue();
+		}
+	}
+}
 
-		//enable write event, wait socket ready
-		m_looper->enable_write(m_event_id);
+//-------------------------------------------------------------------------------------
+bool Connection::send_file(int fd, int64_t offset, uint64_t length)
+{
+	if (fd < 0 || offset < 0) return false;
+	if (length == 0) return true;
+
+	if (get_state() != kConnected)
+	{
+		//log error, give up send file
+		CY_LOG(L_ERROR, "send file state error, state=%d", get_state());
+		return false;
+	}
+
+	int file_fd = _dup_file(fd);
+	if (file_fd < 0) {
+		CY_LOG(L_ERROR, "dup file error, err=%d", errno);
+		return false;
+	}
+
+	Looper* looper = m_looper.load();
+	if (looper && sys_api::thread_get_current_id() == looper->get_thread_id())
+	{
+		_push_file_segment(file_fd, offset, length);
+
+		//write it now, if nothing is waiting
+		if (!looper->is_write(m_event_id) && !m_cork_pending) {
+			_flush_output();
+		}
+	}
+	else
+	{
+		//push to send queue, in order with the message
+		send_node* node = (send_node*)CY_MALLOC(offsetof(send_node, data));
+		node->file_fd = file_fd;
+		node->file_offset = offset;
+		node->len = length;
+
+		if (m_sendQueue.push(&(node->node))) {
+			_post_flush_send_queue();
+		}
+	}
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_push_file_segment(int fd, int64_t offset, uint64_t length)
+{
+	file_segment_s segment;
+	segment.fd = fd;
+	segment.offset = offset;
+	segment.remaining = length;
+	segment.buf_before = m_writeBuf.size() - m_file_buf_before;
+
+	m_file_buf_before += segment.buf_before;
+	m_fileQueue.push_back(segment);
+}
+
+//-------------------------------------------------------------------------------------
+ssize_t Connection::_write_output(void)
+{
+	size_t budget = _get_write_budget();
+	if (budget == 0) return 0;
+
+	ssize_t len = _write_output(budget);
+	if (len > 0) {
+		m_stats.write_bytes += (uint64_t)len;
+		if ((size_t)len < budget && !_is_output_empty()) m_stats.short_writes++;
+		_consume_write_tokens((size_t)len);
+	}
+	else if (len < 0 && socket_api::is_lasterror_WOULDBLOCK()) {
+		m_stats.would_blocks++;
+	}
+	return len;
+}
+
+//-------------------------------------------------------------------------------------
+ssize_t Connection::_write_output(size_t max_len)
+{
+	//max size of one sendfile call
+	const size_t kMaxSendFileSize = 0x40000000;
+	ssize_t total_len = 0;
+
+	//the data spliced from the source connection is always the first
+	if (m_splice_pipe_size > 0) {
+		size_t count = std::min(m_splice_pipe_size, max_len);
+		m_stats.write_calls++;
+		ssize_t len = socket_api::splice(m_splice_pipe->get_read_port(), m_socket, count);
+		if (len <= 0) return len;
+
+		m_splice_pipe_size -= (size_t)len;
+		max_len -= (size_t)len;
+		total_len += len;
+
+		//socket buf busy(or run out of budget), try next time
+		if (m_splice_pipe_size > 0) return total_len;
+	}
+
+	while (!m_fileQueue.empty() && max_len > 0) {
+		file_segment_s& segment = m_fileQueue.front();
+
+		//send the data before the file segment
+		if (segment.buf_before > 0) {
+			m_stats.write_calls++;
+			ssize_t len = m_writeBuf.write_socket(m_socket, std::min(segment.buf_before, max_len));
+			if (len <= 0) return total_len > 0 ? total_len : len;
+
+			segment.buf_before -= (size_t)len;
+			m_file_buf_before -= (size_t)len;
+			max_len -= (size_t)len;
+			total_len += len;
+
+			//socket buf busy, try next time
+			if (segment.buf_before > 0) return total_len;
+			if (max_len == 0) return total_len;
+		}
+
+		size_t count = (size_t)std::min(segment.remaining, (uint64_t)std::min((size_t)kMaxSendFileSize, max_len));
+		m_stats.write_calls++;
+		ssize_t len = socket_api::send_file(m_socket, segment.fd, segment.offset, count);
+		if (len < 0) return total_len > 0 ? total_len : len;
+
+		if (len == 0) {
+			//the file is shorter than expected, drop the rest
+			CY_LOG(L_ERROR, "send file error, reach the end of file, remaining=%llu", (unsigned long long)segment.remaining);
+			segment.remaining = 0;
+		}
+		else {
+			segment.remaining -= (uint64_t)len;
+			max_len -= (size_t)len;
+			total_len += len;
+
+			//socket buf busy, try next time
+			if ((size_t)len < count) return total_len;
+		}
+
+		if (segment.remaining == 0) {
+			_close_file(segment.fd);
+			m_fileQueue.pop_front();
+		}
+	}
+
+	if (!m_writeBuf.empty() && max_len > 0 && m_fileQueue.empty()) {
+		m_stats.write_calls++;
+		ssize_t len = m_writeBuf.write_socket(m_socket, max_len);
+		if (len < 0) return total_len > 0 ? total_len : len;
+		total_len += len;
+	}
+	return total_len;
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_clean_output(void)
+{
+#ifdef CY_HAVE_SPLICE
+	if (m_splice_pipe) {
+		//the pipe with data can't be reused
+		if (m_splice_pipe_size > 0) delete m_splice_pipe;
+		else _splice_pipe_pool().release(m_splice_pipe);
+	}
+#endif
+	m_splice_pipe = nullptr;
+	m_splice_pipe_size = 0;
+
+	m_writeBuf.reset();
+	m_writeBuf.shrink();
+
+	for (file_segment_s& segment : m_fileQueue) {
+		_close_file(segment.fd);
+	}
+	m_fileQueue.clear();
+	m_file_buf_before = 0;
+}
+
+//-------------------------------------------------------------------------------------
+size_t Connection::_drain_send_queue(void)
+{
+	size_t counts = 0;
+
+	MpscNode* node = m_sendQueue.pop_all();
+	while (node) {
+		send_node* data = (send_node*)node;
+		node = node->next;
+
+		if (data->file_fd >= 0) {
+			_push_file_segment(data->file_fd, data->file_offset, data->len);
+		}
+		else {
+			m_writeBuf.memcpy_into(data->data, (size_t)data->len);
+		}
+		counts++;
+		CY_FREE(data);
+	}
+	if (counts > 0) _update_max_output_size();
+	return counts;
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_clean_send_queue(void)
+{
+	MpscNode* node = m_sendQueue.pop_all();
+	while (node) {
+		send_node* data = (send_node*)node;
+		node = node->next;
+
+		if (data->file_fd >= 0) {
+			_close_file(data->file_fd);
+		}
+		CY_FREE(data);
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_post_flush_send_queue(void)
+{
+	//the connection is moving, the new work thread will flush it after attach
+	Looper* looper = m_looper.load();
+	if (looper == nullptr) return;
+
+	ConnectionPtr thisPtr = shared_from_this();
+	looper->post([thisPtr]() {
+		thisPtr->_flush_send_queue();
+	});
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_flush_send_queue(void)
+{
+	Looper* looper = m_looper.load();
+	//the connection is moving, the new work thread will flush it after attach
+	if (looper == nullptr) return;
+
+	//the connection has been moved to other work thread
+	if (sys_api::thread_get_current_id() != looper->get_thread_id()) {
+		_post_flush_send_queue();
+		return;
+	}
+
+	//the connection is closing, the data in send queue has been moved to write buf already
+	if (m_state != kConnected) {
+		_clean_send_queue();
+		return;
+	}
+
+	if (_drain_send_queue() == 0) return;
+
+	//write event enabled already, wait socket ready, or
+	//the data will be flushed at the end of loop step
+	if (looper->is_write(m_event_id) || m_cork_pending) {
+		_check_watermark();
+		return;
+	}
+
+	//try to write directly
+	_flush_output();
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_flush_output(void)
+{
+	ssize_t len = _write_output();
+	if (len < 0 && _is_fault_error()) {
+		_on_send_fault();
+		return;
+	}
+	if (len > 0) m_last_write_time = m_looper.load()->get_loop_time();
+
+	//enable write event, wait socket ready
+	if (!_is_output_empty()) {
+		_enable_write();
+	}
+	_check_watermark();
+	_release_idle_buf();
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_end_write_wait(void)
+{
+	if (m_write_wait_begin == 0) return;
+
+	m_stats.write_blocked_time += (uint64_t)(m_looper.load()->get_loop_time() - m_write_wait_begin);
+	m_write_wait_begin = 0;
+}
+
+//-------------------------------------------------------------------------------------
+ConnectionStats Connection::get_stats(void) const
+{
+	ConnectionStats stats = m_stats;
+	if (m_write_wait_begin > 0) {
+		stats.write_blocked_time += (uint64_t)(m_looper.load()->get_loop_time() - m_write_wait_begin);
+	}
+	return stats;
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_release_idle_buf(void)
+{
+	//the block of default size is cached by the thread, it's cheap to allocate again
+	if (m_readBuf.empty() && m_readBuf.capacity() > 0 && m_readBuf.capacity() <= RingBuf::kDefaultCapacity) {
+		m_readBuf.shrink();
+	}
+	if (m_writeBuf.empty() && m_writeBuf.capacity() > 0 && m_writeBuf.capacity() <= RingBuf::kDefaultCapacity) {
+		m_writeBuf.shrink();
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_shrink_buf(void)
+{
+	m_readBuf.shrink();
+	m_writeBuf.shrink();
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_enable_write(void)
+{
+	Looper* looper = m_looper.load();
+	if (looper->is_write(m_event_id)) return;
+
+	//wait the write bucket refilled
+	if (m_write_throttled) return;
 
+	//begin to wait socket writable
+	m_last_write_time = looper->get_loop_time();
+	m_write_wait_begin = m_last_write_time;
+	looper->enable_write(m_event_id);
+
+	if (m_onWriteWait) {
+		m_onWriteWait(shared_from_this());
 	}
 }
 
 //-------------------------------------------------------------------------------------
-bool Connection::_is_writeBuf_empty(void) const
+bool Connection::set_socket_options(const SocketOptions& options)
+{
+	assert(sys_api::thread_get_current_id() == m_looper.load()->get_thread_id());
+	if (m_state != kConnected) return false;
+
+	return options.apply_connection(m_socket);
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::set_auto_cork(bool enable)
 {
-	sys_api::auto_mutex lock(m_writeBufLock);
-	return  m_writeBuf.empty();
+	assert(sys_api::thread_get_current_id() == m_looper.load()->get_thread_id());
+
+	//the data buffered will be flushed by the deferred task
+	m_auto_cork = enable;
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_flush_cork(void)
+{
+	Looper* looper = m_looper.load();
+	//the connection has been moved, the new work thread will send the data after attach
+	if (looper == nullptr || sys_api::thread_get_current_id() != looper->get_thread_id()) return;
+
+	m_cork_pending = false;
+	if (m_state == kDisconnected || _is_output_empty()) return;
+
+	//write event enabled already, wait socket ready
+	if (looper->is_write(m_event_id)) return;
+
+	//send all data buffered in this step with one call(writev)
+	_flush_output();
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_on_send_fault(void)
+{
+	m_looper.load()->disable_all(m_event_id);
+	_clean_output();
+	shutdown();
+}
+
+//-------------------------------------------------------------------------------------
+bool Connection::_is_fault_error(void)
+{
+	int err = socket_api::get_lasterror();
+	if (socket_api::is_lasterror_WOULDBLOCK()) return false;
+
+	CY_LOG(L_ERROR, "socket send error, err=%d", err);
+
+#ifdef CY_SYS_WINDOWS
+	return (err == WSAESHUTDOWN || err == WSAENETRESET);
+#else
+	return (err == EPIPE || err == ECONNRESET);
+#endif
 }
 
 //-------------------------------------------------------------------------------------
 void Connection::_send(const char* buf, size_t len)
 {
-	assert(sys_api::thread_get_current_id() == m_looper->get_thread_id());
+	assert(sys_api::thread_get_current_id() == m_looper.load()->get_thread_id());
 
 	bool faultError = false;
 	size_t remaining = len;
@@ -120,64 +620,83 @@ void Connection::_send(const char* buf, size_t len)
 		return;
 	}
 
-	//nothing in write buf, send it diretly
-	if (!(m_looper->is_write(m_event_id)) && _is_writeBuf_empty())
+	//auto cork mode, buffer it and flush at the end of loop step
+	if (m_auto_cork)
 	{
-		nwrote = socket_api::write(m_socket, buf, len);
+		m_writeBuf.memcpy_into(buf, len);
+		_update_max_output_size();
+
+		if (!m_cork_pending) {
+			m_cork_pending = true;
+
+			ConnectionPtr thisPtr = shared_from_this();
+			m_looper.load()->defer([thisPtr]() {
+				thisPtr->_flush_cork();
+			});
+		}
+		_check_watermark();
+		return;
+	}
+
+	//nothing wait to write(the write event is disabled when all data sent), send it diretly
+	size_t budget = _is_output_empty() ? _get_write_budget() : 0;
+	if (budget > 0)
+	{
+		m_stats.write_calls++;
+		nwrote = socket_api::write(m_socket, buf, std::min(len, budget));
 		if (nwrote >= 0)
 		{
 			remaining = len - (size_t)nwrote;
+			m_stats.write_bytes += (uint64_t)nwrote;
+			if ((size_t)nwrote < std::min(len, budget)) m_stats.short_writes++;
+			if (nwrote > 0) {
+				m_last_write_time = m_looper.load()->get_loop_time();
+				_consume_write_tokens((size_t)nwrote);
+			}
 		}
 		else
 		{
 			nwrote = 0;
-			int err = socket_api::get_lasterror();
-
-			if(!socket_api::is_lasterror_WOULDBLOCK())
-			{
-				CY_LOG(L_ERROR, "socket send error, err=%d", err);
-
-#ifdef CY_SYS_WINDOWS
-				if (err == WSAESHUTDOWN || err == WSAENETRESET)
-#else
-				if (err == EPIPE || err == ECONNRESET)
-#endif
-				{
-					faultError = true;
-				}
-			}
+			if (socket_api::is_lasterror_WOULDBLOCK()) m_stats.would_blocks++;
+			faultError = _is_fault_error();
 		}
 	}
 
 	if (!faultError && remaining > 0)
 	{
-		sys_api::auto_mutex lock(m_writeBufLock);
-
 		//write to write buffer
 		m_writeBuf.memcpy_into(buf + nwrote, remaining);
+		_update_max_output_size();
 
 		//enable write event, wait socket ready
-		m_looper->enable_write(m_event_id);
+		_enable_write();
 	}
 
 	//shutdown if socket work with fault
 	if (faultError) {
-		m_looper->disable_all(m_event_id);
-		shutdown();
+		_on_send_fault();
+		return;
 	}
+	_check_watermark();
 }
 
 //-------------------------------------------------------------------------------------
 void Connection::shutdown(void)
 {
-	assert(sys_api::thread_get_current_id() == m_looper->get_thread_id());
+	assert(sys_api::thread_get_current_id() == m_looper.load()->get_thread_id());
 	assert(m_state == kConnected || m_state==kDisconnecting);
 
 	//set the state to disconnecting...
 	m_state = kDisconnecting;
 
-	//something still working? wait 
-	if (m_looper->is_write(m_event_id) && !_is_writeBuf_empty()) return;
+	//the data sent from other threads and buffered by auto cork should be sent before close
+	_drain_send_queue();
+	if (!_is_output_empty()) {
+		_enable_write();
+	}
+
+	//something still working(or waiting the write bucket)? wait 
+	if ((m_looper.load()->is_write(m_event_id) || m_write_throttled) && !_is_output_empty()) return;
 	
 	//ok, we can close the socket now
 	socket_api::shutdown(m_socket);
@@ -187,12 +706,34 @@ void Connection::shutdown(void)
 //-------------------------------------------------------------------------------------
 void Connection::_on_socket_read(void)
 {
-	assert(sys_api::thread_get_current_id() == m_looper->get_thread_id());
+	assert(sys_api::thread_get_current_id() == m_looper.load()->get_thread_id());
 
-	ssize_t len = m_readBuf.read_socket(m_socket);
+	if (m_forward_peer) {
+		if (m_forward_peer->get_state() == kConnected) {
+			_on_forward_read();
+			return;
+		}
+		//the peer is closing, read to input buf again
+		_stop_forward();
+	}
+
+	//the read bucket is empty, wait refill
+	size_t budget = _get_read_budget();
+	if (budget == 0) {
+		_pause_read(kPauseByRateLimit);
+		_add_to_throttle_list();
+		return;
+	}
+
+	m_stats.read_calls++;
+	ssize_t len = m_readBuf.read_socket(m_socket, true, budget);
 
 	if (len > 0)
 	{
+		m_stats.read_bytes += (uint64_t)len;
+		m_last_read_time = m_looper.load()->get_loop_time();
+		_consume_read_tokens((size_t)len);
+
 		//notify logic layer...
 		if (m_onMessage) {
 			m_onMessage(shared_from_this());
@@ -203,62 +744,76 @@ void Connection::_on_socket_read(void)
 		//the connection was closed by peer, close now!
 		_on_socket_close();
 	}
+	else if (socket_api::is_lasterror_WOULDBLOCK())
+	{
+		//nothing to read, try next time
+		m_stats.would_blocks++;
+	}
 	else
 	{
 		//error!
 		_on_socket_error();
 	}
+
+	//the data may be consumed by logic layer
+	_release_idle_buf();
 }
 
 //-------------------------------------------------------------------------------------
 void Connection::_on_socket_write(void)
 {
-	assert(sys_api::thread_get_current_id() == m_looper->get_thread_id());
+	assert(sys_api::thread_get_current_id() == m_looper.load()->get_thread_id());
 	assert(m_state == kConnected || m_state == kDisconnecting);
 	
-	if (m_looper->is_write(m_event_id))
+	if (m_looper.load()->is_write(m_event_id))
 	{
-		sys_api::auto_mutex lock(m_writeBufLock);
-		assert(!m_writeBuf.empty());
-
-		if (m_writeBuf.size() > m_max_sendbuf_len) {
-			m_max_sendbuf_len = m_writeBuf.size();
-		}
+		//take the data sent from other threads together
+		if (m_state == kConnected) _drain_send_queue();
+		assert(!_is_output_empty());
 
-		ssize_t len = m_writeBuf.write_socket(m_socket);
-		if (len > 0) {
-			if (m_writeBuf.empty()) {
-				m_looper->disable_write(m_event_id);
+		ssize_t len = _write_output();
+		if (len > 0) m_last_write_time = m_looper.load()->get_loop_time();
 
-				//disconnecting? this is the last message send to client, we can shut it down again
-				if (m_state == kDisconnecting) {
-					shutdown();
-				}
-			}
-		}
-		else
+		if (len < 0)
 		{
 			//log error
 			CY_LOG(L_ERROR, "write socket error, err=%d", socket_api::get_lasterror());
 		}
+		else if (_is_output_empty()) {
+			_end_write_wait();
+			m_looper.load()->disable_write(m_event_id);
+
+			//disconnecting? this is the last message send to client, we can shut it down again
+			if (m_state == kDisconnecting) {
+				shutdown();
+			}
+			else {
+				//the source connection can forward again
+				_resume_forward_source();
+			}
+		}
+		_check_watermark();
+		_release_idle_buf();
 	}
 }
 
 //-------------------------------------------------------------------------------------
 void Connection::_on_socket_close(void)
 {
-	assert(sys_api::thread_get_current_id() == m_looper->get_thread_id());
+	assert(sys_api::thread_get_current_id() == m_looper.load()->get_thread_id());
 	assert(m_state == kConnected || m_state == kDisconnecting);
 
 	ConnectionPtr thisPtr = shared_from_this();
 
 	//disable all event
 	m_state = kDisconnected;
+	_end_write_wait();
 
 	//delete looper event
-	m_looper->disable_all(m_event_id);
-	m_looper->delete_event(m_event_id);
+	m_looper.load()->disable_all(m_event_id);
+	m_looper.load()->delete_event(m_event_id);
 	m_event_id = Looper::INVALID_EVENT_ID;
+	_remove_from_throttle_list();
 	
 	//logic callback
 	if (m_onClose) {
@@ -266,16 +821,509 @@ void Connection::_on_socket_close(void)
 	}
 
 	//reset read/write buf
-	m_writeBuf.reset();
+	_clean_output();
 	m_readBuf.reset();
+	m_readBuf.shrink();
+	_clean_send_queue();
+
+	//the source connection should know the peer has closed
+	_stop_forward();
+	_resume_forward_source();
+	_unlink_source();
+	m_above_high_watermark = false;
 
 	//close socket
 	socket_api::close_socket(m_socket);
 	m_socket = INVALID_SOCKET;
+}
+
+//-------------------------------------------------------------------------------------
+bool Connection::forward_to(ConnectionPtr peer)
+{
+	assert(sys_api::thread_get_current_id() == m_looper.load()->get_thread_id());
+
+	if (!peer) {
+		_stop_forward();
+		return true;
+	}
+
+	if (peer.get() == this || m_state != kConnected || peer->get_state() != kConnected) return false;
+	if (peer->m_looper.load() != m_looper.load()) {
+		CY_LOG(L_ERROR, "forward to a connection in other work thread, id=%d", peer->get_id());
+		return false;
+	}
+
+	_stop_forward();
+	m_forward_peer = peer;
+	peer->m_forward_source = shared_from_this();
+
+	//the data read already
+	_forward_input_buf();
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_on_forward_read(void)
+{
+	Connection* peer = m_forward_peer.get();
+
+	//the data will be sent after the data in peer, wait
+	if (!peer->_is_output_empty()) {
+		_pause_read(kPauseByForward);
+		return;
+	}
+
+	//the read bucket is empty, wait refill
+	size_t budget = _get_read_budget();
+	if (budget == 0) {
+		_pause_read(kPauseByRateLimit);
+		_add_to_throttle_list();
+		return;
+	}
+
+#ifdef CY_HAVE_SPLICE
+	//max size of one splice call(default capacity of pipe)
+	const size_t kMaxSpliceSize = 0x10000;
+
+	if (peer->m_splice_pipe == nullptr) {
+		peer->m_splice_pipe = _splice_pipe_pool().acquire();
+	}
+
+	m_stats.read_calls++;
+	ssize_t len = socket_api::splice(m_socket, peer->m_splice_pipe->get_write_port(), std::min(kMaxSpliceSize, budget));
+	if (len == 0) {
+		//the connection was closed by peer, close now!
+		_on_socket_close();
+		return;
+	}
+	if (len < 0) {
+		if (socket_api::is_lasterror_WOULDBLOCK()) m_stats.would_blocks++;
+		else _on_socket_error();
+		return;
+	}
+
+	m_stats.read_bytes += (uint64_t)len;
+	m_last_read_time = m_looper.load()->get_loop_time();
+	peer->m_splice_pipe_size += (size_t)len;
+	_consume_read_tokens((size_t)len);
+
+	//write to peer socket now
+	peer->_flush_output();
+	if (peer->get_state() == kConnected && !peer->_is_output_empty()) {
+		_pause_read(kPauseByForward);
+	}
+#else
+	m_stats.read_calls++;
+	ssize_t len = m_readBuf.read_socket(m_socket, true, budget);
+	if (len > 0) {
+		m_stats.read_bytes += (uint64_t)len;
+		m_last_read_time = m_looper.load()->get_loop_time();
+		_consume_read_tokens((size_t)len);
+		_forward_input_buf();
+	}
+	else if (len == 0) {
+		_on_socket_close();
+	}
+	else if (socket_api::is_lasterror_WOULDBLOCK()) {
+		//nothing to read, try next time
+		m_stats.would_blocks++;
+	}
+	else {
+		_on_socket_error();
+	}
+#endif
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_forward_input_buf(void)
+{
+	Connection* peer = m_forward_peer.get();
+
+	//send the data in input buf without normalize
+	const uint8_t* block = nullptr;
+	size_t len;
+	while ((len = m_readBuf.get_readable_block(&block)) > 0) {
+		peer->_send((const char*)block, len);
+		m_readBuf.discard(len);
+	}
+
+	if (peer->get_state() == kConnected && !peer->_is_output_empty()) {
+		_pause_read(kPauseByForward);
+	}
+	_release_idle_buf();
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_pause_read(uint32_t reason)
+{
+	if (m_read_pause_flags == 0 && m_state != kDisconnected) {
+		m_looper.load()->disable_read(m_event_id);
+	}
+	m_read_pause_flags |= reason;
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_resume_read(uint32_t reason)
+{
+	if ((m_read_pause_flags & reason) == 0) return;
+
+	m_read_pause_flags &= ~reason;
+	if (m_read_pause_flags == 0 && m_state != kDisconnected) {
+		m_looper.load()->enable_read(m_event_id);
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::set_rate_limit(const RateLimit& limit)
+{
+	assert(sys_api::thread_get_current_id() == m_looper.load()->get_thread_id());
+
+	int64_t now = m_looper.load()->get_loop_time();
+	m_rate_limit = limit;
+	m_read_bucket.set_rate(limit.read_rate, limit.read_burst, now);
+	m_write_bucket.set_rate(limit.write_rate, limit.write_burst, now);
+
+	//the buckets are full now
+	_check_throttle(now);
+}
+
+//-------------------------------------------------------------------------------------
+size_t Connection::_get_read_budget(void)
+{
+	if (!m_read_bucket.is_limited()) return SIZE_MAX;
+
+	int64_t tokens = m_read_bucket.refill(m_looper.load()->get_loop_time());
+	return tokens > 0 ? (size_t)tokens : 0;
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_consume_read_tokens(size_t len)
+{
+	if (!m_read_bucket.is_limited()) return;
+
+	m_read_bucket.consume(len);
+	if (m_read_bucket.refill(m_looper.load()->get_loop_time()) > 0) return;
+
+	//run out, wait refill
+	_pause_read(kPauseByRateLimit);
+	_add_to_throttle_list();
+}
+
+//-------------------------------------------------------------------------------------
+size_t Connection::_get_write_budget(void)
+{
+	if (!m_write_bucket.is_limited()) return SIZE_MAX;
+	if (m_write_throttled) return 0;
+
+	int64_t tokens = m_write_bucket.refill(m_looper.load()->get_loop_time());
+	return tokens > 0 ? (size_t)tokens : 0;
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_consume_write_tokens(size_t len)
+{
+	if (!m_write_bucket.is_limited()) return;
+
+	Looper* looper = m_looper.load();
+	m_write_bucket.consume(len);
+	if (m_write_bucket.refill(looper->get_loop_time()) > 0) return;
+
+	//run out, wait refill
+	m_write_throttled = true;
+	if (looper->is_write(m_event_id)) {
+		_end_write_wait();
+		looper->disable_write(m_event_id);
+	}
+	_add_to_throttle_list();
+}
+
+//-------------------------------------------------------------------------------------
+bool Connection::_check_throttle(int64_t now)
+{
+	if (m_state == kDisconnected) return false;
+
+	if (is_read_throttled() && m_read_bucket.refill(now) > 0) {
+		_resume_read(kPauseByRateLimit);
+	}
+
+	if (m_write_throttled && m_write_bucket.refill(now) > 0) {
+		m_write_throttled = false;
+		if (!_is_output_empty()) _enable_write();
+	}
+	return is_read_throttled() || m_write_throttled;
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_add_to_throttle_list(void)
+{
+	if (m_in_throttle_list) return;
+	m_in_throttle_list = true;
+
+	Looper* looper = m_looper.load();
+	throttle_list_s& list = _throttle_lists()[looper];
+	list.connections.push_back(shared_from_this());
+
+	if (list.timer_id == Looper::INVALID_EVENT_ID) {
+		list.timer_id = looper->register_timer_event(kThrottleCheckPeriod, looper, [](Looper::event_id_t, void* param) {
+			_on_throttle_timer((Looper*)param);
+		});
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_remove_from_throttle_list(void)
+{
+	if (!m_in_throttle_list) return;
+	m_in_throttle_list = false;
+
+	ThrottleListMap& lists = _throttle_lists();
+	auto it = lists.find(m_looper.load());
+	if (it == lists.end()) return;
 
-	//destroy write buf lock
-	sys_api::mutex_destroy(m_writeBufLock);
-	m_writeBufLock = nullptr;
+	//swap with the last one
+	std::vector< std::weak_ptr<Connection> >& connections = it->second.connections;
+	for (size_t i = 0; i < connections.size(); i++) {
+		if (connections[i].lock().get() == this) {
+			connections[i] = connections.back();
+			connections.pop_back();
+			break;
+		}
+	}
+
+	//the timer is not needed now
+	if (connections.empty()) {
+		Looper* looper = it->first;
+		looper->disable_all(it->second.timer_id);
+		looper->delete_event(it->second.timer_id);
+		lists.erase(it);
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_on_throttle_timer(Looper* looper)
+{
+	ThrottleListMap& lists = _throttle_lists();
+	auto it = lists.find(looper);
+	if (it == lists.end()) return;
+
+	//take the list out, the connection may be throttled again or closed in callbacks
+	std::vector< std::weak_ptr<Connection> > connections;
+	connections.swap(it->second.connections);
+
+	int64_t now = looper->get_loop_time();
+	std::vector< std::weak_ptr<Connection> > still_throttled;
+	for (auto& weak_conn : connections) {
+		ConnectionPtr conn = weak_conn.lock();
+		if (!conn || !conn->m_in_throttle_list) continue;
+
+		if (conn->_check_throttle(now)) {
+			still_throttled.push_back(conn);
+		}
+		else {
+			conn->m_in_throttle_list = false;
+		}
+	}
+
+	//the map may be changed in callbacks
+	it = lists.find(looper);
+	if (it == lists.end()) return;
+
+	std::vector< std::weak_ptr<Connection> >& list = it->second.connections;
+	for (auto& weak_conn : still_throttled) {
+		ConnectionPtr conn = weak_conn.lock();
+		if (conn && conn->m_in_throttle_list) list.push_back(weak_conn);
+	}
+
+	if (list.empty()) {
+		looper->disable_all(it->second.timer_id);
+		looper->delete_event(it->second.timer_id);
+		lists.erase(it);
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_resume_forward_source(void)
+{
+	ConnectionPtr source = m_forward_source.lock();
+	if (source) {
+		source->_resume_read(kPauseByForward);
+	}
+}
+
+//-------------------------------------------------------------------------------------
+bool Connection::set_watermark(size_t high, size_t low)
+{
+	assert(sys_api::thread_get_current_id() == m_looper.load()->get_thread_id());
+	if (high > 0 && low >= high) return false;
+
+	m_high_watermark = high;
+	m_low_watermark = low;
+
+	if (m_high_watermark == 0) {
+		//disabled, resume the source
+		if (m_above_high_watermark) {
+			m_above_high_watermark = false;
+			ConnectionPtr source = m_linked_source.lock();
+			if (source) source->_resume_read(kPauseByWatermark);
+		}
+		return true;
+	}
+
+	_check_watermark();
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+bool Connection::link_source(ConnectionPtr source)
+{
+	assert(sys_api::thread_get_current_id() == m_looper.load()->get_thread_id());
+
+	//unlink the old one
+	_unlink_source();
+
+	if (!source) return true;
+	if (source.get() == this || source->m_looper.load() != m_looper.load()) return false;
+
+	m_linked_source = source;
+	source->m_linked_sinks++;
+	if (m_above_high_watermark) {
+		source->_pause_read(kPauseByWatermark);
+	}
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_unlink_source(void)
+{
+	ConnectionPtr source = m_linked_source.lock();
+	m_linked_source.reset();
+	if (!source) return;
+
+	source->m_linked_sinks--;
+	if (m_above_high_watermark) source->_resume_read(kPauseByWatermark);
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_check_watermark(void)
+{
+	if (m_high_watermark == 0 || m_state == kDisconnected) return;
+
+	size_t output_size = get_output_size();
+	if (!m_above_high_watermark && output_size >= m_high_watermark) {
+		m_above_high_watermark = true;
+
+		ConnectionPtr source = m_linked_source.lock();
+		if (source) source->_pause_read(kPauseByWatermark);
+
+		if (m_onHighWatermark) {
+			m_onHighWatermark(shared_from_this());
+		}
+	}
+	else if (m_above_high_watermark && output_size <= m_low_watermark) {
+		m_above_high_watermark = false;
+
+		ConnectionPtr source = m_linked_source.lock();
+		if (source) source->_resume_read(kPauseByWatermark);
+
+		if (m_onLowWatermark) {
+			m_onLowWatermark(shared_from_this());
+		}
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_stop_forward(void)
+{
+	if (!m_forward_peer) return;
+
+	_resume_read(kPauseByForward);
+
+	if (m_forward_peer->m_forward_source.lock().get() == this) {
+		m_forward_peer->m_forward_source.reset();
+	}
+	m_forward_peer.reset();
+}
+
+//-------------------------------------------------------------------------------------
+bool Connection::_is_pinned(void) const
+{
+	return m_forward_peer || !m_forward_source.expired() || !m_linked_source.expired() || m_linked_sinks > 0;
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_detach(void)
+{
+	assert(sys_api::thread_get_current_id() == m_looper.load()->get_thread_id());
+	assert(m_state == kConnected);
+
+	Looper* looper = m_looper.load();
+	_end_write_wait();
+	looper->disable_all(m_event_id);
+	looper->delete_event(m_event_id);
+	m_event_id = Looper::INVALID_EVENT_ID;
+
+	//the new looper will check the throttle
+	_remove_from_throttle_list();
+
+	//the deferred flush task will be ignored, the data will be sent after attach
+	m_cork_pending = false;
+	m_looper = nullptr;
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_attach(int32_t id, Looper* looper, void* param)
+{
+	assert(sys_api::thread_get_current_id() == looper->get_thread_id());
+	assert(m_looper.load() == nullptr && m_event_id == Looper::INVALID_EVENT_ID);
+
+	//the name is kept, it may be used as the key of debug values
+	m_id = id;
+	m_looper = looper;
+	m_param = param;
+
+	//care write event if there are some data wait to send
+	m_event_id = looper->register_event(m_socket,
+		(_is_output_empty() || m_write_throttled) ? Looper::kRead : (Looper::kRead | Looper::kWrite),
+		this,
+		std::bind(&Connection::_on_socket_read, this),
+		std::bind(&Connection::_on_socket_write, this)
+	);
+
+	if (!_is_output_empty() && !m_write_throttled) {
+		m_write_wait_begin = looper->get_loop_time();
+	}
+
+	//keep the paused state
+	if (m_read_pause_flags != 0) {
+		looper->disable_read(m_event_id);
+	}
+	if (m_write_throttled || is_read_throttled()) {
+		_add_to_throttle_list();
+	}
+
+	//the data sent from other threads during moving
+	if (!m_sendQueue.empty()) {
+		_flush_send_queue();
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void Connection::_close_detached(void)
+{
+	assert(m_looper.load() == nullptr && m_event_id == Looper::INVALID_EVENT_ID);
+
+	m_state = kDisconnected;
+
+	//reset read/write buf
+	_clean_output();
+	m_readBuf.reset();
+	m_readBuf.shrink();
+	_clean_send_queue();
+	m_forward_peer.reset();
+
+	//close socket
+	socket_api::close_socket(m_socket);
+	m_socket = INVALID_SOCKET;
 }
 
 //-------------------------------------------------------------------------------------
@@ -287,11 +1335,33 @@ void Connection::_on_socket_error(void)
 //-------------------------------------------------------------------------------------
 void Connection::set_name(const char* name)
 {
-	assert(sys_api::thread_get_current_id() == m_looper->get_thread_id());
+	assert(sys_api::thread_get_current_id() == m_looper.load()->get_thread_id());
 
 	m_name = name;
 }
 
+//-------------------------------------------------------------------------------------
+const char* Connection::get_name(void) const
+{
+	//set default debug name
+	if (m_name.empty()) {
+		char temp[MAX_PATH] = { 0 };
+		std::snprintf(temp, MAX_PATH, "connection_%d", m_id.load());
+		m_name = temp;
+	}
+	return m_name.c_str();
+}
+
+//-------------------------------------------------------------------------------------
+const Address& Connection::get_local_addr(void) const
+{
+	if (!m_local_addr_ready && m_socket != INVALID_SOCKET) {
+		m_local_addr = Address(false, m_socket);
+		m_local_addr_ready = true;
+	}
+	return m_local_addr;
+}
+
 //-------------------------------------------------------------------------------------
 void Connection::debug(DebugInterface* debuger)
 {
@@ -300,14 +1370,17 @@ void Connection::debug(DebugInterface* debuger)
 	m_debuger = debuger;
 	char key_temp[MAX_PATH] = { 0 };
 
-	std::snprintf(key_temp, MAX_PATH, "Connection:%s:readbuf_capcity", m_name.c_str());
+	std::snprintf(key_temp, MAX_PATH, "Connection:%s:readbuf_capcity", get_name());
 	debuger->updateDebugValue(key_temp, (int32_t)m_readBuf.capacity());
 
-	std::snprintf(key_temp, MAX_PATH, "Connection:%s:writebuf_capcity", m_name.c_str());
+	std::snprintf(key_temp, MAX_PATH, "Connection:%s:writebuf_capcity", get_name());
 	debuger->updateDebugValue(key_temp, (int32_t)m_writeBuf.capacity());
 
-	std::snprintf(key_temp, MAX_PATH, "Connection:%s:max_sendbuf_len", m_name.c_str());
-	debuger->updateDebugValue(key_temp, (int32_t)m_max_sendbuf_len);
+	std::snprintf(key_temp, MAX_PATH, "Connection:%s:max_sendbuf_len", get_name());
+	debuger->updateDebugValue(key_temp, (int32_t)m_stats.max_output_size);
+
+	std::snprintf(key_temp, MAX_PATH, "Connection:%s:output_size", get_name());
+	debuger->updateDebugValue(key_temp, (int32_t)get_output_size());
 }
 
 //-------------------------------------------------------------------------------------
@@ -317,13 +1390,16 @@ void Connection::_del_debug_value(void)
 
 	char key_name[MAX_PATH] = { 0 };
 
-	std::snprintf(key_name, MAX_PATH, "Connection:%s:readbuf_capcity", m_name.c_str());
+	std::snprintf(key_name, MAX_PATH, "Connection:%s:readbuf_capcity", get_name());
+	m_debuger->delDebugValue(key_name);
+
+	std::snprintf(key_name, MAX_PATH, "Connection:%s:writebuf_capcity", get_name());
 	m_debuger->delDebugValue(key_name);
 
-	std::snprintf(key_name, MAX_PATH, "Connection:%s:writebuf_capcity", m_name.c_str());
+	std::snprintf(key_name, MAX_PATH, "Connection:%s:max_sendbuf_len", get_name());
 	m_debuger->delDebugValue(key_name);
 
-	std::snprintf(key_name, MAX_PATH, "Connection:%s:max_sendbuf_len", m_name.c_str());
+	std::snprintf(key_name, MAX_PATH, "Connection:%s:output_size", get_name());
 	m_debuger->delDebugValue(key_name);
 }
 
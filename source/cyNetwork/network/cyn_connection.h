@@ -6,6 +6,8 @@ Copyright(C) thecodeway.com
 
 #include <cyclone_config.h>
 #include <network/cyn_address.h>
+#include <network/cyn_socket_options.h>
+#include <network/cyn_rate_limit.h>
 
 namespace cyclone
 {
@@ -13,6 +15,27 @@ namespace cyclone
 class Connection;
 typedef std::shared_ptr<Connection> ConnectionPtr;
 
+//
+// I/O counters of connection, updated in the work thread without lock
+//
+struct ConnectionStats
+{
+	uint64_t read_bytes;
+	uint64_t write_bytes;
+	uint64_t read_calls;			//read(readv, splice) syscalls
+	uint64_t write_calls;			//write(writev, sendfile, splice) syscalls
+	uint64_t short_writes;			//the socket took less data than offered
+	uint64_t would_blocks;			//EAGAIN of read and write
+	uint64_t write_blocked_time;	//time spent waiting the socket writable, in microseconds
+	size_t max_output_size;			//peak of the data buffered and wait to send
+
+	//// accumulate the counters, the peak is the max one
+	void add(const ConnectionStats& other);
+
+	ConnectionStats() : read_bytes(0), write_bytes(0), read_calls(0), write_calls(0), short_writes(0), 
+		would_blocks(0), write_blocked_time(0), max_output_size(0) {}
+};
+
 class Connection : public std::enable_shared_from_this<Connection>, noncopyable
 {
 public:
@@ -28,8 +51,8 @@ public:
 	//
 	enum State { kConnecting, kConnected, kDisconnecting, kDisconnected };
 
-	/// get id(thread safe)
-	int32_t get_id(void) const { return m_id; }
+	/// get id(thread safe), the id is changed when the connection is moved to another work thread
+	int32_t get_id(void) const { return m_id.load(); }
 
 	/// get current state(thread safe)
 	State get_state(void) const;
@@ -37,8 +60,9 @@ public:
 	/// get peer address (thread safe)
 	const Address& get_peer_addr(void) const { return m_peer_addr; }
 
-	/// get local address (thread safe)
-	const Address& get_local_addr(void) const { return m_local_addr; }
+	/// get local address, it's queried from socket on the first call 
+	/// (NOT thread safe, call it in work thread before the connection closed)
+	const Address& get_local_addr(void) const;
 
 	/// get input stream buf (NOT thread safe, call it in work thread)
 	RingBuf& get_input_buf(void) { return m_readBuf; }
@@ -46,19 +70,82 @@ public:
 	/// send message(thread safe)
 	void send(const char* buf, size_t len);
 
+	/// send length bytes of file from offset(thread safe), the file will be sent with sendfile 
+	/// in order with the message sent by send(). the fd is duplicated, the caller can close it after call
+	bool send_file(int fd, int64_t offset, uint64_t length);
+
+	/// forward all data read from socket to the peer connection(splice in kernel if possible), 
+	/// onMessage will not be called until stop forward(peer=nullptr). the reading will be paused 
+	/// when the peer is busy. both connections must be in the same work thread (NOT thread safe)
+	bool forward_to(ConnectionPtr peer);
+
 	/// get native socket
 	socket_t get_socket(void) { return m_socket; }
 
-	/// set/get connection debug name(NOT thread safe)
+	/// set/get connection debug name, default is "connection_<id>", the name is kept when the
+	/// connection is moved to another work thread(NOT thread safe)
 	void set_name(const char* name);
-	const char* get_name(void) const { return m_name.c_str(); }
+	const char* get_name(void) const;
 
 	/// get param
-	void* get_param(void) { return m_param; }
+	void* get_param(void) { return m_param.load(); }
+
+	/// get the looper of the connection, nullptr when it's moving between work threads
+	Looper* get_looper(void) const { return m_looper.load(); }
+
+	/// get the index of the bind port which the connection is accepted from, -1 if it's not accepted by TcpServer
+	int32_t get_listen_index(void) const { return m_listen_index; }
+
+	/// get total bytes received from socket (NOT thread safe, call it in work thread)
+	uint64_t get_read_bytes(void) const { return m_stats.read_bytes; }
+
+	/// get i/o counters, the waiting for socket writable now is counted in (NOT thread safe, call it in work thread)
+	ConnectionStats get_stats(void) const;
+
+	/// get the time of last read/write activity, in microseconds(loop time of work thread), 
+	/// the write time is also updated when data begin to wait for socket writable (NOT thread safe)
+	int64_t get_last_read_time(void) const { return m_last_read_time; }
+	int64_t get_last_write_time(void) const { return m_last_write_time; }
+
+	/// apply socket options to the connection, the options for listen socket and connect are ignored,
+	/// and the options in default value are not reset except keep alive and linger (NOT thread safe, call it in work thread)
+	bool set_socket_options(const SocketOptions& options);
+
+	/// enable/disable auto cork, the data sent in work thread will be buffered and flushed 
+	/// once at the end of current loop step (NOT thread safe, call it in work thread)
+	void set_auto_cork(bool enable);
+	bool is_auto_cork(void) const { return m_auto_cork; }
+
+	/// get the size of data buffered in memory and wait to send (NOT thread safe, call it in work thread)
+	size_t get_output_size(void) const { return m_writeBuf.size() + m_splice_pipe_size; }
+
+	/// set output watermark, onHighWatermark will be called when the output size reach high watermark, 
+	/// and onLowWatermark will be called when it fall to low watermark again. 
+	/// set high to zero to disable it (NOT thread safe, call it in work thread)
+	bool set_watermark(size_t high, size_t low);
+	size_t get_high_watermark(void) const { return m_high_watermark; }
+	size_t get_low_watermark(void) const { return m_low_watermark; }
+
+	/// limit the byte rate of reading and writing, the read(write) event is disabled when the tokens 
+	/// run out, and enabled again after refilled. the throttled connections of one work thread are 
+	/// checked by one timer (NOT thread safe, call it in work thread)
+	void set_rate_limit(const RateLimit& limit);
+	const RateLimit& get_rate_limit(void) const { return m_rate_limit; }
+
+	/// is reading(writing) paused by rate limit now (NOT thread safe, call it in work thread)
+	bool is_read_throttled(void) const { return (m_read_pause_flags & kPauseByRateLimit) != 0; }
+	bool is_write_throttled(void) const { return m_write_throttled; }
+
+	/// link a source connection, the source will stop reading when the output of this connection is 
+	/// above high watermark, and resume below low watermark. both connections must be in the same 
+	/// work thread, set nullptr to unlink (NOT thread safe)
+	bool link_source(ConnectionPtr source);
 
 	///set callbackfunction
 	void setOnMessageFunction(EventCallback callback) { m_onMessage = callback; }
 	void setOnCloseFunction(EventCallback callback) { m_onClose = callback; }
+	void setOnHighWatermarkFunction(EventCallback callback) { m_onHighWatermark = callback; }
+	void setOnLowWatermarkFunction(EventCallback callback) { m_onLowWatermark = callback; }
 
 	/// debug
 	void debug(DebugInterface* debuger);
@@ -67,31 +154,94 @@ public:
 	void shutdown(void);
 
 private:
-	int32_t m_id;
+	std::atomic<int32_t> m_id;	//written in the new work thread when moved
 	socket_t m_socket;
 	std::atomic<State> m_state;
-	Address m_local_addr;
+	mutable Address m_local_addr;
+	mutable bool m_local_addr_ready;
 	Address m_peer_addr;
-	Looper* m_looper;
+	std::atomic<Looper*> m_looper;	//null when the connection is moving between loopers
 	Looper::event_id_t m_event_id;
-	void* m_param;
+	std::atomic<void*> m_param;
+	std::atomic<bool> m_close_requested;	//set by TcpServer::shutdown_connection, kept when the connection is moved
+
+	ConnectionStats m_stats;
+	int64_t m_write_wait_begin;	//the loop time when begin to wait socket writable, zero if not waiting
+
+	//activity time, checked by the timeout wheel of server work thread
+	int64_t m_last_read_time;
+	int64_t m_last_write_time;
+	uint32_t m_timeout_seq;	//the entry in timeout wheel with other sequence is out of date
 
-	enum { kDefaultReadBufSize=1024, kDefaultWriteBufSize=1024 };
-	
+	//the memory of bufs is allocated when data coming, and released when they're empty
 	RingBuf m_readBuf;
 
 	RingBuf m_writeBuf;
-	sys_api::mutex_t m_writeBufLock;	//for multithread lock
+
+	//file segments wait to send, the data in write buf before the segment will be sent first
+	struct file_segment_s
+	{
+		int fd;
+		int64_t offset;
+		uint64_t remaining;
+		size_t buf_before;	//size of data in write buf before this segment(after the previous one)
+	};
+	typedef std::deque< file_segment_s > file_segment_queue;
+	file_segment_queue m_fileQueue;
+	size_t m_file_buf_before;	//total size of data in write buf before the last file segment
+
+	//forward
+	ConnectionPtr m_forward_peer;	//the data read from socket will be forwarded to it
+	std::weak_ptr<Connection> m_forward_source;	//the connection forward data to me
+	Pipe* m_splice_pipe;	//the data spliced from source, wait to write to socket
+	size_t m_splice_pipe_size;
+
+	//data and file sent from other threads, moved to write buf in work thread
+	struct send_node
+	{
+		MpscNode node;
+		int file_fd;	//-1 if it's a data node
+		int64_t file_offset;
+		uint64_t len;
+		char data[1];
+	};
+	MpscQueue m_sendQueue;
 
 	EventCallback m_onMessage;
 	EventCallback m_onClose;
+	EventCallback m_onHighWatermark;
+	EventCallback m_onLowWatermark;
+	EventCallback m_onWriteWait;	//begin to wait socket writable, bound by server work thread for write timeout
+
+	//watermark
+	size_t m_high_watermark;
+	size_t m_low_watermark;
+	bool m_above_high_watermark;
+	std::weak_ptr<Connection> m_linked_source;	//stop reading when I'm above high watermark
+	int32_t m_linked_sinks;	//counts of the connections linked me as source
+
+	//the reason of read event disabled
+	enum { kPauseByForward = 1, kPauseByWatermark = 1<<1, kPauseByRateLimit = 1<<2 };
+	uint32_t m_read_pause_flags;
+
+	//rate limit
+	RateLimit m_rate_limit;
+	TokenBucket m_read_bucket;
+	TokenBucket m_write_bucket;
+	bool m_write_throttled;	//the write event is disabled until the write bucket refilled
+	bool m_in_throttle_list;
 
-	std::string m_name;
+	mutable std::string m_name;	//empty until get_name() is called
 
-	size_t m_max_sendbuf_len;
+	bool m_auto_cork;
+	bool m_cork_pending;	//flush task has been deferred to the end of loop step
 
 	DebugInterface* m_debuger;
 
+	//groups joined in the server(work thread only), kept when the connection is moved
+	std::vector<int32_t> m_groups;
+	int32_t m_listen_index;
+
 private:
 	//// on socket read event
 	void _on_socket_read(void);
@@ -102,20 +252,133 @@ private:
 	//// on socket close
 	void _on_socket_close(void);
 
+	//// on socket read event in forward mode
+	void _on_forward_read(void);
+
+	//// forward the data in input buf to the peer
+	void _forward_input_buf(void);
+
+	//// disable read event, until all pause reasons are resumed
+	void _pause_read(uint32_t reason);
+
+	//// resume the read event paused by the reason
+	void _resume_read(uint32_t reason);
+
+	//// bytes can be read now, SIZE_MAX if the rate is not limited, zero if the bucket is empty
+	size_t _get_read_budget(void);
+
+	//// take the bytes read from the read bucket, pause reading if it runs out
+	void _consume_read_tokens(size_t len);
+
+	//// bytes can be written now, SIZE_MAX if the rate is not limited, zero if throttled
+	size_t _get_write_budget(void);
+
+	//// take the bytes written from the write bucket, disable write event if it runs out
+	void _consume_write_tokens(size_t len);
+
+	//// the throttled connections of the looper, checked by one timer of the looper
+	void _add_to_throttle_list(void);
+	void _remove_from_throttle_list(void);
+	static void _on_throttle_timer(Looper* looper);
+
+	//// resume reading or writing if the bucket is refilled, return false if nothing is throttled
+	bool _check_throttle(int64_t now);
+
+	//// check output size and call watermark callback
+	void _check_watermark(void);
+
+	//// resume the source connection when all data has been sent
+	void _resume_forward_source(void);
+
+	//// stop forward, read to input buf again
+	void _stop_forward(void);
+
+	//// unlink the source connection, resume it if it was paused by me
+	void _unlink_source(void);
+
 	//// on socket error
 	void _on_socket_error(void);
 
 	/// send message (not thread safe, must int work thread)
 	void _send(const char* buf, size_t len);
 
-	//// is write buf empty(thread safe)
-	bool _is_writeBuf_empty(void) const;
+	//// move the data in send queue to write buf, return the counts of node moved (must in work thread)
+	size_t _drain_send_queue(void);
+
+	//// push a file segment after the data in write buf (must in work thread)
+	void _push_file_segment(int fd, int64_t offset, uint64_t length);
+
+	//// write the data in write buf and file segments to socket in order, in the limit of write rate (must in work thread)
+	ssize_t _write_output(void);
+	ssize_t _write_output(size_t max_len);
+
+	//// try to write output directly, enable write event if something left (must in work thread)
+	void _flush_output(void);
+
+	//// the socket is not waited writable any more, count the blocked time
+	void _end_write_wait(void);
+
+	//// update the peak of output size
+	void _update_max_output_size(void) {
+		if (get_output_size() > m_stats.max_output_size) m_stats.max_output_size = get_output_size();
+	}
+
+	//// is there nothing wait to write
+	bool _is_output_empty(void) const { return m_splice_pipe_size == 0 && m_writeBuf.empty() && m_fileQueue.empty(); }
+
+	//// enable write event, the write time is reset if the write event was disabled
+	void _enable_write(void);
+
+	//// release the empty bufs of default size, the grown bufs are kept until _shrink_buf
+	void _release_idle_buf(void);
+
+	//// shrink the bufs, called when the connection is quiet for a while
+	void _shrink_buf(void);
+
+	//// drop all data in splice pipe, write buf and file segments
+	void _clean_output(void);
+
+	//// move the data in send queue to write buf and write to socket (must in work thread)
+	void _flush_send_queue(void);
+
+	//// post a flush task to the work thread
+	void _post_flush_send_queue(void);
+
+	//// flush the data buffered in this loop step(auto cork mode)
+	void _flush_cork(void);
+
+	//// close the connection when socket write failed, the data in write buf will be dropped
+	void _on_send_fault(void);
+
+	//// check last error after send, return true if the connection should be shutdown
+	static bool _is_fault_error(void);
+
+	//// drop all data in send queue
+	void _clean_send_queue(void);
 
 	//// clean all debug value
 	void _del_debug_value(void);
 
+	//// the connection is forwarding data with another connection of the same looper, or linked with
+	//// one by watermark, it can't be moved to other work thread alone
+	bool _is_pinned(void) const;
+
+	//// detach from current looper, the socket events will be removed, but the data in 
+	//// read/write buf and send queue is kept (must call in current work thread)
+	void _detach(void);
+
+	//// attach to a new looper with new id, and re-register socket events (must call in the new work thread)
+	void _attach(int32_t id, Looper* looper, void* param);
+
+	//// close the socket of a detached connection which can't be attached to any looper, the close
+	//// callback is not called (must call in the thread holding the connection)
+	void _close_detached(void);
+
+	friend class ServerWorkThread;
+
 public:
-	Connection(int32_t id, socket_t sfd, Looper* looper, void* param);
+	/// the peer address will be queried from socket if peer_addr is null
+	Connection(int32_t id, socket_t sfd, Looper* looper, void* param, const Address* peer_addr = nullptr);
 	~Connection();
 };
 
@@ -0,0 +1,287 @@
+/*
+Copyright(C) thecodeway.com
+*/
+#include <cy_core.h>
+#include <cy_event.h>
+#include <cy_network.h>
+#include "cyn_dns_resolver.h"
+
+#ifndef CY_SYS_WINDOWS
+#include <netdb.h>
+#endif
+
+namespace cyclone
+{
+
+//-------------------------------------------------------------------------------------
+DnsResolver::DnsResolver(int32_t thread_counts)
+	: m_resolve_function(getaddrinfo_resolve)
+	, m_lock(sys_api::mutex_create())
+	, m_signal(sys_api::signal_create())
+	, m_quit(false)
+	, m_cache_ttl(kDefaultCacheTTL)
+	, m_negative_ttl(kDefaultNegativeTTL)
+	, m_lookup_counts(0)
+	, m_cache_hit_counts(0)
+	, m_coalesced_counts(0)
+{
+	if (thread_counts < 1) thread_counts = 1;
+
+	for (int32_t i = 0; i < thread_counts; i++) {
+		char name[MAX_PATH] = { 0 };
+		std::snprintf(name, MAX_PATH, "dns_%d", i);
+		m_threads.push_back(sys_api::thread_create([this](void*) { _resolve_thread(); }, nullptr, name));
+	}
+}
+
+//-------------------------------------------------------------------------------------
+DnsResolver::~DnsResolver()
+{
+	m_quit = true;
+	sys_api::signal_notify(m_signal);
+	for (auto thread : m_threads) {
+		sys_api::thread_join(thread);
+	}
+	m_threads.clear();
+
+	//the waiting callbacks are dropped
+	for (auto it : m_cache) {
+		delete it.second;
+	}
+	m_cache.clear();
+
+	sys_api::signal_destroy(m_signal);
+	sys_api::mutex_destroy(m_lock);
+}
+
+//-------------------------------------------------------------------------------------
+void DnsResolver::set_cache_ttl(uint32_t ttl_ms, uint32_t negative_ttl_ms)
+{
+	sys_api::auto_mutex lock(m_lock);
+
+	m_cache_ttl = ttl_ms;
+	m_negative_ttl = negative_ttl_ms;
+}
+
+//-------------------------------------------------------------------------------------
+void DnsResolver::clear_cache(void)
+{
+	sys_api::auto_mutex lock(m_lock);
+
+	for (auto it = m_cache.begin(); it != m_cache.end();) {
+		if (it->second->resolving) {
+			++it;
+			continue;
+		}
+		delete it->second;
+		it = m_cache.erase(it);
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void DnsResolver::resolve(Looper* looper, const std::string& hostname, uint16_t port, ResolveCallback callback)
+{
+	assert(looper);
+
+	waiter_s waiter;
+	waiter.looper = looper;
+	waiter.port = port;
+	waiter.callback = callback;
+
+	bool in_place = (sys_api::thread_get_current_id() == looper->get_thread_id());
+
+	//numeric address, no lookup
+	std::vector<Address> addresses;
+	if (_resolve_numeric(hostname, addresses)) {
+		_deliver(waiter, true, addresses, in_place);
+		return;
+	}
+
+	int64_t now = sys_api::utc_time_now();
+	bool success = false;
+	{
+		sys_api::auto_mutex lock(m_lock);
+
+		entry_s* entry = nullptr;
+		auto it = m_cache.find(hostname);
+		if (it != m_cache.end()) {
+			entry = it->second;
+			if (entry->resolving) {
+				//share the pending query
+				entry->waiters.push_back(waiter);
+				m_coalesced_counts++;
+				return;
+			}
+			if (entry->expire_time > now) {
+				success = entry->success;
+				addresses = entry->addresses;
+			}
+			else {
+				entry = nullptr;
+			}
+		}
+
+		if (entry == nullptr) {
+			//begin a new query
+			if (it == m_cache.end()) {
+				if (m_cache.size() >= kMaxCacheCounts) _trim_cache(now);
+
+				entry = new entry_s();
+				m_cache.insert(std::make_pair(hostname, entry));
+			}
+			else {
+				entry = it->second;
+			}
+			entry->resolving = true;
+			entry->success = false;
+			entry->addresses.clear();
+			entry->waiters.push_back(waiter);
+
+			m_jobs.push_back(hostname);
+			m_lookup_counts++;
+			sys_api::signal_notify(m_signal);
+			return;
+		}
+	}
+
+	m_cache_hit_counts++;
+	_deliver(waiter, success, addresses, in_place);
+}
+
+//-------------------------------------------------------------------------------------
+void DnsResolver::_resolve_thread(void)
+{
+	for (;;) {
+		std::string hostname;
+		bool has_job = false;
+		{
+			sys_api::auto_mutex lock(m_lock);
+			if (!m_jobs.empty()) {
+				hostname = m_jobs.front();
+				m_jobs.pop_front();
+				has_job = true;
+
+				//the signal wakes up one thread only, pass the rest jobs to the next thread
+				if (!m_jobs.empty()) sys_api::signal_notify(m_signal);
+			}
+		}
+
+		if (!has_job) {
+			if (m_quit) {
+				//wake up the next thread
+				sys_api::signal_notify(m_signal);
+				break;
+			}
+			sys_api::signal_wait(m_signal);
+			continue;
+		}
+
+		std::vector<Address> addresses;
+		bool success = m_resolve_function(hostname, addresses) && !addresses.empty();
+		if (!success) {
+			addresses.clear();
+			CY_LOG(L_WARN, "resolve \"%s\" failed", hostname.c_str());
+		}
+
+		std::vector<waiter_s> waiters;
+		{
+			sys_api::auto_mutex lock(m_lock);
+
+			auto it = m_cache.find(hostname);
+			if (it == m_cache.end()) continue;
+
+			entry_s* entry = it->second;
+			entry->resolving = false;
+			entry->success = success;
+			entry->addresses = addresses;
+			entry->expire_time = sys_api::utc_time_now() + (int64_t)(success ? m_cache_ttl : m_negative_ttl) * 1000;
+			waiters.swap(entry->waiters);
+		}
+
+		for (auto& waiter : waiters) {
+			_deliver(waiter, success, addresses, false);
+		}
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void DnsResolver::_trim_cache(int64_t now)
+{
+	//remove the expired results
+	for (auto it = m_cache.begin(); it != m_cache.end();) {
+		entry_s* entry = it->second;
+		if (entry->resolving || entry->expire_time > now) {
+			++it;
+			continue;
+		}
+		delete entry;
+		it = m_cache.erase(it);
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void DnsResolver::_deliver(const waiter_s& waiter, bool success, const std::vector<Address>& addresses, bool in_place)
+{
+	//set the port
+	std::vector<Address> result;
+	result.reserve(addresses.size());
+	for (auto& addr : addresses) {
+		struct sockaddr_storage native;
+		memcpy(&native, addr.get_sockaddr(), (size_t)addr.get_sockaddr_len());
+		if (native.ss_family == AF_INET6) {
+			((struct sockaddr_in6*)&native)->sin6_port = htons(waiter.port);
+		}
+		else {
+			((struct sockaddr_in*)&native)->sin_port = htons(waiter.port);
+		}
+		result.push_back(Address((const struct sockaddr*)&native, addr.get_sockaddr_len()));
+	}
+
+	if (in_place) {
+		waiter.callback(success, result);
+		return;
+	}
+
+	ResolveCallback callback = waiter.callback;
+	waiter.looper->post([callback, success, result]() {
+		callback(success, result);
+	});
+}
+
+//-------------------------------------------------------------------------------------
+static bool _getaddrinfo(const std::string& hostname, int flags, std::vector<Address>& addresses)
+{
+	socket_api::global_init();
+
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	hints.ai_flags = flags;
+
+	struct addrinfo *result = nullptr;
+	if (getaddrinfo(hostname.c_str(), nullptr, &hints, &result) != 0) return false;
+
+	for (auto ptr = result; ptr != nullptr; ptr = ptr->ai_next) {
+		if (ptr->ai_family != AF_INET && ptr->ai_family != AF_INET6) continue;
+		addresses.push_back(Address(ptr->ai_addr, (socklen_t)ptr->ai_addrlen));
+	}
+
+	freeaddrinfo(result);
+	return !addresses.empty();
+}
+
+//-------------------------------------------------------------------------------------
+bool DnsResolver::_resolve_numeric(const std::string& hostname, std::vector<Address>& addresses)
+{
+	return _getaddrinfo(hostname, AI_NUMERICHOST, addresses);
+}
+
+//-------------------------------------------------------------------------------------
+bool DnsResolver::getaddrinfo_resolve(const std::string& hostname, std::vector<Address>& addresses)
+{
+	return _getaddrinfo(hostname, 0, addresses);
+}
+
+}
@@ -0,0 +1,98 @@
+/*
+Copyright(C) thecodeway.com
+*/
+#ifndef _CYCLONE_NETWORK_DNS_RESOLVER_H_
+#define _CYCLONE_NETWORK_DNS_RESOLVER_H_
+
+#include <cy_core.h>
+#include <cy_event.h>
+#include "cyn_address.h"
+
+namespace cyclone
+{
+
+//
+// Asynchronous host name resolver, the blocking lookups run in a small thread pool and the
+// results are delivered to the looper of the caller. The results are cached for a while, and
+// the concurrent lookups of the same name share one query
+//
+class DnsResolver : noncopyable
+{
+public:
+	//the addresses are empty if failed
+	typedef std::function<void(bool success, const std::vector<Address>& addresses)> ResolveCallback;
+	//blocking resolve function, called in the resolver threads, the port of addresses is ignored
+	typedef std::function<bool(const std::string& hostname, std::vector<Address>& addresses)> ResolveFunction;
+
+	enum { kDefaultCacheTTL = 60 * 1000, kDefaultNegativeTTL = 5 * 1000, kMaxCacheCounts = 4096 };
+
+public:
+	//// resolve the host name(or numeric ip address), the callback is called in the looper thread,
+	//// and may be called in this function if the result is cached already(thread safe)
+	void resolve(Looper* looper, const std::string& hostname, uint16_t port, ResolveCallback callback);
+
+	//// set how long(milliseconds) the successful and failed results are cached, getaddrinfo doesn't
+	//// expose the ttl of dns records, so the ttl is decided by caller(thread safe)
+	void set_cache_ttl(uint32_t ttl_ms, uint32_t negative_ttl_ms);
+
+	//// replace the blocking resolve function, call it before the first resolve(NOT thread safe)
+	void set_resolve_function(ResolveFunction func) { m_resolve_function = func; }
+
+	//// remove all cached results, the pending lookups are not affected(thread safe)
+	void clear_cache(void);
+
+	//// statistics
+	uint64_t get_lookup_counts(void) const { return m_lookup_counts.load(); }
+	uint64_t get_cache_hit_counts(void) const { return m_cache_hit_counts.load(); }
+	uint64_t get_coalesced_counts(void) const { return m_coalesced_counts.load(); }
+
+	//// the default resolve function, use getaddrinfo
+	static bool getaddrinfo_resolve(const std::string& hostname, std::vector<Address>& addresses);
+
+private:
+	struct waiter_s
+	{
+		Looper* looper;
+		uint16_t port;
+		ResolveCallback callback;
+	};
+
+	struct entry_s
+	{
+		bool resolving;
+		bool success;
+		std::vector<Address> addresses;
+		int64_t expire_time;	//utc time in microseconds
+		std::vector<waiter_s> waiters;
+	};
+	typedef std::map<std::string, entry_s*> EntryMap;
+
+	ResolveFunction m_resolve_function;
+	sys_api::mutex_t m_lock;
+	sys_api::signal_t m_signal;
+	EntryMap m_cache;
+	std::deque<std::string> m_jobs;
+	std::vector<thread_t> m_threads;
+	atomic_bool_t m_quit;
+
+	uint32_t m_cache_ttl;
+	uint32_t m_negative_ttl;
+
+	atomic_uint64_t m_lookup_counts;
+	atomic_uint64_t m_cache_hit_counts;
+	atomic_uint64_t m_coalesced_counts;
+
+private:
+	void _resolve_thread(void);
+	void _trim_cache(int64_t now);
+	static bool _resolve_numeric(const std::string& hostname, std::vector<Address>& addresses);
+	static void _deliver(const waiter_s& waiter, bool success, const std::vector<Address>& addresses, bool in_place);
+
+public:
+	DnsResolver(int32_t thread_counts = 2);
+	virtual ~DnsResolver();
+};
+
+}
+
+#endif
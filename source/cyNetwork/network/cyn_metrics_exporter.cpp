@@ -0,0 +1,422 @@
+/*
+Copyright(C) thecodeway.com
+*/
+#include <cy_core.h>
+#include <cy_event.h>
+#include <cy_network.h>
+#include "cyn_metrics_exporter.h"
+
+#include <stdarg.h>
+#include <ctype.h>
+
+namespace cyclone
+{
+
+namespace {
+
+//-------------------------------------------------------------------------------------
+//render the body to a small buffer, and send it as one chunk when the buffer is full
+class ChunkWriter : noncopyable
+{
+public:
+	void printf(const char* format, ...) {
+		for (int32_t i = 0; i < 2; i++) {
+			size_t free_size = kChunkSize - m_len;
+
+			va_list args;
+			va_start(args, format);
+			int n = vsnprintf(m_buf + kHeadRoom + m_len, free_size + 1, format, args);
+			va_end(args);
+			if (n < 0) return;
+
+			if ((size_t)n <= free_size) {
+				m_len += (size_t)n;
+				return;
+			}
+			//the line is dropped if it's still too long in an empty chunk
+			flush();
+		}
+	}
+
+	void flush(void) {
+		if (m_len == 0) return;
+
+		//chunk size in hex is written just before the data
+		char head[kHeadRoom + 1];
+		int head_len = std::snprintf(head, sizeof(head), "%x\r\n", (uint32_t)m_len);
+		char* chunk = m_buf + kHeadRoom - head_len;
+		memcpy(chunk, head, (size_t)head_len);
+		m_buf[kHeadRoom + m_len] = '\r';
+		m_buf[kHeadRoom + m_len + 1] = '\n';
+
+		m_conn->send(chunk, (size_t)head_len + m_len + 2);
+		m_len = 0;
+	}
+
+	void finish(void) {
+		flush();
+		m_conn->send("0\r\n\r\n", 5);
+	}
+
+private:
+	enum { kChunkSize = 4096, kHeadRoom = 8 };
+
+	ConnectionPtr m_conn;
+	char m_buf[kHeadRoom + kChunkSize + 2];
+	size_t m_len;
+
+public:
+	explicit ChunkWriter(ConnectionPtr conn) : m_conn(conn), m_len(0) { }
+};
+
+//-------------------------------------------------------------------------------------
+//escape label value(\ " and new line), the value is truncated if it's too long
+static const char* _escape_label(const char* src, char* dst, size_t dst_size)
+{
+	size_t len = 0;
+	for (; *src && len + 3 < dst_size; src++) {
+		char c = *src;
+		if (c == '\\' || c == '"' || c == '\n') {
+			dst[len++] = '\\';
+			c = (c == '\n') ? 'n' : c;
+		}
+		dst[len++] = c;
+	}
+	dst[len] = 0;
+	return dst;
+}
+
+//-------------------------------------------------------------------------------------
+//the metrics of every work thread
+struct thread_metric_s {
+	const char* name;
+	const char* type;
+	const char* help;
+	uint64_t(*get)(const TcpServer::WorkThreadStats& stats);
+	bool micro_seconds;		//exported in seconds
+};
+
+static const thread_metric_s kThreadMetrics[] = {
+	{ "cyclone_connections", "gauge", "Live connections of the work thread.",
+		[](const TcpServer::WorkThreadStats& s) -> uint64_t { return (uint64_t)s.connection_counts; }, false },
+	{ "cyclone_loop_busy_seconds_total", "counter", "Time the looper spent on dispatching events.",
+		[](const TcpServer::WorkThreadStats& s) -> uint64_t { return s.busy_time; }, true },
+	{ "cyclone_read_bytes_total", "counter", "Bytes read from sockets.",
+		[](const TcpServer::WorkThreadStats& s) -> uint64_t { return s.io.read_bytes; }, false },
+	{ "cyclone_write_bytes_total", "counter", "Bytes written to sockets.",
+		[](const TcpServer::WorkThreadStats& s) -> uint64_t { return s.io.write_bytes; }, false },
+	{ "cyclone_read_calls_total", "counter", "Read calls on sockets.",
+		[](const TcpServer::WorkThreadStats& s) -> uint64_t { return s.io.read_calls; }, false },
+	{ "cyclone_write_calls_total", "counter", "Write calls on sockets.",
+		[](const TcpServer::WorkThreadStats& s) -> uint64_t { return s.io.write_calls; }, false },
+	{ "cyclone_short_writes_total", "counter", "Writes which sent less than asked.",
+		[](const TcpServer::WorkThreadStats& s) -> uint64_t { return s.io.short_writes; }, false },
+	{ "cyclone_would_blocks_total", "counter", "Writes which returned EAGAIN.",
+		[](const TcpServer::WorkThreadStats& s) -> uint64_t { return s.io.would_blocks; }, false },
+	{ "cyclone_write_blocked_seconds_total", "counter", "Time the output waited for socket writable.",
+		[](const TcpServer::WorkThreadStats& s) -> uint64_t { return s.io.write_blocked_time; }, true },
+	{ "cyclone_max_output_bytes", "gauge", "Max size of output buffered in one connection.",
+		[](const TcpServer::WorkThreadStats& s) -> uint64_t { return s.io.max_output_size; }, false },
+};
+
+//-------------------------------------------------------------------------------------
+//the connections wait the statistics in current work thread, the next request is not parsed until answered
+static std::set<const Connection*>& _get_waiting_connections(void)
+{
+	static thread_local std::set<const Connection*> s_waiting;
+	return s_waiting;
+}
+
+}
+
+//-------------------------------------------------------------------------------------
+MetricsExporter::MetricsExporter()
+	: m_server(nullptr)
+	, m_http_server(nullptr)
+	, m_listen_index(0)
+	, m_standalone(false)
+	, m_debug_lock(sys_api::mutex_create())
+	, m_request_counts(0)
+{
+}
+
+//-------------------------------------------------------------------------------------
+MetricsExporter::~MetricsExporter()
+{
+	stop();
+	sys_api::mutex_destroy(m_debug_lock);
+}
+
+//-------------------------------------------------------------------------------------
+bool MetricsExporter::start(const Address& bind_addr, TcpServer* server)
+{
+	if (m_http_server) return false;
+
+	TcpServer* http_server = new TcpServer("metrics", nullptr);
+	http_server->m_listener.onMessage = [this](TcpServer*, int32_t, ConnectionPtr conn) {
+		_on_message(conn);
+	};
+	if (!http_server->bind(bind_addr, false)) {
+		delete http_server;
+		return false;
+	}
+
+	m_server = server;
+	m_http_server = http_server;
+	m_listen_index = 0;
+	m_standalone = true;
+
+	if (!http_server->start(1)) {
+		CY_LOG(L_ERROR, "start metrics exporter failed");
+		delete http_server;
+		m_server = m_http_server = nullptr;
+		m_standalone = false;
+		return false;
+	}
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+void MetricsExporter::stop(void)
+{
+	if (!m_standalone || m_http_server == nullptr) return;
+
+	m_http_server->stop();
+	m_http_server->join();
+	delete m_http_server;
+
+	m_server = m_http_server = nullptr;
+	m_standalone = false;
+}
+
+//-------------------------------------------------------------------------------------
+bool MetricsExporter::bind(const Address& bind_addr, TcpServer* server, const SocketOptions& options)
+{
+	if (m_http_server || server == nullptr) return false;
+	if (!server->bind(bind_addr, false, options)) return false;
+
+	TcpServer::Listener listener;
+	listener.onMessage = [this](TcpServer*, int32_t, ConnectionPtr conn) {
+		_on_message(conn);
+	};
+
+	size_t index = server->get_bind_counts() - 1;
+	server->set_port_listener(index, listener);
+
+	m_server = m_http_server = server;
+	m_listen_index = index;
+	m_standalone = false;
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+Address MetricsExporter::get_bind_address(void)
+{
+	return m_http_server ? m_http_server->get_bind_address(m_listen_index) : Address();
+}
+
+//-------------------------------------------------------------------------------------
+void MetricsExporter::updateDebugValue(const char* key, const char* value)
+{
+	sys_api::auto_mutex lock(m_debug_lock);
+
+	debug_value_s& debug_value = m_debug_values[key];
+	debug_value.is_string = true;
+	debug_value.int_value = 0;
+	debug_value.str_value = value;
+}
+
+//-------------------------------------------------------------------------------------
+void MetricsExporter::updateDebugValue(const char* key, int32_t value)
+{
+	sys_api::auto_mutex lock(m_debug_lock);
+
+	debug_value_s& debug_value = m_debug_values[key];
+	debug_value.is_string = false;
+	debug_value.int_value = value;
+	debug_value.str_value.clear();
+}
+
+//-------------------------------------------------------------------------------------
+void MetricsExporter::delDebugValue(const char* key)
+{
+	sys_api::auto_mutex lock(m_debug_lock);
+	m_debug_values.erase(key);
+}
+
+//-------------------------------------------------------------------------------------
+void MetricsExporter::_on_message(ConnectionPtr conn)
+{
+	std::set<const Connection*>& waiting = _get_waiting_connections();
+	RingBuf& input = conn->get_input_buf();
+
+	//the head and the chunks of response are flushed by one write at the end of loop step
+	if (!conn->is_auto_cork()) conn->set_auto_cork(true);
+
+	while (conn->get_state() == Connection::kConnected && !input.empty()) {
+		//one request at a time, the pipelined ones wait in input buf
+		if (waiting.find(conn.get()) != waiting.end()) return;
+
+		char head[kMaxRequestHeadSize + 1];
+		size_t head_len = input.peek(0, head, kMaxRequestHeadSize);
+		head[head_len] = 0;
+
+		char* head_end = strstr(head, "\r\n\r\n");
+		if (head_end == nullptr) {
+			if (head_len >= kMaxRequestHeadSize) {
+				_send_status(conn, "431 Request Header Fields Too Large", false);
+			}
+			return;
+		}
+		input.discard((size_t)(head_end - head) + 4);
+		head_end[2] = 0;
+		m_request_counts++;
+
+		//request line
+		char method[16], path[256], version[16];
+		char* headers = strstr(head, "\r\n") + 2;
+		if (std::sscanf(head, "%15s %255s %15s", method, path, version) != 3) {
+			_send_status(conn, "400 Bad Request", false);
+			return;
+		}
+		char* query = strchr(path, '?');
+		if (query) *query = 0;
+
+		//keep alive is default since http/1.1
+		bool keep_alive = (strcmp(version, "HTTP/1.1") == 0);
+		for (char* p = headers; *p; p++) *p = (char)tolower(*p);
+		char* connection = strstr(headers, "connection:");
+		if (connection) {
+			*strstr(connection, "\r\n") = 0;
+			if (strstr(connection, "close")) keep_alive = false;
+			else if (strstr(connection, "keep-alive")) keep_alive = true;
+		}
+
+		if (strcmp(method, "GET") != 0) {
+			_send_status(conn, "405 Method Not Allowed", keep_alive);
+			continue;
+		}
+		if (strcmp(path, "/metrics") != 0) {
+			_send_status(conn, "404 Not Found", keep_alive);
+			continue;
+		}
+
+		TcpServer::StatsSnapshot snapshot;
+		if (m_server == nullptr) {
+			_on_snapshot(conn, snapshot, true, keep_alive);
+			continue;
+		}
+
+		if (m_standalone) {
+			//in the work thread of exporter, only this thread waits the work threads of the server
+			bool complete = m_server->stats_snapshot(snapshot, false, kSnapshotTimeOut);
+			_on_snapshot(conn, snapshot, complete, keep_alive);
+			continue;
+		}
+
+		//in the work thread of the server, never wait, answer when the statistics arrive
+		Looper* looper = conn->get_looper();
+		waiting.insert(conn.get());
+		m_server->stats_snapshot(looper, [this, conn, looper, keep_alive](TcpServer::StatsSnapshot& result) {
+			_get_waiting_connections().erase(conn.get());
+			//the connection has been moved to other work thread
+			if (conn->get_looper() != looper) return;
+
+			_on_snapshot(conn, result, true, keep_alive);
+			_on_message(conn);
+		});
+		return;
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void MetricsExporter::_on_snapshot(ConnectionPtr conn, const TcpServer::StatsSnapshot& snapshot, bool complete, bool keep_alive)
+{
+	if (conn->get_state() != Connection::kConnected) return;
+
+	char head[256];
+	int head_len = std::snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\n"
+		"Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+		"Transfer-Encoding: chunked\r\n"
+		"%s\r\n", keep_alive ? "" : "Connection: close\r\n");
+	conn->send(head, (size_t)head_len);
+
+	_render(conn, snapshot, complete);
+
+	if (!keep_alive) conn->shutdown();
+}
+
+//-------------------------------------------------------------------------------------
+void MetricsExporter::_render(ConnectionPtr conn, const TcpServer::StatsSnapshot& snapshot, bool complete)
+{
+	ChunkWriter writer(conn);
+
+	if (m_server) {
+		char server_name[128];
+		_escape_label(m_server->get_name(), server_name, sizeof(server_name));
+
+		writer.printf("# HELP cyclone_scrape_complete Whether all work threads answered the scrape.\n"
+			"# TYPE cyclone_scrape_complete gauge\n"
+			"cyclone_scrape_complete{server=\"%s\"} %d\n", server_name, complete ? 1 : 0);
+		writer.printf("# HELP cyclone_work_threads Work thread counts of the server.\n"
+			"# TYPE cyclone_work_threads gauge\n"
+			"cyclone_work_threads{server=\"%s\"} %d\n", server_name, m_server->get_work_thread_counts());
+		writer.printf("# HELP cyclone_accept_queue_full_total Times the accept queue was found full.\n"
+			"# TYPE cyclone_accept_queue_full_total counter\n"
+			"cyclone_accept_queue_full_total{server=\"%s\"} %u\n", server_name, m_server->get_accept_queue_full_counts());
+		writer.printf("# HELP cyclone_accept_errors_total Accept failures(EMFILE, ENFILE...).\n"
+			"# TYPE cyclone_accept_errors_total counter\n"
+			"cyclone_accept_errors_total{server=\"%s\"} %u\n", server_name, m_server->get_accept_error_counts());
+
+		for (const thread_metric_s& metric : kThreadMetrics) {
+			writer.printf("# HELP %s %s\n# TYPE %s %s\n", metric.name, metric.help, metric.name, metric.type);
+
+			for (const TcpServer::WorkThreadStats& work : snapshot.work_threads) {
+				uint64_t value = metric.get(work);
+				if (metric.micro_seconds) {
+					writer.printf("%s{server=\"%s\",thread=\"%d\"} %" PRIu64 ".%06" PRIu64 "\n",
+						metric.name, server_name, work.index, value / 1000000, value % 1000000);
+				}
+				else {
+					writer.printf("%s{server=\"%s\",thread=\"%d\"} %" PRIu64 "\n", metric.name, server_name, work.index, value);
+				}
+			}
+		}
+	}
+
+	//copy the debug values, the debuger is not blocked by the sending
+	DebugValueMap debug_values;
+	{
+		sys_api::auto_mutex lock(m_debug_lock);
+		debug_values = m_debug_values;
+	}
+
+	char key[256], value[512];
+	writer.printf("# HELP cyclone_debug_value Integer values of the debuger.\n# TYPE cyclone_debug_value gauge\n");
+	for (auto& it : debug_values) {
+		if (it.second.is_string) continue;
+		writer.printf("cyclone_debug_value{key=\"%s\"} %d\n", _escape_label(it.first.c_str(), key, sizeof(key)), it.second.int_value);
+	}
+
+	writer.printf("# HELP cyclone_debug_info String values of the debuger.\n# TYPE cyclone_debug_info gauge\n");
+	for (auto& it : debug_values) {
+		if (!it.second.is_string) continue;
+		writer.printf("cyclone_debug_info{key=\"%s\",value=\"%s\"} 1\n", _escape_label(it.first.c_str(), key, sizeof(key)),
+			_escape_label(it.second.str_value.c_str(), value, sizeof(value)));
+	}
+
+	writer.finish();
+}
+
+//-------------------------------------------------------------------------------------
+void MetricsExporter::_send_status(ConnectionPtr conn, const char* status, bool keep_alive)
+{
+	char response[256];
+	int len = std::snprintf(response, sizeof(response), "HTTP/1.1 %s\r\nContent-Length: 0\r\n%s\r\n",
+		status, keep_alive ? "" : "Connection: close\r\n");
+	conn->send(response, (size_t)len);
+
+	if (!keep_alive) conn->shutdown();
+}
+
+}
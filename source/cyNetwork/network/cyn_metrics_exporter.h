@@ -0,0 +1,91 @@
+/*
+Copyright(C) thecodeway.com
+*/
+#ifndef _CYCLONE_NETWORK_METRICS_EXPORTER_H_
+#define _CYCLONE_NETWORK_METRICS_EXPORTER_H_
+
+#include <cy_core.h>
+#include <cy_event.h>
+#include "cyn_tcp_server.h"
+
+namespace cyclone
+{
+
+//
+// Export the statistics of a TcpServer in Prometheus text format by http(GET /metrics), the loop,
+// accept queue and connection i/o statistics of every work thread come from TcpServer::stats_snapshot.
+// It's also a debuger, the values updated by the debug functions(TcpServer::debug, Looper::debug...)
+// are exported as "cyclone_debug_value" and "cyclone_debug_info".
+//
+// The response is rendered in a small buffer and sent to the connection chunk by chunk, the
+// work threads of the server are never locked or waited, they fill the statistics like a message.
+//
+class MetricsExporter : public DebugInterface, noncopyable
+{
+public:
+	/// start a standalone http server(one work thread) to export the statistics of the server,
+	/// the server can be nullptr if only the debug values are exported
+	bool start(const Address& bind_addr, TcpServer* server);
+
+	/// stop the standalone http server
+	void stop(void);
+
+	/// add an extra bind port on the server to export its statistics, the requests are served
+	/// in the work threads of the server. the exporter must live until the server is stopped
+	// NOT thread safe, and this function must be called before start the server
+	bool bind(const Address& bind_addr, TcpServer* server, const SocketOptions& options = SocketOptions());
+
+	/// get the address of the http port
+	Address get_bind_address(void);
+
+	/// get counts of requests served(thread safe)
+	uint64_t get_request_counts(void) const { return m_request_counts.load(); }
+
+public:
+	//DebugInterface, all functions are thread safe
+	virtual bool isEnable(void) { return true; }
+	virtual void updateDebugValue(const char* key, const char* value);
+	virtual void updateDebugValue(const char* key, int32_t value);
+	virtual void delDebugValue(const char* key);
+
+private:
+	enum { kMaxRequestHeadSize = 8 * 1024, kSnapshotTimeOut = 1000 };
+
+	struct debug_value_s {
+		bool is_string;
+		int32_t int_value;
+		std::string str_value;
+	};
+	typedef std::map<std::string, debug_value_s> DebugValueMap;
+
+	TcpServer*		m_server;			//the server exported
+	TcpServer*		m_http_server;		//the standalone server, or m_server
+	size_t			m_listen_index;		//the http port in m_http_server
+	bool			m_standalone;
+
+	DebugValueMap	m_debug_values;
+	sys_api::mutex_t m_debug_lock;		//only for the debug values
+
+	atomic_uint64_t	m_request_counts;
+
+private:
+	/// parse and answer the requests in input buf of the connection(work thread)
+	void _on_message(ConnectionPtr conn);
+
+	/// answer the scrape after the statistics collected
+	void _on_snapshot(ConnectionPtr conn, const TcpServer::StatsSnapshot& snapshot, bool complete, bool keep_alive);
+
+	/// render all metrics to the connection
+	void _render(ConnectionPtr conn, const TcpServer::StatsSnapshot& snapshot, bool complete);
+
+	/// send a response without body
+	void _send_status(ConnectionPtr conn, const char* status, bool keep_alive);
+
+public:
+	MetricsExporter();
+	virtual ~MetricsExporter();
+};
+
+}
+
+#endif
@@ -0,0 +1,50 @@
+/*
+Copyright(C) thecodeway.com
+*/
+#include <cy_core.h>
+#include "cyn_rate_limit.h"
+
+namespace cyclone
+{
+
+//-------------------------------------------------------------------------------------
+void TokenBucket::set_rate(uint32_t rate, uint32_t burst, int64_t now)
+{
+	m_rate = rate;
+	if (rate == 0) {
+		m_capacity = m_tokens = 0;
+		return;
+	}
+
+	//100ms by default, and one byte at least
+	if (burst == 0) burst = rate / 10;
+	if (burst == 0) burst = 1;
+
+	m_capacity = (int64_t)burst * kScale;
+	m_tokens = m_capacity;
+	m_last_time = now;
+}
+
+//-------------------------------------------------------------------------------------
+int64_t TokenBucket::refill(int64_t now)
+{
+	if (m_rate == 0) return INT64_MAX;
+
+	if (now > m_last_time) {
+		//the time longer than the capacity is meaningless, and it may overflow
+		int64_t elapsed = std::min(now - m_last_time, (m_capacity - m_tokens) / (int64_t)m_rate + 1);
+		m_tokens = std::min(m_tokens + elapsed * (int64_t)m_rate, m_capacity);
+		m_last_time = now;
+	}
+	return m_tokens / kScale;
+}
+
+//-------------------------------------------------------------------------------------
+int64_t TokenBucket::get_wait_time(void) const
+{
+	if (m_rate == 0 || m_tokens >= kScale) return 0;
+
+	return (kScale - m_tokens + (int64_t)m_rate - 1) / (int64_t)m_rate;
+}
+
+}
@@ -0,0 +1,65 @@
+/*
+Copyright(C) thecodeway.com
+*/
+#ifndef _CYCLONE_NETWORK_RATE_LIMIT_H_
+#define _CYCLONE_NETWORK_RATE_LIMIT_H_
+
+#include <cy_core.h>
+
+namespace cyclone
+{
+
+//
+// Byte rate limit of one connection, zero rate means unlimited. the burst is the max bytes can be
+// read(written) at once after idle, zero means the bytes of 100ms
+//
+struct RateLimit
+{
+	uint32_t read_rate;		//bytes per second
+	uint32_t read_burst;
+	uint32_t write_rate;	//bytes per second
+	uint32_t write_burst;
+
+	bool is_limited(void) const { return read_rate > 0 || write_rate > 0; }
+
+	RateLimit() : read_rate(0), read_burst(0), write_rate(0), write_burst(0) {}
+};
+
+//
+// Token bucket, the tokens are refilled by the time passed when it's used, no timer is needed.
+// the bucket may be overdrawn, the debt is paid back before the tokens are available again
+//
+class TokenBucket
+{
+public:
+	//// set the rate(bytes per second, zero means unlimited) and the capacity, the bucket is full after set
+	void set_rate(uint32_t rate, uint32_t burst, int64_t now);
+
+	//// is the rate limited
+	bool is_limited(void) const { return m_rate > 0; }
+
+	//// refill by the time passed(microseconds), return the bytes available now, may be negative if overdrawn
+	int64_t refill(int64_t now);
+
+	//// take the bytes out of the bucket
+	void consume(size_t bytes) { m_tokens -= (int64_t)bytes * kScale; }
+
+	//// get the time(microseconds) to wait until one byte at least is available
+	int64_t get_wait_time(void) const;
+
+private:
+	//tokens are counted in micro bytes, so the refill of a few microseconds is not lost
+	enum { kScale = 1000 * 1000 };
+
+	uint32_t m_rate;
+	int64_t m_capacity;
+	int64_t m_tokens;
+	int64_t m_last_time;
+
+public:
+	TokenBucket() : m_rate(0), m_capacity(0), m_tokens(0), m_last_time(0) {}
+};
+
+}
+
+#endif
@@ -8,13 +8,100 @@ Copyright(C) thecodeway.com
 namespace cyclone
 {
 
+//-------------------------------------------------------------------------------------
+// free list of the memory blocks of connection objects. the blocks are allocated in work 
+// thread, and may be released in any thread(the last reference may be held by other threads)
+class ConnectionPool : noncopyable
+{
+public:
+	//allocate a block(work thread only)
+	void* allocate(size_t size) {
+		if (m_block_size == 0) m_block_size = size;
+		if (size != m_block_size) return ::operator new(size);
+
+		if (m_free_list == nullptr) {
+			m_free_list = m_returned.pop_all();
+		}
+		if (m_free_list == nullptr) return ::operator new(size);
+
+		MpscNode* node = m_free_list;
+		m_free_list = node->next;
+		m_pooled_counts--;
+		return node;
+	}
+
+	//release a block(thread safe)
+	void deallocate(void* p, size_t size) {
+		if (size != m_block_size || m_pooled_counts++ >= kMaxPooledCounts) {
+			m_pooled_counts--;
+			::operator delete(p);
+			return;
+		}
+		m_returned.push((MpscNode*)p);
+	}
+
+	int32_t get_pooled_counts(void) const { return m_pooled_counts.load(); }
+
+private:
+	enum { kMaxPooledCounts = 4096 };
+
+	size_t m_block_size;		//all blocks allocated by allocate_shared<Connection> have the same size
+	MpscNode* m_free_list;		//taken from returned queue, work thread only
+	MpscQueue m_returned;
+	atomic_int32_t m_pooled_counts;
+
+public:
+	ConnectionPool() : m_block_size(0), m_free_list(nullptr), m_pooled_counts(0) {}
+	~ConnectionPool() {
+		MpscNode* node = m_returned.pop_all();
+		while (node) {
+			MpscNode* next = node->next;
+			::operator delete(node);
+			node = next;
+		}
+		while (m_free_list) {
+			MpscNode* next = m_free_list->next;
+			::operator delete(m_free_list);
+			m_free_list = next;
+		}
+	}
+};
+
+//-------------------------------------------------------------------------------------
+template<typename T>
+struct ConnectionAllocator
+{
+	typedef T value_type;
+	std::shared_ptr<ConnectionPool> pool;
+
+	explicit ConnectionAllocator(const std::shared_ptr<ConnectionPool>& p) : pool(p) {}
+	template<typename U> ConnectionAllocator(const ConnectionAllocator<U>& other) : pool(other.pool) {}
+
+	T* allocate(size_t n) { return (T*)pool->allocate(n * sizeof(T)); }
+	void deallocate(T* p, size_t n) { pool->deallocate(p, n * sizeof(T)); }
+
+	template<typename U> bool operator==(const ConnectionAllocator<U>& other) const { return pool == other.pool; }
+	template<typename U> bool operator!=(const ConnectionAllocator<U>& other) const { return pool != other.pool; }
+};
+
 //-------------------------------------------------------------------------------------
 ServerWorkThread::ServerWorkThread(int32_t index, TcpServer* server, const char* name, DebugInterface* debuger)
 	: m_index(index)
 	, m_server(server)
+	, m_connections(index)
+	, m_connection_counts(0)
+	, m_connection_pool(std::make_shared<ConnectionPool>())
+	, m_spare_socket(INVALID_SOCKET)
+	, m_timeout_cursor(0)
+	, m_timeout_cursor_time(0)
+	, m_timeout_tick(0)
+	, m_timeout_timer(Looper::INVALID_EVENT_ID)
+	, m_shrink_buf_timer(Looper::INVALID_EVENT_ID)
 	, m_debuger(debuger)
 {
 
+	m_accept_batch.counts = 0;
+
 	//run the work thread
 	char temp[MAX_PATH] = { 0 };
 	std::snprintf(temp, MAX_PATH, "%s_%d", (name ? name : "worker"), m_index);
@@ -32,6 +119,10 @@ ServerWorkThread::ServerWorkThread(int32_t index, TcpServer* server, const char*
 ServerWorkThread::~ServerWorkThread()
 {
 	delete m_work_thread;
+
+	if (m_spare_socket != INVALID_SOCKET) {
+		socket_api::close_socket(m_spare_socket);
+	}
 }
 
 //-------------------------------------------------------------------------------------
@@ -67,9 +158,8 @@ ConnectionPtr ServerWorkThread::get_connection(int32_t connection_id)
 {
 	assert(is_in_workthread());
 
-	ConnectionMap::iterator it = m_connections.find(connection_id);
-	if (it == m_connections.end()) return 0;
-	return it->second;
+	ConnectionPtr* conn = m_connections.find(connection_id);
+	return conn ? *conn : nullptr;
 }
 
 //-------------------------------------------------------------------------------------
@@ -78,11 +168,687 @@ bool ServerWorkThread::_on_workthread_start(void)
 	CY_LOG(L_INFO, "Work thread \"%s\" start...", m_name.c_str());
 	TcpServer::WorkThreadStartCallback& onWorkThreadStart = m_server->m_listener.onWorkThreadStart;
 
+	//listen in this work thread
+	if (m_server->get_accept_mode() != TcpServer::kAcceptThread) {
+		if (!_create_listen_sockets()) return false;
+	}
+
+	_start_timeout_wheel();
+
+	m_shrink_buf_timer = m_work_thread->get_looper()->register_timer_event(kShrinkBufPeriod, this,
+		[this](Looper::event_id_t, void*) {
+		_on_shrink_buf_timer();
+	});
+
 	if(onWorkThreadStart)
 		onWorkThreadStart(m_server, get_index(), m_work_thread->get_looper());
 	return true;
 }
 
+//-------------------------------------------------------------------------------------
+void ServerWorkThread::_create_connection(socket_t sfd, const struct sockaddr_storage& peer_addr, socklen_t peer_addr_len, int32_t listen_index)
+{
+	const TcpServer::Listener& server_listener = m_server->_get_port_listener(listen_index);
+
+	//the id is the key of slot map
+	int32_t conn_id = m_connections.insert(nullptr);
+	if (conn_id < 0) {
+		CY_LOG(L_ERROR, "too many connections in work thread \"%s\"", m_name.c_str());
+		socket_api::close_socket(sfd);
+		return;
+	}
+
+	//most options are inherited from listen socket already, but some are not(quick ack...)
+	m_server->get_socket_options((size_t)listen_index).apply_connection(sfd);
+
+	//create tcp connection, the object and the reference counter are allocated in one block from pool
+	Address peer((const struct sockaddr*)&peer_addr, peer_addr_len);
+	ConnectionPtr conn = std::allocate_shared<Connection>(ConnectionAllocator<Connection>(m_connection_pool),
+		conn_id, sfd, m_work_thread->get_looper(), this, &peer);
+	*(m_connections.find(conn_id)) = conn;
+	m_connection_counts = (int32_t)m_connections.size();
+	conn->m_listen_index = listen_index;
+	_bind_connection_callback(conn);
+
+	const RateLimit& rate_limit = m_server->get_rate_limit((size_t)listen_index);
+	if (rate_limit.is_limited()) {
+		conn->set_rate_limit(rate_limit);
+	}
+
+	//notify server listener 
+	if (server_listener.onConnected) {
+		server_listener.onConnected(m_server, get_index(), conn);
+	}
+
+	_add_timeout(conn);
+}
+
+//-------------------------------------------------------------------------------------
+void ServerWorkThread::_bind_connection_callback(ConnectionPtr conn)
+{
+	const TcpServer::Listener& server_listener = m_server->_get_port_listener(conn->get_listen_index());
+
+	//bind onMessage function
+	if (server_listener.onMessage) {
+		conn->setOnMessageFunction([this, &server_listener](ConnectionPtr connection) {
+			server_listener.onMessage(m_server, get_index(), connection);
+		});
+	}
+
+	//bind onClose function
+	conn->setOnCloseFunction([this, &server_listener](ConnectionPtr connection) {
+		if(server_listener.onClose)
+			server_listener.onClose(m_server, get_index(), connection);
+		//leave all groups
+		_remove_from_groups(connection);
+		connection->m_groups.clear();
+		m_closed_stats.add(connection->get_stats());
+		//shutdown this connection next tick
+		m_server->shutdown_connection(connection);
+	});
+
+	//the write deadline is scheduled when begin to wait, the wheel entry may be far away
+	if (m_timeout_timer != Looper::INVALID_EVENT_ID && m_server->get_timeout(TcpServer::kWriteTimeout) > 0) {
+		conn->m_onWriteWait = [this](ConnectionPtr connection) {
+			_add_timeout(connection);
+		};
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void ServerWorkThread::_migrate_connection(int32_t conn_id, int32_t target_index)
+{
+	assert(is_in_workthread());
+
+	if (target_index == m_index || target_index < 0 || target_index >= m_server->get_work_thread_counts()) return;
+	//don't move connection if the server is in shutdown process
+	if (m_server->m_shutdown_ing.load() > 0) return;
+
+	ConnectionPtr* it = m_connections.find(conn_id);
+	if (it == nullptr) return;
+
+	ConnectionPtr conn = *it;
+	if (conn->get_state() != Connection::kConnected) return;
+
+	//the peer would be touched in two work threads
+	if (conn->_is_pinned()) {
+		CY_LOG(L_WARN, "connection %d is forwarding, can't move to work thread %d", conn_id, target_index);
+		return;
+	}
+
+	//remove from this work thread, the groups are joined again in the target
+	_remove_from_groups(conn);
+	conn->_detach();
+	m_connections.erase(conn_id);
+	m_connection_counts = (int32_t)m_connections.size();
+	m_rebalance_snapshot.erase(conn_id);
+
+	//send to the target work thread
+	ServerWorkThread* target = m_server->m_work_thread_pool[(size_t)target_index];
+	target->m_work_thread->get_looper()->post([target, conn]() {
+		target->_attach_connection(conn, false);
+	});
+
+	CY_LOG(L_TRACE, "move connection %d from work thread %d to %d", conn_id, m_index, target_index);
+}
+
+//-------------------------------------------------------------------------------------
+void ServerWorkThread::_attach_connection(ConnectionPtr conn, bool bounced)
+{
+	assert(is_in_workthread());
+
+	//get a new id in this work thread
+	int32_t conn_id = m_connections.insert(conn);
+	if (conn_id < 0 && !bounced) {
+		//send back to the source work thread, it had a free slot at least
+		CY_LOG(L_ERROR, "too many connections in work thread \"%s\", can't move connection %d", m_name.c_str(), conn->get_id());
+		ServerWorkThread* source = (ServerWorkThread*)(conn->get_param());
+		source->m_work_thread->get_looper()->post([source, conn]() {
+			source->_attach_connection(conn, true);
+		});
+		return;
+	}
+	if (conn_id < 0) {
+		//the slot of source work thread has been taken during the moving
+		CY_LOG(L_ERROR, "too many connections in work thread \"%s\", close moving connection %d", m_name.c_str(), conn->get_id());
+		conn->_close_detached();
+		const TcpServer::Listener& server_listener = m_server->_get_port_listener(conn->get_listen_index());
+		if (server_listener.onClose) {
+			server_listener.onClose(m_server, get_index(), conn);
+		}
+		m_closed_stats.add(conn->get_stats());
+		return;
+	}
+
+	conn->_attach(conn_id, m_work_thread->get_looper(), this);
+	_bind_connection_callback(conn);
+	_add_to_groups(conn);
+	m_connection_counts = (int32_t)m_connections.size();
+
+	//the activity time is kept, the entry in old work thread is out of date
+	_add_timeout(conn);
+
+	//the server is in shutdown process, or the connection was closed by shutdown_connection during the moving
+	if (m_server->m_shutdown_ing.load() > 0 || conn->m_close_requested.load()) {
+		conn->shutdown();
+		return;
+	}
+
+	//let logic layer continue with the data left in input buf
+	const TcpServer::Listener& server_listener = m_server->_get_port_listener(conn->get_listen_index());
+	if (!conn->get_input_buf().empty() && server_listener.onMessage) {
+		server_listener.onMessage(m_server, get_index(), conn);
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void ServerWorkThread::_rebalance(int32_t target_index)
+{
+	assert(is_in_workthread());
+
+	//find the connection received the most bytes since last rebalance
+	ReadBytesMap snapshot;
+	int32_t hottest_id = 0, hottest_counts = 0;
+	uint64_t hottest_bytes = 0, total_bytes = 0;
+
+	for (const ConnectionPtr& conn : m_connections) {
+		if (conn->get_state() != Connection::kConnected) continue;
+
+		uint64_t read_bytes = conn->get_read_bytes();
+		ReadBytesMap::iterator last = m_rebalance_snapshot.find(conn->get_id());
+		uint64_t recent_bytes = read_bytes - (last == m_rebalance_snapshot.end() ? 0 : last->second);
+		snapshot[conn->get_id()] = read_bytes;
+
+		total_bytes += recent_bytes;
+
+		//the load of pinned connection is counted, but it can't be moved
+		if (conn->_is_pinned()) continue;
+		if (hottest_counts == 0 || recent_bytes > hottest_bytes) {
+			hottest_id = conn->get_id();
+			hottest_bytes = recent_bytes;
+		}
+		hottest_counts++;
+	}
+	m_rebalance_snapshot.swap(snapshot);
+
+	//if one connection takes most of the load, moving it will just move the hot spot
+	if (hottest_counts < 2 || hottest_bytes == 0 || hottest_bytes * 2 > total_bytes) return;
+
+	_migrate_connection(hottest_id, target_index);
+}
+
+//-------------------------------------------------------------------------------------
+bool ServerWorkThread::join_group(ConnectionPtr conn, int32_t group_id)
+{
+	assert(is_in_workthread());
+	assert(conn->get_param() == this);
+
+	if (conn->get_state() != Connection::kConnected) return false;
+
+	group_s& group = m_groups[group_id];
+	if (!group.positions.insert(std::make_pair(conn->get_id(), group.members.size())).second) return false;
+
+	group.members.push_back(conn);
+	conn->m_groups.push_back(group_id);
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+bool ServerWorkThread::leave_group(ConnectionPtr conn, int32_t group_id)
+{
+	assert(is_in_workthread());
+
+	std::vector<int32_t>& groups = conn->m_groups;
+	for (size_t i = 0; i < groups.size(); i++) {
+		if (groups[i] != group_id) continue;
+
+		groups.erase(groups.begin() + (std::ptrdiff_t)i);
+		_remove_member(group_id, conn->get_id());
+		return true;
+	}
+	return false;
+}
+
+//-------------------------------------------------------------------------------------
+ServerWorkThread::StatsRequest::StatsRequest(int32_t counts, bool with_conn)
+	: with_connections(with_conn)
+	, work_threads((size_t)counts)
+	, answered((size_t)counts, false)
+	, pending(counts)
+	, lock(sys_api::mutex_create())
+	, done(sys_api::signal_create())
+	, reply_looper(nullptr)
+	, callback(nullptr)
+{
+}
+
+//-------------------------------------------------------------------------------------
+ServerWorkThread::StatsRequest::~StatsRequest()
+{
+	sys_api::signal_destroy(done);
+	sys_api::mutex_destroy(lock);
+}
+
+//-------------------------------------------------------------------------------------
+void ServerWorkThread::fill_stats(StatsRequest& request)
+{
+	assert(is_in_workthread());
+
+	//collect without lock, the caller may be waiting
+	TcpServer::WorkThreadStats stats;
+	stats.index = m_index;
+	stats.connection_counts = (int32_t)m_connections.size();
+	stats.busy_time = get_busy_time();
+	stats.io = m_closed_stats;
+
+	if (request.with_connections) stats.connections.reserve(m_connections.size());
+	for (const ConnectionPtr& conn : m_connections) {
+		if (!conn) continue;
+
+		ConnectionStats conn_stats = conn->get_stats();
+		stats.io.add(conn_stats);
+
+		if (request.with_connections) {
+			TcpServer::ConnectionStatsEntry entry;
+			entry.conn_id = conn->get_id();
+			entry.peer_addr = conn->get_peer_addr();
+			entry.stats = conn_stats;
+			stats.connections.push_back(entry);
+		}
+	}
+
+	std::shared_ptr<TcpServer::StatsSnapshot> snapshot;
+	{
+		sys_api::auto_mutex lock(request.lock);
+		request.work_threads[(size_t)m_index] = std::move(stats);
+		request.answered[(size_t)m_index] = true;
+		if (--request.pending > 0) return;
+
+		sys_api::signal_notify(request.done);
+		if (!request.callback) return;
+
+		//the last one, nobody touch the request any more
+		snapshot = std::make_shared<TcpServer::StatsSnapshot>();
+		for (TcpServer::WorkThreadStats& work_stats : request.work_threads) {
+			snapshot->io.add(work_stats.io);
+			snapshot->work_threads.push_back(std::move(work_stats));
+		}
+	}
+
+	TcpServer::StatsCallback callback = request.callback;
+	request.reply_looper->post([snapshot, callback]() {
+		callback(*snapshot);
+	});
+}
+
+//-------------------------------------------------------------------------------------
+void ServerWorkThread::publish(int32_t group_id, const char* buf, size_t len)
+{
+	assert(is_in_workthread());
+
+	GroupMap::iterator it = m_groups.find(group_id);
+	if (it == m_groups.end()) return;
+
+	//the members may be changed by the callbacks of connection(onClose if send failed...)
+	std::vector<ConnectionPtr> members(it->second.members);
+	for (const ConnectionPtr& conn : members) {
+		if (conn->get_state() == Connection::kConnected) {
+			conn->send(buf, len);
+		}
+	}
+}
+
+//-------------------------------------------------------------------------------------
+int32_t ServerWorkThread::get_group_size(int32_t group_id) const
+{
+	assert(is_in_workthread());
+
+	GroupMap::const_iterator it = m_groups.find(group_id);
+	return it == m_groups.end() ? 0 : (int32_t)(it->second.members.size());
+}
+
+//-------------------------------------------------------------------------------------
+void ServerWorkThread::_remove_from_groups(ConnectionPtr conn)
+{
+	for (int32_t group_id : conn->m_groups) {
+		_remove_member(group_id, conn->get_id());
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void ServerWorkThread::_remove_member(int32_t group_id, int32_t conn_id)
+{
+	GroupMap::iterator it = m_groups.find(group_id);
+	if (it == m_groups.end()) return;
+
+	group_s& group = it->second;
+	auto pos = group.positions.find(conn_id);
+	if (pos == group.positions.end()) return;
+
+	size_t index = pos->second;
+	size_t last = group.members.size() - 1;
+	if (index != last) {
+		group.members[index] = std::move(group.members[last]);
+		group.positions[group.members[index]->get_id()] = index;
+	}
+	group.members.pop_back();
+	group.positions.erase(pos);
+
+	if (group.members.empty()) {
+		m_groups.erase(it);
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void ServerWorkThread::_add_to_groups(ConnectionPtr conn)
+{
+	for (int32_t group_id : conn->m_groups) {
+		group_s& group = m_groups[group_id];
+		if (group.positions.insert(std::make_pair(conn->get_id(), group.members.size())).second) {
+			group.members.push_back(conn);
+		}
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void ServerWorkThread::_start_timeout_wheel(void)
+{
+	//the shortest timeout
+	uint32_t min_timeout = 0;
+	for (int32_t i = 0; i < TcpServer::kTimeoutTypeCounts; i++) {
+		uint32_t timeout = m_server->get_timeout((TcpServer::TimeoutType)i);
+		if (timeout > 0 && (min_timeout == 0 || timeout < min_timeout)) min_timeout = timeout;
+	}
+	if (min_timeout == 0) return;
+
+	//one timer for all connections of this work thread
+	uint32_t tick_ms = std::max(10u, std::min(1000u, min_timeout / 8));
+	m_timeout_tick = (int64_t)tick_ms * 1000;
+	m_timeout_wheel.resize(kTimeoutWheelSize);
+	m_timeout_cursor = 0;
+	m_timeout_cursor_time = sys_api::utc_time_now();
+
+	m_timeout_timer = m_work_thread->get_looper()->register_timer_event(tick_ms, this,
+		[this](Looper::event_id_t, void*) {
+		_on_timeout_tick();
+	});
+}
+
+//-------------------------------------------------------------------------------------
+void ServerWorkThread::_stop_timeout_wheel(void)
+{
+	if (m_timeout_timer == Looper::INVALID_EVENT_ID) return;
+
+	Looper* looper = m_work_thread->get_looper();
+	looper->disable_all(m_timeout_timer);
+	looper->delete_event(m_timeout_timer);
+	m_timeout_timer = Looper::INVALID_EVENT_ID;
+
+	TimeoutWheel().swap(m_timeout_wheel);
+}
+
+//-------------------------------------------------------------------------------------
+void ServerWorkThread::_add_timeout(ConnectionPtr conn)
+{
+	if (m_timeout_timer == Looper::INVALID_EVENT_ID) return;
+
+	TcpServer::TimeoutType type;
+	_schedule_timeout(conn->get_id(), ++(conn->m_timeout_seq), _get_timeout_deadline(conn, type));
+}
+
+//-------------------------------------------------------------------------------------
+void ServerWorkThread::_schedule_timeout(int32_t conn_id, uint32_t seq, int64_t deadline)
+{
+	//the deadline beyond the wheel will be checked again when the last slot expired
+	int64_t ticks = 1;
+	if (deadline > m_timeout_cursor_time) {
+		ticks = (deadline - m_timeout_cursor_time + m_timeout_tick - 1) / m_timeout_tick;
+		ticks = std::max((int64_t)1, std::min(ticks, (int64_t)kTimeoutWheelSize - 1));
+	}
+
+	size_t slot = (m_timeout_cursor + (size_t)ticks) % kTimeoutWheelSize;
+	m_timeout_wheel[slot].push_back(std::make_pair(conn_id, seq));
+}
+
+//-------------------------------------------------------------------------------------
+int64_t ServerWorkThread::_get_timeout_deadline(const ConnectionPtr& conn, TcpServer::TimeoutType& type)
+{
+	int64_t deadline = INT64_MAX;
+	type = TcpServer::kIdleTimeout;
+
+	//only the write deadline is kept after shutdown
+	bool disconnecting = (conn->get_state() == Connection::kDisconnecting);
+
+	for (int32_t i = 0; i < TcpServer::kTimeoutTypeCounts; i++) {
+		int64_t timeout = (int64_t)m_server->get_timeout((TcpServer::TimeoutType)i) * 1000;
+		if (timeout == 0) continue;
+		if (disconnecting && i != TcpServer::kWriteTimeout) continue;
+
+		int64_t activity_time;
+		switch (i) {
+		case TcpServer::kIdleTimeout:
+			activity_time = std::max(conn->m_last_read_time, conn->m_last_write_time);
+			break;
+		case TcpServer::kReadTimeout:
+			activity_time = conn->m_last_read_time;
+			break;
+		default:
+			//nothing wait for socket writable
+			if (!(m_work_thread->get_looper()->is_write(conn->m_event_id))) continue;
+			activity_time = conn->m_last_write_time;
+			break;
+		}
+
+		if (activity_time + timeout < deadline) {
+			deadline = activity_time + timeout;
+			type = (TcpServer::TimeoutType)i;
+		}
+	}
+	return deadline;
+}
+
+//-------------------------------------------------------------------------------------
+void ServerWorkThread::_on_timeout_tick(void)
+{
+	int64_t now = m_work_thread->get_looper()->get_loop_time();
+
+	//collect all expired connections, and deliver them together
+	std::vector< std::pair<ConnectionPtr, TcpServer::TimeoutType> > expired;
+	TimeoutSlot slot;
+
+	while (m_timeout_cursor_time + m_timeout_tick <= now) {
+		m_timeout_cursor = (m_timeout_cursor + 1) % kTimeoutWheelSize;
+		m_timeout_cursor_time += m_timeout_tick;
+		slot.swap(m_timeout_wheel[m_timeout_cursor]);
+
+		for (auto& entry : slot) {
+			ConnectionPtr* it = m_connections.find(entry.first);
+			//closed, moved or rescheduled
+			if (it == nullptr || (*it)->m_timeout_seq != entry.second) continue;
+
+			const ConnectionPtr& conn = *it;
+			if (conn->get_state() == Connection::kDisconnected) continue;
+
+			TcpServer::TimeoutType type;
+			int64_t deadline = _get_timeout_deadline(conn, type);
+			if (deadline <= now) {
+				expired.push_back(std::make_pair(conn, type));
+			}
+			else {
+				_schedule_timeout(entry.first, entry.second, deadline);
+			}
+		}
+
+		//reuse the memory of slot
+		slot.clear();
+		slot.swap(m_timeout_wheel[m_timeout_cursor]);
+	}
+
+	for (auto& it : expired) {
+		ConnectionPtr& conn = it.first;
+		//closed by the callback of other connection
+		if (conn->get_state() == Connection::kDisconnected) continue;
+
+		if (conn->get_state() == Connection::kDisconnecting) {
+			//shutdown already, but the peer doesn't read the data left, drop it and close
+			if (it.second == TcpServer::kWriteTimeout) conn->_on_send_fault();
+			else _add_timeout(conn);
+			continue;
+		}
+
+		CY_LOG(L_TRACE, "connection %d timeout, type=%d", conn->get_id(), it.second);
+		const TcpServer::Listener& server_listener = m_server->_get_port_listener(conn->get_listen_index());
+		if (server_listener.onTimeout) {
+			server_listener.onTimeout(m_server, get_index(), conn, it.second);
+		}
+		else if (it.second == TcpServer::kWriteTimeout) {
+			//the data can't be sent, drop it and close
+			conn->_on_send_fault();
+		}
+		else {
+			conn->shutdown();
+		}
+
+		//still alive, check again after another timeout period
+		if (conn->get_state() != Connection::kDisconnected && m_connections.find(conn->get_id()) != nullptr) {
+			_schedule_timeout(conn->get_id(), ++(conn->m_timeout_seq), now + (int64_t)m_server->get_timeout(it.second) * 1000);
+		}
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void ServerWorkThread::_on_shrink_buf_timer(void)
+{
+	int64_t quiet_time = m_work_thread->get_looper()->get_loop_time() - (int64_t)kShrinkBufPeriod * 1000;
+
+	for (const ConnectionPtr& it : m_connections) {
+		Connection* conn = it.get();
+		if (conn->get_state() != Connection::kConnected) continue;
+		if (conn->m_last_read_time > quiet_time || conn->m_last_write_time > quiet_time) continue;
+
+		conn->_shrink_buf();
+	}
+}
+
+//-------------------------------------------------------------------------------------
+bool ServerWorkThread::_create_listen_sockets(void)
+{
+	Looper* looper = m_work_thread->get_looper();
+	TcpServer::AcceptMode accept_mode = m_server->get_accept_mode();
+	m_spare_socket = socket_api::create_socket();
+
+	for (size_t i = 0; i < m_server->m_acceptor_sockets.size(); i++) {
+		socket_t sfd = INVALID_SOCKET;
+		Looper::event_t event = Looper::kRead;
+
+		if (accept_mode == TcpServer::kReusePort) {
+			//bind the address which server socket binded(the port may be auto selected)
+			Address bind_addr = m_server->get_bind_address(i);
+
+			sfd = socket_api::create_socket(bind_addr.get_family());
+			if (sfd == INVALID_SOCKET) {
+				CY_LOG(L_ERROR, "create socket error");
+				return false;
+			}
+
+			socket_api::set_nonblock(sfd, true);
+			socket_api::set_close_onexec(sfd, true);
+			socket_api::set_reuse_port(sfd, true);
+			socket_api::set_reuse_addr(sfd, true);
+			m_server->get_socket_options(i).apply_listen(sfd);
+
+			if (!(socket_api::bind(sfd, bind_addr.get_sockaddr(), bind_addr.get_sockaddr_len())) || !(socket_api::listen(sfd, m_server->get_listen_backlog()))) {
+				CY_LOG(L_ERROR, "work thread %d listen to address %s:%d failed", m_index, bind_addr.get_ip(), bind_addr.get_port());
+				socket_api::close_socket(sfd);
+				return false;
+			}
+		}
+		else {
+			//share the listen socket of server, every work thread has its own file descriptor
+			//so it can be closed safely in work thread
+#ifdef CY_SYS_WINDOWS
+			sfd = INVALID_SOCKET;
+#else
+			sfd = ::dup(std::get<0>(m_server->m_acceptor_sockets[i]));
+#endif
+			if (sfd == INVALID_SOCKET) {
+				CY_LOG(L_ERROR, "dup listen socket error, err=%d", socket_api::get_lasterror());
+				return false;
+			}
+			socket_api::set_close_onexec(sfd, true);
+			event |= Looper::kExclusive;
+		}
+
+		Looper::event_id_t event_id = looper->register_event(sfd, event, this,
+			std::bind(&ServerWorkThread::_on_accept_event, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
+			0);
+
+		m_listen_sockets.push_back(std::make_tuple(sfd, event_id));
+	}
+
+	CY_LOG(L_TRACE, "work thread %d listen %zd port(s), accept mode=%d", m_index, m_listen_sockets.size(), accept_mode);
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+void ServerWorkThread::_close_listen_socket(size_t index)
+{
+	if (index >= m_listen_sockets.size()) return;
+
+	Looper* looper = m_work_thread->get_looper();
+	auto& listen_socket = m_listen_sockets[index];
+	auto& sfd = std::get<0>(listen_socket);
+	auto& event_id = std::get<1>(listen_socket);
+
+	if (event_id != Looper::INVALID_EVENT_ID) {
+		looper->disable_all(event_id);
+		looper->delete_event(event_id);
+		event_id = Looper::INVALID_EVENT_ID;
+	}
+	if (sfd != INVALID_SOCKET) {
+		socket_api::close_socket(sfd);
+		sfd = INVALID_SOCKET;
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void ServerWorkThread::_on_accept_event(Looper::event_id_t id, socket_t fd, Looper::event_t event)
+{
+	(void)id;
+	(void)event;
+
+	//is shutdown in processing?
+	if (m_server->m_shutdown_ing.load() > 0) return;
+
+	//the listen sockets have the same index as server's
+	int32_t listen_index = -1;
+	for (size_t i = 0; i < m_listen_sockets.size(); i++) {
+		if (std::get<0>(m_listen_sockets[i]) == fd) listen_index = (int32_t)i;
+	}
+
+	//drain the accept queue, until it's empty or the batch is full
+	int32_t accept_counts = 0;
+	while (accept_counts < NewConnectionCmd::MAX_SOCKET_COUNTS)
+	{
+		sockaddr_storage peer_addr;
+		socklen_t peer_addr_len;
+		socket_t connfd = socket_api::accept_nonblock(fd, &peer_addr, &peer_addr_len);
+		if (connfd == INVALID_SOCKET)
+		{
+			//the connection may be accepted by other work thread already
+			if (!socket_api::is_lasterror_WOULDBLOCK()) m_server->_on_accept_error(fd, m_spare_socket);
+			break;
+		}
+		accept_counts++;
+
+		_create_connection(connfd, peer_addr, peer_addr_len, listen_index);
+	}
+
+	//the new connections may have been dropped by kernel already
+	m_server->_check_accept_queue(fd, accept_counts);
+	m_server->_on_accept_batch(accept_counts);
+}
+
 //-------------------------------------------------------------------------------------
 void ServerWorkThread::_on_workthread_message(Packet* message)
 {
@@ -90,40 +856,17 @@ void ServerWorkThread::_on_workthread_message(Packet* message)
 	assert(message);
 	assert(m_server);
 
-	const TcpServer::Listener& server_listener = m_server->m_listener;
-
 	uint16_t msg_id = message->get_packet_id();
 	if (msg_id == NewConnectionCmd::ID)
 	{
-		assert(message->get_packet_size() == sizeof(NewConnectionCmd));
+		assert(message->get_packet_size() <= sizeof(NewConnectionCmd));
 		NewConnectionCmd newConnectionCmd;
-		memcpy(&newConnectionCmd, message->get_packet_content(), sizeof(NewConnectionCmd));
-
-		//create tcp connection 
-		ConnectionPtr conn = std::make_shared<Connection>(m_server->get_next_connection_id(), newConnectionCmd.sfd, m_work_thread->get_looper(), this);
-		
-		//bind onMessage function
-		if (server_listener.onMessage) {
-			conn->setOnMessageFunction([this](ConnectionPtr connection) {
-				m_server->m_listener.onMessage(m_server, get_index(), connection);
-			});
-		}
-
-		//bind onClose function
-		conn->setOnCloseFunction([this](ConnectionPtr connection) {
-			if(m_server->m_listener.onClose)
-				m_server->m_listener.onClose(m_server, get_index(), connection);
-			//shutdown this connection next tick
-			m_server->shutdown_connection(connection);
-		});
-		
+		memcpy(&newConnectionCmd, message->get_packet_content(), message->get_packet_size());
+		assert(message->get_packet_size() == newConnectionCmd.get_size());
 
-		//notify server listener 
-		if (server_listener.onConnected) {
-			server_listener.onConnected(m_server, get_index(), conn);
+		for (int32_t i = 0; i < newConnectionCmd.counts; i++) {
+			_create_connection(newConnectionCmd.conn[i].sfd, newConnectionCmd.conn[i].peer_addr, newConnectionCmd.conn[i].peer_addr_len, newConnectionCmd.conn[i].listen_index);
 		}
-		
-		m_connections.insert(std::make_pair(conn->get_id(), conn));
 	}
 	else if (msg_id == CloseConnectionCmd::ID)
 	{
@@ -131,10 +874,10 @@ void ServerWorkThread::_on_workthread_message(Packet* message)
 		CloseConnectionCmd closeConnectionCmd;
 		memcpy(&closeConnectionCmd, message->get_packet_content(), sizeof(CloseConnectionCmd));
 
-		ConnectionMap::iterator it = m_connections.find(closeConnectionCmd.conn_id);
-		if (it == m_connections.end()) return;
+		ConnectionPtr* it = m_connections.find(closeConnectionCmd.conn_id);
+		if (it == nullptr) return;
 
-		ConnectionPtr conn = it->second;
+		ConnectionPtr conn = *it;
 		Connection::State curr_state = conn->get_state();
 
 		if (curr_state == Connection::kConnected)
@@ -146,6 +889,8 @@ void ServerWorkThread::_on_workthread_message(Packet* message)
 		{
 			//delete the connection object
 			m_connections.erase(conn->get_id());
+			m_connection_counts = (int32_t)m_connections.size();
+			m_rebalance_snapshot.erase(conn->get_id());
 		}
 		else
 		{
@@ -162,6 +907,21 @@ void ServerWorkThread::_on_workthread_message(Packet* message)
 	}
 	else if (msg_id == ShutdownCmd::ID)
 	{
+		//close all listen socket(s)
+		for (size_t i = 0; i < m_listen_sockets.size(); i++) {
+			_close_listen_socket(i);
+		}
+		m_listen_sockets.clear();
+
+		//all connections will be shutdown, no need to check timeout
+		_stop_timeout_wheel();
+		if (m_shrink_buf_timer != Looper::INVALID_EVENT_ID) {
+			Looper* looper = m_work_thread->get_looper();
+			looper->disable_all(m_shrink_buf_timer);
+			looper->delete_event(m_shrink_buf_timer);
+			m_shrink_buf_timer = Looper::INVALID_EVENT_ID;
+		}
+
 		//all connection is disconnect, just quit the loop
 		if (m_connections.empty()) {
 			//push loop request command
@@ -169,11 +929,11 @@ void ServerWorkThread::_on_workthread_message(Packet* message)
 			return;
 		}
 
-		//send shutdown command to all connection
-		ConnectionMap::iterator it, end = m_connections.end();
-		for (it = m_connections.begin(); it != end; ++it)
+		//send shutdown command to all connection(the close message is handled later, so the map
+		//is not changed in the loop)
+		for (size_t i = 0; i < m_connections.size(); i++)
 		{
-			ConnectionPtr conn = it->second;
+			ConnectionPtr conn = *(m_connections.begin() + (std::ptrdiff_t)i);
 			if (conn->get_state() == Connection::kConnected)
 			{
 				conn->shutdown();
@@ -189,11 +949,35 @@ void ServerWorkThread::_on_workthread_message(Packet* message)
 
 		_debug(debugCmd);
 	}
+	else if (msg_id == MigrateConnectionCmd::ID)
+	{
+		assert(message->get_packet_size() == sizeof(MigrateConnectionCmd));
+		MigrateConnectionCmd migrateCmd;
+		memcpy(&migrateCmd, message->get_packet_content(), sizeof(MigrateConnectionCmd));
+
+		_migrate_connection(migrateCmd.conn_id, migrateCmd.target_index);
+	}
+	else if (msg_id == RebalanceCmd::ID)
+	{
+		assert(message->get_packet_size() == sizeof(RebalanceCmd));
+		RebalanceCmd rebalanceCmd;
+		memcpy(&rebalanceCmd, message->get_packet_content(), sizeof(RebalanceCmd));
+
+		_rebalance(rebalanceCmd.target_index);
+	}
+	else if (msg_id == StopListenCmd::ID)
+	{
+		assert(message->get_packet_size() == sizeof(StopListenCmd));
+		StopListenCmd stopListenCmd;
+		memcpy(&stopListenCmd, message->get_packet_content(), sizeof(StopListenCmd));
+
+		_close_listen_socket(stopListenCmd.index);
+	}
 	else
 	{
 		//extra message
-		if (server_listener.onWorkThreadCommand) {
-			server_listener.onWorkThreadCommand(m_server, get_index(), message);
+		if (m_server->m_listener.onWorkThreadCommand) {
+			m_server->m_listener.onWorkThreadCommand(m_server, get_index(), message);
 		}
 	}
 }
@@ -218,15 +1002,18 @@ void ServerWorkThread::_debug(DebugCmd&)
 	std::snprintf(key_temp, MAX_PATH, "ServerWorkThread:%s:connection_map_counts", m_name.c_str());
 	m_debuger->updateDebugValue(key_temp, (int32_t)m_connections.size());
 
+	std::snprintf(key_temp, MAX_PATH, "ServerWorkThread:%s:connection_pool_counts", m_name.c_str());
+	m_debuger->updateDebugValue(key_temp, m_connection_pool->get_pooled_counts());
+
 	//Debug Looper
 	Looper* looper = m_work_thread->get_looper();
 	looper->debug(m_debuger, m_name.c_str());
 
 	//Debug all connections
 	int index = 0;
-	ConnectionMap::iterator it, end = m_connections.end();
-	for (it = m_connections.begin(); it != end; ++it, ++index) {
-		it->second->debug(m_debuger);
+	for (const ConnectionPtr& conn : m_connections) {
+		conn->debug(m_debuger);
+		++index;
 	}
 
 }
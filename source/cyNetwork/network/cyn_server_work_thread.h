@@ -7,14 +7,36 @@ Copyright(C) thecodeway.com
 namespace cyclone
 {
 
+//pre-define
+class ConnectionPool;
+
 class ServerWorkThread : noncopyable
 {
 public:
-	enum { kNewConnectionCmdID = 1, kCloseConnectionCmdID, kShutdownCmdID, kDebugCmdID };
+	//connections indexed by id, the id is created by the slot map
+	typedef SlotMap<ConnectionPtr> ConnectionMap;
+
+	enum { 
+		kNewConnectionCmdID = 1, kCloseConnectionCmdID, kShutdownCmdID, kDebugCmdID, kStopListenCmdID, 
+		kMigrateConnectionCmdID, kRebalanceCmdID 
+	};
 	struct NewConnectionCmd
 	{
-		enum { ID = kNewConnectionCmdID };
-		socket_t sfd;
+		enum { ID = kNewConnectionCmdID, MAX_SOCKET_COUNTS = 64 };
+		struct accepted_s
+		{
+			socket_t sfd;
+			socklen_t peer_addr_len;
+			int32_t listen_index;				//the socket options of the listen socket are applied
+			struct sockaddr_storage peer_addr;	//returned by accept, no need to query again
+		};
+		int32_t counts;
+		accepted_s conn[MAX_SOCKET_COUNTS];
+
+		//// size of the message, only valid sockets will be sent
+		uint16_t get_size(void) const {
+			return (uint16_t)(offsetof(NewConnectionCmd, conn) + sizeof(accepted_s)*(size_t)counts);
+		}
 	};
 
 	struct CloseConnectionCmd
@@ -34,11 +56,50 @@ public:
 		enum { ID = kDebugCmdID };
 	};
 
+	struct StopListenCmd
+	{
+		enum { ID = kStopListenCmdID };
+		size_t index;
+	};
+
+	//move a connection of this work thread to the target
+	struct MigrateConnectionCmd
+	{
+		enum { ID = kMigrateConnectionCmdID };
+		int32_t conn_id;
+		int32_t target_index;
+	};
+
+	//move the hottest connection of this work thread to the target
+	struct RebalanceCmd
+	{
+		enum { ID = kRebalanceCmdID };
+		int32_t target_index;
+	};
+
+	//the statistics collected from all work threads, every work thread fills its own slot
+	struct StatsRequest : noncopyable
+	{
+		bool with_connections;
+		std::vector<TcpServer::WorkThreadStats> work_threads;
+		std::vector<bool> answered;
+		int32_t pending;
+		sys_api::mutex_t lock;
+		sys_api::signal_t done;	//lighted when all work threads answered
+		Looper* reply_looper;	//the callback is posted to it when all work threads answered(async only)
+		TcpServer::StatsCallback callback;
+
+		StatsRequest(int32_t counts, bool with_conn);
+		~StatsRequest();
+	};
+
 public:
 	//// send message to this work thread (thread safe)
 	void send_message(uint16_t id, uint16_t size, const char* message);
 	void send_message(const Packet* message);
 	void send_message(const Packet** message, int32_t counts);
+	//// run the task in work thread, the objects captured are released after it's done (thread safe)
+	void post_task(Looper::task_callback task) { m_work_thread->get_looper()->post(task); }
 
 	//// get work thread index in work thread pool (thread safe)
 	int32_t get_index(void) const { return m_index; }
@@ -48,15 +109,71 @@ public:
 	void join(void);
 	//// get connection(NOT thread safe, MUST call in work thread)
 	ConnectionPtr get_connection(int32_t connection_id);
+	//// get live connection counts (thread safe)
+	int32_t get_connection_counts(void) const { return m_connection_counts.load(); }
+	//// get total busy time of the work thread looper, in microseconds (thread safe)
+	uint64_t get_busy_time(void) const { return m_work_thread->get_looper()->get_busy_time(); }
+	//// join or leave a group, return false if the connection is in(or not in) the group already(NOT thread safe, MUST call in work thread)
+	bool join_group(ConnectionPtr conn, int32_t group_id);
+	bool leave_group(ConnectionPtr conn, int32_t group_id);
+	//// send the data to the members of the group in this work thread(NOT thread safe, MUST call in work thread)
+	void publish(int32_t group_id, const char* buf, size_t len);
+	//// get member counts of the group in this work thread(NOT thread safe, MUST call in work thread)
+	int32_t get_group_size(int32_t group_id) const;
+	//// fill the statistics of this work thread to the request(NOT thread safe, MUST call in work thread)
+	void fill_stats(StatsRequest& request);
+	//// mark the connection to be closed, the mark is checked again when a moving connection is attached(thread safe)
+	static void request_close(ConnectionPtr conn) { conn->m_close_requested = true; }
+	//// the connections accepted for this work thread in current wake up of accept thread(accept thread only)
+	NewConnectionCmd& get_accept_batch(void) { return m_accept_batch; }
 
 private:
 	const int32_t	m_index;
 	TcpServer*		m_server;
 	WorkThread*		m_work_thread;
 
-	typedef std::unordered_map< int32_t, ConnectionPtr > ConnectionMap;
-
 	ConnectionMap	m_connections;
+	atomic_int32_t	m_connection_counts;
+
+	//i/o counters of the connections closed in this work thread
+	ConnectionStats	m_closed_stats;
+
+	//members of the groups in this work thread, the member is removed by swapping the last one to its position
+	struct group_s
+	{
+		std::vector<ConnectionPtr> members;
+		std::unordered_map<int32_t, size_t> positions;	//position of the connection id in members
+	};
+	typedef std::unordered_map< int32_t, group_s > GroupMap;
+	GroupMap		m_groups;
+
+	//the memory of connection objects is recycled, shared by the connections which may outlive this thread
+	std::shared_ptr<ConnectionPool> m_connection_pool;
+
+	//read bytes snapshot of connections at last rebalance
+	typedef std::unordered_map< int32_t, uint64_t > ReadBytesMap;
+	ReadBytesMap	m_rebalance_snapshot;
+
+	//listen sockets of this work thread(accept directly mode)
+	typedef std::vector< std::tuple<socket_t, Looper::event_id_t> > SocketVector;
+	SocketVector	m_listen_sockets;
+	socket_t		m_spare_socket;		//reserved fd for accept error, see TcpServer::_on_accept_error
+	NewConnectionCmd m_accept_batch;	//filled by accept thread, sent and reset at the end of each wake up
+
+	//timeout wheel, every connection has one entry in the slot of its nearest deadline. the activity 
+	//of connection just updates the time, the entry is checked and moved when the slot expires
+	enum { kTimeoutWheelSize = 512 };
+	typedef std::vector< std::pair<int32_t, uint32_t> > TimeoutSlot;	//connection id and timeout sequence
+	typedef std::vector< TimeoutSlot > TimeoutWheel;
+	TimeoutWheel	m_timeout_wheel;
+	size_t			m_timeout_cursor;
+	int64_t			m_timeout_cursor_time;	//the time when current slot expired, in microseconds
+	int64_t			m_timeout_tick;			//time span of one slot, in microseconds
+	Looper::event_id_t m_timeout_timer;
+
+	//shrink the grown bufs of the connections which are quiet for one period
+	enum { kShrinkBufPeriod = 10 * 1000 };
+	Looper::event_id_t m_shrink_buf_timer;
 
 	std::string		m_name;
 	DebugInterface*	m_debuger;
@@ -66,6 +183,40 @@ private:
 	bool _on_workthread_start(void);
 	void _on_workthread_message(Packet*);
 
+	//// create connection from accepted socket
+	void _create_connection(socket_t sfd, const struct sockaddr_storage& peer_addr, socklen_t peer_addr_len, int32_t listen_index);
+	void _bind_connection_callback(ConnectionPtr conn);
+
+	//// move connection to other work thread, the connection is sent back once if the target is full,
+	//// and closed if it can't be attached again
+	void _migrate_connection(int32_t conn_id, int32_t target_index);
+	void _attach_connection(ConnectionPtr conn, bool bounced);
+	void _rebalance(int32_t target_index);
+
+	//// remove the connection from the members of its groups, the group list of connection is kept
+	void _remove_from_groups(ConnectionPtr conn);
+	void _remove_member(int32_t group_id, int32_t conn_id);
+	//// add the connection to the members of its groups again, after it's attached to this work thread
+	void _add_to_groups(ConnectionPtr conn);
+
+	//// timeout wheel
+	void _start_timeout_wheel(void);
+	void _stop_timeout_wheel(void);
+	void _add_timeout(ConnectionPtr conn);
+	void _schedule_timeout(int32_t conn_id, uint32_t seq, int64_t deadline);
+	void _on_timeout_tick(void);
+
+	//// get the nearest deadline of connection, and the timeout type of it
+	int64_t _get_timeout_deadline(const ConnectionPtr& conn, TcpServer::TimeoutType& type);
+
+	//// shrink bufs of quiet connections
+	void _on_shrink_buf_timer(void);
+
+	//// listen sockets(accept directly mode)
+	bool _create_listen_sockets(void);
+	void _close_listen_socket(size_t index);
+	void _on_accept_event(Looper::event_id_t id, socket_t fd, Looper::event_t event);
+
 	void _debug(DebugCmd& cmd);
 public:
 	ServerWorkThread(int32_t index, TcpServer* server, const char* name, DebugInterface* debuger);
@@ -0,0 +1,88 @@
+/*
+Copyright(C) thecodeway.com
+*/
+#include <cy_core.h>
+#include "cyn_socket_options.h"
+
+namespace cyclone
+{
+
+//-------------------------------------------------------------------------------------
+SocketOptions::SocketOptions()
+	: send_buf_size(0)
+	, recv_buf_size(0)
+	, no_delay(false)
+	, keep_alive(true)
+	, linger_time(-1)
+	, notsent_lowat(0)
+	, quick_ack(false)
+	, defer_accept(0)
+	, fast_open_queue(0)
+	, fast_open_connect(false)
+{
+}
+
+//-------------------------------------------------------------------------------------
+bool SocketOptions::apply_listen(socket_t sfd) const
+{
+	//the bufs should be set before listen, the window scale is decided in handshake
+	bool success = apply_connection(sfd);
+
+	if (defer_accept > 0 && !socket_api::set_defer_accept(sfd, defer_accept)) success = false;
+	if (fast_open_queue > 0 && !socket_api::set_fast_open(sfd, fast_open_queue)) success = false;
+	return success;
+}
+
+//-------------------------------------------------------------------------------------
+bool SocketOptions::apply_connect(socket_t sfd) const
+{
+	bool success = apply_connection(sfd);
+
+	if (fast_open_connect && !socket_api::set_fast_open_connect(sfd, true)) success = false;
+	return success;
+}
+
+//-------------------------------------------------------------------------------------
+bool SocketOptions::apply_connection(socket_t sfd) const
+{
+	bool success = true;
+
+	if (send_buf_size > 0 && !socket_api::set_send_buf_size(sfd, send_buf_size)) success = false;
+	if (recv_buf_size > 0 && !socket_api::set_recv_buf_size(sfd, recv_buf_size)) success = false;
+	if (no_delay && !socket_api::set_nodelay(sfd, true)) success = false;
+	if (!socket_api::set_keep_alive(sfd, keep_alive)) success = false;
+	if (!socket_api::set_linger(sfd, linger_time >= 0, (uint16_t)(linger_time >= 0 ? linger_time : 0))) success = false;
+	if (notsent_lowat > 0 && !socket_api::set_notsent_lowat(sfd, notsent_lowat)) success = false;
+	if (quick_ack && !socket_api::set_quick_ack(sfd, true)) success = false;
+	return success;
+}
+
+//-------------------------------------------------------------------------------------
+SocketOptions SocketOptions::default_options(void)
+{
+	return SocketOptions();
+}
+
+//-------------------------------------------------------------------------------------
+SocketOptions SocketOptions::low_latency_rpc(void)
+{
+	SocketOptions options;
+	options.no_delay = true;
+	options.quick_ack = true;
+	options.notsent_lowat = 16 * 1024;
+	options.defer_accept = 1;
+	options.fast_open_queue = 256;
+	options.fast_open_connect = true;
+	return options;
+}
+
+//-------------------------------------------------------------------------------------
+SocketOptions SocketOptions::bulk_transfer(void)
+{
+	SocketOptions options;
+	options.send_buf_size = 4 * 1024 * 1024;
+	options.recv_buf_size = 4 * 1024 * 1024;
+	return options;
+}
+
+}
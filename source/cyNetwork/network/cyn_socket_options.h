@@ -0,0 +1,53 @@
+/*
+Copyright(C) thecodeway.com
+*/
+#ifndef _CYCLONE_NETWORK_SOCKET_OPTIONS_H_
+#define _CYCLONE_NETWORK_SOCKET_OPTIONS_H_
+
+#include <cy_core.h>
+
+namespace cyclone
+{
+
+//
+// Socket options profile of listen sockets, connecting sockets and connections. The options
+// not supported by the platform(or the kernel) are skipped with an error log
+//
+struct SocketOptions
+{
+	int32_t send_buf_size;		//SO_SNDBUF, zero means system default(auto tuning)
+	int32_t recv_buf_size;		//SO_RCVBUF, zero means system default(auto tuning)
+	bool no_delay;				//TCP_NODELAY
+	bool keep_alive;			//SO_KEEPALIVE
+	int32_t linger_time;		//SO_LINGER in seconds, negative means disable
+	uint32_t notsent_lowat;		//TCP_NOTSENT_LOWAT in bytes, zero means system default
+	bool quick_ack;				//TCP_QUICKACK, ack at once instead of delayed ack
+
+	//listen socket only
+	uint32_t defer_accept;		//TCP_DEFER_ACCEPT in seconds, wake up accept only after the first data arrives, zero means disable
+	int32_t fast_open_queue;	//TCP_FASTOPEN, max counts of pending fast open requests, zero means disable
+
+	//connect only
+	bool fast_open_connect;		//TCP_FASTOPEN_CONNECT, the first data is sent with SYN if the cookie of server is cached
+
+	//// apply to listen socket, call it before listen, the accepted sockets inherit the most of options
+	bool apply_listen(socket_t sfd) const;
+	//// apply to the socket before connect
+	bool apply_connect(socket_t sfd) const;
+	//// apply to the connected or accepted socket
+	bool apply_connection(socket_t sfd) const;
+
+	//// keep alive, no linger, the others are system default
+	static SocketOptions default_options(void);
+	//// small request and response, the client talks first: no delay, quick ack, small unsent buf,
+	//// deferred accept and fast open(save one round trip and one wakeup of new connection)
+	static SocketOptions low_latency_rpc(void);
+	//// large stream: big socket bufs and the small writes are merged
+	static SocketOptions bulk_transfer(void);
+
+	SocketOptions();
+};
+
+}
+
+#endif
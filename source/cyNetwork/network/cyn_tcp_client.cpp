@@ -18,8 +18,13 @@ namespace cyclone
 //-------------------------------------------------------------------------------------
 TcpClient::TcpClient(Looper* looper, void* param)
 	: m_socket(INVALID_SOCKET)
-	, m_socket_event_id(Looper::INVALID_EVENT_ID)
+	, m_connecting(false)
 	, m_retry_timer_id(Looper::INVALID_EVENT_ID)
+	, m_timeout_timer_id(Looper::INVALID_EVENT_ID)
+	, m_attempt_timer_id(Looper::INVALID_EVENT_ID)
+	, m_next_candidate(0)
+	, m_connect_timeout(0)
+	, m_attempt_delay(0)
 	, m_looper(looper)
 	, m_param(param)
 	, m_connection(nullptr)
@@ -42,7 +47,7 @@ TcpClient::~TcpClient()
 	sys_api::mutex_destroy(m_connection_lock);
 	m_connection_lock = nullptr;
 
-	RELEASE_EVENT(m_looper, m_socket_event_id);
+	_release_attempts();
 	RELEASE_EVENT(m_looper, m_retry_timer_id);
 
 	if (m_connection) {
@@ -51,47 +56,123 @@ TcpClient::~TcpClient()
 }
 
 //-------------------------------------------------------------------------------------
-bool TcpClient::connect(const Address& addr)
+bool TcpClient::connect(const Address& addr, uint32_t timeout_ms, const SocketOptions& options)
 {
-	assert(sys_api::thread_get_current_id() == m_looper->get_thread_id());
-	assert(m_socket == INVALID_SOCKET);
+	return connect(std::vector<Address>(1, addr), timeout_ms, 0, options);
+}
 
-	sys_api::auto_mutex lock(m_connection_lock);
+//-------------------------------------------------------------------------------------
+bool TcpClient::connect(const std::vector<Address>& candidates, uint32_t timeout_ms, uint32_t attempt_delay_ms, const SocketOptions& options)
+{
+	assert(sys_api::thread_get_current_id() == m_looper->get_thread_id());
+	assert(!m_connecting && m_attempts.empty());
+	if (candidates.empty()) return false;
+
+	//interleave the address families, begin with the family of first candidate
+	std::vector<Address> sorted;
+	std::vector<Address> others;
+	int family = candidates[0].get_family();
+	for (auto& addr : candidates) {
+		if (addr.get_family() == family) sorted.push_back(addr);
+		else others.push_back(addr);
+	}
+	for (size_t i = 0; i < others.size(); i++) {
+		size_t pos = std::min(i * 2 + 1, sorted.size());
+		sorted.insert(sorted.begin() + (std::ptrdiff_t)pos, others[i]);
+	}
 
-	//create socket
-	m_socket = socket_api::create_socket();
-	//set socket to non-block and close-onexec
-	socket_api::set_nonblock(m_socket, true);
-	socket_api::set_close_onexec(m_socket, true);
-	//set other socket option
-	socket_api::set_keep_alive(m_socket, true);
-	socket_api::set_linger(m_socket, false, 0);
-
-	m_serverAddr = addr;
-
-	//set event callback
-	m_socket_event_id = m_looper->register_event(m_socket, Looper::kRead | Looper::kWrite, this,
-		std::bind(&TcpClient::_on_socket_read_write, this),
-		std::bind(&TcpClient::_on_socket_read_write, this)
-		);
+	{
+		sys_api::auto_mutex lock(m_connection_lock);
+
+		m_candidates = sorted;
+		m_next_candidate = 0;
+		m_connect_timeout = timeout_ms;
+		m_attempt_delay = attempt_delay_ms;
+		m_socket_options = options;
+		m_serverAddr = m_candidates[0];
+		m_connecting = true;
+	}
 
 	//start connect to server
-	if (!socket_api::connect(m_socket, addr.get_sockaddr_in()))
-	{
-		CY_LOG(L_ERROR, "connect to server error, errno=%d", socket_api::get_lasterror());
+	if (!_start_next_attempt()) {
+		_abort_connect(0u);
 		return false;
 	}
 
+	//connect deadline
+	if (timeout_ms > 0) {
+		m_timeout_timer_id = m_looper->register_timer_event(timeout_ms, this,
+			std::bind(&TcpClient::_on_connect_timeout_timer, this, std::placeholders::_1));
+	}
 	return true;
 }
 
+//-------------------------------------------------------------------------------------
+bool TcpClient::_start_next_attempt(void)
+{
+	RELEASE_EVENT(m_looper, m_attempt_timer_id);
+
+	while (m_next_candidate < m_candidates.size()) {
+		size_t index = m_next_candidate++;
+		const Address& addr = m_candidates[index];
+
+		//create socket
+		socket_t sfd = socket_api::create_socket(addr.get_family());
+		if (sfd == INVALID_SOCKET) continue;
+
+		//set socket to non-block and close-onexec
+		socket_api::set_nonblock(sfd, true);
+		socket_api::set_close_onexec(sfd, true);
+		//set other socket option
+		if (addr.is_unix()) SocketOptions().apply_connect(sfd);
+		else m_socket_options.apply_connect(sfd);
+
+		if (!socket_api::connect(sfd, addr.get_sockaddr(), addr.get_sockaddr_len())) {
+			CY_LOG(L_ERROR, "connect to server %s:%d error, errno=%d", addr.get_ip(), addr.get_port(), socket_api::get_lasterror());
+			socket_api::close_socket(sfd);
+			continue;
+		}
+
+		//set event callback
+		attempt_s attempt;
+		attempt.sfd = sfd;
+		attempt.index = index;
+		attempt.event_id = m_looper->register_event(sfd, Looper::kRead | Looper::kWrite, this,
+			std::bind(&TcpClient::_on_socket_read_write, this, std::placeholders::_2),
+			std::bind(&TcpClient::_on_socket_read_write, this, std::placeholders::_2)
+		);
+		m_attempts.push_back(attempt);
+
+		//start the next one if this one is slow
+		if (m_attempt_delay > 0 && m_next_candidate < m_candidates.size()) {
+			m_attempt_timer_id = m_looper->register_timer_event(m_attempt_delay, this,
+				std::bind(&TcpClient::_on_attempt_delay_timer, this, std::placeholders::_1));
+		}
+		return true;
+	}
+	return false;
+}
+
+//-------------------------------------------------------------------------------------
+void TcpClient::_release_attempts(void)
+{
+	for (auto& attempt : m_attempts) {
+		RELEASE_EVENT(m_looper, attempt.event_id);
+		socket_api::close_socket(attempt.sfd);
+	}
+	m_attempts.clear();
+
+	RELEASE_EVENT(m_looper, m_timeout_timer_id);
+	RELEASE_EVENT(m_looper, m_attempt_timer_id);
+}
+
 //-------------------------------------------------------------------------------------
 Connection::State TcpClient::get_connection_state(void) const
 {
 	sys_api::auto_mutex lock(m_connection_lock);
 
 	if (m_connection) return m_connection->get_state();
-	else return (m_socket==INVALID_SOCKET) ? Connection::kDisconnected : Connection::kConnecting;
+	else return m_connecting ? Connection::kConnecting : Connection::kDisconnected;
 }
 
 //-------------------------------------------------------------------------------------
@@ -99,7 +180,7 @@ void TcpClient::_on_connect_status_changed(bool timeout)
 {
 	assert(m_connection == nullptr);
 
-	if (timeout || socket_api::get_socket_error(m_socket) != 0) {
+	if (timeout || m_socket == INVALID_SOCKET) {
 		//logic callback
 		uint32_t retry_sleep_ms = 0;
 		if (m_listener.onConnected) {
@@ -109,12 +190,13 @@ void TcpClient::_on_connect_status_changed(bool timeout)
 	}
 	else {
 		//connect success!
-		
-		//remove from event system, taked by Connection
-		RELEASE_EVENT(m_looper, m_socket_event_id);
 
 		//established the connection
-		m_connection = std::make_shared<Connection>(0, m_socket, m_looper, this);
+		{
+			sys_api::auto_mutex lock(m_connection_lock);
+			m_connection = std::make_shared<Connection>(0, m_socket, m_looper, this, &m_serverAddr);
+			m_connecting = false;
+		}
 
 		//bind callback functions
 		if (m_listener.onMessage) {
@@ -147,12 +229,15 @@ void TcpClient::_abort_connect(uint32_t retry_sleep_ms)
 	assert(sys_api::thread_get_current_id() == m_looper->get_thread_id());
 	assert(get_connection_state() == Connection::kConnecting);
 
-	RELEASE_EVENT(m_looper, m_socket_event_id);
+	//close all connecting sockets
+	_release_attempts();
 	RELEASE_EVENT(m_looper, m_retry_timer_id);
 
-	//close current socket
-	socket_api::close_socket(m_socket);
-	m_socket = INVALID_SOCKET;
+	{
+		sys_api::auto_mutex lock(m_connection_lock);
+		m_socket = INVALID_SOCKET;
+		m_connecting = false;
+	}
 
 	if (retry_sleep_ms>0) {
 		//retry connection? create retry the timer
@@ -192,7 +277,8 @@ void TcpClient::_on_retry_connect_timer(Looper::event_id_t id)
 	RELEASE_EVENT(m_looper, m_retry_timer_id);
 
 	//connect again
-	if (!connect(m_serverAddr)) {
+	std::vector<Address> candidates = m_candidates;
+	if (!connect(candidates, m_connect_timeout, m_attempt_delay)) {
 		//failed at once!, logic callback
 		if (m_listener.onConnected) {
 			uint32_t retry_sleep_ms = m_listener.onConnected(shared_from_this(), nullptr, false);
@@ -207,11 +293,62 @@ void TcpClient::_on_retry_connect_timer(Looper::event_id_t id)
 }
 
 //-------------------------------------------------------------------------------------
-void TcpClient::_on_socket_read_write(void)
+void TcpClient::_on_connect_timeout_timer(Looper::event_id_t id)
+{
+	assert(id == m_timeout_timer_id);
+	RELEASE_EVENT(m_looper, m_timeout_timer_id);
+
+	CY_LOG(L_WARN, "connect to server %s:%d timeout", m_serverAddr.get_ip(), m_serverAddr.get_port());
+	_on_connect_status_changed(true);
+}
+
+//-------------------------------------------------------------------------------------
+void TcpClient::_on_attempt_delay_timer(Looper::event_id_t id)
+{
+	assert(id == m_attempt_timer_id);
+
+	//the former ones keep connecting
+	_start_next_attempt();
+}
+
+//-------------------------------------------------------------------------------------
+void TcpClient::_on_socket_read_write(socket_t sfd)
 {
-	if (get_connection_state() == Connection::kConnecting) {
+	if (get_connection_state() != Connection::kConnecting) return;
+
+	auto it = m_attempts.begin();
+	for (; it != m_attempts.end(); ++it) {
+		if (it->sfd == sfd) break;
+	}
+	if (it == m_attempts.end()) return;
+
+	if (socket_api::get_socket_error(sfd) != 0) {
+		CY_LOG(L_DEBUG, "connect to server %s:%d failed", m_candidates[it->index].get_ip(), m_candidates[it->index].get_port());
+
+		RELEASE_EVENT(m_looper, it->event_id);
+		socket_api::close_socket(sfd);
+		m_attempts.erase(it);
+
+		//try the next candidate at once
+		if (_start_next_attempt() || !m_attempts.empty()) return;
+
+		//all failed
 		_on_connect_status_changed(false);
+		return;
+	}
+
+	//the winner, remove from event system, taked by Connection
+	RELEASE_EVENT(m_looper, it->event_id);
+	Address addr = m_candidates[it->index];
+	m_attempts.erase(it);
+
+	_release_attempts();
+	{
+		sys_api::auto_mutex lock(m_connection_lock);
+		m_socket = sfd;
+		m_serverAddr = addr;
 	}
+	_on_connect_status_changed(false);
 }
 
 //-------------------------------------------------------------------------------------
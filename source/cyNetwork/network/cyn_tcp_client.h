@@ -5,6 +5,7 @@ Copyright(C) thecodeway.com
 #define _CYCLONE_NETWORK_TCP_CLIENT_H_
 
 #include <cy_core.h>
+#include "cyn_socket_options.h"
 
 namespace cyclone
 {
@@ -28,9 +29,19 @@ public:
 	};
 	Listener m_listener;
 
+	enum { kDefaultAttemptDelay = 250 };
+
 public:
-	//// connect to remote server(NOT thread safe)
-	bool connect(const Address& addr);
+	//// connect to remote server, ipv4, ipv6 or unix domain socket address. if the connection is not
+	//// established in timeout_ms(zero means no timeout), onConnected is called with failure. the socket
+	//// options are used by the retries too(ignored for unix domain socket)(NOT thread safe)
+	bool connect(const Address& addr, uint32_t timeout_ms = 0, const SocketOptions& options = SocketOptions());
+	//// race the connects to candidate addresses(happy eyeballs), the candidates are tried in turn with
+	//// the address families interleaved, the next one is started if the former ones are not connected
+	//// in attempt_delay_ms or failed(zero means only after failed), the first established one is kept
+	//// and the others are closed(NOT thread safe)
+	bool connect(const std::vector<Address>& candidates, uint32_t timeout_ms = 0, uint32_t attempt_delay_ms = kDefaultAttemptDelay,
+		const SocketOptions& options = SocketOptions());
 	//// disconnect(NOT thread safe)
 	void disconnect(void);
 	//// get server address
@@ -43,9 +54,26 @@ public:
 	Connection::State get_connection_state(void) const;
     
 private:
+	struct attempt_s
+	{
+		socket_t sfd;
+		Looper::event_id_t event_id;
+		size_t index;	//index of candidates
+	};
+	typedef std::vector<attempt_s> AttemptVec;
+
 	socket_t m_socket;
-	Looper::event_id_t m_socket_event_id;
+	bool m_connecting;
+	AttemptVec m_attempts;
 	Looper::event_id_t m_retry_timer_id;
+	Looper::event_id_t m_timeout_timer_id;
+	Looper::event_id_t m_attempt_timer_id;
+
+	std::vector<Address> m_candidates;
+	size_t m_next_candidate;
+	uint32_t m_connect_timeout;
+	uint32_t m_attempt_delay;
+	SocketOptions m_socket_options;
 
 	Address	 m_serverAddr;
 	Looper*	m_looper;
@@ -56,10 +84,14 @@ private:
 
 private:
 	/// on read/write callback function
-	void _on_socket_read_write(void);
+	void _on_socket_read_write(socket_t sfd);
 	void _on_retry_connect_timer(Looper::event_id_t id);
+	void _on_connect_timeout_timer(Looper::event_id_t id);
+	void _on_attempt_delay_timer(Looper::event_id_t id);
 
 private:
+	bool _start_next_attempt(void);
+	void _release_attempts(void);
 	void _on_connect_status_changed(bool timeout);
 	void _abort_connect(uint32_t retry_sleep_ms);
 
@@ -0,0 +1,447 @@
+/*
+Copyright(C) thecodeway.com
+*/
+#include <cy_core.h>
+#include <cy_event.h>
+#include <cy_network.h>
+#include "cyn_tcp_client_pool.h"
+
+namespace cyclone
+{
+
+//-------------------------------------------------------------------------------------
+TcpClientPool::TcpClientPool(Looper* looper)
+	: m_looper(looper)
+	, m_next_id(0)
+	, m_max_idle(8)
+	, m_idle_timeout(60 * 1000)
+	, m_max_connecting(16)
+	, m_connect_timeout(10 * 1000)
+	, m_check_timer(Looper::INVALID_EVENT_ID)
+	, m_created_counts(0)
+	, m_reused_counts(0)
+	, m_failed_counts(0)
+{
+	//looper muste be setted
+	assert(looper);
+}
+
+//-------------------------------------------------------------------------------------
+TcpClientPool::~TcpClientPool()
+{
+	assert(sys_api::thread_get_current_id() == m_looper->get_thread_id());
+
+	close_all();
+
+	if (m_check_timer != Looper::INVALID_EVENT_ID) {
+		m_looper->disable_all(m_check_timer);
+		m_looper->delete_event(m_check_timer);
+		m_check_timer = Looper::INVALID_EVENT_ID;
+	}
+
+	//the connections still flushing output keep themselves alive until closed
+	Looper* looper = m_looper;
+	for (auto conn : m_closing) {
+		conn->setOnCloseFunction([looper, conn](ConnectionPtr) {
+			looper->defer([conn]() { conn->setOnCloseFunction(nullptr); });
+		});
+	}
+	m_closing.clear();
+
+	for (auto it : m_endpoints) {
+		delete it.second;
+	}
+	m_endpoints.clear();
+}
+
+//-------------------------------------------------------------------------------------
+void TcpClientPool::set_max_idle(size_t counts)
+{
+	m_max_idle = counts;
+
+	//close the extra idle connections
+	for (auto it : m_endpoints) {
+		endpoint_s* endpoint = it.second;
+		while (endpoint->idle.size() > m_max_idle) {
+			ConnectionPtr conn = endpoint->idle.front().conn;
+			endpoint->idle.pop_front();
+			_close(conn);
+		}
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void TcpClientPool::set_idle_timeout(uint32_t timeout_ms)
+{
+	m_idle_timeout = timeout_ms;
+	if (m_check_timer != Looper::INVALID_EVENT_ID) _update_check_timer();
+}
+
+//-------------------------------------------------------------------------------------
+void TcpClientPool::set_max_connecting(size_t counts)
+{
+	m_max_connecting = (counts == 0) ? 1 : counts;
+}
+
+//-------------------------------------------------------------------------------------
+size_t TcpClientPool::get_idle_counts(const Address& addr) const
+{
+	endpoint_s* endpoint = _find_endpoint(addr);
+	return endpoint ? endpoint->idle.size() : 0;
+}
+
+//-------------------------------------------------------------------------------------
+size_t TcpClientPool::get_connecting_counts(const Address& addr) const
+{
+	endpoint_s* endpoint = _find_endpoint(addr);
+	return endpoint ? endpoint->connecting : 0;
+}
+
+//-------------------------------------------------------------------------------------
+size_t TcpClientPool::get_waiting_counts(const Address& addr) const
+{
+	endpoint_s* endpoint = _find_endpoint(addr);
+	return endpoint ? endpoint->waiting.size() : 0;
+}
+
+//-------------------------------------------------------------------------------------
+std::string TcpClientPool::_get_key(const Address& addr)
+{
+	return std::string((const char*)addr.get_sockaddr(), (size_t)addr.get_sockaddr_len());
+}
+
+//-------------------------------------------------------------------------------------
+TcpClientPool::endpoint_s* TcpClientPool::_find_endpoint(const Address& addr) const
+{
+	auto it = m_endpoints.find(_get_key(addr));
+	return (it == m_endpoints.end()) ? nullptr : it->second;
+}
+
+//-------------------------------------------------------------------------------------
+TcpClientPool::endpoint_s* TcpClientPool::_get_endpoint(const Address& addr)
+{
+	std::string key = _get_key(addr);
+	auto it = m_endpoints.find(key);
+	if (it != m_endpoints.end()) return it->second;
+
+	endpoint_s* endpoint = new endpoint_s();
+	endpoint->addr = addr;
+	endpoint->connecting = 0;
+	m_endpoints.insert(std::make_pair(key, endpoint));
+	return endpoint;
+}
+
+//-------------------------------------------------------------------------------------
+void TcpClientPool::lease(const Address& addr, LeaseCallback callback)
+{
+	assert(sys_api::thread_get_current_id() == m_looper->get_thread_id());
+
+	endpoint_s* endpoint = _get_endpoint(addr);
+
+	//reuse the newest idle connection, it's the most likely alive one
+	while (!endpoint->idle.empty()) {
+		ConnectionPtr conn = endpoint->idle.back().conn;
+		endpoint->idle.pop_back();
+
+		if (conn->get_state() != Connection::kConnected || !conn->get_input_buf().empty()) {
+			_close(conn);
+			continue;
+		}
+
+		conn->setOnMessageFunction(nullptr);
+		conn->setOnCloseFunction(nullptr);
+		m_reused_counts++;
+		callback(conn);
+		return;
+	}
+
+	endpoint->waiting.push_back(callback);
+	_try_connect(endpoint);
+}
+
+//-------------------------------------------------------------------------------------
+void TcpClientPool::release(ConnectionPtr conn, bool reusable)
+{
+	assert(sys_api::thread_get_current_id() == m_looper->get_thread_id());
+	if (!conn) return;
+
+	auto owner = m_owners.find(conn.get());
+	if (owner == m_owners.end()) {
+		CY_LOG(L_WARN, "release connection %s which is not created by the pool, ignored", conn->get_name());
+		return;
+	}
+
+	endpoint_s* endpoint = owner->second;
+	if (!reusable || conn->get_state() != Connection::kConnected ||
+		!conn->get_input_buf().empty() || conn->get_output_size() > 0) {
+		_close(conn);
+		return;
+	}
+
+	_hand_over(endpoint, conn);
+}
+
+//-------------------------------------------------------------------------------------
+void TcpClientPool::close_all(void)
+{
+	assert(sys_api::thread_get_current_id() == m_looper->get_thread_id());
+
+	//abort connecting
+	while (!m_connecting.empty()) {
+		_abort_connect(*(m_connecting.begin()));
+	}
+
+	for (auto it : m_endpoints) {
+		endpoint_s* endpoint = it.second;
+
+		while (!endpoint->idle.empty()) {
+			ConnectionPtr conn = endpoint->idle.front().conn;
+			endpoint->idle.pop_front();
+			_close(conn);
+		}
+
+		//fail the waiting leases
+		std::deque<LeaseCallback> waiting;
+		waiting.swap(endpoint->waiting);
+		for (auto& callback : waiting) {
+			callback(nullptr);
+		}
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void TcpClientPool::_try_connect(endpoint_s* endpoint)
+{
+	//one connection for one waiting lease, but no more than max connecting
+	while (endpoint->waiting.size() > endpoint->connecting && endpoint->connecting < m_max_connecting) {
+		if (_start_connect(endpoint)) continue;
+
+		//failed at once
+		m_failed_counts++;
+		LeaseCallback callback = endpoint->waiting.front();
+		endpoint->waiting.pop_front();
+		callback(nullptr);
+	}
+}
+
+//-------------------------------------------------------------------------------------
+bool TcpClientPool::_start_connect(endpoint_s* endpoint)
+{
+	const Address& addr = endpoint->addr;
+
+	socket_t sfd = socket_api::create_socket(addr.get_family());
+	if (sfd == INVALID_SOCKET) return false;
+
+	//set socket to non-block and close-onexec
+	socket_api::set_nonblock(sfd, true);
+	socket_api::set_close_onexec(sfd, true);
+	if (addr.is_unix()) SocketOptions().apply_connect(sfd);
+	else m_socket_options.apply_connect(sfd);
+
+	if (!socket_api::connect(sfd, addr.get_sockaddr(), addr.get_sockaddr_len())) {
+		CY_LOG(L_ERROR, "connect to %s:%d error, errno=%d", addr.get_ip(), addr.get_port(), socket_api::get_lasterror());
+		socket_api::close_socket(sfd);
+		return false;
+	}
+
+	connecting_s* connecting = new connecting_s();
+	connecting->endpoint = endpoint;
+	connecting->sfd = sfd;
+	connecting->event_id = m_looper->register_event(sfd, Looper::kRead | Looper::kWrite, this,
+		[this, connecting](Looper::event_id_t, socket_t, Looper::event_t, void*) { _on_connect_event(connecting); },
+		[this, connecting](Looper::event_id_t, socket_t, Looper::event_t, void*) { _on_connect_event(connecting); }
+	);
+	connecting->timer_id = Looper::INVALID_EVENT_ID;
+	if (m_connect_timeout > 0) {
+		connecting->timer_id = m_looper->register_timer_event(m_connect_timeout, this,
+			[this, connecting](Looper::event_id_t, void*) { _on_connect_timeout(connecting); });
+	}
+
+	endpoint->connecting++;
+	m_connecting.insert(connecting);
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+void TcpClientPool::_abort_connect(connecting_s* connecting)
+{
+	m_looper->disable_all(connecting->event_id);
+	m_looper->delete_event(connecting->event_id);
+	if (connecting->timer_id != Looper::INVALID_EVENT_ID) {
+		m_looper->disable_all(connecting->timer_id);
+		m_looper->delete_event(connecting->timer_id);
+	}
+
+	if (connecting->sfd != INVALID_SOCKET) {
+		socket_api::close_socket(connecting->sfd);
+	}
+
+	connecting->endpoint->connecting--;
+	m_connecting.erase(connecting);
+	delete connecting;
+}
+
+//-------------------------------------------------------------------------------------
+void TcpClientPool::_on_connect_event(connecting_s* connecting)
+{
+	endpoint_s* endpoint = connecting->endpoint;
+	socket_t sfd = connecting->sfd;
+
+	//the socket is taken by connection or closed
+	bool success = (socket_api::get_socket_error(sfd) == 0);
+	if (success) connecting->sfd = INVALID_SOCKET;
+	_abort_connect(connecting);
+
+	if (!success) {
+		CY_LOG(L_WARN, "connect to %s:%d failed", endpoint->addr.get_ip(), endpoint->addr.get_port());
+		_on_connect_failed(endpoint);
+		return;
+	}
+
+	ConnectionPtr conn = std::make_shared<Connection>(m_next_id++, sfd, m_looper, this, &(endpoint->addr));
+	m_owners[conn.get()] = endpoint;
+	m_created_counts++;
+	_hand_over(endpoint, conn);
+
+	//the other waiting leases
+	_try_connect(endpoint);
+}
+
+//-------------------------------------------------------------------------------------
+void TcpClientPool::_on_connect_timeout(connecting_s* connecting)
+{
+	endpoint_s* endpoint = connecting->endpoint;
+
+	//the timer is deleted with the connecting
+	_abort_connect(connecting);
+
+	CY_LOG(L_WARN, "connect to %s:%d timeout", endpoint->addr.get_ip(), endpoint->addr.get_port());
+	_on_connect_failed(endpoint);
+}
+
+//-------------------------------------------------------------------------------------
+void TcpClientPool::_on_connect_failed(endpoint_s* endpoint)
+{
+	m_failed_counts++;
+
+	//fail one waiting lease, and retry for the others
+	if (!endpoint->waiting.empty()) {
+		LeaseCallback callback = endpoint->waiting.front();
+		endpoint->waiting.pop_front();
+		callback(nullptr);
+	}
+	_try_connect(endpoint);
+}
+
+//-------------------------------------------------------------------------------------
+void TcpClientPool::_hand_over(endpoint_s* endpoint, ConnectionPtr conn)
+{
+	//give it to the first waiting lease, or keep it idle
+	if (endpoint->waiting.empty()) {
+		_push_idle(endpoint, conn);
+		return;
+	}
+
+	LeaseCallback callback = endpoint->waiting.front();
+	endpoint->waiting.pop_front();
+
+	conn->setOnMessageFunction(nullptr);
+	conn->setOnCloseFunction(nullptr);
+	callback(conn);
+}
+
+//-------------------------------------------------------------------------------------
+void TcpClientPool::_push_idle(endpoint_s* endpoint, ConnectionPtr conn)
+{
+	if (endpoint->idle.size() >= m_max_idle) {
+		_close(conn);
+		return;
+	}
+
+	//health check, the idle connection should not receive anything, and closed by peer
+	conn->setOnMessageFunction([this](ConnectionPtr c) {
+		CY_LOG(L_DEBUG, "idle connection %s receive unexpected data", c->get_name());
+		_remove_idle(c);
+		_close(c);
+	});
+	conn->setOnCloseFunction([this](ConnectionPtr c) {
+		_remove_idle(c);
+		m_owners.erase(c.get());
+	});
+	conn->setOnHighWatermarkFunction(nullptr);
+	conn->setOnLowWatermarkFunction(nullptr);
+
+	idle_s idle;
+	idle.conn = conn;
+	idle.since = m_looper->get_loop_time();
+	endpoint->idle.push_back(idle);
+
+	if (m_check_timer == Looper::INVALID_EVENT_ID) _update_check_timer();
+}
+
+//-------------------------------------------------------------------------------------
+void TcpClientPool::_remove_idle(ConnectionPtr conn)
+{
+	auto owner = m_owners.find(conn.get());
+	if (owner == m_owners.end()) return;
+
+	endpoint_s* endpoint = owner->second;
+	for (auto it = endpoint->idle.begin(); it != endpoint->idle.end(); ++it) {
+		if (it->conn == conn) {
+			endpoint->idle.erase(it);
+			return;
+		}
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void TcpClientPool::_close(ConnectionPtr conn)
+{
+	m_owners.erase(conn.get());
+	conn->setOnMessageFunction(nullptr);
+	if (conn->get_state() == Connection::kDisconnected) {
+		conn->setOnCloseFunction(nullptr);
+		return;
+	}
+
+	//hold it until the output flushed and closed
+	m_closing.insert(conn);
+	conn->setOnCloseFunction([this](ConnectionPtr c) {
+		m_closing.erase(c);
+	});
+	if (conn->get_state() == Connection::kConnected) conn->shutdown();
+}
+
+//-------------------------------------------------------------------------------------
+void TcpClientPool::_update_check_timer(void)
+{
+	if (m_check_timer != Looper::INVALID_EVENT_ID) {
+		m_looper->disable_all(m_check_timer);
+		m_looper->delete_event(m_check_timer);
+		m_check_timer = Looper::INVALID_EVENT_ID;
+	}
+	if (m_idle_timeout == 0) return;
+
+	uint32_t period = std::min(std::max(m_idle_timeout / 4, 10u), 1000u);
+	m_check_timer = m_looper->register_timer_event(period, this, [this](Looper::event_id_t, void*) {
+		_on_check_timer();
+	});
+}
+
+//-------------------------------------------------------------------------------------
+void TcpClientPool::_on_check_timer(void)
+{
+	int64_t expire_time = m_looper->get_loop_time() - (int64_t)m_idle_timeout * 1000;
+
+	//the oldest idle connections at the front
+	for (auto it : m_endpoints) {
+		endpoint_s* endpoint = it.second;
+		while (!endpoint->idle.empty() && endpoint->idle.front().since <= expire_time) {
+			ConnectionPtr conn = endpoint->idle.front().conn;
+			endpoint->idle.pop_front();
+			_close(conn);
+		}
+	}
+}
+
+}
@@ -0,0 +1,148 @@
+/*
+Copyright(C) thecodeway.com
+*/
+#ifndef _CYCLONE_NETWORK_TCP_CLIENT_POOL_H_
+#define _CYCLONE_NETWORK_TCP_CLIENT_POOL_H_
+
+#include <cy_core.h>
+#include <cy_event.h>
+#include "cyn_connection.h"
+
+namespace cyclone
+{
+
+//
+// Upstream connection pool of one looper, the connections are grouped by remote address.
+// The connection released by caller is kept as idle connection, and reused by next lease
+// of the same address, so the short-lived sessions can skip the tcp handshake
+//
+class TcpClientPool : noncopyable
+{
+public:
+	//the conn is nullptr if connect failed
+	typedef std::function<void(ConnectionPtr conn)> LeaseCallback;
+
+public:
+	//// lease a connection to the address. the newest idle connection is reused if possible, otherwise
+	//// a new connection is created, or wait for one if there are too many connecting connections.
+	//// the callback may be called in this function, the caller should set the message and close
+	//// callbacks of the connection, and release it at last(NOT thread safe, call it in looper thread)
+	void lease(const Address& addr, LeaseCallback callback);
+
+	//// give back a leased connection, it's kept as idle connection if it's reusable(the caller has read
+	//// the whole response, and the connection is still connected), otherwise it will be shutdown.
+	//// only the connections created by this pool are accepted, the others are ignored
+	//// (NOT thread safe, call it in looper thread)
+	void release(ConnectionPtr conn, bool reusable);
+
+	//// shutdown all idle connections, abort the connecting ones and fail the waiting leases
+	//// (NOT thread safe, call it in looper thread)
+	void close_all(void);
+
+	//// max idle connections of one address(default 8), zero means no idle connection is kept
+	void set_max_idle(size_t counts);
+	size_t get_max_idle(void) const { return m_max_idle; }
+
+	//// the idle connection will be closed after idle timeout in milliseconds(default 60s, zero means never)
+	void set_idle_timeout(uint32_t timeout_ms);
+	uint32_t get_idle_timeout(void) const { return m_idle_timeout; }
+
+	//// max connecting connections of one address(default 16), the other leases will wait
+	void set_max_connecting(size_t counts);
+	size_t get_max_connecting(void) const { return m_max_connecting; }
+
+	//// the connecting connection will be aborted after connect timeout in milliseconds(default 10s, zero means never)
+	void set_connect_timeout(uint32_t timeout_ms) { m_connect_timeout = timeout_ms; }
+	uint32_t get_connect_timeout(void) const { return m_connect_timeout; }
+
+	//// socket options of the new connections(ignored for unix domain socket)
+	void set_socket_options(const SocketOptions& options) { m_socket_options = options; }
+	const SocketOptions& get_socket_options(void) const { return m_socket_options; }
+
+	//// get counts of idle/connecting connections and waiting leases of the address
+	size_t get_idle_counts(const Address& addr) const;
+	size_t get_connecting_counts(const Address& addr) const;
+	size_t get_waiting_counts(const Address& addr) const;
+
+	//// statistics
+	uint64_t get_created_counts(void) const { return m_created_counts; }
+	uint64_t get_reused_counts(void) const { return m_reused_counts; }
+	uint64_t get_failed_counts(void) const { return m_failed_counts; }
+
+	//// get the looper
+	Looper* get_looper(void) const { return m_looper; }
+
+private:
+	struct idle_s
+	{
+		ConnectionPtr conn;
+		int64_t since;	//loop time when it's released
+	};
+
+	struct endpoint_s
+	{
+		Address addr;
+		std::deque<idle_s> idle;	//the newest one at the back
+		std::deque<LeaseCallback> waiting;
+		size_t connecting;
+	};
+	typedef std::map<std::string, endpoint_s*> EndpointMap;
+
+	struct connecting_s
+	{
+		endpoint_s* endpoint;
+		socket_t sfd;
+		Looper::event_id_t event_id;
+		Looper::event_id_t timer_id;	//connect timeout
+	};
+	typedef std::set<connecting_s*> ConnectingSet;
+
+	//the endpoint of the connections created by the pool, leased or idle, removed when closed by pool
+	typedef std::unordered_map<Connection*, endpoint_s*> OwnerMap;
+
+	Looper*			m_looper;
+	EndpointMap		m_endpoints;
+	ConnectingSet	m_connecting;
+	OwnerMap		m_owners;
+	std::set<ConnectionPtr> m_closing;	//shutdown but wait for output flushed
+	int32_t			m_next_id;
+
+	size_t			m_max_idle;
+	uint32_t		m_idle_timeout;
+	size_t			m_max_connecting;
+	uint32_t		m_connect_timeout;
+	SocketOptions	m_socket_options;
+	Looper::event_id_t m_check_timer;
+
+	uint64_t		m_created_counts;
+	uint64_t		m_reused_counts;
+	uint64_t		m_failed_counts;
+
+private:
+	static std::string _get_key(const Address& addr);
+	endpoint_s* _find_endpoint(const Address& addr) const;
+	endpoint_s* _get_endpoint(const Address& addr);
+
+	void _try_connect(endpoint_s* endpoint);
+	bool _start_connect(endpoint_s* endpoint);
+	void _on_connect_event(connecting_s* connecting);
+	void _on_connect_timeout(connecting_s* connecting);
+	void _on_connect_failed(endpoint_s* endpoint);
+	void _abort_connect(connecting_s* connecting);
+
+	void _hand_over(endpoint_s* endpoint, ConnectionPtr conn);
+	void _push_idle(endpoint_s* endpoint, ConnectionPtr conn);
+	void _remove_idle(ConnectionPtr conn);
+	void _close(ConnectionPtr conn);
+
+	void _update_check_timer(void);
+	void _on_check_timer(void);
+
+public:
+	TcpClientPool(Looper* looper);
+	virtual ~TcpClientPool();
+};
+
+}
+
+#endif
@@ -12,11 +12,21 @@ namespace cyclone
 
 //-------------------------------------------------------------------------------------
 TcpServer::TcpServer(const char* name, DebugInterface* debuger)
-	: m_work_thread_counts(0)
+	: m_accept_mode(kAcceptThread)
+	, m_listen_backlog(SOMAXCONN)
+	, m_accept_queue_full_counts(0)
+	, m_accept_error_counts(0)
+	, m_max_accept_batch(0)
+	, m_spare_socket(INVALID_SOCKET)
+	, m_work_thread_counts(0)
 	, m_next_work(0)
+	, m_placement_policy(kRoundRobin)
+	, m_random_seed(0x9E3779B9u)
+	, m_busy_sample_timer(Looper::INVALID_EVENT_ID)
+	, m_rebalance_period(0)
+	, m_rebalance_timer(Looper::INVALID_EVENT_ID)
 	, m_running(0)
 	, m_shutdown_ing(0)
-	, m_next_connection_id(0)
 	, m_name(name ? name : "server")
 	, m_debuger(debuger)
 {
@@ -25,6 +35,12 @@ TcpServer::TcpServer(const char* name, DebugInterface* debuger)
 	m_listener.onConnected = nullptr;
 	m_listener.onMessage = nullptr;
 	m_listener.onClose = nullptr;
+	m_listener.onTimeout = nullptr;
+
+	memset(m_busy_time_snapshot, 0, sizeof(m_busy_time_snapshot));
+	memset(m_recent_busy_time, 0, sizeof(m_recent_busy_time));
+	memset(m_rebalance_busy_snapshot, 0, sizeof(m_rebalance_busy_snapshot));
+	memset(m_timeouts, 0, sizeof(m_timeouts));
 }
 
 //-------------------------------------------------------------------------------------
@@ -35,13 +51,88 @@ TcpServer::~TcpServer()
 }
 
 //-------------------------------------------------------------------------------------
-bool TcpServer::bind(const Address& bind_addr, bool enable_reuse_port)
+bool TcpServer::set_accept_mode(AcceptMode mode)
+{
+	//is running already?
+	if (m_running > 0 || !m_acceptor_sockets.empty()) return false;
+
+#ifdef CY_SYS_WINDOWS
+	if (mode != kAcceptThread) {
+		CY_LOG(L_ERROR, "accept mode %d is not supported in this platform", mode);
+		return false;
+	}
+#endif
+
+	m_accept_mode = mode;
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+bool TcpServer::set_listen_backlog(int32_t backlog)
+{
+	//is running already?
+	if (m_running > 0 || backlog <= 0) return false;
+
+	m_listen_backlog = backlog;
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+bool TcpServer::set_placement_policy(PlacementPolicy policy)
+{
+	//is running already?
+	if (m_running > 0) return false;
+
+	m_placement_policy = policy;
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+bool TcpServer::set_auto_rebalance(uint32_t period_ms)
+{
+	//is running already?
+	if (m_running > 0) return false;
+
+	m_rebalance_period = period_ms;
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+bool TcpServer::set_timeout(TimeoutType type, uint32_t milli_seconds)
+{
+	//is running already?
+	if (m_running > 0 || type < 0 || type >= kTimeoutTypeCounts) return false;
+
+	m_timeouts[type] = milli_seconds;
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+int32_t TcpServer::get_connection_counts(int32_t work_thread_index) const
+{
+	if (work_thread_index < 0 || work_thread_index >= (int32_t)m_work_thread_pool.size()) return 0;
+	return m_work_thread_pool[(size_t)work_thread_index]->get_connection_counts();
+}
+
+//-------------------------------------------------------------------------------------
+bool TcpServer::bind(const Address& bind_addr, bool enable_reuse_port, const SocketOptions& options)
 {
 	//is running already?
 	if (m_running > 0) return false;
 
+	//every work thread will bind the same address
+	if (m_accept_mode == kReusePort) {
+		//SO_REUSEPORT doesn't balance unix domain socket
+		if (bind_addr.is_unix()) {
+			CY_LOG(L_ERROR, "unix domain socket can't be used in reuse port mode");
+			return false;
+		}
+		enable_reuse_port = true;
+	}
+	if (bind_addr.is_unix()) enable_reuse_port = false;
+
 	//create a non blocking socket
-	socket_t sfd = socket_api::create_socket();
+	socket_t sfd = socket_api::create_socket(bind_addr.get_family());
 	if (sfd == INVALID_SOCKET) {
 		CY_LOG(L_ERROR, "create socket error");
 		return false;
@@ -68,18 +159,83 @@ bool TcpServer::bind(const Address& bind_addr, bool enable_reuse_port)
 	}
 #endif
 
+	//tcp options are meaningless for unix domain socket
+	SocketOptions socket_options = bind_addr.is_unix() ? SocketOptions() : options;
+	if (!bind_addr.is_unix()) {
+		socket_options.apply_listen(sfd);
+	}
+
 	//bind address
-	if (!(socket_api::bind(sfd, bind_addr.get_sockaddr_in()))){
+	if (!(socket_api::bind(sfd, bind_addr.get_sockaddr(), bind_addr.get_sockaddr_len()))){
 		CY_LOG(L_ERROR, "bind to address %s:%d failed", bind_addr.get_ip(), bind_addr.get_port());
 		socket_api::close_socket(sfd);
 		return false;
 	}
 
+	//the socket file should be removed when the server stop(abstract socket has no file)
+	if (bind_addr.is_unix() && bind_addr.get_ip()[0] != '@' && bind_addr.get_ip()[0] != 0) {
+		m_unix_socket_paths.push_back(bind_addr.get_ip());
+	}
+
 	CY_LOG(L_TRACE, "bind to address %s:%d ok", bind_addr.get_ip(), bind_addr.get_port());
 	m_acceptor_sockets.push_back(std::make_tuple(sfd, Looper::INVALID_EVENT_ID));
+	m_socket_options.push_back(socket_options);
+	m_rate_limits.push_back(RateLimit());
+	m_port_listeners.push_back(nullptr);
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+const SocketOptions& TcpServer::get_socket_options(size_t index) const
+{
+	static const SocketOptions default_options;
+	return index < m_socket_options.size() ? m_socket_options[index] : default_options;
+}
+
+//-------------------------------------------------------------------------------------
+bool TcpServer::set_rate_limit(size_t index, const RateLimit& limit)
+{
+	if (index >= m_rate_limits.size()) return false;
+
+	m_rate_limits[index] = limit;
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+const RateLimit& TcpServer::get_rate_limit(size_t index) const
+{
+	static const RateLimit unlimited;
+	return index < m_rate_limits.size() ? m_rate_limits[index] : unlimited;
+}
+
+//-------------------------------------------------------------------------------------
+bool TcpServer::set_port_listener(size_t index, const Listener& listener)
+{
+	//is running already? the work threads read the listeners without lock
+	if (m_running > 0 || index >= m_port_listeners.size()) return false;
+
+	m_port_listeners[index] = std::make_shared<Listener>(listener);
 	return true;
 }
 
+//-------------------------------------------------------------------------------------
+const TcpServer::Listener& TcpServer::_get_port_listener(int32_t listen_index) const
+{
+	if (listen_index < 0 || (size_t)listen_index >= m_port_listeners.size() || !m_port_listeners[(size_t)listen_index]) {
+		return m_listener;
+	}
+	return *(m_port_listeners[(size_t)listen_index]);
+}
+
+//-------------------------------------------------------------------------------------
+int32_t TcpServer::_get_listen_index(socket_t listen_fd) const
+{
+	for (size_t i = 0; i < m_acceptor_sockets.size(); i++) {
+		if (std::get<0>(m_acceptor_sockets[i]) == listen_fd) return (int32_t)i;
+	}
+	return -1;
+}
+
 //-------------------------------------------------------------------------------------
 bool TcpServer::start(int32_t work_thread_counts)
 {
@@ -98,6 +254,13 @@ bool TcpServer::start(int32_t work_thread_counts)
 	//is running already?
 	if (m_running.exchange(1) > 0) return false;
 
+	//work threads will wait on the listen socket directly
+	if (m_accept_mode == kSharedListener) {
+		for (auto& listen_socket : m_acceptor_sockets) {
+			socket_api::listen(std::get<0>(listen_socket), m_listen_backlog);
+		}
+	}
+
 	//start work thread pool
 	m_work_thread_counts = work_thread_counts;
 	for (int32_t i = 0; i < m_work_thread_counts; i++) {
@@ -125,10 +288,11 @@ Address TcpServer::get_bind_address(size_t index)
 	Address address;
 	if (index >= m_acceptor_sockets.size()) return address;
 
-	sockaddr_in addr;
-	socket_api::getsockname(std::get<0>(m_acceptor_sockets[index]), addr);
+	sockaddr_storage addr;
+	socklen_t addr_len;
+	if (!socket_api::getsockname(std::get<0>(m_acceptor_sockets[index]), addr, addr_len)) return address;
 
-	return Address(addr);
+	return Address((const struct sockaddr*)&addr, addr_len);
 }
 
 //-------------------------------------------------------------------------------------
@@ -141,6 +305,15 @@ void TcpServer::stop_listen(size_t index)
 	StopListenCmd cmd;
 	cmd.index = index;
 	m_accept_thread.send_message(StopListenCmd::ID, sizeof(cmd), (const char*)&cmd);
+
+	//close the listen socket in work threads
+	if (m_accept_mode != kAcceptThread) {
+		ServerWorkThread::StopListenCmd workCmd;
+		workCmd.index = index;
+		for (auto work : m_work_thread_pool) {
+			work->send_message(ServerWorkThread::StopListenCmd::ID, sizeof(workCmd), (const char*)&workCmd);
+		}
+	}
 }
 
 //-------------------------------------------------------------------------------------
@@ -178,30 +351,279 @@ void TcpServer::_on_accept_event(Looper::event_id_t id, socket_t fd, Looper::eve
 	//is shutdown in processing?		
 	if (m_shutdown_ing.load() > 0) return;
 
-	//call accept and create peer socket		
-	socket_t connfd = socket_api::accept(fd, 0);
-	if (connfd == INVALID_SOCKET)
+	typedef ServerWorkThread::NewConnectionCmd NewConnectionCmd;
+	int32_t listen_index = _get_listen_index(fd);
+
+	//drain the accept queue, until it's empty or the batch is full
+	int32_t accept_counts = 0;
+	while (accept_counts < NewConnectionCmd::MAX_SOCKET_COUNTS)
+	{
+		//call accept and create peer socket
+		sockaddr_storage peer_addr;
+		socklen_t peer_addr_len;
+		socket_t connfd = socket_api::accept_nonblock(fd, &peer_addr, &peer_addr_len);
+		if (connfd == INVALID_SOCKET)
+		{
+			if (!socket_api::is_lasterror_WOULDBLOCK()) _on_accept_error(fd, m_spare_socket);
+			break;
+		}
+		accept_counts++;
+
+		//dispatch it to one of work thread
+		int32_t index = _select_work_thread(peer_addr);
+		NewConnectionCmd& cmd = m_work_thread_pool[(size_t)index]->get_accept_batch();
+		cmd.conn[cmd.counts].sfd = connfd;
+		memcpy(&(cmd.conn[cmd.counts].peer_addr), &peer_addr, (size_t)peer_addr_len);
+		cmd.conn[cmd.counts].peer_addr_len = peer_addr_len;
+		cmd.conn[cmd.counts].listen_index = listen_index;
+		cmd.counts++;
+	}
+
+	//send to work threads, one message for each work thread
+	for (int32_t i = 0; i < m_work_thread_counts && accept_counts > 0; i++) {
+		ServerWorkThread* work = m_work_thread_pool[(size_t)i];
+		NewConnectionCmd& cmd = work->get_accept_batch();
+		if (cmd.counts == 0) continue;
+
+		work->send_message(NewConnectionCmd::ID, cmd.get_size(), (const char*)&cmd);
+		CY_LOG(L_TRACE, "accept %d socket(s), send to work thread %d ", cmd.counts, i);
+		cmd.counts = 0;
+	}
+
+	//the new connections may have been dropped by kernel already
+	_check_accept_queue(fd, accept_counts);
+	_on_accept_batch(accept_counts);
+}
+
+//-------------------------------------------------------------------------------------
+int32_t TcpServer::_select_work_thread(const struct sockaddr_storage& peer_addr)
+{
+	//connection counts include the pending one(s)
+	auto _load = [this](int32_t index) -> int32_t {
+		ServerWorkThread* work = m_work_thread_pool[(size_t)index];
+		return work->get_connection_counts() + work->get_accept_batch().counts;
+	};
+
+	switch (m_placement_policy) {
+	case kLeastConnections:
+	{
+		int32_t best = 0;
+		for (int32_t i = 1; i < m_work_thread_counts; i++) {
+			if (_load(i) < _load(best)) best = i;
+		}
+		return best;
+	}
+
+	case kLeastBusy:
 	{
-		//log error		
-		CY_LOG(L_ERROR, "accept socket error");
+		//the busy time expected after the new connection placed, every connection(include the pending
+		//ones) costs the average busy time of the work thread, and kMinConnectionCost at least, so the
+		//idle work threads are compared by connection counts
+		auto _score = [this, &_load](int32_t index) -> uint64_t {
+			uint64_t connections = (uint64_t)std::max(m_work_thread_pool[(size_t)index]->get_connection_counts(), 1);
+			uint64_t cost = std::max(m_recent_busy_time[index] / connections, (uint64_t)kMinConnectionCost);
+			return cost * (uint64_t)(_load(index) + 1);
+		};
+
+		int32_t best = 0;
+		uint64_t best_score = _score(0);
+		for (int32_t i = 1; i < m_work_thread_counts; i++) {
+			uint64_t score = _score(i);
+			if (score < best_score) {
+				best = i;
+				best_score = score;
+			}
+		}
+		return best;
+	}
+
+	case kPowerOfTwo:
+	{
+		//xorshift32
+		m_random_seed ^= m_random_seed << 13;
+		m_random_seed ^= m_random_seed >> 17;
+		m_random_seed ^= m_random_seed << 5;
+
+		if (m_work_thread_counts == 1) return 0;
+
+		//the second one is chosen from the other work threads
+		int32_t first = (int32_t)(m_random_seed % (uint32_t)m_work_thread_counts);
+		int32_t second = (first + 1 + (int32_t)((m_random_seed >> 16) % (uint32_t)(m_work_thread_counts - 1))) % m_work_thread_counts;
+		return (_load(second) < _load(first)) ? second : first;
+	}
+
+	case kPeerHash:
+	{
+		//Knuth's multiplicative hash, fold ipv6 address to 32 bits
+		uint32_t ip = 0;
+		if (peer_addr.ss_family == AF_INET) {
+			ip = socket_api::ntoh_32((uint32_t)((const struct sockaddr_in*)&peer_addr)->sin_addr.s_addr);
+		}
+		else if (peer_addr.ss_family == AF_INET6) {
+			uint32_t words[4];
+			memcpy(words, &(((const struct sockaddr_in6*)&peer_addr)->sin6_addr), sizeof(words));
+			ip = words[0] ^ words[1] ^ words[2] ^ words[3];
+		}
+		else {
+			//unix domain socket peer has no address
+			return _get_next_work_thread();
+		}
+		return (int32_t)((ip * 2654435761u) % (uint32_t)m_work_thread_counts);
+	}
+
+	default:
+		return _get_next_work_thread();
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void TcpServer::_update_busy_sample(void)
+{
+	for (int32_t i = 0; i < m_work_thread_counts; i++) {
+		uint64_t busy_time = m_work_thread_pool[(size_t)i]->get_busy_time();
+		m_recent_busy_time[i] = busy_time - m_busy_time_snapshot[i];
+		m_busy_time_snapshot[i] = busy_time;
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void TcpServer::_on_rebalance_timer(void)
+{
+	if (m_shutdown_ing.load() > 0) return;
+
+	//busy time since last check, the sample of placement policy has a shorter period
+	uint64_t recent_busy_time[MAX_WORK_THREAD_COUNTS];
+	for (int32_t i = 0; i < m_work_thread_counts; i++) {
+		uint64_t busy_time = m_work_thread_pool[(size_t)i]->get_busy_time();
+		recent_busy_time[i] = busy_time - m_rebalance_busy_snapshot[i];
+		m_rebalance_busy_snapshot[i] = busy_time;
+	}
+
+	int32_t busiest = 0, idlest = 0;
+	for (int32_t i = 1; i < m_work_thread_counts; i++) {
+		if (recent_busy_time[i] > recent_busy_time[busiest]) busiest = i;
+		if (recent_busy_time[i] < recent_busy_time[idlest]) idlest = i;
+	}
+
+	//the busiest work thread should be busy enough(10% of the period at least), and 
+	//at least twice as busy as the idlest one
+	uint64_t busy_threshold = (uint64_t)m_rebalance_period * 1000 / 10;
+	if (busiest == idlest || recent_busy_time[busiest] < busy_threshold ||
+		recent_busy_time[busiest] < recent_busy_time[idlest] * 2) return;
+
+	ServerWorkThread::RebalanceCmd rebalanceCmd;
+	rebalanceCmd.target_index = idlest;
+	m_work_thread_pool[(size_t)busiest]->send_message(ServerWorkThread::RebalanceCmd::ID, sizeof(rebalanceCmd), (const char*)&rebalanceCmd);
+}
+
+//-------------------------------------------------------------------------------------
+void TcpServer::_on_accept_error(socket_t listen_fd, socket_t& spare_socket)
+{
+	int err = socket_api::get_lasterror();
+	m_accept_error_counts++;
+
+#ifndef CY_SYS_WINDOWS
+	if (err == EMFILE || err == ENFILE) {
+		//the listen socket is still readable, drop the pending connection with the spare fd,
+		//otherwise the loop is waked up again and again
+		if (spare_socket != INVALID_SOCKET) {
+			socket_api::close_socket(spare_socket);
+			socket_t sfd = socket_api::accept_nonblock(listen_fd, nullptr, nullptr);
+			if (sfd != INVALID_SOCKET) socket_api::close_socket(sfd);
+			spare_socket = socket_api::create_socket();
+		}
+		CY_LOG(L_ERROR, "accept socket error, too many open files, the connection is dropped, err=%d", err);
 		return;
 	}
+#else
+	(void)listen_fd;
+	(void)spare_socket;
+#endif
+	CY_LOG(L_ERROR, "accept socket error, err=%d", err);
+}
+
+//-------------------------------------------------------------------------------------
+void TcpServer::_check_accept_queue(socket_t listen_fd, int32_t accept_counts)
+{
+	//the queue can't be full if fewer connections than the backlog were waiting, skip the syscall
+	if (accept_counts < ServerWorkThread::NewConnectionCmd::MAX_SOCKET_COUNTS && accept_counts < m_listen_backlog) return;
+
+	//the queue length before this batch drained
+	uint32_t queue_len, max_len;
+	if (!socket_api::get_accept_queue_len(listen_fd, queue_len, max_len)) return;
+	queue_len += (uint32_t)accept_counts;
+
+	if (queue_len >= max_len) {
+		m_accept_queue_full_counts++;
+		CY_LOG(L_WARN, "accept queue is full(%u/%u), the new connection may be dropped", queue_len, max_len);
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void TcpServer::_on_accept_batch(int32_t accept_counts)
+{
+	uint32_t max_batch = m_max_accept_batch.load();
+	while ((uint32_t)accept_counts > max_batch && !m_max_accept_batch.compare_exchange_weak(max_batch, (uint32_t)accept_counts)) {}
+}
+
+//-------------------------------------------------------------------------------------
+void TcpServer::_debug_accept(void)
+{
+	if (!m_debuger || !(m_debuger->isEnable())) return;
+
+	char key_temp[MAX_PATH] = { 0 };
+
+	std::snprintf(key_temp, MAX_PATH, "TcpServer:%s:listen_backlog", m_name.c_str());
+	m_debuger->updateDebugValue(key_temp, m_listen_backlog);
+
+	std::snprintf(key_temp, MAX_PATH, "TcpServer:%s:accept_queue_full_counts", m_name.c_str());
+	m_debuger->updateDebugValue(key_temp, (int32_t)m_accept_queue_full_counts.load());
+
+	std::snprintf(key_temp, MAX_PATH, "TcpServer:%s:accept_error_counts", m_name.c_str());
+	m_debuger->updateDebugValue(key_temp, (int32_t)m_accept_error_counts.load());
+
+	//placement policy and the imbalance(max-min) of connection counts between work threads
+	int32_t max_counts = 0, min_counts = 0;
+	for (int32_t i = 0; i < m_work_thread_counts; i++) {
+		int32_t counts = get_connection_counts(i);
+		if (i == 0 || counts > max_counts) max_counts = counts;
+		if (i == 0 || counts < min_counts) min_counts = counts;
+	}
 
-	//send it to one of work thread		
-	int32_t index = _get_next_work_thread();
-	ServerWorkThread* work = m_work_thread_pool[(size_t)index];
-	
-	//write new connection command(cmd, socket_t)		
-	ServerWorkThread::NewConnectionCmd newConnectionCmd;
-	newConnectionCmd.sfd = connfd;
-	work->send_message(ServerWorkThread::NewConnectionCmd::ID, sizeof(newConnectionCmd), (const char*)&newConnectionCmd);
+	std::snprintf(key_temp, MAX_PATH, "TcpServer:%s:placement_policy", m_name.c_str());
+	m_debuger->updateDebugValue(key_temp, (int32_t)m_placement_policy);
 
-	CY_LOG(L_TRACE, "accept a socket, send to work thread %d ", index);
+	std::snprintf(key_temp, MAX_PATH, "TcpServer:%s:connection_imbalance", m_name.c_str());
+	m_debuger->updateDebugValue(key_temp, max_counts - min_counts);
 }
 
 //-------------------------------------------------------------------------------------
 bool TcpServer::_on_accept_start(void)
 {
+	//auto rebalance timer
+	if (m_rebalance_period > 0 && m_work_thread_counts > 1) {
+		m_rebalance_timer = m_accept_thread.get_looper()->register_timer_event(m_rebalance_period, this,
+			[this](Looper::event_id_t, void*) {
+			_on_rebalance_timer();
+		});
+	}
+
+	//the connections are accepted in work threads
+	if (m_accept_mode != kAcceptThread) {
+		CY_LOG(L_TRACE, "accept thread run, accept in work thread mode(%d)", m_accept_mode);
+		return true;
+	}
+
+	//sample the busy time of work threads for placement
+	if (m_placement_policy == kLeastBusy && m_work_thread_counts > 1) {
+		m_busy_sample_timer = m_accept_thread.get_looper()->register_timer_event(kBusySamplePeriod, this,
+			[this](Looper::event_id_t, void*) {
+			_update_busy_sample();
+		});
+	}
+
+	m_spare_socket = socket_api::create_socket();
+
 	int32_t counts = 0;
 	for (auto& listen_socket : m_acceptor_sockets)
 	{
@@ -216,7 +638,7 @@ bool TcpServer::_on_accept_start(void)
 			0);
 
 		//begin listen
-		socket_api::listen(sfd);
+		socket_api::listen(sfd, m_listen_backlog);
 		counts++;
 	}
 
@@ -234,6 +656,18 @@ void TcpServer::_on_accept_message(Packet* message)
 	if (msg_id == ShutdownCmd::ID) {
 		Looper* looper = m_accept_thread.get_looper();
 
+		//stop rebalance timer
+		if (m_rebalance_timer != Looper::INVALID_EVENT_ID) {
+			looper->disable_all(m_rebalance_timer);
+			looper->delete_event(m_rebalance_timer);
+			m_rebalance_timer = Looper::INVALID_EVENT_ID;
+		}
+		if (m_busy_sample_timer != Looper::INVALID_EVENT_ID) {
+			looper->disable_all(m_busy_sample_timer);
+			looper->delete_event(m_busy_sample_timer);
+			m_busy_sample_timer = Looper::INVALID_EVENT_ID;
+		}
+
 		//close all listen socket(s)
 		for (auto listen_socket : m_acceptor_sockets){
 			auto& sfd = std::get<0>(listen_socket);
@@ -251,11 +685,24 @@ void TcpServer::_on_accept_message(Packet* message)
 		}
 		m_acceptor_sockets.clear();
 
+		if (m_spare_socket != INVALID_SOCKET) {
+			socket_api::close_socket(m_spare_socket);
+			m_spare_socket = INVALID_SOCKET;
+		}
+
+		//remove unix domain socket file(s)
+#ifdef CY_HAVE_SYS_UN_H
+		for (auto& path : m_unix_socket_paths) {
+			::unlink(path.c_str());
+		}
+#endif
+		m_unix_socket_paths.clear();
+
 		//stop looper
 		looper->push_stop_request();
 	}
 	else if (msg_id == DebugCmd::ID) {
-		//TODO: debug accept thread
+		_debug_accept();
 	}
 	else if (msg_id == StopListenCmd::ID) {
 		assert(message->get_packet_size() == sizeof(StopListenCmd));
@@ -302,6 +749,9 @@ void TcpServer::join(void)
 //-------------------------------------------------------------------------------------
 void TcpServer::shutdown_connection(ConnectionPtr conn)
 {
+	//the connection may be moving, the close request is kept on the connection, and the new work
+	//thread closes it after attached(the param is read after the mark, then the id)
+	ServerWorkThread::request_close(conn);
 	ServerWorkThread* work = (ServerWorkThread*)(conn->get_param());
 
 	ServerWorkThread::CloseConnectionCmd closeConnectionCmd;
@@ -310,6 +760,131 @@ void TcpServer::shutdown_connection(ConnectionPtr conn)
 	work->send_message(ServerWorkThread::CloseConnectionCmd::ID, sizeof(closeConnectionCmd), (const char*)&closeConnectionCmd);
 }
 
+//-------------------------------------------------------------------------------------
+void TcpServer::migrate_connection(ConnectionPtr conn, int32_t target_index)
+{
+	assert(target_index >= 0 && target_index < m_work_thread_counts);
+	ServerWorkThread* work = (ServerWorkThread*)(conn->get_param());
+	if (work == nullptr || work->get_index() == target_index) return;
+
+	ServerWorkThread::MigrateConnectionCmd migrateCmd;
+	migrateCmd.conn_id = conn->get_id();
+	migrateCmd.target_index = target_index;
+	work->send_message(ServerWorkThread::MigrateConnectionCmd::ID, sizeof(migrateCmd), (const char*)&migrateCmd);
+}
+
+//-------------------------------------------------------------------------------------
+bool TcpServer::join_group(ConnectionPtr conn, int32_t group_id)
+{
+	ServerWorkThread* work = (ServerWorkThread*)(conn->get_param());
+	if (work == nullptr) return false;
+
+	return work->join_group(conn, group_id);
+}
+
+//-------------------------------------------------------------------------------------
+bool TcpServer::leave_group(ConnectionPtr conn, int32_t group_id)
+{
+	ServerWorkThread* work = (ServerWorkThread*)(conn->get_param());
+	if (work == nullptr) return false;
+
+	return work->leave_group(conn, group_id);
+}
+
+//-------------------------------------------------------------------------------------
+void TcpServer::publish(int32_t group_id, const char* buf, size_t len)
+{
+	if (buf == nullptr || len == 0 || m_work_thread_pool.empty()) return;
+
+	//one copy of payload for all other work threads
+	std::shared_ptr<std::string> payload;
+
+	for (auto work : m_work_thread_pool) {
+		if (work->is_in_workthread()) {
+			work->publish(group_id, buf, len);
+			continue;
+		}
+
+		if (!payload) payload = std::make_shared<std::string>(buf, len);
+		work->post_task([work, group_id, payload]() {
+			work->publish(group_id, payload->c_str(), payload->size());
+		});
+	}
+}
+
+//-------------------------------------------------------------------------------------
+bool TcpServer::stats_snapshot(StatsSnapshot& snapshot, bool with_connections, uint32_t timeout_ms)
+{
+	snapshot.io = ConnectionStats();
+	snapshot.work_threads.clear();
+	if (m_work_thread_pool.empty()) return true;
+
+	typedef ServerWorkThread::StatsRequest StatsRequest;
+	std::shared_ptr<StatsRequest> request = std::make_shared<StatsRequest>(m_work_thread_counts, with_connections);
+
+	for (auto work : m_work_thread_pool) {
+		if (work->is_in_workthread()) {
+			work->fill_stats(*request);
+			continue;
+		}
+
+		//the request is shared by all work threads and the caller
+		work->post_task([work, request]() {
+			work->fill_stats(*request);
+		});
+	}
+
+	//the request is kept by the work threads which answer late
+	bool all_answered = sys_api::signal_timewait(request->done, timeout_ms);
+
+	sys_api::auto_mutex lock(request->lock);
+	for (size_t i = 0; i < request->work_threads.size(); i++) {
+		if (!request->answered[i]) {
+			all_answered = false;
+			continue;
+		}
+		snapshot.io.add(request->work_threads[i].io);
+		snapshot.work_threads.push_back(std::move(request->work_threads[i]));
+	}
+	return all_answered;
+}
+
+//-------------------------------------------------------------------------------------
+void TcpServer::stats_snapshot(Looper* looper, StatsCallback callback, bool with_connections)
+{
+	assert(looper && callback);
+
+	if (m_work_thread_pool.empty()) {
+		looper->post([callback]() {
+			StatsSnapshot snapshot;
+			callback(snapshot);
+		});
+		return;
+	}
+
+	//the last work thread answered posts the callback
+	typedef ServerWorkThread::StatsRequest StatsRequest;
+	std::shared_ptr<StatsRequest> request = std::make_shared<StatsRequest>(m_work_thread_counts, with_connections);
+	request->reply_looper = looper;
+	request->callback = callback;
+
+	for (auto work : m_work_thread_pool) {
+		//the request is shared by all work threads and the caller
+		work->post_task([work, request]() {
+			work->fill_stats(*request);
+		});
+	}
+}
+
+//-------------------------------------------------------------------------------------
+int32_t TcpServer::get_group_size(int32_t work_thread_index, int32_t group_id)
+{
+	assert(work_thread_index >= 0 && work_thread_index < m_work_thread_counts);
+	ServerWorkThread* work = m_work_thread_pool[(size_t)work_thread_index];
+
+	return work->get_group_size(group_id);
+}
+
 //-------------------------------------------------------------------------------------
 void TcpServer::send_work_message(int32_t work_thread_index, const Packet* message)
 {
@@ -328,6 +903,13 @@ void TcpServer::send_work_message(int32_t work_thread_index, const Packet** mess
 	work->send_message(message, counts);
 }
 
+//-------------------------------------------------------------------------------------
+int32_t TcpServer::get_work_thread_index(int32_t conn_id)
+{
+	typedef ServerWorkThread::ConnectionMap ConnectionMap;
+	return (int32_t)(((uint32_t)conn_id >> ConnectionMap::kSlotBits) & (ConnectionMap::kMaxTags - 1));
+}
+
 //-------------------------------------------------------------------------------------
 ConnectionPtr TcpServer::get_connection(int32_t work_thread_index, int32_t conn_id)
 {
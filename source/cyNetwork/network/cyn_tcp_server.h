@@ -7,6 +7,7 @@ Copyright(C) thecodeway.com
 #include <cy_core.h>
 #include <cy_event.h>
 #include "cyn_connection.h"
+#include "cyn_socket_options.h"
 
 namespace cyclone
 {
@@ -21,19 +22,135 @@ public:
 	typedef std::function<void(TcpServer* server, int32_t thread_index, Packet* cmd)> WorkThreadCommandCallback;
 	typedef std::function<void(TcpServer* server, int32_t thread_index, ConnectionPtr conn)> EventCallback;
 
+	//the reason of connection timeout
+	enum TimeoutType {
+		kIdleTimeout = 0,	//nothing read or written
+		kReadTimeout,		//nothing read
+		kWriteTimeout,		//there is data wait to send, but the socket can't be written(also after shutdown, the output is dropped and closed without onTimeout)
+
+		kTimeoutTypeCounts
+	};
+	typedef std::function<void(TcpServer* server, int32_t thread_index, ConnectionPtr conn, TimeoutType type)> TimeoutCallback;
+
 	struct Listener {
 		WorkThreadStartCallback onWorkThreadStart;
 		WorkThreadCommandCallback onWorkThreadCommand;
 		EventCallback onConnected;
 		EventCallback onMessage;
 		EventCallback onClose;
+		TimeoutCallback onTimeout;	//if it's not set, the connection will be shutdown(the output is dropped if write timeout)
 	};
 
 	Listener m_listener;
+
+	enum AcceptMode {
+		kAcceptThread = 0,	//one accept thread accept all connections, and dispatch them to work threads
+		kReusePort,			//every work thread listen on its own SO_REUSEPORT socket and accept directly
+		kSharedListener,	//all work threads wait on the same listen socket(EPOLLEXCLUSIVE) and accept directly
+	};
+
+	//statistics of one live connection
+	struct ConnectionStatsEntry {
+		int32_t conn_id;
+		Address peer_addr;
+		ConnectionStats stats;
+	};
+
+	//statistics of one work thread, the i/o counters of the connections closed in this work thread
+	//are counted in, a moved connection takes its counters to the new work thread
+	struct WorkThreadStats {
+		int32_t index;
+		int32_t connection_counts;
+		uint64_t busy_time;			//total busy time of the looper, in microseconds
+		ConnectionStats io;
+		std::vector<ConnectionStatsEntry> connections;	//empty if not required
+	};
+
+	struct StatsSnapshot {
+		ConnectionStats io;			//all work threads
+		std::vector<WorkThreadStats> work_threads;
+	};
+	typedef std::function<void(StatsSnapshot& snapshot)> StatsCallback;
+
+	//how the accept thread choose the work thread for a new connection(kAcceptThread mode only)
+	enum PlacementPolicy {
+		kRoundRobin = 0,	//one by one
+		kLeastConnections,	//the work thread which has the fewest live connections
+		kLeastBusy,			//the work thread expected to be least busy, counts the recent busy time and connections
+		kPowerOfTwo,		//pick two different work threads randomly, and choose the one with fewer connections
+		kPeerHash,			//hash of peer ip address, connections from the same host go to the same work thread
+	};
 public:
+	/// set accept mode, return false if the mode is not supported in current platform
+	// NOT thread safe, and this function must be called before bind any port
+	bool set_accept_mode(AcceptMode mode);
+
+	/// get accept mode
+	AcceptMode get_accept_mode(void) const { return m_accept_mode; }
+
+	/// set the backlog of listen socket(s), default is SOMAXCONN
+	// NOT thread safe, and this function must be called before start the server
+	bool set_listen_backlog(int32_t backlog);
+
+	/// get the backlog of listen socket(s)
+	int32_t get_listen_backlog(void) const { return m_listen_backlog; }
+
+	/// set the placement policy of new connection, default is kRoundRobin
+	// NOT thread safe, and this function must be called before start the server
+	bool set_placement_policy(PlacementPolicy policy);
+
+	/// get the placement policy
+	PlacementPolicy get_placement_policy(void) const { return m_placement_policy; }
+
+	/// get live connection counts of one work thread(thread safe)
+	int32_t get_connection_counts(int32_t work_thread_index) const;
+
+	/// enable auto rebalance, check the load of work threads every period, and move the hot 
+	/// connection from the busiest work thread to the idlest one, 0 means disable(default)
+	// NOT thread safe, and this function must be called before start the server
+	bool set_auto_rebalance(uint32_t period_ms);
+
+	/// set timeout of connections, 0 means disable(default). the timeouts are checked by a timing 
+	/// wheel in every work thread, the precision is about 1/8 of the shortest timeout(10ms-1s)
+	// NOT thread safe, and this function must be called before start the server
+	bool set_timeout(TimeoutType type, uint32_t milli_seconds);
+
+	/// get timeout of connections, in milliseconds
+	uint32_t get_timeout(TimeoutType type) const { return (type >= 0 && type < kTimeoutTypeCounts) ? m_timeouts[type] : 0; }
+
+	/// get counts of accept queue was found full(the new connection may be dropped by kernel), the queue
+	/// is checked only when one wake up drained a full batch or as many connections as the backlog
+	uint32_t get_accept_queue_full_counts(void) const { return m_accept_queue_full_counts.load(); }
+
+	/// get counts of accept failed(EMFILE, ENFILE...)
+	uint32_t get_accept_error_counts(void) const { return m_accept_error_counts.load(); }
+
+	/// get the max counts of connections accepted in one wake up
+	uint32_t get_max_accept_batch(void) const { return m_max_accept_batch.load(); }
+
 	/// add a bind port, return false means too much port has been binded or bind failed
+	/// the address can be ipv4, ipv6 or unix domain socket(the socket file will be removed when the server stop,
+	/// unix domain socket can't be used in kReusePort mode). the socket options are applied to the listen
+	/// socket and the connections accepted from it(the options are ignored for unix domain socket)
 	// NOT thread safe, and this function must be called before start the server
-	bool bind(const Address& bind_addr, bool enable_reuse_port);
+	bool bind(const Address& bind_addr, bool enable_reuse_port, const SocketOptions& options = SocketOptions());
+
+	/// get socket options of the bind port, if index is invalid return default options
+	const SocketOptions& get_socket_options(size_t index) const;
+
+	/// set the rate limit of the connections accepted from the bind port, the connection can change
+	/// it by Connection::set_rate_limit in onConnected callback
+	// NOT thread safe, and this function must be called after bind and before start the server
+	bool set_rate_limit(size_t index, const RateLimit& limit);
+
+	/// get rate limit of the bind port, if index is invalid return unlimited
+	const RateLimit& get_rate_limit(size_t index) const;
+
+	/// set the listener of the connections accepted from the bind port, the connection callbacks
+	/// (onConnected, onMessage, onClose and onTimeout) are taken from it instead of m_listener,
+	/// the work thread callbacks are always taken from m_listener
+	// NOT thread safe, and this function must be called after bind and before start the server
+	bool set_port_listener(size_t index, const Listener& listener);
 
 	/// start the server(start one accept thread and n workthreads)
 	/// (thread safe, but you wouldn't want call it again...)
@@ -49,9 +166,37 @@ public:
 	/// shutdown one of connection(thread safe)
 	void shutdown_connection(ConnectionPtr conn);
 
+	/// move a connection to another work thread, the data in read/write buf and the callbacks are
+	/// kept, onMessage will be called in the new work thread if there is data left in input buf(thread safe)
+	// the connection should not be touched in the old work thread after it's moved, 
+	// a shutdown_connection request during the moving is done after it's attached to the new work thread
+	// the connection forwarding data with another one(Connection::forward_to), or linked with another
+	// one by watermark(Connection::link_source) is never moved
+	void migrate_connection(ConnectionPtr conn, int32_t target_index);
+
+	/// join a group, the data published to the group is sent to all members in all work threads,
+	/// the connection leaves all groups when it's closed, return false if it's in the group already
+	// (NOT thread safe, MUST call in the work thread of the connection)
+	bool join_group(ConnectionPtr conn, int32_t group_id);
+
+	/// leave a group, return false if the connection is not in the group
+	// (NOT thread safe, MUST call in the work thread of the connection)
+	bool leave_group(ConnectionPtr conn, int32_t group_id);
+
+	/// send data to all members of the group, the data is copied once and handed to every work thread
+	/// by one message, then sent to the members in that work thread(thread safe)
+	// if it's called in a work thread, the members in this work thread are sent at once
+	void publish(int32_t group_id, const char* buf, size_t len);
+
+	/// get member counts of the group in one work thread(NOT thread safe, MUST call in the work thread)
+	int32_t get_group_size(int32_t work_thread_index, int32_t group_id);
+
 	/// get bind address, if index is invalid return default Address value
 	Address get_bind_address(size_t index);
 
+	/// get counts of bind ports, the index of the port which is binded last is counts-1
+	size_t get_bind_counts(void) const { return m_acceptor_sockets.size(); }
+
 	/// stop listen binded port(thread safe, after start the server)
 	void stop_listen(size_t index);
 
@@ -61,13 +206,28 @@ public:
 
 	/// get connection (NOT thread safe, MUST call in the work thread)
 	ConnectionPtr get_connection(int32_t work_thread_index, int32_t conn_id);
+	/// get index of the work thread which the connection id belongs to, the id has the index as tag,
+	/// so it's unique in the server(the id of a connection is changed when it's moved to other work thread)
+	static int32_t get_work_thread_index(int32_t conn_id);
 
 	/// get work thread counts
 	int32_t get_work_thread_counts(void) const { return m_work_thread_counts; }
 
-	int32_t get_next_connection_id(void) {
-		return m_next_connection_id++;
-	}
+	/// collect the statistics of all work threads, every work thread fills its own part in its loop 
+	/// like a normal message, so the loops are not stopped. the stats of every live connection are 
+	/// collected if with_connections is true. return false if some work thread doesn't answer in time, 
+	/// the answered ones are still in the snapshot
+	// (thread safe, the part of current work thread is filled at once if it's called in a work thread)
+	bool stats_snapshot(StatsSnapshot& snapshot, bool with_connections = false, uint32_t timeout_ms = 1000);
+
+	/// collect the statistics like above without waiting, the callback is posted to the looper after 
+	/// all work threads answered. the looper must live until then, a work thread looper of this server 
+	/// is always safe, the callback is dropped if the server is stopped before all work threads answer
+	// (thread safe)
+	void stats_snapshot(Looper* looper, StatsCallback callback, bool with_connections = false);
+
+	/// get the name of server
+	const char* get_name(void) const { return m_name.c_str(); }
 
 	/// print debug variable to debuger cache system
 	void debug(void);
@@ -78,7 +238,18 @@ private:
 	typedef std::vector< ServerWorkThread* > ServerWorkThreadArray;
 
 	SocketVector	m_acceptor_sockets;
+	std::vector<SocketOptions> m_socket_options;	//options of acceptor sockets, same index
+	std::vector<RateLimit> m_rate_limits;			//rate limit of accepted connections, same index
+	std::vector< std::shared_ptr<Listener> > m_port_listeners;	//nullptr means m_listener, same index
+	std::vector<std::string> m_unix_socket_paths;
 	WorkThread		m_accept_thread;
+	AcceptMode		m_accept_mode;
+	int32_t			m_listen_backlog;
+
+	atomic_uint32_t	m_accept_queue_full_counts;
+	atomic_uint32_t	m_accept_error_counts;
+	atomic_uint32_t	m_max_accept_batch;
+	socket_t		m_spare_socket;		//reserved fd of accept thread, see _on_accept_error
 
 	ServerWorkThreadArray	m_work_thread_pool;
 	int32_t			m_work_thread_counts;
@@ -88,11 +259,32 @@ private:
 		return (m_next_work++) % m_work_thread_counts;
 	}
 
+	//placement policy(accept thread only), the busy time is sampled by timer in kLeastBusy policy
+	enum { kBusySamplePeriod = 100 /*ms*/, kMinConnectionCost = 100 /*us*/ };
+	PlacementPolicy	m_placement_policy;
+	uint32_t		m_random_seed;
+	Looper::event_id_t m_busy_sample_timer;
+	uint64_t		m_busy_time_snapshot[MAX_WORK_THREAD_COUNTS];
+	uint64_t		m_recent_busy_time[MAX_WORK_THREAD_COUNTS];
+
+	/// choose work thread for the new connection, the connections in the accept batch of work 
+	/// thread have been dispatched but not be created in work thread yet
+	int32_t _select_work_thread(const struct sockaddr_storage& peer_addr);
+	void _update_busy_sample(void);
+
+	//auto rebalance(accept thread only)
+	uint32_t		m_rebalance_period;
+	Looper::event_id_t m_rebalance_timer;
+	uint64_t		m_rebalance_busy_snapshot[MAX_WORK_THREAD_COUNTS];
+
+	void _on_rebalance_timer(void);
+
+	//connection timeouts, in milliseconds
+	uint32_t		m_timeouts[kTimeoutTypeCounts];
+
 	atomic_int32_t m_running;
 	atomic_int32_t m_shutdown_ing;
 
-	atomic_int32_t m_next_connection_id;
-
 	std::string	m_name;
 
 	DebugInterface*	m_debuger;
@@ -125,6 +317,22 @@ private:
 	/// on acception callback function
 	void _on_accept_event(Looper::event_id_t id, socket_t fd, Looper::event_t event);
 
+	/// get the index of listen socket, -1 if not found
+	int32_t _get_listen_index(socket_t listen_fd) const;
+
+	/// get the listener of the connections accepted from the bind port
+	const Listener& _get_port_listener(int32_t listen_index) const;
+
+	/// accept error and accept queue overflow statistics, when the fds run out, the spare socket is
+	/// closed to accept and drop the pending connection, then reserved again
+	void _on_accept_error(socket_t listen_fd, socket_t& spare_socket);
+	void _check_accept_queue(socket_t listen_fd, int32_t accept_counts);
+	void _on_accept_batch(int32_t accept_counts);
+
+	/// debug accept thread
+	void _debug_accept(void);
+
+	friend class ServerWorkThread;
 public:
 	TcpServer(const char* name, DebugInterface* debuger);
 	~TcpServer();
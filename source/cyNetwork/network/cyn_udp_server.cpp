@@ -0,0 +1,260 @@
+/*
+Copyright(C) thecodeway.com
+*/
+#include <cy_core.h>
+#include <cy_event.h>
+#include <cy_network.h>
+#include "cyn_udp_server.h"
+
+namespace cyclone
+{
+
+//-------------------------------------------------------------------------------------
+UdpServer::UdpServer(const char* name, DebugInterface* debuger)
+	: m_socket(INVALID_SOCKET)
+	, m_max_datagram_size(UdpSocket::kDefaultDatagramSize)
+	, m_work_thread_counts(0)
+	, m_running(0)
+	, m_name(name ? name : "udp")
+	, m_debuger(debuger)
+{
+	m_listener.onWorkThreadStart = nullptr;
+	m_listener.onMessage = nullptr;
+}
+
+//-------------------------------------------------------------------------------------
+UdpServer::~UdpServer()
+{
+	assert(m_running.load() == 0);
+
+	_clear_shards();
+	if (m_socket != INVALID_SOCKET) {
+		socket_api::close_socket(m_socket);
+		m_socket = INVALID_SOCKET;
+	}
+}
+
+//-------------------------------------------------------------------------------------
+bool UdpServer::bind(const Address& bind_addr)
+{
+	//is running already?
+	if (m_running > 0 || m_socket != INVALID_SOCKET) return false;
+
+	socket_t sfd = socket_api::create_udp_socket(bind_addr.get_family());
+	if (sfd == INVALID_SOCKET) {
+		CY_LOG(L_ERROR, "create udp socket error");
+		return false;
+	}
+	socket_api::set_nonblock(sfd, true);
+	socket_api::set_close_onexec(sfd, true);
+
+	//other work threads will bind the same address
+#ifndef CY_SYS_WINDOWS
+	socket_api::set_reuse_port(sfd, true);
+	socket_api::set_reuse_addr(sfd, true);
+#endif
+
+	if (!socket_api::bind(sfd, bind_addr.get_sockaddr(), bind_addr.get_sockaddr_len())) {
+		CY_LOG(L_ERROR, "udp bind to address %s:%d failed", bind_addr.get_ip(), bind_addr.get_port());
+		socket_api::close_socket(sfd);
+		return false;
+	}
+
+	//the port may be auto selected
+	m_socket = sfd;
+	m_bind_addr = Address(false, sfd);
+
+	CY_LOG(L_TRACE, "udp bind to address %s:%d ok", m_bind_addr.get_ip(), m_bind_addr.get_port());
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+bool UdpServer::set_max_datagram_size(size_t size)
+{
+	if (m_running > 0 || size == 0) return false;
+
+	m_max_datagram_size = size;
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+bool UdpServer::start(int32_t work_thread_counts)
+{
+	CY_LOG(L_INFO, "UdpServer start with %d workthread(s)", work_thread_counts);
+
+	if (work_thread_counts<1 || work_thread_counts > MAX_WORK_THREAD_COUNTS) {
+		CY_LOG(L_ERROR, "param thread counts error");
+		return false;
+	}
+#ifdef CY_SYS_WINDOWS
+	if (work_thread_counts > 1) {
+		CY_LOG(L_ERROR, "multi work threads need SO_REUSEPORT, which is not supported in this platform");
+		return false;
+	}
+#endif
+
+	if (m_socket == INVALID_SOCKET) {
+		CY_LOG(L_ERROR, "bind an address before start!");
+		return false;
+	}
+
+	//is running already?
+	if (m_running.exchange(1) > 0) return false;
+
+	//the sockets of last run
+	_clear_shards();
+
+	m_work_thread_counts = work_thread_counts;
+	for (int32_t i = 0; i < m_work_thread_counts; i++) {
+		shard_s* shard = new shard_s();
+		shard->server = this;
+		shard->index = i;
+		shard->thread = new WorkThread();
+		shard->udp = nullptr;
+		m_shards.push_back(shard);
+
+		char name[MAX_PATH] = { 0 };
+		std::snprintf(name, MAX_PATH, "%s_%d", m_name.c_str(), i);
+
+		shard->thread->setOnStartFunction(std::bind(&UdpServer::_on_workthread_start, this, shard));
+		shard->thread->setOnMessageFunction(std::bind(&UdpServer::_on_workthread_message, this, shard, std::placeholders::_1));
+		shard->thread->start(name);
+	}
+
+	//write debug variable
+	if (m_debuger && m_debuger->isEnable()) {
+		char key_value[256] = { 0 };
+		std::snprintf(key_value, 256, "UdpServer:%s:thread_counts", m_name.c_str());
+		m_debuger->updateDebugValue(key_value, m_work_thread_counts);
+	}
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+void UdpServer::stop(void)
+{
+	//not running?
+	if (m_running == 0) return;
+
+	//this function can't run in work thread
+	for (auto shard : m_shards) {
+		if (sys_api::thread_get_current_id() == shard->thread->get_looper()->get_thread_id()) {
+			CY_LOG(L_ERROR, "you can't stop server in work thread.");
+			return;
+		}
+	}
+
+	for (auto shard : m_shards) {
+		shard->thread->send_message(kShutdownCmdID, 0, 0);
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void UdpServer::join(void)
+{
+	for (auto shard : m_shards) {
+		shard->thread->join();
+	}
+	m_running = 0;
+
+	CY_LOG(L_TRACE, "udp server stop!");
+}
+
+//-------------------------------------------------------------------------------------
+uint64_t UdpServer::get_received_counts(void) const
+{
+	uint64_t counts = 0;
+	for (auto shard : m_shards) {
+		UdpSocket* udp = shard->udp.load();
+		if (udp) counts += udp->get_received_counts();
+	}
+	return counts;
+}
+
+//-------------------------------------------------------------------------------------
+uint64_t UdpServer::get_sent_counts(void) const
+{
+	uint64_t counts = 0;
+	for (auto shard : m_shards) {
+		UdpSocket* udp = shard->udp.load();
+		if (udp) counts += udp->get_sent_counts();
+	}
+	return counts;
+}
+
+//-------------------------------------------------------------------------------------
+uint64_t UdpServer::get_dropped_counts(void) const
+{
+	uint64_t counts = 0;
+	for (auto shard : m_shards) {
+		UdpSocket* udp = shard->udp.load();
+		if (udp) counts += udp->get_dropped_counts();
+	}
+	return counts;
+}
+
+//-------------------------------------------------------------------------------------
+bool UdpServer::_on_workthread_start(shard_s* shard)
+{
+	Looper* looper = shard->thread->get_looper();
+	UdpSocket* udp = new UdpSocket(looper, this, m_max_datagram_size);
+
+	//the first work thread use the socket bound already, the others bind the same address
+	bool ret = false;
+	if (shard->index == 0) {
+		ret = udp->attach(m_socket);
+		m_socket = INVALID_SOCKET;
+	}
+	else {
+		ret = udp->bind(m_bind_addr, true);
+	}
+	if (!ret) {
+		CY_LOG(L_ERROR, "work thread %d bind udp address %s:%d failed", shard->index, m_bind_addr.get_ip(), m_bind_addr.get_port());
+		delete udp;
+		return false;
+	}
+
+	int32_t index = shard->index;
+	udp->m_listener.onMessage = [this, index](UdpSocket* _udp, const char* buf, size_t len, const Address& peer) {
+		if (m_listener.onMessage) {
+			m_listener.onMessage(this, index, _udp, buf, len, peer);
+		}
+	};
+	shard->udp = udp;
+
+	CY_LOG(L_INFO, "Udp work thread \"%s\" start...", shard->thread->get_name());
+	if (m_listener.onWorkThreadStart) {
+		m_listener.onWorkThreadStart(this, shard->index, looper);
+	}
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+void UdpServer::_on_workthread_message(shard_s* shard, Packet* message)
+{
+	assert(message);
+
+	uint16_t msg_id = message->get_packet_id();
+	if (msg_id == kShutdownCmdID) {
+		//send the queued datagrams, and stop receiving
+		UdpSocket* udp = shard->udp.load();
+		if (udp) {
+			udp->flush();
+			udp->close();
+		}
+		shard->thread->get_looper()->push_stop_request();
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void UdpServer::_clear_shards(void)
+{
+	for (auto shard : m_shards) {
+		delete shard->udp.load();
+		delete shard->thread;
+		delete shard;
+	}
+	m_shards.clear();
+}
+
+}
@@ -0,0 +1,95 @@
+/*
+Copyright(C) thecodeway.com
+*/
+#ifndef _CYCLONE_NETWORK_UDP_SERVER_H_
+#define _CYCLONE_NETWORK_UDP_SERVER_H_
+
+#include <cy_core.h>
+#include <cy_event.h>
+#include "cyn_udp_socket.h"
+
+namespace cyclone
+{
+
+//
+// Datagram server, every work thread receive on its own SO_REUSEPORT socket, the kernel
+// choose the socket by the hash of 4-tuple, so the datagrams from one peer go to the same work thread
+//
+class UdpServer : noncopyable
+{
+public:
+	typedef std::function<void(UdpServer* server, int32_t thread_index, Looper* looper)> WorkThreadStartCallback;
+	typedef std::function<void(UdpServer* server, int32_t thread_index, UdpSocket* udp, const char* buf, size_t len, const Address& peer)> MessageCallback;
+
+	struct Listener {
+		WorkThreadStartCallback onWorkThreadStart;
+		MessageCallback onMessage;	//reply by udp->send_to, in the same work thread
+	};
+	Listener m_listener;
+
+public:
+	/// bind the address, return false if bind failed or the server is running
+	/// NOT thread safe, and this function must be called before start the server
+	bool bind(const Address& bind_addr);
+
+	/// set max size of datagram(default 2048), must be called before start the server
+	bool set_max_datagram_size(size_t size);
+
+	/// start the server with n workthreads(multi work threads need SO_REUSEPORT)
+	bool start(int32_t work_thread_counts);
+
+	/// stop the server gracefully(thread safe, but can't be called in work thread)
+	void stop(void);
+
+	/// wait server to terminate(thread safe)
+	void join(void);
+
+	/// get the bind address(the port may be auto selected)
+	Address get_bind_address(void) const { return m_bind_addr; }
+
+	/// get work thread counts
+	int32_t get_work_thread_counts(void) const { return m_work_thread_counts; }
+
+	/// statistics of all work threads(thread safe)
+	uint64_t get_received_counts(void) const;
+	uint64_t get_sent_counts(void) const;
+	uint64_t get_dropped_counts(void) const;
+
+private:
+	enum { MAX_WORK_THREAD_COUNTS = 32 };
+	enum { kShutdownCmdID = 1 };
+
+	struct shard_s
+	{
+		UdpServer* server;
+		int32_t index;
+		WorkThread* thread;
+		std::atomic<UdpSocket*> udp;	//created in work thread, deleted after the work thread quit
+	};
+	typedef std::vector< shard_s* > ShardArray;
+
+	socket_t		m_socket;	//bound in bind(), used by the first work thread
+	Address			m_bind_addr;
+	size_t			m_max_datagram_size;
+	ShardArray		m_shards;
+	int32_t			m_work_thread_counts;
+	atomic_int32_t	m_running;
+	std::string		m_name;
+	DebugInterface*	m_debuger;
+
+private:
+	/// work thread function start
+	bool _on_workthread_start(shard_s* shard);
+	/// work thread message
+	void _on_workthread_message(shard_s* shard, Packet* message);
+	/// delete all work threads and sockets
+	void _clear_shards(void);
+
+public:
+	UdpServer(const char* name, DebugInterface* debuger);
+	virtual ~UdpServer();
+};
+
+}
+
+#endif
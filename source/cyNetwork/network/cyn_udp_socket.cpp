@@ -0,0 +1,379 @@
+/*
+Copyright(C) thecodeway.com
+*/
+#include <cy_core.h>
+#include <cy_event.h>
+#include <cy_network.h>
+#include "cyn_udp_socket.h"
+
+#ifdef CY_SYS_LINUX
+#include <netinet/udp.h>
+#endif
+
+namespace cyclone
+{
+
+//-------------------------------------------------------------------------------------
+UdpSocket::UdpSocket(Looper* looper, void* param, size_t max_datagram_size)
+	: m_looper(looper)
+	, m_param(param)
+	, m_socket(INVALID_SOCKET)
+	, m_event_id(Looper::INVALID_EVENT_ID)
+	, m_max_datagram_size(max_datagram_size)
+	, m_gso_enabled(false)
+	, m_arena(nullptr)
+	, m_send_head(0)
+	, m_send_counts(0)
+	, m_write_blocked(false)
+	, m_flush_deferred(false)
+	, m_self(std::make_shared<UdpSocket*>(this))
+	, m_received_counts(0)
+	, m_sent_counts(0)
+	, m_dropped_counts(0)
+{
+	m_listener.onMessage = nullptr;
+
+	if (m_max_datagram_size == 0) m_max_datagram_size = kDefaultDatagramSize;
+	m_arena = (char*)CY_MALLOC((size_t)(kMaxBatchCounts * 2)*m_max_datagram_size);
+}
+
+//-------------------------------------------------------------------------------------
+UdpSocket::~UdpSocket()
+{
+	close();
+
+	CY_FREE(m_arena);
+	m_arena = nullptr;
+}
+
+//-------------------------------------------------------------------------------------
+bool UdpSocket::bind(const Address& bind_addr, bool enable_reuse_port)
+{
+	assert(sys_api::thread_get_current_id() == m_looper->get_thread_id());
+	if (m_socket != INVALID_SOCKET) return false;
+
+	socket_t sfd = socket_api::create_udp_socket(bind_addr.get_family());
+	if (sfd == INVALID_SOCKET) return false;
+
+	socket_api::set_nonblock(sfd, true);
+	socket_api::set_close_onexec(sfd, true);
+
+#ifdef CY_SYS_WINDOWS
+	(void)enable_reuse_port;
+#else
+	if (enable_reuse_port) {
+		//the kernel choose the socket by hash of 4-tuple, datagrams from one peer go to the same socket
+		socket_api::set_reuse_port(sfd, true);
+		socket_api::set_reuse_addr(sfd, true);
+	}
+#endif
+
+	if (!socket_api::bind(sfd, bind_addr.get_sockaddr(), bind_addr.get_sockaddr_len())) {
+		CY_LOG(L_ERROR, "udp bind to address %s:%d failed", bind_addr.get_ip(), bind_addr.get_port());
+		socket_api::close_socket(sfd);
+		return false;
+	}
+	return attach(sfd);
+}
+
+//-------------------------------------------------------------------------------------
+bool UdpSocket::attach(socket_t sfd)
+{
+	assert(sys_api::thread_get_current_id() == m_looper->get_thread_id());
+	if (m_socket != INVALID_SOCKET || sfd == INVALID_SOCKET) return false;
+
+	m_socket = sfd;
+	socket_api::set_nonblock(m_socket, true);
+
+	//probe UDP GSO support(linux 4.18+)
+	m_gso_enabled = false;
+#ifdef UDP_SEGMENT
+	int gso_size = 0;
+	socklen_t optlen = (socklen_t)sizeof(gso_size);
+	m_gso_enabled = (::getsockopt(m_socket, SOL_UDP, UDP_SEGMENT, &gso_size, &optlen) == 0);
+#endif
+
+	m_event_id = m_looper->register_event(m_socket,
+		Looper::kRead,
+		this,
+		std::bind(&UdpSocket::_on_socket_read, this),
+		std::bind(&UdpSocket::_on_socket_write, this)
+	);
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+void UdpSocket::close(void)
+{
+	if (m_event_id != Looper::INVALID_EVENT_ID) {
+		m_looper->disable_all(m_event_id);
+		m_looper->delete_event(m_event_id);
+		m_event_id = Looper::INVALID_EVENT_ID;
+	}
+	if (m_socket != INVALID_SOCKET) {
+		socket_api::close_socket(m_socket);
+		m_socket = INVALID_SOCKET;
+	}
+
+	if (m_send_counts > m_send_head) m_dropped_counts += (uint64_t)(m_send_counts - m_send_head);
+	m_send_head = m_send_counts = 0;
+	m_write_blocked = false;
+}
+
+//-------------------------------------------------------------------------------------
+bool UdpSocket::send_to(const Address& peer, const char* buf, size_t len)
+{
+	assert(sys_api::thread_get_current_id() == m_looper->get_thread_id());
+
+	if (m_socket == INVALID_SOCKET || len > m_max_datagram_size) {
+		m_dropped_counts++;
+		return false;
+	}
+
+	//the queue is full, try to send them now
+	if (m_send_counts == kMaxBatchCounts && !m_write_blocked) flush();
+	if (m_send_counts == kMaxBatchCounts) {
+		m_dropped_counts++;
+		return false;
+	}
+
+	datagram_s& datagram = m_send_datagrams[m_send_counts];
+	memcpy(&(datagram.addr), peer.get_sockaddr(), (size_t)peer.get_sockaddr_len());
+	datagram.addr_len = peer.get_sockaddr_len();
+	datagram.len = len;
+	if (len > 0) memcpy(_get_send_buf(m_send_counts), buf, len);
+	m_send_counts++;
+
+	if (!m_write_blocked) _defer_flush();
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+bool UdpSocket::send_segments(const Address& peer, const char* buf, size_t len, size_t segment_size)
+{
+	assert(sys_api::thread_get_current_id() == m_looper->get_thread_id());
+	if (segment_size == 0) return false;
+	if (len <= segment_size) return send_to(peer, buf, len);
+
+	//keep the order of the queued datagrams
+	if (m_gso_enabled) {
+		flush();
+		if (m_send_counts == 0 && _send_gso(peer, buf, len, segment_size)) return true;
+	}
+
+	//send the rest one by one
+	bool ret = true;
+	while (len > 0) {
+		size_t n = std::min(len, segment_size);
+		if (!send_to(peer, buf, n)) ret = false;
+		buf += n;
+		len -= n;
+	}
+	return ret;
+}
+
+//-------------------------------------------------------------------------------------
+bool UdpSocket::_send_gso(const Address& peer, const char*& buf, size_t& len, size_t segment_size)
+{
+#ifdef UDP_SEGMENT
+	//the kernel accept 64 segments at most, and the total size must fit in one udp packet
+	const size_t MAX_GSO_SEGMENTS = 64;
+	const size_t MAX_GSO_SIZE = 65000;
+	if (segment_size > MAX_GSO_SIZE || segment_size > 0xFFFF) return false;
+	size_t batch_size = std::min(MAX_GSO_SEGMENTS, MAX_GSO_SIZE / segment_size) * segment_size;
+
+	while (len > 0) {
+		size_t n = std::min(len, batch_size);
+
+		struct iovec iov;
+		iov.iov_base = (void*)buf;
+		iov.iov_len = n;
+
+		char control[CMSG_SPACE(sizeof(uint16_t))];
+		memset(control, 0, sizeof(control));
+
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_name = (void*)peer.get_sockaddr();
+		msg.msg_namelen = peer.get_sockaddr_len();
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+		cm->cmsg_level = SOL_UDP;
+		cm->cmsg_type = UDP_SEGMENT;
+		cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+		uint16_t gso_size = (uint16_t)segment_size;
+		memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+
+		if (::sendmsg(m_socket, &msg, 0) < 0) {
+			//the device may not support gso, don't try again
+			if (!socket_api::is_lasterror_WOULDBLOCK()) {
+				CY_LOG(L_WARN, "udp gso send failed, err=%d, gso disabled", socket_api::get_lasterror());
+				m_gso_enabled = false;
+			}
+			return false;
+		}
+		m_sent_counts += (uint64_t)((n + segment_size - 1) / segment_size);
+		buf += n;
+		len -= n;
+	}
+	return true;
+#else
+	(void)peer; (void)buf; (void)len; (void)segment_size;
+	return false;
+#endif
+}
+
+//-------------------------------------------------------------------------------------
+void UdpSocket::flush(void)
+{
+	if (m_socket == INVALID_SOCKET) return;
+
+	while (m_send_head < m_send_counts) {
+		int32_t counts = m_send_counts - m_send_head;
+		int32_t sent = 0;
+
+#ifdef CY_HAVE_SENDMMSG
+		struct mmsghdr msgs[kMaxBatchCounts];
+		struct iovec iovs[kMaxBatchCounts];
+		for (int32_t i = 0; i < counts; i++) {
+			datagram_s& datagram = m_send_datagrams[m_send_head + i];
+			iovs[i].iov_base = _get_send_buf(m_send_head + i);
+			iovs[i].iov_len = datagram.len;
+
+			memset(&(msgs[i]), 0, sizeof(msgs[i]));
+			msgs[i].msg_hdr.msg_name = &(datagram.addr);
+			msgs[i].msg_hdr.msg_namelen = datagram.addr_len;
+			msgs[i].msg_hdr.msg_iov = &(iovs[i]);
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		sent = ::sendmmsg(m_socket, msgs, (unsigned int)counts, 0);
+#else
+		for (; sent < counts; sent++) {
+			datagram_s& datagram = m_send_datagrams[m_send_head + sent];
+			if (socket_api::sendto(m_socket, _get_send_buf(m_send_head + sent), datagram.len,
+				(const struct sockaddr*)&(datagram.addr), datagram.addr_len) < 0) break;
+		}
+		if (sent == 0) sent = -1;
+#endif
+
+		if (sent < 0) {
+			if (socket_api::is_lasterror_WOULDBLOCK()) {
+				//wait the socket writable
+				if (!m_write_blocked) {
+					m_write_blocked = true;
+					m_looper->enable_write(m_event_id);
+				}
+				return;
+			}
+
+			//drop the bad one(too large, unreachable...)
+			CY_LOG(L_DEBUG, "udp send failed, err=%d", socket_api::get_lasterror());
+			m_dropped_counts++;
+			m_send_head++;
+			continue;
+		}
+
+		m_sent_counts += (uint64_t)sent;
+		m_send_head += sent;
+	}
+
+	//all sent
+	m_send_head = m_send_counts = 0;
+	if (m_write_blocked) {
+		m_write_blocked = false;
+		m_looper->disable_write(m_event_id);
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void UdpSocket::_defer_flush(void)
+{
+	if (m_flush_deferred) return;
+	m_flush_deferred = true;
+
+	std::weak_ptr<UdpSocket*> self = m_self;
+	m_looper->defer([self]() {
+		std::shared_ptr<UdpSocket*> udp = self.lock();
+		if (!udp) return;
+
+		(*udp)->m_flush_deferred = false;
+		(*udp)->flush();
+	});
+}
+
+//-------------------------------------------------------------------------------------
+void UdpSocket::_on_socket_read(void)
+{
+	//read a few batches at most, don't starve other events
+	const int32_t MAX_READ_ROUNDS = 4;
+
+	for (int32_t round = 0; round < MAX_READ_ROUNDS && m_socket != INVALID_SOCKET; round++) {
+		int32_t counts = 0;
+
+#ifdef CY_HAVE_RECVMMSG
+		struct mmsghdr msgs[kMaxBatchCounts];
+		struct iovec iovs[kMaxBatchCounts];
+		for (int32_t i = 0; i < kMaxBatchCounts; i++) {
+			iovs[i].iov_base = _get_recv_buf(i);
+			iovs[i].iov_len = m_max_datagram_size;
+
+			memset(&(msgs[i]), 0, sizeof(msgs[i]));
+			msgs[i].msg_hdr.msg_name = &(m_recv_datagrams[i].addr);
+			msgs[i].msg_hdr.msg_namelen = (socklen_t)sizeof(m_recv_datagrams[i].addr);
+			msgs[i].msg_hdr.msg_iov = &(iovs[i]);
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		counts = ::recvmmsg(m_socket, msgs, kMaxBatchCounts, MSG_DONTWAIT, nullptr);
+		for (int32_t i = 0; i < counts; i++) {
+			//too large, drop it
+			m_recv_datagrams[i].len = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) ? (size_t)-1 : (size_t)msgs[i].msg_len;
+			m_recv_datagrams[i].addr_len = msgs[i].msg_hdr.msg_namelen;
+		}
+#else
+		for (; counts < kMaxBatchCounts; counts++) {
+			datagram_s& datagram = m_recv_datagrams[counts];
+			ssize_t len = socket_api::recvfrom(m_socket, _get_recv_buf(counts), m_max_datagram_size, &(datagram.addr), &(datagram.addr_len));
+			if (len < 0) break;
+			datagram.len = (size_t)len;
+		}
+		if (counts == 0) counts = -1;
+#endif
+
+		if (counts <= 0) {
+			if (counts < 0 && !socket_api::is_lasterror_WOULDBLOCK()) {
+				CY_LOG(L_ERROR, "udp receive failed, err=%d", socket_api::get_lasterror());
+			}
+			return;
+		}
+		m_received_counts += (uint64_t)counts;
+
+		for (int32_t i = 0; i < counts; i++) {
+			const datagram_s& datagram = m_recv_datagrams[i];
+			if (datagram.len == (size_t)-1) {
+				m_dropped_counts++;
+				continue;
+			}
+
+			if (m_listener.onMessage) {
+				m_listener.onMessage(this, _get_recv_buf(i), datagram.len, Address((const struct sockaddr*)&(datagram.addr), datagram.addr_len));
+			}
+			//closed in callback
+			if (m_socket == INVALID_SOCKET) return;
+		}
+
+		//the socket is empty
+		if (counts < kMaxBatchCounts) return;
+	}
+}
+
+//-------------------------------------------------------------------------------------
+void UdpSocket::_on_socket_write(void)
+{
+	flush();
+}
+
+}
@@ -0,0 +1,113 @@
+/*
+Copyright(C) thecodeway.com
+*/
+#ifndef _CYCLONE_NETWORK_UDP_SOCKET_H_
+#define _CYCLONE_NETWORK_UDP_SOCKET_H_
+
+#include <cy_core.h>
+#include <cy_event.h>
+#include "cyn_address.h"
+
+namespace cyclone
+{
+
+//
+// Non-blocking datagram socket work in a looper
+// Datagrams are received and sent in batches(recvmmsg/sendmmsg if possible), the buffers of
+// one batch are allocated in one arena when the socket is created and reused all the time
+//
+class UdpSocket : noncopyable
+{
+public:
+	typedef std::function<void(UdpSocket* udp, const char* buf, size_t len, const Address& peer)> MessageCallback;
+
+	struct Listener {
+		MessageCallback onMessage;	//the buf is valid only in the callback
+	};
+	Listener m_listener;
+
+	enum { kMaxBatchCounts = 64, kDefaultDatagramSize = 2048 };
+
+public:
+	//// bind to local address and start receiving(NOT thread safe, call it in the looper thread)
+	bool bind(const Address& bind_addr, bool enable_reuse_port);
+	//// receive from a bound socket, the socket will be closed by this object(NOT thread safe)
+	bool attach(socket_t sfd);
+	//// close the socket, the queued datagrams will be dropped(NOT thread safe)
+	void close(void);
+
+	//// queue a datagram, the datagrams queued in one loop step will be sent in one batch at the
+	//// end of the step. return false if the datagram is too large, or the send queue is full(dropped)
+	//// (NOT thread safe, call it in the looper thread)
+	bool send_to(const Address& peer, const char* buf, size_t len);
+	//// send a large buffer as datagrams of segment_size bytes each(the last one may be shorter),
+	//// by UDP GSO(UDP_SEGMENT) in one syscall if possible(NOT thread safe)
+	bool send_segments(const Address& peer, const char* buf, size_t len, size_t segment_size);
+	//// send all queued datagrams now(NOT thread safe)
+	void flush(void);
+
+	//// get native socket
+	socket_t get_socket(void) const { return m_socket; }
+	//// get the address which the socket bound
+	Address get_local_addr(void) const { return Address(false, m_socket); }
+	//// get the looper which the socket work in
+	Looper* get_looper(void) const { return m_looper; }
+	//// get callback param
+	void* get_param(void) const { return m_param; }
+	//// get max size of datagram which can be received or queued
+	size_t get_max_datagram_size(void) const { return m_max_datagram_size; }
+	//// is UDP GSO available
+	bool is_gso_enabled(void) const { return m_gso_enabled; }
+
+	//// statistics(thread safe), the truncated, too large or dropped by full queue datagrams are dropped
+	uint64_t get_received_counts(void) const { return m_received_counts.load(); }
+	uint64_t get_sent_counts(void) const { return m_sent_counts.load(); }
+	uint64_t get_dropped_counts(void) const { return m_dropped_counts.load(); }
+
+private:
+	struct datagram_s
+	{
+		struct sockaddr_storage addr;
+		socklen_t addr_len;
+		size_t len;
+	};
+
+	Looper*				m_looper;
+	void*				m_param;
+	socket_t			m_socket;
+	Looper::event_id_t	m_event_id;
+	size_t				m_max_datagram_size;
+	bool				m_gso_enabled;
+
+	//one block for all datagram buffers, receive slots first then send slots
+	char*				m_arena;
+	datagram_s			m_recv_datagrams[kMaxBatchCounts];
+	datagram_s			m_send_datagrams[kMaxBatchCounts];
+	int32_t				m_send_head;	//the first datagram not sent
+	int32_t				m_send_counts;	//queued datagrams
+	bool				m_write_blocked;
+	bool				m_flush_deferred;
+
+	//the deferred flush task hold a weak reference, so it can't touch a deleted socket
+	std::shared_ptr<UdpSocket*> m_self;
+
+	atomic_uint64_t		m_received_counts;
+	atomic_uint64_t		m_sent_counts;
+	atomic_uint64_t		m_dropped_counts;
+
+private:
+	char* _get_recv_buf(int32_t index) { return m_arena + (size_t)index*m_max_datagram_size; }
+	char* _get_send_buf(int32_t index) { return m_arena + (size_t)(kMaxBatchCounts + index)*m_max_datagram_size; }
+
+	void _on_socket_read(void);
+	void _on_socket_write(void);
+	void _defer_flush(void);
+	bool _send_gso(const Address& peer, const char*& buf, size_t& len, size_t segment_size);
+
+public:
+	UdpSocket(Looper* looper, void* param, size_t max_datagram_size = kDefaultDatagramSize);
+	virtual ~UdpSocket();
+};
+
+}
+#endif
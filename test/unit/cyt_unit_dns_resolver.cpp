@@ -0,0 +1,174 @@
+#include <cy_core.h>
+#include <cy_event.h>
+#include <cy_network.h>
+
+#include <gtest/gtest.h>
+
+using namespace cyclone;
+
+namespace {
+
+//-------------------------------------------------------------------------------------
+static bool _stepUntil(Looper* looper, std::function<bool()> condition)
+{
+	//wait 2 seconds at most
+	int64_t end_time = sys_api::utc_time_now() + 2 * 1000 * 1000;
+	while (!condition()) {
+		if (sys_api::utc_time_now() > end_time) return false;
+		looper->step();
+	}
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+TEST(DnsResolver, Basic)
+{
+	atomic_int32_t query_counts(0);
+
+	DnsResolver resolver(2);
+	resolver.set_resolve_function([&query_counts](const std::string& hostname, std::vector<Address>& addresses) {
+		query_counts++;
+		sys_api::thread_sleep(50);
+		if (hostname != "stub.test") return false;
+
+		addresses.push_back(Address("127.0.0.1", (uint16_t)0));
+		addresses.push_back(Address("::1", (uint16_t)0));
+		return true;
+	});
+
+	Looper* looper = Looper::create_looper();
+
+	//concurrent lookups of the same name share one query
+	int32_t done_counts = 0;
+	for (uint16_t i = 0; i < 3; i++) {
+		uint16_t port = (uint16_t)(80 + i);
+		resolver.resolve(looper, "stub.test", port, [&done_counts, port](bool success, const std::vector<Address>& addresses) {
+			EXPECT_TRUE(success);
+			EXPECT_EQ(2u, addresses.size());
+			EXPECT_STREQ("127.0.0.1", addresses[0].get_ip());
+			EXPECT_EQ(port, addresses[0].get_port());
+			EXPECT_STREQ("::1", addresses[1].get_ip());
+			EXPECT_EQ(port, addresses[1].get_port());
+			done_counts++;
+		});
+	}
+	EXPECT_EQ(0, done_counts);
+	EXPECT_TRUE(_stepUntil(looper, [&done_counts]() { return done_counts == 3; }));
+	EXPECT_EQ(1, query_counts.load());
+	EXPECT_EQ(1u, resolver.get_lookup_counts());
+	EXPECT_EQ(2u, resolver.get_coalesced_counts());
+
+	//cached, called at once
+	bool done = false;
+	resolver.resolve(looper, "stub.test", 8080, [&done](bool success, const std::vector<Address>& addresses) {
+		EXPECT_TRUE(success);
+		EXPECT_EQ(8080, addresses[0].get_port());
+		done = true;
+	});
+	EXPECT_TRUE(done);
+	EXPECT_EQ(1u, resolver.get_cache_hit_counts());
+
+	//failed result is cached too
+	for (int32_t i = 0; i < 2; i++) {
+		done = false;
+		resolver.resolve(looper, "unknown.test", 80, [&done](bool success, const std::vector<Address>& addresses) {
+			EXPECT_FALSE(success);
+			EXPECT_TRUE(addresses.empty());
+			done = true;
+		});
+		EXPECT_TRUE(_stepUntil(looper, [&done]() { return done; }));
+	}
+	EXPECT_EQ(2, query_counts.load());
+	EXPECT_EQ(2u, resolver.get_cache_hit_counts());
+
+	//expired
+	resolver.set_cache_ttl(10, 10);
+	resolver.clear_cache();
+	for (int32_t i = 0; i < 2; i++) {
+		done = false;
+		resolver.resolve(looper, "stub.test", 80, [&done](bool, const std::vector<Address>&) { done = true; });
+		EXPECT_TRUE(_stepUntil(looper, [&done]() { return done; }));
+		sys_api::thread_sleep(20);
+	}
+	EXPECT_EQ(4, query_counts.load());
+
+	//numeric address
+	done = false;
+	resolver.resolve(looper, "::1", 443, [&done](bool success, const std::vector<Address>& addresses) {
+		EXPECT_TRUE(success);
+		EXPECT_EQ(1u, addresses.size());
+		EXPECT_TRUE(addresses[0].is_ipv6());
+		EXPECT_EQ(443, addresses[0].get_port());
+		done = true;
+	});
+	EXPECT_TRUE(done);
+	EXPECT_EQ(4, query_counts.load());
+
+	Looper::destroy_looper(looper);
+}
+
+//-------------------------------------------------------------------------------------
+TEST(DnsResolver, Concurrent)
+{
+	const int32_t thread_counts = 4;
+	atomic_int32_t running_counts(0), max_running_counts(0);
+
+	//the different names are resolved by all threads together
+	DnsResolver resolver(thread_counts);
+	resolver.set_resolve_function([&](const std::string&, std::vector<Address>& addresses) {
+		int32_t running = ++running_counts;
+		int32_t max_running = max_running_counts.load();
+		while (running > max_running && !max_running_counts.compare_exchange_weak(max_running, running)) {}
+
+		sys_api::thread_sleep(200);
+		running_counts--;
+		addresses.push_back(Address("127.0.0.1", (uint16_t)0));
+		return true;
+	});
+
+	//all threads are waiting
+	sys_api::thread_sleep(50);
+
+	Looper* looper = Looper::create_looper();
+	int32_t done_counts = 0;
+	for (int32_t i = 0; i < thread_counts; i++) {
+		char hostname[64] = { 0 };
+		std::snprintf(hostname, sizeof(hostname), "host%d.test", i);
+		resolver.resolve(looper, hostname, 80, [&done_counts](bool success, const std::vector<Address>&) {
+			EXPECT_TRUE(success);
+			done_counts++;
+		});
+	}
+	EXPECT_TRUE(_stepUntil(looper, [&done_counts]() { return done_counts == thread_counts; }));
+	EXPECT_EQ(thread_counts, max_running_counts.load());
+	EXPECT_EQ((uint64_t)thread_counts, resolver.get_lookup_counts());
+
+	Looper::destroy_looper(looper);
+}
+
+//-------------------------------------------------------------------------------------
+TEST(DnsResolver, HostsFile)
+{
+	//"localhost" is defined in hosts file
+	std::vector<Address> addresses;
+	EXPECT_TRUE(DnsResolver::getaddrinfo_resolve("localhost", addresses));
+	EXPECT_FALSE(addresses.empty());
+
+	DnsResolver resolver(1);
+	Looper* looper = Looper::create_looper();
+
+	bool done = false;
+	resolver.resolve(looper, "localhost", 1984, [&done](bool success, const std::vector<Address>& result) {
+		EXPECT_TRUE(success);
+		EXPECT_FALSE(result.empty());
+		for (auto& addr : result) {
+			EXPECT_EQ(1984, addr.get_port());
+		}
+		done = true;
+	});
+	EXPECT_TRUE(_stepUntil(looper, [&done]() { return done; }));
+
+	Looper::destroy_looper(looper);
+}
+
+}
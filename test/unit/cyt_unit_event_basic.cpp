@@ -57,4 +57,25 @@ TEST(EventLooper, Basic)
 	CHECK_CHANNEL_SIZE(default_channel_counts * 2, 0, default_channel_counts*2);
 }
 
+
+//-------------------------------------------------------------------------------------
+TEST(EventLooper, DeferOnQuit)
+{
+	Looper* looper = Looper::create_looper();
+	int32_t deferred_counts = 0;
+
+	//quit in the same step, the deferred tasks still run before the loop returned
+	looper->post([&]() {
+		looper->defer([&]() {
+			deferred_counts++;
+			looper->defer([&]() { deferred_counts++; });
+		});
+		looper->push_stop_request();
+	});
+	looper->loop();
+	EXPECT_EQ(2, deferred_counts);
+
+	Looper::destroy_looper(looper);
+}
+
 }
@@ -0,0 +1,183 @@
+#include <cy_core.h>
+#include <cy_event.h>
+#include <cy_network.h>
+
+#include <gtest/gtest.h>
+
+using namespace cyclone;
+
+namespace {
+
+//-------------------------------------------------------------------------------------
+static std::string _httpRequest(const Address& address, const std::string& request)
+{
+	socket_t sfd = socket_api::create_socket();
+	EXPECT_TRUE(socket_api::connect(sfd, address.get_sockaddr_in()));
+	EXPECT_EQ((ssize_t)request.size(), socket_api::write(sfd, request.c_str(), request.size()));
+
+	//the last request should close the connection
+	std::string response;
+	char temp[4096];
+	for (;;) {
+		ssize_t n = socket_api::read(sfd, temp, sizeof(temp));
+		if (n <= 0) break;
+		response.append(temp, (size_t)n);
+	}
+	socket_api::close_socket(sfd);
+	return response;
+}
+
+//-------------------------------------------------------------------------------------
+static std::string _dechunk(const std::string& response)
+{
+	size_t pos = response.find("\r\n\r\n");
+	if (pos == std::string::npos) return std::string();
+	pos += 4;
+
+	std::string body;
+	for (;;) {
+		size_t chunk_size = (size_t)strtoul(response.c_str() + pos, nullptr, 16);
+		pos = response.find("\r\n", pos);
+		if (chunk_size == 0 || pos == std::string::npos) break;
+		body.append(response, pos + 2, chunk_size);
+		pos += 2 + chunk_size + 2;
+	}
+	return body;
+}
+
+//-------------------------------------------------------------------------------------
+static void _echoOnce(const Address& address)
+{
+	socket_t sfd = socket_api::create_socket();
+	EXPECT_TRUE(socket_api::connect(sfd, address.get_sockaddr_in()));
+	char temp[64] = { 0 };
+	EXPECT_EQ(64, socket_api::write(sfd, temp, sizeof(temp)));
+	size_t received = 0;
+	while (received < sizeof(temp)) {
+		ssize_t n = socket_api::read(sfd, temp, sizeof(temp));
+		if (n <= 0) break;
+		received += (size_t)n;
+	}
+	EXPECT_EQ(sizeof(temp), received);
+	socket_api::close_socket(sfd);
+}
+
+//-------------------------------------------------------------------------------------
+TEST(MetricsExporter, Standalone)
+{
+	MetricsExporter exporter;
+
+	TcpServer server("metrics_test", &exporter);
+	server.m_listener.onMessage = [](TcpServer*, int32_t, ConnectionPtr conn) {
+		RingBuf& rb = conn->get_input_buf();
+		conn->send((const char*)rb.normalize(), rb.size());
+		rb.reset();
+	};
+	EXPECT_TRUE(server.bind(Address(0, true), false));
+	EXPECT_TRUE(server.start(2));
+	EXPECT_TRUE(exporter.start(Address(0, true), &server));
+	EXPECT_FALSE(exporter.start(Address(0, true), &server));
+	EXPECT_FALSE(exporter.bind(Address(0, true), &server));
+
+	_echoOnce(server.get_bind_address(0));
+	exporter.updateDebugValue("test:string", "a\"b");
+	exporter.updateDebugValue("test:int", 42);
+	exporter.updateDebugValue("test:deleted", 1);
+	exporter.delDebugValue("test:deleted");
+	server.debug();
+	sys_api::thread_sleep(50);
+
+	std::string response = _httpRequest(exporter.get_bind_address(), "GET /metrics HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n");
+	EXPECT_EQ(0u, response.find("HTTP/1.1 200 OK\r\n"));
+	EXPECT_NE(std::string::npos, response.find("Transfer-Encoding: chunked\r\n"));
+
+	std::string body = _dechunk(response);
+	EXPECT_NE(std::string::npos, body.find("cyclone_scrape_complete{server=\"metrics_test\"} 1\n"));
+	EXPECT_NE(std::string::npos, body.find("cyclone_work_threads{server=\"metrics_test\"} 2\n"));
+	EXPECT_NE(std::string::npos, body.find("# TYPE cyclone_read_bytes_total counter\n"));
+	EXPECT_NE(std::string::npos, body.find("cyclone_read_bytes_total{server=\"metrics_test\",thread=\"1\"} "));
+	EXPECT_NE(std::string::npos, body.find("cyclone_debug_value{key=\"TcpServer:metrics_test:thread_counts\"} 2\n"));
+	EXPECT_NE(std::string::npos, body.find("cyclone_debug_value{key=\"test:int\"} 42\n"));
+	EXPECT_NE(std::string::npos, body.find("cyclone_debug_info{key=\"test:string\",value=\"a\\\"b\"} 1\n"));
+	EXPECT_EQ(std::string::npos, body.find("test:deleted"));
+
+	//64 bytes echoed, the connection is closed already
+	uint64_t read_bytes = 0;
+	for (size_t pos = body.find("cyclone_read_bytes_total{"); pos != std::string::npos; pos = body.find("cyclone_read_bytes_total{", pos + 1)) {
+		read_bytes += strtoull(body.c_str() + body.find("} ", pos) + 2, nullptr, 10);
+	}
+	EXPECT_EQ(64u, read_bytes);
+
+	//unknown path and method
+	response = _httpRequest(exporter.get_bind_address(), "GET /unknown HTTP/1.1\r\nConnection: close\r\n\r\n");
+	EXPECT_EQ(0u, response.find("HTTP/1.1 404 Not Found\r\n"));
+	response = _httpRequest(exporter.get_bind_address(), "POST /metrics HTTP/1.0\r\n\r\n");
+	EXPECT_EQ(0u, response.find("HTTP/1.1 405 Method Not Allowed\r\n"));
+	EXPECT_EQ(3u, exporter.get_request_counts());
+
+	exporter.stop();
+	server.stop();
+	server.join();
+}
+
+//-------------------------------------------------------------------------------------
+TEST(MetricsExporter, ServerPort)
+{
+	MetricsExporter exporter;
+	atomic_int32_t message_counts(0);
+
+	TcpServer server("metrics_port", nullptr);
+	server.m_listener.onMessage = [&message_counts](TcpServer*, int32_t, ConnectionPtr conn) {
+		message_counts++;
+		RingBuf& rb = conn->get_input_buf();
+		conn->send((const char*)rb.normalize(), rb.size());
+		rb.reset();
+	};
+	EXPECT_TRUE(server.bind(Address(0, true), false));
+	EXPECT_TRUE(exporter.bind(Address(0, true), &server));
+	EXPECT_EQ(2u, server.get_bind_counts());
+	EXPECT_TRUE(server.start(2));
+
+	//the listeners can't be changed after start
+	EXPECT_FALSE(server.set_port_listener(0, TcpServer::Listener()));
+
+	_echoOnce(server.get_bind_address(0));
+	EXPECT_EQ(1, message_counts.load());
+
+	//pipelined requests are answered one by one in order, the metrics port never reaches the server listener
+	std::string response = _httpRequest(exporter.get_bind_address(),
+		"GET /metrics HTTP/1.1\r\n\r\nGET /none HTTP/1.1\r\n\r\nGET /metrics HTTP/1.1\r\nConnection: close\r\n\r\n");
+	size_t first = response.find("HTTP/1.1 200 OK\r\n");
+	size_t second = response.find("HTTP/1.1 404 Not Found\r\n");
+	size_t third = response.find("HTTP/1.1 200 OK\r\n", first + 1);
+	EXPECT_EQ(0u, first);
+	EXPECT_NE(std::string::npos, second);
+	EXPECT_NE(std::string::npos, third);
+	EXPECT_LT(second, third);
+	EXPECT_EQ(1, message_counts.load());
+	EXPECT_EQ(3u, exporter.get_request_counts());
+
+	std::string body = _dechunk(response.substr(third));
+	EXPECT_NE(std::string::npos, body.find("cyclone_scrape_complete{server=\"metrics_port\"} 1\n"));
+	EXPECT_NE(std::string::npos, body.find("cyclone_connections{server=\"metrics_port\",thread=\"0\"} "));
+	EXPECT_NE(std::string::npos, body.find("cyclone_connections{server=\"metrics_port\",thread=\"1\"} "));
+
+	//the asynchronous snapshot
+	Looper* looper = Looper::create_looper();
+	bool done = false;
+	server.stats_snapshot(looper, [&done](TcpServer::StatsSnapshot& snapshot) {
+		EXPECT_EQ(2u, snapshot.work_threads.size());
+		done = true;
+	});
+	int64_t end_time = sys_api::utc_time_now() + 2 * 1000 * 1000;
+	while (!done && sys_api::utc_time_now() < end_time) {
+		looper->step();
+	}
+	EXPECT_TRUE(done);
+	Looper::destroy_looper(looper);
+
+	server.stop();
+	server.join();
+}
+
+}
@@ -0,0 +1,119 @@
+#include <cy_core.h>
+#include <gtest/gtest.h>
+
+using namespace cyclone;
+
+namespace {
+
+//-------------------------------------------------------------------------------------
+struct IntNode : public MpscNode
+{
+	int32_t producer;
+	int32_t value;
+};
+
+//-------------------------------------------------------------------------------------
+TEST(MpscQueue, Basic)
+{
+	MpscQueue queue;
+	EXPECT_TRUE(queue.empty());
+	EXPECT_EQ(nullptr, queue.pop_all());
+
+	const int32_t NODE_COUNTS = 16;
+	IntNode nodes[NODE_COUNTS];
+
+	for (int32_t i = 0; i < NODE_COUNTS; i++) {
+		nodes[i].value = i;
+		//only the first push find the queue empty
+		EXPECT_EQ(i == 0, queue.push(&nodes[i]));
+		EXPECT_FALSE(queue.empty());
+	}
+
+	//FIFO order
+	MpscNode* node = queue.pop_all();
+	EXPECT_TRUE(queue.empty());
+	for (int32_t i = 0; i < NODE_COUNTS; i++) {
+		ASSERT_NE(nullptr, node);
+		EXPECT_EQ(i, ((IntNode*)node)->value);
+		node = node->next;
+	}
+	EXPECT_EQ(nullptr, node);
+
+	//push again
+	EXPECT_TRUE(queue.push(&nodes[0]));
+	node = queue.pop_all();
+	EXPECT_EQ(&nodes[0], node);
+	EXPECT_EQ(nullptr, node->next);
+	EXPECT_EQ(nullptr, queue.pop_all());
+}
+
+//-------------------------------------------------------------------------------------
+struct ProducerData
+{
+	MpscQueue* queue;
+	int32_t producer;
+	int32_t value_counts;
+	sys_api::signal_t complete;
+};
+
+//-------------------------------------------------------------------------------------
+static void _producerFunction(void* param)
+{
+	ProducerData* data = (ProducerData*)param;
+
+	for (int32_t i = 0; i < data->value_counts; i++) {
+		IntNode* node = new IntNode();
+		node->producer = data->producer;
+		node->value = i;
+		data->queue->push(node);
+	}
+	sys_api::signal_notify(data->complete);
+}
+
+//-------------------------------------------------------------------------------------
+TEST(MpscQueue, MultiProducer)
+{
+	const int32_t PRODUCER_COUNTS = 4;
+	const int32_t VALUE_COUNTS = 100000;
+
+	MpscQueue queue;
+	ProducerData data[PRODUCER_COUNTS];
+
+	for (int32_t i = 0; i < PRODUCER_COUNTS; i++) {
+		data[i].queue = &queue;
+		data[i].producer = i;
+		data[i].value_counts = VALUE_COUNTS;
+		data[i].complete = sys_api::signal_create();
+		sys_api::thread_create_detached(_producerFunction, &(data[i]), "producer");
+	}
+
+	//consume while producing, the values from one producer must be in order
+	int32_t next_value[PRODUCER_COUNTS] = { 0 };
+	int32_t total_counts = 0;
+	while (total_counts < PRODUCER_COUNTS*VALUE_COUNTS) {
+		MpscNode* node = queue.pop_all();
+		if (node == nullptr) {
+			sys_api::thread_yield();
+			continue;
+		}
+
+		while (node) {
+			IntNode* intNode = (IntNode*)node;
+			node = node->next;
+
+			EXPECT_EQ(next_value[intNode->producer], intNode->value);
+			next_value[intNode->producer] = intNode->value + 1;
+			total_counts++;
+			delete intNode;
+		}
+	}
+
+	for (int32_t i = 0; i < PRODUCER_COUNTS; i++) {
+		sys_api::signal_wait(data[i].complete);
+		sys_api::signal_destroy(data[i].complete);
+		EXPECT_EQ(VALUE_COUNTS, next_value[i]);
+	}
+	EXPECT_TRUE(queue.empty());
+}
+
+}
@@ -127,4 +127,240 @@ TEST(Packet, Basic)
 	PACKET_CHECK_ZERO();
 }
 
+//-------------------------------------------------------------------------------------
+void _makeWideHead(uint32_t size, uint16_t id, uint8_t head[6])
+{
+	head[0] = (uint8_t)(size >> 24); head[1] = (uint8_t)(size >> 16);
+	head[2] = (uint8_t)(size >> 8); head[3] = (uint8_t)(size);
+	head[4] = (uint8_t)(id >> 8); head[5] = (uint8_t)(id);
+}
+
+//-------------------------------------------------------------------------------------
+TEST(Packet, WideHead)
+{
+	const size_t HEAD_SIZE = 8;
+	const uint16_t PACKET_ID = 0x1234;
+	const uint16_t RESERVED = 0xC00D;
+
+	//larger than 64k
+	const uint32_t large_size = 0x30001;
+	char* large_buf = (char*)CY_MALLOC(large_size);
+	for (size_t i = 0; i < large_size; i++) {
+		((uint8_t*)large_buf)[i] = (uint8_t)(rand() & 0xFF);
+	}
+
+	uint8_t head[6];
+	_makeWideHead(large_size, PACKET_ID, head);
+
+	Packet packet;
+	packet.build_wide(HEAD_SIZE, PACKET_ID, large_size, large_buf);
+	EXPECT_EQ(Packet::kWideHead, packet.get_head_format());
+	EXPECT_EQ(0, memcmp(packet.get_memory_buf(), head, sizeof(head)));
+	EXPECT_EQ(HEAD_SIZE + large_size, packet.get_memory_size());
+	EXPECT_EQ(PACKET_ID, packet.get_packet_id());
+	EXPECT_EQ(large_size, packet.get_packet_size());
+	EXPECT_EQ(0, memcmp(packet.get_packet_content(), large_buf, large_size));
+
+	//copy
+	Packet* other = Packet::alloc_packet(&packet);
+	EXPECT_EQ(Packet::kWideHead, other->get_head_format());
+	EXPECT_EQ(large_size, other->get_packet_size());
+	EXPECT_EQ(0, memcmp(other->get_memory_buf(), packet.get_memory_buf(), packet.get_memory_size()));
+	Packet::free_packet(other);
+
+	packet.clean();
+	EXPECT_EQ(Packet::kNarrowHead, packet.get_head_format());
+	EXPECT_EQ(0u, packet.get_packet_size());
+
+	//build from ringbuf
+	RingBuf rb;
+	EXPECT_FALSE(packet.build_wide(HEAD_SIZE, rb));
+
+	uint16_t packet_id = 0;
+	uint32_t packet_size = 0;
+	rb.memcpy_into(head, 3);
+	EXPECT_FALSE(Packet::peek_head(Packet::kWideHead, rb, packet_id, packet_size));
+	rb.memcpy_into(head + 3, 3);
+	EXPECT_TRUE(Packet::peek_head(Packet::kWideHead, rb, packet_id, packet_size));
+	EXPECT_EQ(PACKET_ID, packet_id);
+	EXPECT_EQ(large_size, packet_size);
+
+	rb.memcpy_into(&RESERVED, sizeof(RESERVED));
+	rb.memcpy_into(large_buf, large_size - 1);
+	EXPECT_FALSE(packet.build_wide(HEAD_SIZE, rb));
+
+	rb.memcpy_into(large_buf + large_size - 1, 1);
+
+	//larger than the max, refused and the ring buf is not changed
+	EXPECT_FALSE(packet.build_wide(HEAD_SIZE, rb, large_size - 1));
+	EXPECT_EQ(HEAD_SIZE + large_size, rb.size());
+	EXPECT_TRUE(packet.build_wide(HEAD_SIZE, rb));
+	EXPECT_TRUE(rb.empty());
+	EXPECT_EQ(PACKET_ID, packet.get_packet_id());
+	EXPECT_EQ(large_size, packet.get_packet_size());
+	EXPECT_EQ(0, memcmp(packet.get_memory_buf() + sizeof(head), &RESERVED, sizeof(RESERVED)));
+	EXPECT_EQ(0, memcmp(packet.get_packet_content(), large_buf, large_size));
+
+	CY_FREE(large_buf);
+}
+
+//-------------------------------------------------------------------------------------
+TEST(Packet, StreamReader)
+{
+	const size_t HEAD_SIZE = 6;
+	const uint32_t packet_size = 0x20000;
+	const uint16_t PACKET_ID = 0x4321;
+
+	char* content = (char*)CY_MALLOC(packet_size);
+	for (size_t i = 0; i < packet_size; i++) {
+		((uint8_t*)content)[i] = (uint8_t)(rand() & 0xFF);
+	}
+	std::vector<char> received;
+	int32_t head_counts = 0, complete_counts = 0, chunk_counts = 0;
+
+	PacketReader reader(HEAD_SIZE, 0x100000,
+		[&](uint16_t id, uint32_t size, const char*) {
+			EXPECT_EQ(PACKET_ID, id);
+			EXPECT_EQ(packet_size, size);
+			head_counts++;
+		},
+		[&](uint16_t id, const char* chunk, size_t chunk_size, uint32_t offset) {
+			EXPECT_EQ(PACKET_ID, id);
+			EXPECT_EQ((size_t)offset, received.size());
+			received.insert(received.end(), chunk, chunk + chunk_size);
+			chunk_counts++;
+		},
+		[&](uint16_t id) {
+			EXPECT_EQ(PACKET_ID, id);
+			complete_counts++;
+		});
+
+	uint8_t head[HEAD_SIZE];
+	_makeWideHead(packet_size, PACKET_ID, head);
+
+	//feed two packets in small pieces, the ring buf never hold a whole packet
+	RingBuf rb;
+	for (int32_t i = 0; i < 2; i++) {
+		received.clear();
+		rb.memcpy_into(head, 2);
+		EXPECT_TRUE(reader.read(rb));
+		EXPECT_FALSE(reader.is_reading_content());
+
+		rb.memcpy_into(head + 2, HEAD_SIZE - 2);
+		EXPECT_TRUE(reader.read(rb));
+		EXPECT_TRUE(reader.is_reading_content());
+
+		const size_t piece = 1000;
+		for (size_t off = 0; off < packet_size; off += piece) {
+			rb.memcpy_into(content + off, std::min(piece, packet_size - off));
+			EXPECT_TRUE(reader.read(rb));
+			EXPECT_LT(rb.capacity(), (size_t)packet_size);
+		}
+		EXPECT_FALSE(reader.is_reading_content());
+		EXPECT_TRUE(rb.empty());
+		EXPECT_EQ(packet_size, received.size());
+		EXPECT_EQ(0, memcmp(&(received[0]), content, packet_size));
+	}
+	EXPECT_EQ(2, head_counts);
+	EXPECT_EQ(2, complete_counts);
+	EXPECT_LE(2 * (int32_t)(packet_size / 1000), chunk_counts);
+
+	//too large
+	_makeWideHead(0x100001, PACKET_ID, head);
+	rb.memcpy_into(head, HEAD_SIZE);
+	EXPECT_FALSE(reader.read(rb));
+
+	CY_FREE(content);
+}
+
+//-------------------------------------------------------------------------------------
+TEST(Packet, View)
+{
+	const size_t HEAD_SIZE = 8;
+	const uint16_t PACKET_ID = 0x1234;
+	const uint32_t RESERVED = 0xFACEC00Du;
+
+	char content[100];
+	for (size_t i = 0; i < sizeof(content); i++) {
+		content[i] = (char)(rand() & 0xFF);
+	}
+	uint32_t head = 0;
+
+	PacketView view;
+	EXPECT_TRUE(view.empty());
+
+	//not complete
+	RingBuf rb;
+	EXPECT_FALSE(view.parse(HEAD_SIZE, rb));
+	rb.memcpy_into(_makeHead((uint16_t)sizeof(content), PACKET_ID, head), sizeof(uint32_t));
+	rb.memcpy_into(&RESERVED, sizeof(RESERVED));
+	rb.memcpy_into(content, sizeof(content) - 1);
+	EXPECT_FALSE(view.parse(HEAD_SIZE, rb));
+	EXPECT_TRUE(view.empty());
+
+	//contiguous, point to the ring buf
+	rb.memcpy_into(content + sizeof(content) - 1, 1);
+	EXPECT_TRUE(view.parse(HEAD_SIZE, rb));
+	const uint8_t* block = nullptr;
+	rb.get_readable_block(&block);
+	EXPECT_FALSE(view.is_copied());
+	EXPECT_EQ((const char*)block, view.get_memory_buf());
+	EXPECT_EQ(PACKET_ID, view.get_packet_id());
+	EXPECT_EQ(sizeof(content), view.get_packet_size());
+	EXPECT_EQ(HEAD_SIZE + sizeof(content), view.get_memory_size());
+	EXPECT_EQ(0, memcmp(view.get_memory_buf() + sizeof(uint32_t), &RESERVED, sizeof(RESERVED)));
+	EXPECT_EQ(0, memcmp(view.get_packet_content(), content, sizeof(content)));
+
+	//parse again without consume, the same one
+	EXPECT_TRUE(view.parse(HEAD_SIZE, rb));
+	EXPECT_EQ(HEAD_SIZE + sizeof(content), rb.size());
+	view.consume();
+	EXPECT_TRUE(view.empty());
+	EXPECT_TRUE(rb.empty());
+
+	//wrapped around the end of ring buf(the head too), copied
+	std::vector<char> filler(RingBuf::kDefaultCapacity - 2);
+	rb.memcpy_into(&(filler[0]), filler.size());
+	rb.discard(filler.size() - 2);
+	rb.memcpy_into(_makeHead((uint16_t)sizeof(content), PACKET_ID, head), sizeof(uint32_t));
+	rb.memcpy_into(&RESERVED, sizeof(RESERVED));
+	rb.memcpy_into(content, sizeof(content));
+	rb.discard(2);
+	EXPECT_EQ(RingBuf::kDefaultCapacity, rb.capacity());
+
+	EXPECT_TRUE(view.parse(HEAD_SIZE, rb));
+	EXPECT_TRUE(view.is_copied());
+	EXPECT_EQ(PACKET_ID, view.get_packet_id());
+	EXPECT_EQ(sizeof(content), view.get_packet_size());
+	EXPECT_EQ(0, memcmp(view.get_memory_buf() + sizeof(uint32_t), &RESERVED, sizeof(RESERVED)));
+	EXPECT_EQ(0, memcmp(view.get_packet_content(), content, sizeof(content)));
+	view.consume();
+	EXPECT_TRUE(rb.empty());
+
+	//wide head, empty content
+	uint8_t wide_head[6];
+	_makeWideHead(0, PACKET_ID, wide_head);
+	rb.memcpy_into(wide_head, sizeof(wide_head));
+	rb.memcpy_into(&RESERVED, 2);
+	rb.memcpy_into(wide_head, sizeof(wide_head));
+	EXPECT_TRUE(view.parse_wide(HEAD_SIZE, rb));
+	EXPECT_EQ(Packet::kWideHead, view.get_head_format());
+	EXPECT_EQ(PACKET_ID, view.get_packet_id());
+	EXPECT_EQ(0u, view.get_packet_size());
+	EXPECT_EQ(nullptr, view.get_packet_content());
+	view.consume();
+	EXPECT_EQ(sizeof(wide_head), rb.size());
+
+	//a huge size in head, never wait it when it's larger than the max
+	rb.reset();
+	_makeWideHead(0xFFFFFFF0u, PACKET_ID, wide_head);
+	rb.memcpy_into(wide_head, sizeof(wide_head));
+	rb.memcpy_into(&RESERVED, 2);
+	EXPECT_FALSE(view.parse_wide(HEAD_SIZE, rb));
+	EXPECT_FALSE(view.is_oversize());
+	EXPECT_FALSE(view.parse_wide(HEAD_SIZE, rb, 1024));
+	EXPECT_TRUE(view.is_oversize());
+	EXPECT_EQ(HEAD_SIZE, rb.size());
+}
+
 }
@@ -0,0 +1,141 @@
+#include <cy_core.h>
+#include <cy_event.h>
+#include <cy_network.h>
+
+#include <gtest/gtest.h>
+
+using namespace cyclone;
+
+namespace {
+
+//-------------------------------------------------------------------------------------
+TEST(RateLimit, TokenBucket)
+{
+	TokenBucket bucket;
+	EXPECT_FALSE(bucket.is_limited());
+	EXPECT_EQ(INT64_MAX, bucket.refill(0));
+
+	//1000 bytes per second, 100 bytes burst
+	bucket.set_rate(1000, 100, 0);
+	EXPECT_TRUE(bucket.is_limited());
+	EXPECT_EQ(100, bucket.refill(0));
+	EXPECT_EQ(0, bucket.get_wait_time());
+
+	//overdraw
+	bucket.consume(150);
+	EXPECT_EQ(-50, bucket.refill(0));
+	EXPECT_EQ(51 * 1000, bucket.get_wait_time());
+	EXPECT_EQ(0, bucket.refill(50 * 1000));
+	EXPECT_EQ(1, bucket.refill(51 * 1000));
+
+	//never above the burst
+	EXPECT_EQ(100, bucket.refill(100 * 1000 * 1000));
+
+	//default burst is the bytes of 100ms
+	bucket.set_rate(1000, 0, 0);
+	EXPECT_EQ(100, bucket.refill(0));
+
+	bucket.set_rate(0, 0, 0);
+	EXPECT_FALSE(bucket.is_limited());
+	EXPECT_EQ(INT64_MAX, bucket.refill(0));
+}
+
+//-------------------------------------------------------------------------------------
+TEST(RateLimit, Read)
+{
+	const size_t kTotalSize = 60 * 1024;
+
+	RateLimit limit;
+	limit.read_rate = 100 * 1024;
+	limit.read_burst = 10 * 1024;
+
+	atomic_uint64_t received(0);
+	atomic_bool_t throttled(false);
+
+	TcpServer server("rate_limit", nullptr);
+	server.m_listener.onMessage = [&](TcpServer*, int32_t, ConnectionPtr conn) {
+		RingBuf& rb = conn->get_input_buf();
+		received += rb.size();
+		rb.reset();
+		if (conn->is_read_throttled()) throttled = true;
+	};
+	EXPECT_TRUE(server.bind(Address(0, true), false));
+	EXPECT_FALSE(server.set_rate_limit(1, limit));
+	EXPECT_TRUE(server.set_rate_limit(0, limit));
+	EXPECT_EQ(limit.read_rate, server.get_rate_limit(0).read_rate);
+	EXPECT_TRUE(server.start(1));
+
+	socket_t sfd = socket_api::create_socket();
+	EXPECT_TRUE(socket_api::connect(sfd, server.get_bind_address(0).get_sockaddr_in()));
+
+	std::vector<char> data(kTotalSize, 'x');
+	int64_t begin_time = sys_api::utc_time_now();
+	size_t sent = 0;
+	while (sent < kTotalSize) {
+		ssize_t n = socket_api::write(sfd, &data[sent], kTotalSize - sent);
+		if (n <= 0) break;
+		sent += (size_t)n;
+	}
+
+	//wait 2 seconds at most
+	while (received.load() < kTotalSize && sys_api::utc_time_now() - begin_time < 2 * 1000 * 1000) {
+		sys_api::thread_sleep(1);
+	}
+	int64_t cost_time = sys_api::utc_time_now() - begin_time;
+
+	//the burst is read at once, the others wait refill
+	EXPECT_EQ(kTotalSize, received.load());
+	EXPECT_TRUE(throttled.load());
+	EXPECT_GE(cost_time, 400 * 1000);
+	EXPECT_LT(cost_time, 2 * 1000 * 1000);
+
+	socket_api::close_socket(sfd);
+	sys_api::thread_sleep(50);
+	server.stop();
+	server.join();
+}
+
+//-------------------------------------------------------------------------------------
+TEST(RateLimit, Write)
+{
+	const size_t kTotalSize = 60 * 1024;
+
+	TcpServer server("rate_limit", nullptr);
+	server.m_listener.onConnected = [&](TcpServer*, int32_t, ConnectionPtr conn) {
+		RateLimit limit;
+		limit.write_rate = 100 * 1024;
+		limit.write_burst = 10 * 1024;
+		conn->set_rate_limit(limit);
+
+		//all the data should be sent before close
+		std::vector<char> data(kTotalSize, 'x');
+		conn->send(&data[0], kTotalSize);
+		EXPECT_TRUE(conn->is_write_throttled());
+		conn->shutdown();
+	};
+	EXPECT_TRUE(server.bind(Address(0, true), false));
+	EXPECT_TRUE(server.start(1));
+
+	int64_t begin_time = sys_api::utc_time_now();
+	socket_t sfd = socket_api::create_socket();
+	EXPECT_TRUE(socket_api::connect(sfd, server.get_bind_address(0).get_sockaddr_in()));
+
+	char temp[4096];
+	size_t received = 0;
+	for (;;) {
+		ssize_t n = socket_api::read(sfd, temp, sizeof(temp));
+		if (n <= 0) break;
+		received += (size_t)n;
+	}
+	int64_t cost_time = sys_api::utc_time_now() - begin_time;
+
+	EXPECT_EQ(kTotalSize, received);
+	EXPECT_GE(cost_time, 400 * 1000);
+	EXPECT_LT(cost_time, 2 * 1000 * 1000);
+
+	socket_api::close_socket(sfd);
+	server.stop();
+	server.join();
+}
+
+}
@@ -433,6 +433,65 @@ TEST(RingBuf, Basic)
 	}
 }
 
+//-------------------------------------------------------------------------------------
+TEST(RingBuf, Shrink)
+{
+	const char* text_pattern = "Hello,World!";
+	const size_t text_length = strlen(text_pattern);
+
+	//no memory until the first write
+	{
+		RingBuf rb(0);
+		CHECK_RINGBUF_EMPTY(rb, 0);
+		EXPECT_EQ(0u, rb.discard(1));
+		EXPECT_EQ(0u, rb.peek(0, nullptr, 1));
+
+		rb.memcpy_into(text_pattern, text_length);
+		CHECK_RINGBUF_SIZE(rb, text_length, RingBuf::kDefaultCapacity);
+		EXPECT_EQ(0, memcmp(rb.normalize(), text_pattern, text_length));
+
+		//can't release memory with data
+		rb.shrink();
+		CHECK_RINGBUF_SIZE(rb, text_length, RingBuf::kDefaultCapacity);
+
+		rb.discard(text_length);
+		rb.shrink();
+		CHECK_RINGBUF_EMPTY(rb, 0);
+	}
+
+	//shrink the grown buf
+	{
+		const size_t big_size = RingBuf::kDefaultCapacity * 8;
+		uint8_t* buffer = new uint8_t[big_size];
+		_fillRandom(buffer, big_size);
+
+		RingBuf rb;
+		rb.memcpy_into(buffer, big_size);
+		EXPECT_LT(big_size, rb.capacity());
+
+		rb.discard(big_size - RingBuf::kDefaultCapacity * 2);
+		rb.shrink();
+		CHECK_RINGBUF_SIZE(rb, RingBuf::kDefaultCapacity * 2, (RingBuf::kDefaultCapacity + 1) * 2 - 1);
+		EXPECT_EQ(0, memcmp(rb.normalize(), buffer + big_size - RingBuf::kDefaultCapacity * 2, rb.size()));
+
+		rb.discard(RingBuf::kDefaultCapacity * 2 - text_length);
+		rb.shrink();
+		CHECK_RINGBUF_SIZE(rb, text_length, RingBuf::kDefaultCapacity);
+		EXPECT_EQ(0, memcmp(rb.normalize(), buffer + big_size - text_length, text_length));
+
+		delete[] buffer;
+	}
+
+	//read socket into the buf without memory
+	{
+		Pipe pipe;
+		RingBuf rb(0);
+		EXPECT_EQ((ssize_t)text_length, pipe.write(text_pattern, text_length));
+		EXPECT_EQ((ssize_t)text_length, rb.read_socket(pipe.get_read_port()));
+		CHECK_RINGBUF_SIZE(rb, text_length, RingBuf::kDefaultCapacity);
+		EXPECT_EQ(0, memcmp(rb.normalize(), text_pattern, text_length));
+	}
+}
 
 //-------------------------------------------------------------------------------------
 TEST(RingBuf, Socket)
@@ -551,6 +610,44 @@ TEST(RingBuf, Socket)
 
 		EXPECT_EQ(0, memcmp(rb_rcv.normalize(), buffer1 + RingBuf::kDefaultCapacity - TEST_WRAP_SIZE * 2, TEST_WRAP_SIZE * 4));
 	}
+
+	//make wrap condition and write_socket with max count
+	{
+		const size_t TEST_WRAP_SIZE = 32;
+
+		RingBuf rb_snd;
+		rb_snd.memcpy_into(buffer1, RingBuf::kDefaultCapacity - TEST_WRAP_SIZE);
+		rb_snd.discard(RingBuf::kDefaultCapacity - TEST_WRAP_SIZE * 2);
+		rb_snd.memcpy_into(buffer1 + RingBuf::kDefaultCapacity - TEST_WRAP_SIZE, TEST_WRAP_SIZE * 3);
+		CHECK_RINGBUF_SIZE(rb_snd, TEST_WRAP_SIZE * 4, RingBuf::kDefaultCapacity);
+
+		Pipe pipe;
+		EXPECT_EQ(TEST_WRAP_SIZE, (size_t)rb_snd.write_socket(pipe.get_write_port(), TEST_WRAP_SIZE));
+		CHECK_RINGBUF_SIZE(rb_snd, TEST_WRAP_SIZE * 3, RingBuf::kDefaultCapacity);
+		EXPECT_EQ(TEST_WRAP_SIZE * 2, (size_t)rb_snd.write_socket(pipe.get_write_port(), TEST_WRAP_SIZE * 2));
+		CHECK_RINGBUF_SIZE(rb_snd, TEST_WRAP_SIZE, RingBuf::kDefaultCapacity);
+		EXPECT_EQ(TEST_WRAP_SIZE, (size_t)rb_snd.write_socket(pipe.get_write_port(), TEST_WRAP_SIZE * 2));
+		CHECK_RINGBUF_EMPTY(rb_snd, RingBuf::kDefaultCapacity);
+
+		RingBuf rb_rcv;
+		EXPECT_EQ(TEST_WRAP_SIZE * 4, (size_t)rb_rcv.read_socket(pipe.get_read_port()));
+		EXPECT_EQ(0, memcmp(rb_rcv.normalize(), buffer1 + RingBuf::kDefaultCapacity - TEST_WRAP_SIZE * 2, TEST_WRAP_SIZE * 4));
+	}
+
+	//read_socket with max count
+	{
+		Pipe pipe;
+		EXPECT_EQ(RingBuf::kDefaultCapacity * 2, pipe.write((const char*)buffer1, RingBuf::kDefaultCapacity * 2));
+
+		RingBuf rb_rcv;
+		EXPECT_EQ(text_length, (size_t)rb_rcv.read_socket(pipe.get_read_port(), true, text_length));
+		CHECK_RINGBUF_SIZE(rb_rcv, text_length, RingBuf::kDefaultCapacity);
+
+		//the extra data is cut too
+		EXPECT_EQ(RingBuf::kDefaultCapacity, (size_t)rb_rcv.read_socket(pipe.get_read_port(), true, RingBuf::kDefaultCapacity));
+		CHECK_RINGBUF_SIZE(rb_rcv, text_length + RingBuf::kDefaultCapacity, (RingBuf::kDefaultCapacity + 1) * 2 - 1);
+		EXPECT_EQ(0, memcmp(rb_rcv.normalize(), buffer1, text_length + RingBuf::kDefaultCapacity));
+	}
 }
 
 }
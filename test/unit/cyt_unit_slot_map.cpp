@@ -0,0 +1,124 @@
+#include <cy_core.h>
+
+#include <gtest/gtest.h>
+
+using namespace cyclone;
+
+namespace {
+
+//-------------------------------------------------------------------------------------
+TEST(SlotMap, Basic)
+{
+	SlotMap<int32_t> slot_map(3);
+	EXPECT_TRUE(slot_map.empty());
+	EXPECT_EQ(3, slot_map.get_tag());
+
+	std::vector<int32_t> keys;
+	for (int32_t i = 0; i < 100; i++) {
+		int32_t key = slot_map.insert(i);
+		EXPECT_GE(key, 0);
+		EXPECT_EQ(3, (key >> SlotMap<int32_t>::kSlotBits) & (SlotMap<int32_t>::kMaxTags - 1));
+		keys.push_back(key);
+	}
+	EXPECT_EQ(100u, slot_map.size());
+
+	for (int32_t i = 0; i < 100; i++) {
+		int32_t* value = slot_map.find(keys[(size_t)i]);
+		ASSERT_NE(nullptr, value);
+		EXPECT_EQ(i, *value);
+	}
+
+	//erase the even ones, the last value is moved to the hole
+	for (int32_t i = 0; i < 100; i += 2) {
+		EXPECT_TRUE(slot_map.erase(keys[(size_t)i]));
+		EXPECT_FALSE(slot_map.erase(keys[(size_t)i]));
+	}
+	EXPECT_EQ(50u, slot_map.size());
+	for (int32_t i = 0; i < 100; i++) {
+		int32_t* value = slot_map.find(keys[(size_t)i]);
+		if (i % 2 == 0) {
+			EXPECT_EQ(nullptr, value);
+		}
+		else {
+			ASSERT_NE(nullptr, value);
+			EXPECT_EQ(i, *value);
+		}
+	}
+
+	//dense iteration
+	int32_t sum = 0;
+	size_t index = 0;
+	for (auto it = slot_map.begin(); it != slot_map.end(); ++it, ++index) {
+		sum += *it;
+		EXPECT_EQ(*it, *slot_map.find(slot_map.get_key(index)));
+	}
+	EXPECT_EQ(2500, sum);
+
+	//not enough free slots, a new slot is used, the stale key is invalid
+	int32_t new_key = slot_map.insert(1000);
+	EXPECT_EQ(100, new_key & (SlotMap<int32_t>::kMaxSlots - 1));
+	EXPECT_EQ(nullptr, slot_map.find(keys[0]));
+	EXPECT_EQ(1000, *slot_map.find(new_key));
+
+	//the key of other tag
+	SlotMap<int32_t> other(4);
+	int32_t other_key = other.insert(0);
+	EXPECT_NE(nullptr, other.find(other_key));
+	EXPECT_EQ(nullptr, slot_map.find(other_key));
+	EXPECT_EQ(nullptr, slot_map.find(-1));
+
+	slot_map.clear();
+	EXPECT_TRUE(slot_map.empty());
+	EXPECT_EQ(nullptr, slot_map.find(new_key));
+}
+
+//-------------------------------------------------------------------------------------
+TEST(SlotMap, Reuse)
+{
+	const int32_t min_free = SlotMap<int32_t>::kMinFreeSlots;
+	const int32_t slot_mask = SlotMap<int32_t>::kMaxSlots - 1;
+
+	SlotMap<int32_t> slot_map;
+	int32_t stale_key = slot_map.insert(0);
+	EXPECT_TRUE(slot_map.erase(stale_key));
+
+	//the freed slot comes back in fifo order after min_free slots are free
+	for (int32_t i = 1; i <= min_free; i++) {
+		int32_t key = slot_map.insert(i);
+		EXPECT_EQ(i == min_free ? 0 : i, key & slot_mask);
+		EXPECT_TRUE(slot_map.erase(key));
+	}
+
+	//all slots are free and used in turn, the stale key(generation 0) doesn't match until the
+	//generation of slot 0 wrapped
+	int32_t insert_counts = 0;
+	for (;;) {
+		int32_t key = slot_map.insert(insert_counts++);
+		if (key == stale_key) break;
+		ASSERT_EQ(nullptr, slot_map.find(stale_key));
+		ASSERT_GT(64 * min_free, insert_counts);
+		EXPECT_TRUE(slot_map.erase(key));
+	}
+	EXPECT_LE(62 * min_free, insert_counts);
+}
+
+//-------------------------------------------------------------------------------------
+TEST(SlotMap, Full)
+{
+	const int32_t max_slots = SlotMap<int32_t>::kMaxSlots;
+
+	SlotMap<int32_t> slot_map;
+	int32_t last_key = -1;
+	for (int32_t i = 0; i < max_slots; i++) {
+		last_key = slot_map.insert(i);
+		ASSERT_GE(last_key, 0);
+	}
+	EXPECT_EQ((size_t)max_slots, slot_map.size());
+	EXPECT_EQ(-1, slot_map.insert(0));
+
+	EXPECT_TRUE(slot_map.erase(last_key));
+	EXPECT_GE(slot_map.insert(0), 0);
+	EXPECT_EQ(-1, slot_map.insert(0));
+}
+
+}
@@ -0,0 +1,113 @@
+#include <cy_core.h>
+#include <cy_event.h>
+#include <cy_network.h>
+
+#include <gtest/gtest.h>
+
+#ifndef CY_SYS_WINDOWS
+#include <netinet/tcp.h>
+
+using namespace cyclone;
+
+namespace {
+
+//-------------------------------------------------------------------------------------
+static int _getOption(socket_t sfd, int level, int optname)
+{
+	int optval = -1;
+	socklen_t optlen = (socklen_t)sizeof(optval);
+	if (::getsockopt(sfd, level, optname, &optval, &optlen) != 0) return -1;
+	return optval;
+}
+
+//-------------------------------------------------------------------------------------
+TEST(SocketOptions, Apply)
+{
+	//default is keep alive only
+	socket_t sfd = socket_api::create_socket();
+	EXPECT_TRUE(SocketOptions().apply_connection(sfd));
+	EXPECT_EQ(1, _getOption(sfd, SOL_SOCKET, SO_KEEPALIVE));
+	EXPECT_EQ(0, _getOption(sfd, IPPROTO_TCP, TCP_NODELAY));
+	socket_api::close_socket(sfd);
+
+	SocketOptions options;
+	options.send_buf_size = 64 * 1024;
+	options.recv_buf_size = 64 * 1024;
+	options.no_delay = true;
+	options.keep_alive = false;
+	options.notsent_lowat = 16 * 1024;
+
+	sfd = socket_api::create_socket();
+	EXPECT_TRUE(options.apply_connect(sfd));
+	EXPECT_EQ(0, _getOption(sfd, SOL_SOCKET, SO_KEEPALIVE));
+	EXPECT_EQ(1, _getOption(sfd, IPPROTO_TCP, TCP_NODELAY));
+	EXPECT_LE(64 * 1024, _getOption(sfd, SOL_SOCKET, SO_SNDBUF));
+	EXPECT_LE(64 * 1024, _getOption(sfd, SOL_SOCKET, SO_RCVBUF));
+#ifdef TCP_NOTSENT_LOWAT
+	EXPECT_EQ(16 * 1024, _getOption(sfd, IPPROTO_TCP, TCP_NOTSENT_LOWAT));
+#endif
+	socket_api::close_socket(sfd);
+
+	//presets
+	EXPECT_TRUE(SocketOptions::low_latency_rpc().no_delay);
+	EXPECT_LT(0u, SocketOptions::low_latency_rpc().defer_accept);
+	EXPECT_LT(0, SocketOptions::bulk_transfer().recv_buf_size);
+}
+
+//-------------------------------------------------------------------------------------
+TEST(SocketOptions, Server)
+{
+	SocketOptions options = SocketOptions::low_latency_rpc();
+	//client side tfo may be disabled by sysctl, use normal connect
+	options.fast_open_connect = false;
+
+	atomic_int32_t connected_counts(0);
+	atomic_int32_t no_delay(-1);
+
+	TcpServer server("options", nullptr);
+	server.m_listener.onConnected = [&](TcpServer*, int32_t, ConnectionPtr conn) {
+		no_delay = _getOption(conn->get_socket(), IPPROTO_TCP, TCP_NODELAY);
+		connected_counts++;
+	};
+	server.m_listener.onMessage = [](TcpServer*, int32_t, ConnectionPtr conn) {
+		RingBuf& rb = conn->get_input_buf();
+		char temp[64];
+		while (!rb.empty()) {
+			size_t len = rb.memcpy_out(temp, sizeof(temp));
+			conn->send(temp, len);
+		}
+	};
+	EXPECT_TRUE(server.bind(Address(0, true), false, options));
+	EXPECT_TRUE(server.start(1));
+	EXPECT_TRUE(server.get_socket_options(0).no_delay);
+
+	socket_t sfd = socket_api::create_socket();
+	EXPECT_TRUE(options.apply_connect(sfd));
+	EXPECT_TRUE(socket_api::connect(sfd, server.get_bind_address(0).get_sockaddr_in()));
+
+#ifdef TCP_DEFER_ACCEPT
+	//the connection is not accepted until the first data arrives
+	sys_api::thread_sleep(100);
+	EXPECT_EQ(0, connected_counts.load());
+#endif
+
+	char temp[64] = { 0 };
+	EXPECT_EQ(5, socket_api::write(sfd, "hello", 5));
+	size_t received = 0;
+	while (received < 5) {
+		ssize_t n = socket_api::read(sfd, temp + received, 5 - received);
+		if (n <= 0) break;
+		received += (size_t)n;
+	}
+	EXPECT_EQ(0, memcmp(temp, "hello", 5));
+	EXPECT_EQ(1, connected_counts.load());
+	EXPECT_EQ(1, no_delay.load());
+
+	socket_api::close_socket(sfd);
+	sys_api::thread_sleep(50);
+	server.stop();
+	server.join();
+}
+
+}
+#endif
@@ -0,0 +1,195 @@
+#include <cy_core.h>
+#include <cy_event.h>
+#include <cy_network.h>
+
+#include <gtest/gtest.h>
+
+using namespace cyclone;
+
+namespace {
+
+//-------------------------------------------------------------------------------------
+static bool _stepUntil(Looper* looper, std::function<bool()> condition)
+{
+	//wait 2 seconds at most
+	int64_t end_time = sys_api::utc_time_now() + 2 * 1000 * 1000;
+	while (!condition()) {
+		if (sys_api::utc_time_now() > end_time) return false;
+		looper->step();
+	}
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+struct BlackHole
+{
+	//a listen socket never accept, after the accept queue is full, the syn is dropped
+	socket_t listen_socket;
+	std::vector<socket_t> fillers;
+	Address address;
+
+	BlackHole() {
+		listen_socket = socket_api::create_socket(AF_INET);
+		Address bind_addr(0, true);
+		socket_api::bind(listen_socket, bind_addr.get_sockaddr(), bind_addr.get_sockaddr_len());
+		socket_api::listen(listen_socket, 0);
+		address = Address(false, listen_socket);
+
+		//fill the accept queue
+		for (int32_t i = 0; i < 1024; i++) {
+			socket_t sfd = socket_api::create_socket(AF_INET);
+			socket_api::set_nonblock(sfd, true);
+			socket_api::connect(sfd, address.get_sockaddr(), address.get_sockaddr_len());
+			fillers.push_back(sfd);
+
+			fd_set wset;
+			FD_ZERO(&wset);
+			FD_SET(sfd, &wset);
+			timeval tv = { 0, 100 * 1000 };
+			if (select((int)sfd + 1, nullptr, &wset, nullptr, &tv) == 0) break;
+		}
+	}
+	~BlackHole() {
+		for (auto sfd : fillers) {
+			socket_api::close_socket(sfd);
+		}
+		socket_api::close_socket(listen_socket);
+	}
+};
+
+//-------------------------------------------------------------------------------------
+static Address _closedAddress(void)
+{
+	//bind a port and close it, the connect will be refused
+	socket_t sfd = socket_api::create_socket(AF_INET);
+	Address bind_addr(0, true);
+	socket_api::bind(sfd, bind_addr.get_sockaddr(), bind_addr.get_sockaddr_len());
+	Address address(false, sfd);
+	socket_api::close_socket(sfd);
+	return address;
+}
+
+//-------------------------------------------------------------------------------------
+TEST(TcpClient, ConnectTimeout)
+{
+	BlackHole black_hole;
+	Looper* looper = Looper::create_looper();
+
+	int32_t result = -1;
+	TcpClientPtr client = std::make_shared<TcpClient>(looper, nullptr);
+	client->m_listener.onConnected = [&result](TcpClientPtr, ConnectionPtr conn, bool success) -> uint32_t {
+		EXPECT_EQ(nullptr, conn);
+		result = success ? 1 : 0;
+		return 0;
+	};
+
+	int64_t begin_time = sys_api::utc_time_now();
+	EXPECT_TRUE(client->connect(black_hole.address, 100));
+	EXPECT_EQ(Connection::kConnecting, client->get_connection_state());
+	EXPECT_TRUE(_stepUntil(looper, [&result]() { return result >= 0; }));
+	int64_t cost_time = sys_api::utc_time_now() - begin_time;
+
+	EXPECT_EQ(0, result);
+	EXPECT_GE(cost_time, 90 * 1000);
+	EXPECT_LT(cost_time, 1000 * 1000);
+	EXPECT_EQ(Connection::kDisconnected, client->get_connection_state());
+
+	client = nullptr;
+	Looper::destroy_looper(looper);
+}
+
+//-------------------------------------------------------------------------------------
+TEST(TcpClient, RaceConnect)
+{
+	BlackHole black_hole;
+	Address refused_address = _closedAddress();
+
+	TcpServer server("race", nullptr);
+	EXPECT_TRUE(server.bind(Address(0, true), false));
+	EXPECT_TRUE(server.start(1));
+	sys_api::thread_sleep(50);
+	Address server_address = server.get_bind_address(0);
+
+	Looper* looper = Looper::create_looper();
+
+	ConnectionPtr connection;
+	bool done = false;
+	TcpClientPtr client = std::make_shared<TcpClient>(looper, nullptr);
+	client->m_listener.onConnected = [&](TcpClientPtr, ConnectionPtr conn, bool success) -> uint32_t {
+		EXPECT_TRUE(success);
+		connection = conn;
+		done = true;
+		return 0;
+	};
+	client->m_listener.onClose = [&](TcpClientPtr) {
+		connection = nullptr;
+	};
+
+	//the slow one is raced by the next candidate after attempt delay
+	std::vector<Address> candidates;
+	candidates.push_back(black_hole.address);
+	candidates.push_back(server_address);
+
+	int64_t begin_time = sys_api::utc_time_now();
+	EXPECT_TRUE(client->connect(candidates, 2000, 50));
+	EXPECT_TRUE(_stepUntil(looper, [&done]() { return done; }));
+	int64_t cost_time = sys_api::utc_time_now() - begin_time;
+
+	EXPECT_GE(cost_time, 40 * 1000);
+	EXPECT_LT(cost_time, 1000 * 1000);
+	EXPECT_EQ(server_address.get_port(), client->get_server_address().get_port());
+	EXPECT_EQ(Connection::kConnected, client->get_connection_state());
+
+	client->disconnect();
+	EXPECT_TRUE(_stepUntil(looper, [&connection]() { return connection == nullptr; }));
+
+	//the failed one is skipped at once, without waiting attempt delay
+	done = false;
+	candidates.clear();
+	candidates.push_back(refused_address);
+	candidates.push_back(server_address);
+
+	client = std::make_shared<TcpClient>(looper, nullptr);
+	client->m_listener.onConnected = [&](TcpClientPtr, ConnectionPtr conn, bool success) -> uint32_t {
+		EXPECT_TRUE(success);
+		connection = conn;
+		done = true;
+		return 0;
+	};
+	client->m_listener.onClose = [&](TcpClientPtr) {
+		connection = nullptr;
+	};
+
+	begin_time = sys_api::utc_time_now();
+	EXPECT_TRUE(client->connect(candidates, 0, 5000));
+	EXPECT_TRUE(_stepUntil(looper, [&done]() { return done; }));
+	EXPECT_LT(sys_api::utc_time_now() - begin_time, 1000 * 1000);
+	EXPECT_EQ(server_address.get_port(), client->get_server_address().get_port());
+
+	client->disconnect();
+	EXPECT_TRUE(_stepUntil(looper, [&connection]() { return connection == nullptr; }));
+
+	//all failed
+	int32_t result = -1;
+	candidates.clear();
+	candidates.push_back(refused_address);
+	candidates.push_back(refused_address);
+
+	client = std::make_shared<TcpClient>(looper, nullptr);
+	client->m_listener.onConnected = [&result](TcpClientPtr, ConnectionPtr, bool success) -> uint32_t {
+		result = success ? 1 : 0;
+		return 0;
+	};
+	EXPECT_TRUE(client->connect(candidates, 0, 10));
+	EXPECT_TRUE(_stepUntil(looper, [&result]() { return result >= 0; }));
+	EXPECT_EQ(0, result);
+	EXPECT_EQ(Connection::kDisconnected, client->get_connection_state());
+
+	client = nullptr;
+	Looper::destroy_looper(looper);
+
+	server.stop();
+	server.join();
+}
+
+}
@@ -0,0 +1,179 @@
+#include <cy_core.h>
+#include <cy_event.h>
+#include <cy_network.h>
+
+#include <gtest/gtest.h>
+
+using namespace cyclone;
+
+namespace {
+
+//-------------------------------------------------------------------------------------
+static bool _stepUntil(Looper* looper, std::function<bool()> condition)
+{
+	//wait 2 seconds at most
+	int64_t end_time = sys_api::utc_time_now() + 2 * 1000 * 1000;
+	while (!condition()) {
+		if (sys_api::utc_time_now() > end_time) return false;
+		looper->step();
+	}
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+TEST(TcpClientPool, Basic)
+{
+	TcpServer server("pool_echo", nullptr);
+	server.m_listener.onMessage = [](TcpServer*, int32_t, ConnectionPtr conn) {
+		RingBuf& buf = conn->get_input_buf();
+		char temp[256];
+		size_t len = buf.memcpy_out(temp, sizeof(temp));
+		conn->send(temp, len);
+	};
+	EXPECT_TRUE(server.bind(Address(0, true), false));
+	EXPECT_TRUE(server.start(1));
+	sys_api::thread_sleep(50);
+
+	Address address = server.get_bind_address(0);
+
+	Looper* looper = Looper::create_looper();
+	TcpClientPool* pool = new TcpClientPool(looper);
+	EXPECT_EQ(looper, pool->get_looper());
+
+	//first lease, create a new connection
+	ConnectionPtr leased;
+	pool->lease(address, [&leased](ConnectionPtr conn) { leased = conn; });
+	EXPECT_EQ(1u, pool->get_connecting_counts(address));
+	EXPECT_TRUE(_stepUntil(looper, [&leased]() { return leased != nullptr; }));
+	EXPECT_EQ(Connection::kConnected, leased->get_state());
+	EXPECT_EQ(1u, pool->get_created_counts());
+	EXPECT_EQ(0u, pool->get_connecting_counts(address));
+
+	//send request and wait response
+	size_t received = 0;
+	leased->setOnMessageFunction([&received](ConnectionPtr conn) {
+		received += conn->get_input_buf().size();
+		conn->get_input_buf().reset();
+	});
+	leased->send("hello", 5);
+	EXPECT_TRUE(_stepUntil(looper, [&received]() { return received == 5; }));
+
+	//release and lease again, the same connection should be reused
+	Connection* first = leased.get();
+	pool->release(leased, true);
+	leased = nullptr;
+	EXPECT_EQ(1u, pool->get_idle_counts(address));
+
+	pool->lease(address, [&leased](ConnectionPtr conn) { leased = conn; });
+	EXPECT_EQ(first, leased.get());
+	EXPECT_EQ(1u, pool->get_reused_counts());
+	EXPECT_EQ(1u, pool->get_created_counts());
+	EXPECT_EQ(0u, pool->get_idle_counts(address));
+
+	//not reusable, shutdown it
+	pool->release(leased, false);
+	EXPECT_TRUE(_stepUntil(looper, [&leased]() { return leased->get_state() == Connection::kDisconnected; }));
+	leased = nullptr;
+
+	//the connection of other pool is ignored, even it's connected to the same address
+	TcpClientPool* other = new TcpClientPool(looper);
+	other->lease(address, [&leased](ConnectionPtr conn) { leased = conn; });
+	EXPECT_TRUE(_stepUntil(looper, [&leased]() { return leased != nullptr; }));
+	pool->release(leased, true);
+	EXPECT_EQ(0u, pool->get_idle_counts(address));
+	EXPECT_EQ(Connection::kConnected, leased->get_state());
+	other->release(leased, true);
+	EXPECT_EQ(1u, other->get_idle_counts(address));
+	leased = nullptr;
+	delete other;
+
+	//too many leases, wait for the connecting one
+	pool->set_max_connecting(1);
+	std::vector<ConnectionPtr> conns;
+	for (int32_t i = 0; i < 3; i++) {
+		pool->lease(address, [&conns](ConnectionPtr conn) { conns.push_back(conn); });
+	}
+	EXPECT_EQ(1u, pool->get_connecting_counts(address));
+	EXPECT_EQ(3u, pool->get_waiting_counts(address));
+	EXPECT_TRUE(_stepUntil(looper, [&conns]() { return conns.size() == 3; }));
+	EXPECT_EQ(4u, pool->get_created_counts());
+	EXPECT_EQ(0u, pool->get_waiting_counts(address));
+
+	//only two idle connections are kept, and closed after idle timeout
+	pool->set_max_idle(2);
+	pool->set_idle_timeout(50);
+	for (auto conn : conns) {
+		pool->release(conn, true);
+	}
+	EXPECT_EQ(2u, pool->get_idle_counts(address));
+	EXPECT_TRUE(_stepUntil(looper, [&]() { return pool->get_idle_counts(address) == 0; }));
+	EXPECT_TRUE(_stepUntil(looper, [&conns]() {
+		for (auto conn : conns) {
+			if (conn->get_state() != Connection::kDisconnected) return false;
+		}
+		return true;
+	}));
+	conns.clear();
+
+	//connect failed
+	server.stop();
+	server.join();
+
+	bool failed = false;
+	pool->lease(address, [&failed](ConnectionPtr conn) { failed = (conn == nullptr); });
+	EXPECT_TRUE(_stepUntil(looper, [&failed]() { return failed; }));
+	EXPECT_EQ(1u, pool->get_failed_counts());
+
+	delete pool;
+	Looper::destroy_looper(looper);
+}
+
+#ifdef CY_SYS_LINUX
+//-------------------------------------------------------------------------------------
+TEST(TcpClientPool, ConnectTimeout)
+{
+	//a listen socket never accept, the syn is dropped after the accept queue is full
+	socket_t listen_fd = socket_api::create_socket();
+	EXPECT_TRUE(socket_api::bind(listen_fd, Address(0, true).get_sockaddr_in()));
+	EXPECT_TRUE(socket_api::listen(listen_fd, 0));
+	Address address(false, listen_fd);
+
+	std::vector<socket_t> fillers;
+	for (int32_t i = 0; i < 4; i++) {
+		socket_t sfd = socket_api::create_socket();
+		socket_api::set_nonblock(sfd, true);
+		socket_api::connect(sfd, address.get_sockaddr_in());
+		fillers.push_back(sfd);
+	}
+	sys_api::thread_sleep(50);
+
+	Looper* looper = Looper::create_looper();
+	TcpClientPool* pool = new TcpClientPool(looper);
+	EXPECT_EQ(10u * 1000u, pool->get_connect_timeout());
+	pool->set_connect_timeout(100);
+	pool->set_max_connecting(1);
+
+	//both leases failed one by one
+	int32_t failed = 0;
+	for (int32_t i = 0; i < 2; i++) {
+		pool->lease(address, [&failed](ConnectionPtr conn) { if (conn == nullptr) failed++; });
+	}
+	EXPECT_EQ(1u, pool->get_connecting_counts(address));
+	EXPECT_EQ(2u, pool->get_waiting_counts(address));
+	EXPECT_TRUE(_stepUntil(looper, [&failed]() { return failed == 2; }));
+	EXPECT_EQ(2u, pool->get_failed_counts());
+	EXPECT_EQ(0u, pool->get_created_counts());
+	EXPECT_EQ(0u, pool->get_connecting_counts(address));
+	EXPECT_EQ(0u, pool->get_waiting_counts(address));
+
+	delete pool;
+	Looper::destroy_looper(looper);
+
+	for (auto sfd : fillers) {
+		socket_api::close_socket(sfd);
+	}
+	socket_api::close_socket(listen_fd);
+}
+#endif
+
+}
@@ -0,0 +1,1580 @@
+#include <cy_core.h>
+#include <cy_event.h>
+#include <cy_network.h>
+
+#include <gtest/gtest.h>
+
+#ifdef CY_SYS_LINUX
+#include <sys/resource.h>
+#endif
+
+using namespace cyclone;
+
+namespace {
+
+//-------------------------------------------------------------------------------------
+struct EchoServerData
+{
+	atomic_int32_t connected_counts;
+	atomic_int32_t closed_counts;
+};
+
+//-------------------------------------------------------------------------------------
+static void _startEchoServer(TcpServer& server, EchoServerData& data)
+{
+	data.connected_counts = 0;
+	data.closed_counts = 0;
+
+	server.m_listener.onConnected = [&data](TcpServer*, int32_t, ConnectionPtr) {
+		data.connected_counts++;
+	};
+	server.m_listener.onMessage = [](TcpServer*, int32_t, ConnectionPtr conn) {
+		RingBuf& rb = conn->get_input_buf();
+		char temp[64];
+		while (!rb.empty()) {
+			size_t len = rb.memcpy_out(temp, sizeof(temp));
+			conn->send(temp, len);
+		}
+	};
+	server.m_listener.onClose = [&data](TcpServer*, int32_t, ConnectionPtr) {
+		data.closed_counts++;
+	};
+}
+
+//-------------------------------------------------------------------------------------
+static bool _echoClient(const Address& address)
+{
+	socket_t sfd = socket_api::create_socket(address.get_family());
+	if (sfd == INVALID_SOCKET) return false;
+
+	bool ret = false;
+	const char* hello = "hello,cyclone!";
+	const size_t len = strlen(hello);
+	char temp[64] = { 0 };
+	if (socket_api::connect(sfd, address.get_sockaddr(), address.get_sockaddr_len()) &&
+		socket_api::write(sfd, hello, len) == (ssize_t)len) {
+
+		size_t received = 0;
+		while (received < len) {
+			ssize_t n = socket_api::read(sfd, temp + received, len - received);
+			if (n <= 0) break;
+			received += (size_t)n;
+		}
+		ret = (received == len && memcmp(temp, hello, len) == 0);
+	}
+	socket_api::close_socket(sfd);
+	return ret;
+}
+
+//-------------------------------------------------------------------------------------
+static void _testAcceptMode(TcpServer::AcceptMode mode)
+{
+	const int32_t thread_counts = 4;
+	const int32_t client_counts = 64;
+
+	EchoServerData data;
+
+	TcpServer server("echo", nullptr);
+	EXPECT_TRUE(server.set_accept_mode(mode));
+	EXPECT_EQ(mode, server.get_accept_mode());
+	_startEchoServer(server, data);
+
+	EXPECT_FALSE(server.set_listen_backlog(0));
+	EXPECT_TRUE(server.set_listen_backlog(128));
+	EXPECT_EQ(128, server.get_listen_backlog());
+
+	EXPECT_TRUE(server.bind(Address(0, true), false));
+	EXPECT_FALSE(server.set_accept_mode(TcpServer::kAcceptThread));
+	EXPECT_TRUE(server.start(thread_counts));
+	EXPECT_FALSE(server.set_listen_backlog(256));
+
+	Address address = server.get_bind_address(0);
+	EXPECT_NE(0, address.get_port());
+
+	//wait work threads listen
+	sys_api::thread_sleep(100);
+
+	for (int32_t i = 0; i < client_counts; i++) {
+		EXPECT_TRUE(_echoClient(address));
+	}
+
+	//wait close
+	for (int32_t i = 0; i < 100 && data.closed_counts.load() < client_counts; i++) {
+		sys_api::thread_sleep(10);
+	}
+	EXPECT_EQ(client_counts, data.connected_counts.load());
+	EXPECT_EQ(client_counts, data.closed_counts.load());
+	EXPECT_EQ(0u, server.get_accept_error_counts());
+
+	server.stop();
+	server.join();
+}
+
+//-------------------------------------------------------------------------------------
+static void _testConnectionAddress(TcpServer::AcceptMode mode)
+{
+	std::string peer_ip, local_ip, name;
+	std::atomic<uint16_t> peer_port(0), local_port(0);
+
+	TcpServer server("address", nullptr);
+	EXPECT_TRUE(server.set_accept_mode(mode));
+	server.m_listener.onConnected = [&](TcpServer*, int32_t, ConnectionPtr conn) {
+		peer_ip = conn->get_peer_addr().get_ip();
+		local_ip = conn->get_local_addr().get_ip();
+		name = conn->get_name();
+		local_port = conn->get_local_addr().get_port();
+		peer_port = conn->get_peer_addr().get_port();
+	};
+	EXPECT_TRUE(server.bind(Address(0, true), false));
+	EXPECT_TRUE(server.start(1));
+	sys_api::thread_sleep(50);
+
+	socket_t sfd = socket_api::create_socket();
+	EXPECT_TRUE(socket_api::connect(sfd, server.get_bind_address(0).get_sockaddr_in()));
+	for (int32_t i = 0; i < 100 && peer_port.load() == 0; i++) {
+		sys_api::thread_sleep(10);
+	}
+
+	//the peer address comes from accept, it should be the same as the client socket
+	struct sockaddr_in client_addr;
+	EXPECT_TRUE(socket_api::getsockname(sfd, client_addr));
+	EXPECT_EQ(Address(client_addr).get_port(), peer_port.load());
+	EXPECT_STREQ("127.0.0.1", peer_ip.c_str());
+	EXPECT_EQ(server.get_bind_address(0).get_port(), local_port.load());
+	EXPECT_STREQ("127.0.0.1", local_ip.c_str());
+	EXPECT_EQ(0u, name.find("connection_"));
+
+	socket_api::close_socket(sfd);
+	sys_api::thread_sleep(50);
+	server.stop();
+	server.join();
+}
+
+//-------------------------------------------------------------------------------------
+TEST(TcpServer, ConnectionAddress)
+{
+	_testConnectionAddress(TcpServer::kAcceptThread);
+#ifndef CY_SYS_WINDOWS
+	_testConnectionAddress(TcpServer::kReusePort);
+#endif
+}
+
+//-------------------------------------------------------------------------------------
+static void _testEchoAddress(TcpServer::AcceptMode mode, const Address& bind_addr)
+{
+	const int32_t client_counts = 16;
+
+	EchoServerData data;
+	TcpServer server("echo", nullptr);
+	EXPECT_TRUE(server.set_accept_mode(mode));
+	_startEchoServer(server, data);
+	EXPECT_TRUE(server.bind(bind_addr, false));
+	EXPECT_TRUE(server.start(2));
+	sys_api::thread_sleep(50);
+
+	Address address = server.get_bind_address(0);
+	EXPECT_EQ(bind_addr.get_family(), address.get_family());
+	for (int32_t i = 0; i < client_counts; i++) {
+		EXPECT_TRUE(_echoClient(address));
+	}
+
+	for (int32_t i = 0; i < 100 && data.closed_counts.load() < client_counts; i++) {
+		sys_api::thread_sleep(10);
+	}
+	EXPECT_EQ(client_counts, data.connected_counts.load());
+	EXPECT_EQ(client_counts, data.closed_counts.load());
+
+	server.stop();
+	server.join();
+}
+
+//-------------------------------------------------------------------------------------
+TEST(TcpServer, IPv6)
+{
+	Address address("::1", (uint16_t)0);
+	EXPECT_TRUE(address.is_ipv6());
+	EXPECT_STREQ("::1", address.get_ip());
+
+	//assignment copies the length and the formatted ip string
+	Address copied(8080, true);
+	copied = address;
+	EXPECT_TRUE(copied.is_ipv6());
+	EXPECT_EQ(address.get_sockaddr_len(), copied.get_sockaddr_len());
+	EXPECT_STREQ("::1", copied.get_ip());
+
+	_testEchoAddress(TcpServer::kAcceptThread, address);
+#ifndef CY_SYS_WINDOWS
+	_testEchoAddress(TcpServer::kReusePort, address);
+#endif
+}
+
+#ifdef CY_HAVE_SYS_UN_H
+//-------------------------------------------------------------------------------------
+TEST(TcpServer, UnixDomain)
+{
+	char path[MAX_PATH];
+	std::snprintf(path, MAX_PATH, "/tmp/cyt_unit_%d.sock", (int32_t)::getpid());
+
+	Address address = Address::unix_domain(path);
+	EXPECT_TRUE(address.is_unix());
+	EXPECT_STREQ(path, address.get_ip());
+	EXPECT_EQ(0, address.get_port());
+
+	//the socket file is removed after the server stop
+	_testEchoAddress(TcpServer::kAcceptThread, address);
+	EXPECT_NE(0, ::access(path, F_OK));
+
+	_testEchoAddress(TcpServer::kSharedListener, address);
+	EXPECT_NE(0, ::access(path, F_OK));
+
+	//abstract socket
+	Address abstract = Address::unix_domain("@cyt_unit_abstract");
+	EXPECT_TRUE(abstract.is_unix());
+	EXPECT_STREQ("@cyt_unit_abstract", abstract.get_ip());
+	_testEchoAddress(TcpServer::kAcceptThread, abstract);
+
+	//SO_REUSEPORT can't balance unix domain socket
+	TcpServer server("unix", nullptr);
+	EXPECT_TRUE(server.set_accept_mode(TcpServer::kReusePort));
+	EXPECT_FALSE(server.bind(address, false));
+}
+#endif
+
+//-------------------------------------------------------------------------------------
+TEST(TcpServer, AcceptThread)
+{
+	_testAcceptMode(TcpServer::kAcceptThread);
+}
+
+#ifndef CY_SYS_WINDOWS
+//-------------------------------------------------------------------------------------
+TEST(TcpServer, AcceptReusePort)
+{
+	_testAcceptMode(TcpServer::kReusePort);
+}
+
+//-------------------------------------------------------------------------------------
+TEST(TcpServer, AcceptSharedListener)
+{
+	_testAcceptMode(TcpServer::kSharedListener);
+}
+#endif
+
+//-------------------------------------------------------------------------------------
+struct PlacementData
+{
+	sys_api::mutex_t lock;
+	std::map<uint16_t, int32_t> port_to_thread;
+};
+
+//-------------------------------------------------------------------------------------
+static socket_t _connectTo(TcpServer& server, PlacementData& data)
+{
+	socket_t sfd = socket_api::create_socket();
+	socket_api::connect(sfd, server.get_bind_address(0).get_sockaddr_in());
+	
+	uint16_t port = Address(false, sfd).get_port();
+	for (int32_t i = 0; i < 100; i++) {
+		{
+			sys_api::auto_mutex lock(data.lock);
+			if (data.port_to_thread.find(port) != data.port_to_thread.end()) break;
+		}
+		sys_api::thread_sleep(10);
+	}
+	return sfd;
+}
+
+//-------------------------------------------------------------------------------------
+static int32_t _threadOf(socket_t sfd, PlacementData& data)
+{
+	sys_api::auto_mutex lock(data.lock);
+	auto it = data.port_to_thread.find(Address(false, sfd).get_port());
+	return it == data.port_to_thread.end() ? -1 : it->second;
+}
+
+//-------------------------------------------------------------------------------------
+static void _waitConnectionCounts(TcpServer& server, int32_t index, int32_t counts)
+{
+	for (int32_t i = 0; i < 100 && server.get_connection_counts(index) != counts; i++) {
+		sys_api::thread_sleep(10);
+	}
+}
+
+//-------------------------------------------------------------------------------------
+TEST(TcpServer, Placement)
+{
+	const int32_t thread_counts = 4;
+
+	PlacementData data;
+	data.lock = sys_api::mutex_create();
+
+	//least connections
+	{
+		TcpServer server("placement", nullptr);
+		EXPECT_TRUE(server.set_placement_policy(TcpServer::kLeastConnections));
+		server.m_listener.onConnected = [&data](TcpServer*, int32_t thread_index, ConnectionPtr conn) {
+			sys_api::auto_mutex lock(data.lock);
+			data.port_to_thread[conn->get_peer_addr().get_port()] = thread_index;
+		};
+		EXPECT_TRUE(server.bind(Address(0, true), false));
+		EXPECT_TRUE(server.start(thread_counts));
+		EXPECT_FALSE(server.set_placement_policy(TcpServer::kRoundRobin));
+
+		//one connection per work thread
+		std::vector<socket_t> clients;
+		for (int32_t i = 0; i < thread_counts; i++) {
+			clients.push_back(_connectTo(server, data));
+			EXPECT_EQ(i, _threadOf(clients.back(), data));
+			_waitConnectionCounts(server, i, 1);
+		}
+
+		//close connections in work thread 2 and 3
+		for (size_t i = 2; i < clients.size(); i++) {
+			socket_api::close_socket(clients[i]);
+			_waitConnectionCounts(server, (int32_t)i, 0);
+			EXPECT_EQ(0, server.get_connection_counts((int32_t)i));
+		}
+		clients.resize(2);
+
+		//new connections should be placed in work thread 2 and 3 (round robin will choose 0 and 1)
+		for (int32_t i = 2; i < thread_counts; i++) {
+			clients.push_back(_connectTo(server, data));
+			EXPECT_LE(2, _threadOf(clients.back(), data));
+			_waitConnectionCounts(server, _threadOf(clients.back(), data), 1);
+		}
+		for (int32_t i = 0; i < thread_counts; i++) {
+			EXPECT_EQ(1, server.get_connection_counts(i));
+		}
+
+		for (socket_t sfd : clients) socket_api::close_socket(sfd);
+		server.stop();
+		server.join();
+	}
+
+	//peer hash, all connections from the same host go to the same work thread
+	{
+		TcpServer server("placement", nullptr);
+		EXPECT_TRUE(server.set_placement_policy(TcpServer::kPeerHash));
+		server.m_listener.onConnected = [&data](TcpServer*, int32_t thread_index, ConnectionPtr conn) {
+			sys_api::auto_mutex lock(data.lock);
+			data.port_to_thread[conn->get_peer_addr().get_port()] = thread_index;
+		};
+		EXPECT_TRUE(server.bind(Address(0, true), false));
+		EXPECT_TRUE(server.start(thread_counts));
+
+		std::vector<socket_t> clients;
+		for (int32_t i = 0; i < 8; i++) {
+			clients.push_back(_connectTo(server, data));
+			EXPECT_NE(-1, _threadOf(clients.back(), data));
+			EXPECT_EQ(_threadOf(clients[0], data), _threadOf(clients.back(), data));
+		}
+
+		for (socket_t sfd : clients) socket_api::close_socket(sfd);
+		server.stop();
+		server.join();
+	}
+
+	//power of two, the two choices are different work threads, so two work threads are always balanced
+	{
+		TcpServer server("placement", nullptr);
+		EXPECT_TRUE(server.set_placement_policy(TcpServer::kPowerOfTwo));
+		server.m_listener.onConnected = [&data](TcpServer*, int32_t thread_index, ConnectionPtr conn) {
+			sys_api::auto_mutex lock(data.lock);
+			data.port_to_thread[conn->get_peer_addr().get_port()] = thread_index;
+		};
+		EXPECT_TRUE(server.bind(Address(0, true), false));
+		EXPECT_TRUE(server.start(2));
+
+		std::vector<socket_t> clients;
+		for (int32_t i = 0; i < 8; i++) {
+			//the connection counts is updated before onConnected
+			clients.push_back(_connectTo(server, data));
+			int32_t diff = server.get_connection_counts(0) - server.get_connection_counts(1);
+			EXPECT_TRUE(diff >= -1 && diff <= 1);
+		}
+		EXPECT_EQ(4, server.get_connection_counts(0));
+		EXPECT_EQ(4, server.get_connection_counts(1));
+
+		for (socket_t sfd : clients) socket_api::close_socket(sfd);
+		server.stop();
+		server.join();
+	}
+
+	//least busy, the idle work threads are compared by connection counts, and the busy one is avoided
+	{
+		TcpServer server("placement", nullptr);
+		EXPECT_TRUE(server.set_placement_policy(TcpServer::kLeastBusy));
+		server.m_listener.onConnected = [&data](TcpServer*, int32_t thread_index, ConnectionPtr conn) {
+			sys_api::auto_mutex lock(data.lock);
+			data.port_to_thread[conn->get_peer_addr().get_port()] = thread_index;
+		};
+		server.m_listener.onMessage = [](TcpServer*, int32_t, ConnectionPtr conn) {
+			conn->get_input_buf().reset();
+			sys_api::thread_sleep(10);
+			conn->send("b", 1);
+		};
+		EXPECT_TRUE(server.bind(Address(0, true), false));
+		EXPECT_TRUE(server.start(2));
+
+		socket_t busy_client = _connectTo(server, data);
+		int32_t busy_thread = _threadOf(busy_client, data);
+		EXPECT_NE(-1, busy_thread);
+
+		//keep the work thread busy
+		atomic_int32_t pumping(1);
+		thread_t pump = sys_api::thread_create([&pumping, busy_client](void*) {
+			char c;
+			while (pumping.load() != 0) {
+				if (socket_api::write(busy_client, "b", 1) != 1 || socket_api::read(busy_client, &c, 1) != 1) break;
+			}
+		}, nullptr, "pump");
+		sys_api::thread_sleep(300);
+
+		//both of them have one connection then, the busy one still be avoided
+		std::vector<socket_t> clients;
+		for (int32_t i = 0; i < 2; i++) {
+			clients.push_back(_connectTo(server, data));
+			EXPECT_EQ(1 - busy_thread, _threadOf(clients.back(), data));
+			_waitConnectionCounts(server, 1 - busy_thread, i + 1);
+		}
+
+		pumping = 0;
+		sys_api::thread_join(pump);
+		socket_api::close_socket(busy_client);
+		for (socket_t sfd : clients) socket_api::close_socket(sfd);
+		server.stop();
+		server.join();
+	}
+
+	sys_api::mutex_destroy(data.lock);
+}
+
+//-------------------------------------------------------------------------------------
+TEST(TcpServer, MigrateConnection)
+{
+	const int32_t thread_counts = 2;
+
+	sys_api::mutex_t lock = sys_api::mutex_create();
+	ConnectionPtr server_conn;
+	atomic_int32_t message_thread(-1);
+
+	TcpServer server("migrate", nullptr);
+	server.m_listener.onConnected = [&](TcpServer*, int32_t, ConnectionPtr conn) {
+		sys_api::auto_mutex auto_lock(lock);
+		server_conn = conn;
+	};
+	server.m_listener.onMessage = [&](TcpServer*, int32_t thread_index, ConnectionPtr conn) {
+		message_thread = thread_index;
+		RingBuf& rb = conn->get_input_buf();
+		char temp[64];
+		while (!rb.empty()) {
+			size_t len = rb.memcpy_out(temp, sizeof(temp));
+			conn->send(temp, len);
+		}
+	};
+	EXPECT_TRUE(server.bind(Address(0, true), false));
+	EXPECT_TRUE(server.start(thread_counts));
+
+	socket_t sfd = socket_api::create_socket();
+	EXPECT_TRUE(socket_api::connect(sfd, server.get_bind_address(0).get_sockaddr_in()));
+
+	char temp[64] = { 0 };
+	EXPECT_EQ(1, socket_api::write(sfd, "a", 1));
+	EXPECT_EQ(1, socket_api::read(sfd, temp, 1));
+	EXPECT_EQ('a', temp[0]);
+
+	int32_t from = message_thread.load();
+	int32_t to = (from + 1) % thread_counts;
+	EXPECT_EQ(1, server.get_connection_counts(from));
+	EXPECT_EQ(0, server.get_connection_counts(to));
+
+	ConnectionPtr conn;
+	{
+		sys_api::auto_mutex auto_lock(lock);
+		conn = server_conn;
+	}
+
+	//the id is tagged with the work thread index
+	EXPECT_EQ(from, TcpServer::get_work_thread_index(conn->get_id()));
+
+	//move it
+	server.migrate_connection(conn, to);
+	for (int32_t i = 0; i < 100 && server.get_connection_counts(to) != 1; i++) {
+		sys_api::thread_sleep(10);
+	}
+	EXPECT_EQ(0, server.get_connection_counts(from));
+	EXPECT_EQ(1, server.get_connection_counts(to));
+	EXPECT_EQ(to, TcpServer::get_work_thread_index(conn->get_id()));
+
+	//send message from other thread
+	conn->send("b", 1);
+	EXPECT_EQ(1, socket_api::read(sfd, temp, 1));
+	EXPECT_EQ('b', temp[0]);
+
+	//the message will be processed in the new work thread
+	EXPECT_EQ(5, socket_api::write(sfd, "hello", 5));
+	size_t received = 0;
+	while (received < 5) {
+		ssize_t n = socket_api::read(sfd, temp + received, 5 - received);
+		if (n <= 0) break;
+		received += (size_t)n;
+	}
+	EXPECT_EQ(0, memcmp(temp, "hello", 5));
+	EXPECT_EQ(to, message_thread.load());
+
+	//move back and forth while sending
+	for (int32_t i = 0; i < 10; i++) {
+		server.migrate_connection(conn, i % thread_counts);
+		EXPECT_EQ(1, socket_api::write(sfd, "c", 1));
+		EXPECT_EQ(1, socket_api::read(sfd, temp, 1));
+		EXPECT_EQ('c', temp[0]);
+	}
+
+#ifndef CY_SYS_WINDOWS
+	//shutdown during the moving, the close message reaches the old work thread after the connection left
+	struct timeval read_timeout = { 2, 0 };
+	EXPECT_TRUE(socket_api::setsockopt(sfd, SOL_SOCKET, SO_RCVTIMEO, &read_timeout, sizeof(read_timeout)));
+	server.migrate_connection(conn, (TcpServer::get_work_thread_index(conn->get_id()) + 1) % thread_counts);
+	server.shutdown_connection(conn);
+	EXPECT_EQ(0, socket_api::read(sfd, temp, 1));
+#endif
+
+	conn.reset();
+	{
+		sys_api::auto_mutex auto_lock(lock);
+		server_conn.reset();
+	}
+	socket_api::close_socket(sfd);
+	server.stop();
+	server.join();
+	sys_api::mutex_destroy(lock);
+}
+
+//-------------------------------------------------------------------------------------
+typedef std::function<bool(ConnectionPtr first, ConnectionPtr second)> PinFunction;
+
+//-------------------------------------------------------------------------------------
+static void _testMigratePinned(PinFunction pin, socket_t sfd[3], TcpServer& server)
+{
+	//round robin, the first and third connection are in work thread 0
+	const int32_t thread_counts = 2;
+
+	sys_api::mutex_t lock = sys_api::mutex_create();
+	std::vector<ConnectionPtr> conns;
+	ConnectionPtr pending;
+	atomic_int32_t pinned(0);
+
+	EXPECT_TRUE(server.set_placement_policy(TcpServer::kRoundRobin));
+	server.m_listener.onConnected = [&](TcpServer*, int32_t thread_index, ConnectionPtr conn) {
+		{
+			sys_api::auto_mutex auto_lock(lock);
+			conns.push_back(conn);
+		}
+		if (thread_index != 0) return;
+		if (!pending) {
+			pending = conn;
+			return;
+		}
+		if (pin(pending, conn)) pinned = 1;
+	};
+	EXPECT_TRUE(server.bind(Address(0, true), false));
+	EXPECT_TRUE(server.start(thread_counts));
+
+	for (int32_t i = 0; i < 3; i++) {
+		sfd[i] = socket_api::create_socket();
+		EXPECT_TRUE(socket_api::connect(sfd[i], server.get_bind_address(0).get_sockaddr_in()));
+		_waitConnectionCounts(server, i % thread_counts, i / thread_counts + 1);
+	}
+	for (int32_t i = 0; i < 100 && pinned.load() == 0; i++) {
+		sys_api::thread_sleep(10);
+	}
+	EXPECT_EQ(1, pinned.load());
+
+	//the pinned connections stay in work thread 0, the free one moves to it
+	{
+		sys_api::auto_mutex auto_lock(lock);
+		for (const ConnectionPtr& conn : conns) {
+			int32_t from = TcpServer::get_work_thread_index(conn->get_id());
+			server.migrate_connection(conn, (from + 1) % thread_counts);
+		}
+	}
+	_waitConnectionCounts(server, 0, 3);
+	sys_api::thread_sleep(50);
+	EXPECT_EQ(3, server.get_connection_counts(0));
+	EXPECT_EQ(0, server.get_connection_counts(1));
+
+	{
+		sys_api::auto_mutex auto_lock(lock);
+		conns.clear();
+	}
+	pending.reset();
+	sys_api::mutex_destroy(lock);
+}
+
+//-------------------------------------------------------------------------------------
+TEST(TcpServer, MigrateForward)
+{
+	TcpServer server("migrate_forward", nullptr);
+	socket_t sfd[3];
+	_testMigratePinned([](ConnectionPtr first, ConnectionPtr second) {
+		return first->forward_to(second) && second->forward_to(first);
+	}, sfd, server);
+
+	//the tunnel still works
+	char temp[4] = { 0 };
+	EXPECT_EQ(4, socket_api::write(sfd[0], "ping", 4));
+	size_t received = 0;
+	while (received < 4) {
+		ssize_t n = socket_api::read(sfd[2], temp + received, 4 - received);
+		if (n <= 0) break;
+		received += (size_t)n;
+	}
+	EXPECT_EQ(0, memcmp(temp, "ping", 4));
+
+	for (int32_t i = 0; i < 3; i++) {
+		socket_api::close_socket(sfd[i]);
+	}
+	server.stop();
+	server.join();
+}
+
+//-------------------------------------------------------------------------------------
+TEST(TcpServer, MigrateLinked)
+{
+	TcpServer server("migrate_linked", nullptr);
+	socket_t sfd[3];
+	_testMigratePinned([](ConnectionPtr first, ConnectionPtr second) {
+		return second->set_watermark(1024, 512) && second->link_source(first);
+	}, sfd, server);
+
+	for (int32_t i = 0; i < 3; i++) {
+		socket_api::close_socket(sfd[i]);
+	}
+	server.stop();
+	server.join();
+}
+
+//-------------------------------------------------------------------------------------
+static bool _request(socket_t sfd, const char* request, char* reply, size_t reply_len)
+{
+	size_t len = strlen(request);
+	if (socket_api::write(sfd, request, len) != (ssize_t)len) return false;
+
+	size_t received = 0;
+	while (received < reply_len) {
+		ssize_t n = socket_api::read(sfd, reply + received, reply_len - received);
+		if (n <= 0) return false;
+		received += (size_t)n;
+	}
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+TEST(TcpServer, Group)
+{
+	const int32_t thread_counts = 2;
+	const int32_t client_counts = 4;
+	const int32_t group_id = 1;
+
+	PlacementData data;
+	data.lock = sys_api::mutex_create();
+	std::map<uint16_t, ConnectionPtr> connections;
+
+	//"P..." publish the rest, "L" leave and reply "l", "E" reply "e", "S" reply the group size of its work thread
+	TcpServer server("group", nullptr);
+	server.m_listener.onConnected = [&](TcpServer* s, int32_t thread_index, ConnectionPtr conn) {
+		EXPECT_TRUE(s->join_group(conn, group_id));
+		EXPECT_FALSE(s->join_group(conn, group_id));
+
+		sys_api::auto_mutex lock(data.lock);
+		data.port_to_thread[conn->get_peer_addr().get_port()] = thread_index;
+		connections[conn->get_peer_addr().get_port()] = conn;
+	};
+	server.m_listener.onMessage = [&](TcpServer* s, int32_t thread_index, ConnectionPtr conn) {
+		RingBuf& rb = conn->get_input_buf();
+		char temp[64] = { 0 };
+		size_t len = rb.memcpy_out(temp, sizeof(temp));
+		if (len == 0) return;
+
+		switch (temp[0]) {
+		case 'P': s->publish(group_id, temp + 1, len - 1); break;
+		case 'L': EXPECT_TRUE(s->leave_group(conn, group_id)); EXPECT_FALSE(s->leave_group(conn, group_id)); conn->send("l", 1); break;
+		case 'E': conn->send("e", 1); break;
+		case 'S': temp[0] = (char)('0' + s->get_group_size(thread_index, group_id)); conn->send(temp, 1); break;
+		}
+	};
+	server.m_listener.onClose = [&](TcpServer*, int32_t, ConnectionPtr conn) {
+		sys_api::auto_mutex lock(data.lock);
+		connections.erase(conn->get_peer_addr().get_port());
+	};
+	EXPECT_TRUE(server.bind(Address(0, true), false));
+	EXPECT_TRUE(server.start(thread_counts));
+
+	socket_t clients[client_counts];
+	for (int32_t i = 0; i < client_counts; i++) {
+		clients[i] = _connectTo(server, data);
+	}
+	_waitConnectionCounts(server, 0, client_counts / thread_counts);
+	_waitConnectionCounts(server, 1, client_counts / thread_counts);
+
+	//all members in all work threads receive it
+	char temp[64] = { 0 };
+	EXPECT_TRUE(_request(clients[0], "Phi", temp, 2));
+	EXPECT_EQ(0, memcmp(temp, "hi", 2));
+	for (int32_t i = 1; i < client_counts; i++) {
+		EXPECT_TRUE(_request(clients[i], "", temp, 2));
+		EXPECT_EQ(0, memcmp(temp, "hi", 2));
+	}
+
+	//leave
+	EXPECT_TRUE(_request(clients[1], "S", temp, 1));
+	EXPECT_EQ('2', temp[0]);
+	EXPECT_TRUE(_request(clients[1], "L", temp, 1));
+	EXPECT_EQ('l', temp[0]);
+	EXPECT_TRUE(_request(clients[1], "S", temp, 1));
+	EXPECT_EQ('1', temp[0]);
+
+	EXPECT_TRUE(_request(clients[0], "Px", temp, 1));
+	EXPECT_EQ('x', temp[0]);
+	for (int32_t i = 2; i < client_counts; i++) {
+		EXPECT_TRUE(_request(clients[i], "", temp, 1));
+		EXPECT_EQ('x', temp[0]);
+	}
+	//the publish has been handled by all work threads, nothing is sent to the one left
+	EXPECT_TRUE(_request(clients[1], "E", temp, 1));
+	EXPECT_EQ('e', temp[0]);
+
+	//the member in the group is moved with the connection
+	int32_t from = _threadOf(clients[2], data);
+	int32_t to = (from + 1) % thread_counts;
+	ConnectionPtr conn;
+	{
+		sys_api::auto_mutex lock(data.lock);
+		conn = connections[Address(false, clients[2]).get_port()];
+	}
+	int32_t counts = server.get_connection_counts(to);
+	server.migrate_connection(conn, to);
+	_waitConnectionCounts(server, to, counts + 1);
+	conn.reset();
+
+	EXPECT_TRUE(_request(clients[3], "Py", temp, 1));
+	EXPECT_EQ('y', temp[0]);
+	EXPECT_TRUE(_request(clients[0], "", temp, 1));
+	EXPECT_EQ('y', temp[0]);
+	EXPECT_TRUE(_request(clients[2], "", temp, 1));
+	EXPECT_EQ('y', temp[0]);
+	EXPECT_TRUE(_request(clients[2], "S", temp, 1));
+	EXPECT_EQ((char)('0' + (to == _threadOf(clients[3], data) ? 2 : 1) + (to == _threadOf(clients[0], data) ? 1 : 0)), temp[0]);
+
+	//closed connection leaves the group
+	socket_api::close_socket(clients[3]);
+	for (int32_t i = 0; i < 100; i++) {
+		{
+			sys_api::auto_mutex lock(data.lock);
+			if (connections.size() == (size_t)(client_counts - 1)) break;
+		}
+		sys_api::thread_sleep(10);
+	}
+	EXPECT_TRUE(_request(clients[0], "Pz", temp, 1));
+	EXPECT_EQ('z', temp[0]);
+	EXPECT_TRUE(_request(clients[2], "", temp, 1));
+	EXPECT_EQ('z', temp[0]);
+
+	for (int32_t i = 0; i < client_counts - 1; i++) {
+		socket_api::close_socket(clients[i]);
+	}
+	{
+		sys_api::auto_mutex lock(data.lock);
+		connections.clear();
+	}
+	server.stop();
+	server.join();
+	sys_api::mutex_destroy(data.lock);
+}
+
+//-------------------------------------------------------------------------------------
+struct SenderData
+{
+	ConnectionPtr conn;
+	int32_t sender;
+	int32_t message_counts;
+	sys_api::signal_t complete;
+};
+
+//-------------------------------------------------------------------------------------
+static void _senderFunction(void* param)
+{
+	SenderData* data = (SenderData*)param;
+
+	for (int32_t i = 0; i < data->message_counts; i++) {
+		int32_t message[2] = { data->sender, i };
+		data->conn->send((const char*)message, sizeof(message));
+	}
+	sys_api::signal_notify(data->complete);
+}
+
+//-------------------------------------------------------------------------------------
+TEST(TcpServer, MultiThreadSend)
+{
+	const int32_t sender_counts = 4;
+	const int32_t message_counts = 20000;
+
+	sys_api::mutex_t lock = sys_api::mutex_create();
+	ConnectionPtr server_conn;
+
+	TcpServer server("sender", nullptr);
+	server.m_listener.onConnected = [&](TcpServer*, int32_t, ConnectionPtr conn) {
+		sys_api::auto_mutex auto_lock(lock);
+		server_conn = conn;
+	};
+	EXPECT_TRUE(server.bind(Address(0, true), false));
+	EXPECT_TRUE(server.start(1));
+
+	socket_t sfd = socket_api::create_socket();
+	EXPECT_TRUE(socket_api::connect(sfd, server.get_bind_address(0).get_sockaddr_in()));
+
+	ConnectionPtr conn;
+	for (int32_t i = 0; i < 100 && !conn; i++) {
+		{
+			sys_api::auto_mutex auto_lock(lock);
+			conn = server_conn;
+		}
+		if (!conn) sys_api::thread_sleep(10);
+	}
+	ASSERT_TRUE(conn != nullptr);
+
+	//send from other threads at the same time
+	SenderData data[sender_counts];
+	for (int32_t i = 0; i < sender_counts; i++) {
+		data[i].conn = conn;
+		data[i].sender = i;
+		data[i].message_counts = message_counts;
+		data[i].complete = sys_api::signal_create();
+		sys_api::thread_create_detached(_senderFunction, &(data[i]), "sender");
+	}
+
+	//the messages from one sender must be in order
+	int32_t next_message[sender_counts] = { 0 };
+	int32_t total_counts = 0;
+	int32_t message[2];
+	size_t received = 0;
+	while (total_counts < sender_counts*message_counts) {
+		ssize_t n = socket_api::read(sfd, (char*)message + received, sizeof(message) - received);
+		if (n <= 0) break;
+		received += (size_t)n;
+		if (received < sizeof(message)) continue;
+
+		received = 0;
+		ASSERT_TRUE(message[0] >= 0 && message[0] < sender_counts);
+		EXPECT_EQ(next_message[message[0]], message[1]);
+		next_message[message[0]] = message[1] + 1;
+		total_counts++;
+	}
+	EXPECT_EQ(sender_counts*message_counts, total_counts);
+
+	for (int32_t i = 0; i < sender_counts; i++) {
+		sys_api::signal_wait(data[i].complete);
+		sys_api::signal_destroy(data[i].complete);
+		data[i].conn.reset();
+	}
+
+	conn.reset();
+	{
+		sys_api::auto_mutex auto_lock(lock);
+		server_conn.reset();
+	}
+	socket_api::close_socket(sfd);
+	server.stop();
+	server.join();
+	sys_api::mutex_destroy(lock);
+}
+
+//-------------------------------------------------------------------------------------
+TEST(TcpServer, AutoCork)
+{
+	TcpServer server("cork", nullptr);
+	server.m_listener.onConnected = [](TcpServer*, int32_t, ConnectionPtr conn) {
+		EXPECT_FALSE(conn->is_auto_cork());
+		conn->set_auto_cork(true);
+		EXPECT_TRUE(conn->is_auto_cork());
+	};
+	server.m_listener.onMessage = [](TcpServer*, int32_t, ConnectionPtr conn) {
+		RingBuf& rb = conn->get_input_buf();
+		char c;
+		while (rb.memcpy_out(&c, 1) == 1) {
+			if (c == 'q') {
+				//the buffered data must be sent before close
+				conn->send("bye", 3);
+				conn->shutdown();
+				return;
+			}
+			//send one byte per call, will be flushed together
+			conn->send(&c, 1);
+			conn->send("!", 1);
+		}
+	};
+	EXPECT_TRUE(server.bind(Address(0, true), false));
+	EXPECT_TRUE(server.start(1));
+
+	socket_t sfd = socket_api::create_socket();
+	EXPECT_TRUE(socket_api::connect(sfd, server.get_bind_address(0).get_sockaddr_in()));
+
+	char temp[64] = { 0 };
+	EXPECT_EQ(5, socket_api::write(sfd, "hello", 5));
+	size_t received = 0;
+	while (received < 10) {
+		ssize_t n = socket_api::read(sfd, temp + received, 10 - received);
+		if (n <= 0) break;
+		received += (size_t)n;
+	}
+	EXPECT_EQ(0, memcmp(temp, "h!e!l!l!o!", 10));
+
+	EXPECT_EQ(2, socket_api::write(sfd, "aq", 2));
+	received = 0;
+	for (;;) {
+		ssize_t n = socket_api::read(sfd, temp + received, sizeof(temp) - received);
+		if (n <= 0) break;
+		received += (size_t)n;
+	}
+	EXPECT_EQ(5u, received);
+	EXPECT_EQ(0, memcmp(temp, "a!bye", 5));
+
+	socket_api::close_socket(sfd);
+	server.stop();
+	server.join();
+}
+
+//-------------------------------------------------------------------------------------
+TEST(TcpServer, Timeout)
+{
+	const uint32_t read_timeout = 300;
+	const uint32_t write_timeout = 200;
+	atomic_int32_t read_timeout_counts(0), write_timeout_counts(0);
+
+	TcpServer server("timeout", nullptr);
+	EXPECT_FALSE(server.set_timeout(TcpServer::kTimeoutTypeCounts, 100));
+	EXPECT_TRUE(server.set_timeout(TcpServer::kReadTimeout, read_timeout));
+	EXPECT_TRUE(server.set_timeout(TcpServer::kWriteTimeout, write_timeout));
+	EXPECT_EQ(0u, server.get_timeout(TcpServer::kIdleTimeout));
+	EXPECT_EQ(read_timeout, server.get_timeout(TcpServer::kReadTimeout));
+
+	server.m_listener.onMessage = [](TcpServer*, int32_t, ConnectionPtr conn) {
+		RingBuf& rb = conn->get_input_buf();
+		char c;
+		while (rb.memcpy_out(&c, 1) == 1) {
+			if (c != 'w') continue;
+
+			//the client never read, the socket buf will be full
+			std::string data(16 * 1024 * 1024, 'x');
+			conn->send(data.c_str(), data.length());
+		}
+	};
+	server.m_listener.onTimeout = [&](TcpServer*, int32_t, ConnectionPtr conn, TcpServer::TimeoutType type) {
+		if (type == TcpServer::kReadTimeout) {
+			read_timeout_counts++;
+			conn->shutdown();
+		}
+		else if (type == TcpServer::kWriteTimeout) {
+			write_timeout_counts++;
+		}
+	};
+	EXPECT_TRUE(server.bind(Address(0, true), false));
+	EXPECT_TRUE(server.start(1));
+	EXPECT_FALSE(server.set_timeout(TcpServer::kIdleTimeout, 100));
+
+	//keep active longer than the timeout
+	socket_t sfd = socket_api::create_socket();
+	EXPECT_TRUE(socket_api::connect(sfd, server.get_bind_address(0).get_sockaddr_in()));
+	for (int32_t i = 0; i < 12; i++) {
+		EXPECT_EQ(1, socket_api::write(sfd, "a", 1));
+		sys_api::thread_sleep(50);
+	}
+	EXPECT_EQ(0, read_timeout_counts.load());
+
+	//stop sending, the server will close the connection
+	int64_t begin_time = sys_api::utc_time_now();
+	char temp[64];
+	EXPECT_EQ(0, socket_api::read(sfd, temp, sizeof(temp)));
+	int64_t elapsed_ms = (sys_api::utc_time_now() - begin_time) / 1000;
+	EXPECT_EQ(1, read_timeout_counts.load());
+	EXPECT_LE((int64_t)read_timeout - 100, elapsed_ms);
+	EXPECT_GT((int64_t)read_timeout + 500, elapsed_ms);
+	socket_api::close_socket(sfd);
+
+	//keep sending but never read
+	sfd = socket_api::create_socket();
+	EXPECT_TRUE(socket_api::connect(sfd, server.get_bind_address(0).get_sockaddr_in()));
+	EXPECT_EQ(1, socket_api::write(sfd, "w", 1));
+	for (int32_t i = 0; i < 20 && write_timeout_counts.load() == 0; i++) {
+		EXPECT_EQ(1, socket_api::write(sfd, "a", 1));
+		sys_api::thread_sleep(50);
+	}
+	EXPECT_LE(1, write_timeout_counts.load());
+	EXPECT_EQ(1, read_timeout_counts.load());
+	socket_api::close_socket(sfd);
+
+	sys_api::thread_sleep(50);
+	server.stop();
+	server.join();
+}
+
+//-------------------------------------------------------------------------------------
+TEST(TcpServer, WriteTimeout)
+{
+	const uint32_t write_timeout = 200;
+	atomic_int32_t write_timeout_counts(0);
+	atomic_int32_t close_counts(0);
+	atomic_int64_t timeout_time(0);
+
+	//only the write timeout, nothing is scheduled in the wheel until the connection begin to wait writable
+	TcpServer server("write_timeout", nullptr);
+	EXPECT_TRUE(server.set_timeout(TcpServer::kWriteTimeout, write_timeout));
+	server.m_listener.onMessage = [](TcpServer*, int32_t, ConnectionPtr conn) {
+		char command = 0;
+		conn->get_input_buf().memcpy_out(&command, 1);
+		conn->get_input_buf().reset();
+
+		//the client never read, the socket buf will be full
+		std::string data(16 * 1024 * 1024, 'x');
+		conn->send(data.c_str(), data.length());
+		if (command == 's') conn->shutdown();
+	};
+	server.m_listener.onClose = [&](TcpServer*, int32_t, ConnectionPtr) {
+		close_counts++;
+	};
+	server.m_listener.onTimeout = [&](TcpServer*, int32_t, ConnectionPtr conn, TcpServer::TimeoutType type) {
+		EXPECT_EQ(TcpServer::kWriteTimeout, type);
+		if (write_timeout_counts++ == 0) timeout_time = sys_api::utc_time_now();
+		conn->shutdown();
+	};
+	EXPECT_TRUE(server.bind(Address(0, true), false));
+	EXPECT_TRUE(server.start(1));
+
+	//quiet longer than the timeout before the server begin to write
+	socket_t sfd = socket_api::create_socket();
+	EXPECT_TRUE(socket_api::connect(sfd, server.get_bind_address(0).get_sockaddr_in()));
+	sys_api::thread_sleep(write_timeout * 2);
+	EXPECT_EQ(0, write_timeout_counts.load());
+
+	int64_t begin_time = sys_api::utc_time_now();
+	EXPECT_EQ(1, socket_api::write(sfd, "w", 1));
+	for (int32_t i = 0; i < 100 && write_timeout_counts.load() == 0; i++) {
+		sys_api::thread_sleep(10);
+	}
+	EXPECT_EQ(1, write_timeout_counts.load());
+	int64_t elapsed_ms = (timeout_time.load() - begin_time) / 1000;
+	EXPECT_LE((int64_t)write_timeout - 50, elapsed_ms);
+	EXPECT_GT((int64_t)write_timeout + 500, elapsed_ms);
+
+	//shutdown but the output can't be sent, closed after another write timeout
+	for (int32_t i = 0; i < 100 && close_counts.load() == 0; i++) {
+		sys_api::thread_sleep(10);
+	}
+	EXPECT_EQ(1, close_counts.load());
+	socket_api::close_socket(sfd);
+
+	//shutdown with pending output, the write timeout closes it without onTimeout
+	sfd = socket_api::create_socket();
+	EXPECT_TRUE(socket_api::connect(sfd, server.get_bind_address(0).get_sockaddr_in()));
+	EXPECT_EQ(1, socket_api::write(sfd, "s", 1));
+	for (int32_t i = 0; i < 100 && close_counts.load() == 1; i++) {
+		sys_api::thread_sleep(10);
+	}
+	EXPECT_EQ(2, close_counts.load());
+	EXPECT_EQ(1, write_timeout_counts.load());
+	socket_api::close_socket(sfd);
+
+	sys_api::thread_sleep(50);
+	server.stop();
+	server.join();
+}
+
+#ifndef CY_SYS_WINDOWS
+//-------------------------------------------------------------------------------------
+static bool _readUntil(socket_t sfd, char* buf, size_t len)
+{
+	size_t received = 0;
+	while (received < len) {
+		ssize_t n = socket_api::read(sfd, buf + received, len - received);
+		if (n <= 0) return false;
+		received += (size_t)n;
+	}
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+TEST(TcpServer, SendFile)
+{
+	//multi-GB sparse file, the last 4 bytes is a mark
+	const uint64_t file_size = 0x80000000ull + 4096;
+	char file_name[] = "/tmp/cyt_unit_sendfile_XXXXXX";
+	int fd = mkstemp(file_name);
+	ASSERT_GE(fd, 0);
+	unlink(file_name);
+	ASSERT_EQ(0, ftruncate(fd, (off_t)file_size));
+	ASSERT_EQ(4, pwrite(fd, "MARK", 4, (off_t)(file_size - 4)));
+
+	sys_api::mutex_t lock = sys_api::mutex_create();
+	ConnectionPtr server_conn;
+
+	TcpServer server("sendfile", nullptr);
+	server.m_listener.onConnected = [&](TcpServer*, int32_t, ConnectionPtr conn) {
+		{
+			sys_api::auto_mutex auto_lock(lock);
+			server_conn = conn;
+		}
+		//send in work thread, in order with the message
+		conn->send("head", 4);
+		EXPECT_TRUE(conn->send_file(fd, 0, file_size));
+		conn->send("tail", 4);
+	};
+	EXPECT_TRUE(server.bind(Address(0, true), false));
+	EXPECT_TRUE(server.start(1));
+
+	socket_t sfd = socket_api::create_socket();
+	EXPECT_TRUE(socket_api::connect(sfd, server.get_bind_address(0).get_sockaddr_in()));
+
+	char temp[8] = { 0 };
+	ASSERT_TRUE(_readUntil(sfd, temp, 4));
+	EXPECT_EQ(0, memcmp(temp, "head", 4));
+
+	//the file content, all zero except the mark
+	const size_t buf_size = 256 * 1024;
+	char* buf = new char[buf_size];
+	uint64_t received = 0;
+	bool all_zero = true;
+	while (received < file_size - 4) {
+		size_t n = (size_t)std::min((uint64_t)buf_size, file_size - 4 - received);
+		if (!_readUntil(sfd, buf, n)) break;
+		for (size_t i = 0; i < n && all_zero; i++) {
+			if (buf[i] != 0) all_zero = false;
+		}
+		received += n;
+	}
+	EXPECT_EQ(file_size - 4, received);
+	EXPECT_TRUE(all_zero);
+	delete[] buf;
+
+	ASSERT_TRUE(_readUntil(sfd, temp, 8));
+	EXPECT_EQ(0, memcmp(temp, "MARKtail", 8));
+
+	ConnectionPtr conn;
+	{
+		sys_api::auto_mutex auto_lock(lock);
+		conn = server_conn;
+	}
+
+	//send from other thread, and close after sent
+	conn->send("x", 1);
+	EXPECT_TRUE(conn->send_file(fd, (int64_t)(file_size - 4), 4));
+	conn->send("y", 1);
+	server.shutdown_connection(conn);
+
+	//the fd is duplicated
+	close(fd);
+
+	ASSERT_TRUE(_readUntil(sfd, temp, 6));
+	EXPECT_EQ(0, memcmp(temp, "xMARKy", 6));
+	EXPECT_EQ(0, socket_api::read(sfd, temp, 1));
+
+	conn.reset();
+	{
+		sys_api::auto_mutex auto_lock(lock);
+		server_conn.reset();
+	}
+	socket_api::close_socket(sfd);
+	server.stop();
+	server.join();
+	sys_api::mutex_destroy(lock);
+}
+
+//-------------------------------------------------------------------------------------
+struct WriterData
+{
+	socket_t sfd;
+	const char* buf;
+	size_t len;
+	sys_api::signal_t complete;
+};
+
+//-------------------------------------------------------------------------------------
+static void _writerFunction(void* param)
+{
+	WriterData* data = (WriterData*)param;
+
+	size_t sent = 0;
+	while (sent < data->len) {
+		ssize_t n = socket_api::write(data->sfd, data->buf + sent, data->len - sent);
+		if (n <= 0) break;
+		sent += (size_t)n;
+	}
+	sys_api::signal_notify(data->complete);
+}
+
+//-------------------------------------------------------------------------------------
+TEST(TcpServer, ForwardTo)
+{
+	const size_t data_size = 8 * 1024 * 1024;
+
+	ConnectionPtr first_conn;
+	atomic_int32_t forward_counts(0);
+	atomic_int32_t message_counts(0);
+
+	TcpServer server("forward", nullptr);
+	server.m_listener.onConnected = [&](TcpServer*, int32_t, ConnectionPtr conn) {
+		if (!first_conn) {
+			//some data before forward
+			first_conn = conn;
+			return;
+		}
+		if (first_conn->forward_to(conn)) forward_counts++;
+		if (conn->forward_to(first_conn)) forward_counts++;
+		first_conn.reset();
+	};
+	server.m_listener.onMessage = [&](TcpServer*, int32_t, ConnectionPtr) {
+		message_counts++;
+	};
+	EXPECT_TRUE(server.bind(Address(0, true), false));
+	EXPECT_TRUE(server.start(1));
+
+	socket_t sfd1 = socket_api::create_socket();
+	EXPECT_TRUE(socket_api::connect(sfd1, server.get_bind_address(0).get_sockaddr_in()));
+	EXPECT_EQ(4, socket_api::write(sfd1, "head", 4));
+	sys_api::thread_sleep(50);
+
+	socket_t sfd2 = socket_api::create_socket();
+	EXPECT_TRUE(socket_api::connect(sfd2, server.get_bind_address(0).get_sockaddr_in()));
+	for (int32_t i = 0; i < 100 && forward_counts.load() != 2; i++) {
+		sys_api::thread_sleep(10);
+	}
+	EXPECT_EQ(2, forward_counts.load());
+
+	char temp[8] = { 0 };
+	ASSERT_TRUE(_readUntil(sfd2, temp, 4));
+	EXPECT_EQ(0, memcmp(temp, "head", 4));
+
+	//write a lot of data, the receiver is slow
+	char* send_buf = new char[data_size];
+	for (size_t i = 0; i < data_size; i++) send_buf[i] = (char)(i * 7 + i / 4096);
+
+	WriterData writer;
+	writer.sfd = sfd1;
+	writer.buf = send_buf;
+	writer.len = data_size;
+	writer.complete = sys_api::signal_create();
+	sys_api::thread_create_detached(_writerFunction, &writer, "writer");
+	sys_api::thread_sleep(100);
+
+	char* recv_buf = new char[data_size];
+	EXPECT_TRUE(_readUntil(sfd2, recv_buf, data_size));
+	EXPECT_EQ(0, memcmp(send_buf, recv_buf, data_size));
+	sys_api::signal_wait(writer.complete);
+	sys_api::signal_destroy(writer.complete);
+	delete[] send_buf;
+	delete[] recv_buf;
+
+	//the other direction
+	EXPECT_EQ(4, socket_api::write(sfd2, "pong", 4));
+	ASSERT_TRUE(_readUntil(sfd1, temp, 4));
+	EXPECT_EQ(0, memcmp(temp, "pong", 4));
+
+	//onMessage is not called in forward mode, only the "head" before forward
+	EXPECT_EQ(1, message_counts.load());
+
+	socket_api::close_socket(sfd1);
+	socket_api::close_socket(sfd2);
+	server.stop();
+	server.join();
+}
+
+//-------------------------------------------------------------------------------------
+TEST(TcpServer, Watermark)
+{
+	const size_t data_size = 64 * 1024 * 1024;
+	const size_t high_watermark = 256 * 1024;
+	const size_t low_watermark = 64 * 1024;
+
+	ConnectionPtr source_conn, sink_conn;
+	atomic_int32_t high_counts(0), low_counts(0), linked(0);
+	std::atomic<size_t> max_output_size(0);
+
+	TcpServer server("watermark", nullptr);
+	server.m_listener.onConnected = [&](TcpServer*, int32_t, ConnectionPtr conn) {
+		if (!source_conn) {
+			source_conn = conn;
+			return;
+		}
+		sink_conn = conn;
+		EXPECT_FALSE(sink_conn->set_watermark(low_watermark, high_watermark));
+		EXPECT_TRUE(sink_conn->set_watermark(high_watermark, low_watermark));
+		EXPECT_EQ(high_watermark, sink_conn->get_high_watermark());
+		EXPECT_EQ(low_watermark, sink_conn->get_low_watermark());
+		sink_conn->setOnHighWatermarkFunction([&](ConnectionPtr) { high_counts++; });
+		sink_conn->setOnLowWatermarkFunction([&](ConnectionPtr) { low_counts++; });
+		EXPECT_TRUE(sink_conn->link_source(source_conn));
+		linked = 1;
+	};
+	server.m_listener.onMessage = [&](TcpServer*, int32_t, ConnectionPtr conn) {
+		if (conn != source_conn || !sink_conn) return;
+
+		//forward to the slow sink
+		RingBuf& rb = conn->get_input_buf();
+		const uint8_t* block = nullptr;
+		size_t len;
+		while ((len = rb.get_readable_block(&block)) > 0) {
+			sink_conn->send((const char*)block, len);
+			rb.discard(len);
+		}
+		if (sink_conn->get_output_size() > max_output_size.load()) {
+			max_output_size = sink_conn->get_output_size();
+		}
+	};
+	server.m_listener.onClose = [&](TcpServer*, int32_t, ConnectionPtr conn) {
+		if (conn == sink_conn) sink_conn.reset();
+		if (conn == source_conn) source_conn.reset();
+	};
+	EXPECT_TRUE(server.bind(Address(0, true), false));
+	EXPECT_TRUE(server.start(1));
+
+	socket_t source = socket_api::create_socket();
+	EXPECT_TRUE(socket_api::connect(source, server.get_bind_address(0).get_sockaddr_in()));
+	sys_api::thread_sleep(50);
+	socket_t sink = socket_api::create_socket();
+	EXPECT_TRUE(socket_api::connect(sink, server.get_bind_address(0).get_sockaddr_in()));
+	for (int32_t i = 0; i < 100 && linked.load() == 0; i++) {
+		sys_api::thread_sleep(10);
+	}
+
+	char* send_buf = new char[data_size];
+	for (size_t i = 0; i < data_size; i++) send_buf[i] = (char)(i * 13 + i / 4096);
+
+	WriterData writer;
+	writer.sfd = source;
+	writer.buf = send_buf;
+	writer.len = data_size;
+	writer.complete = sys_api::signal_create();
+	sys_api::thread_create_detached(_writerFunction, &writer, "writer");
+
+	//the sink is not reading, the source should be paused
+	sys_api::thread_sleep(300);
+	EXPECT_EQ(1, high_counts.load());
+	EXPECT_EQ(0, low_counts.load());
+
+	char* recv_buf = new char[data_size];
+	EXPECT_TRUE(_readUntil(sink, recv_buf, data_size));
+	EXPECT_EQ(0, memcmp(send_buf, recv_buf, data_size));
+	sys_api::signal_wait(writer.complete);
+	sys_api::signal_destroy(writer.complete);
+	delete[] send_buf;
+	delete[] recv_buf;
+
+	//the buffered data is limited(high watermark + the data read in one step)
+	EXPECT_LE(1, low_counts.load());
+	EXPECT_GT(data_size / 4, max_output_size.load());
+
+	socket_api::close_socket(source);
+	socket_api::close_socket(sink);
+	sys_api::thread_sleep(50);
+	server.stop();
+	server.join();
+}
+
+//-------------------------------------------------------------------------------------
+TEST(TcpServer, Stats)
+{
+	const int32_t thread_counts = 2;
+	const size_t bulk_size = 8 * 1024 * 1024;
+
+	PlacementData data;
+	data.lock = sys_api::mutex_create();
+
+	//"B" reply a bulk of data, "S" reply the connection counts in snapshot(called in work thread), others echo
+	std::vector<char> bulk(bulk_size, 'b');
+	TcpServer server("stats", nullptr);
+	server.m_listener.onConnected = [&](TcpServer*, int32_t thread_index, ConnectionPtr conn) {
+		sys_api::auto_mutex lock(data.lock);
+		data.port_to_thread[conn->get_peer_addr().get_port()] = thread_index;
+	};
+	server.m_listener.onMessage = [&](TcpServer* s, int32_t, ConnectionPtr conn) {
+		RingBuf& rb = conn->get_input_buf();
+		char temp[64] = { 0 };
+		size_t len = rb.memcpy_out(temp, sizeof(temp));
+		if (len == 0) return;
+
+		if (temp[0] == 'B') {
+			conn->send(&bulk[0], bulk_size);
+		}
+		else if (temp[0] == 'S') {
+			TcpServer::StatsSnapshot snapshot;
+			EXPECT_TRUE(s->stats_snapshot(snapshot, true));
+			int32_t counts = 0;
+			for (auto& work : snapshot.work_threads) counts += (int32_t)work.connections.size();
+			temp[0] = (char)('0' + counts);
+			conn->send(temp, 1);
+		}
+		else {
+			conn->send(temp, len);
+		}
+	};
+	EXPECT_TRUE(server.bind(Address(0, true), false));
+	EXPECT_TRUE(server.start(thread_counts));
+
+	socket_t clients[2];
+	for (int32_t i = 0; i < 2; i++) {
+		clients[i] = _connectTo(server, data);
+	}
+	_waitConnectionCounts(server, 0, 1);
+	_waitConnectionCounts(server, 1, 1);
+
+	char temp[64] = { 0 };
+	EXPECT_TRUE(_request(clients[0], "hello", temp, 5));
+	EXPECT_TRUE(_request(clients[1], "hi", temp, 2));
+	EXPECT_TRUE(_request(clients[1], "S", temp, 1));
+	EXPECT_EQ('2', temp[0]);
+
+	TcpServer::StatsSnapshot snapshot;
+	EXPECT_TRUE(server.stats_snapshot(snapshot, true));
+	EXPECT_EQ((size_t)thread_counts, snapshot.work_threads.size());
+	EXPECT_EQ(8u, snapshot.io.read_bytes);
+	EXPECT_EQ(8u, snapshot.io.write_bytes);
+	EXPECT_LE(3u, snapshot.io.read_calls);
+	EXPECT_LE(3u, snapshot.io.write_calls);
+	for (auto& work : snapshot.work_threads) {
+		EXPECT_EQ(1, work.connection_counts);
+		EXPECT_EQ(1u, work.connections.size());
+		EXPECT_EQ(work.index, TcpServer::get_work_thread_index(work.connections[0].conn_id));
+	}
+
+	//the client doesn't read, the server is blocked on writing
+	EXPECT_EQ(1, socket_api::write(clients[0], "B", 1));
+	sys_api::thread_sleep(200);
+
+	std::vector<char> received(bulk_size);
+	EXPECT_TRUE(_readUntil(clients[0], &received[0], bulk_size));
+	EXPECT_TRUE(server.stats_snapshot(snapshot, true));
+
+	const TcpServer::WorkThreadStats& work = snapshot.work_threads[(size_t)_threadOf(clients[0], data)];
+	const ConnectionStats& stats = work.connections[0].stats;
+	EXPECT_EQ(5u + bulk_size, stats.write_bytes);
+	EXPECT_LE(1u, stats.short_writes);
+	EXPECT_LT(0u, stats.max_output_size);
+	EXPECT_LE(150u * 1000, stats.write_blocked_time);
+
+	//the counters of closed connection are kept by the work thread
+	socket_api::close_socket(clients[0]);
+	_waitConnectionCounts(server, work.index, 0);
+	EXPECT_TRUE(server.stats_snapshot(snapshot, false));
+	EXPECT_EQ(0, snapshot.work_threads[(size_t)work.index].connection_counts);
+	EXPECT_TRUE(snapshot.work_threads[(size_t)work.index].connections.empty());
+	EXPECT_EQ(8u + bulk_size, snapshot.io.write_bytes);
+
+	socket_api::close_socket(clients[1]);
+	sys_api::thread_sleep(50);
+	server.stop();
+	server.join();
+	sys_api::mutex_destroy(data.lock);
+}
+#endif
+
+#ifdef CY_SYS_LINUX
+//-------------------------------------------------------------------------------------
+TEST(TcpServer, AcceptBatch)
+{
+	const int32_t backlog = 8;
+	const int32_t client_counts = 20;
+
+	EchoServerData data;
+
+	//the only work thread is blocked by the first message, the new connections are queued in kernel
+	TcpServer server("batch", nullptr);
+	EXPECT_TRUE(server.set_accept_mode(TcpServer::kReusePort));
+	EXPECT_TRUE(server.set_listen_backlog(backlog));
+	_startEchoServer(server, data);
+	server.m_listener.onMessage = [](TcpServer*, int32_t, ConnectionPtr conn) {
+		conn->get_input_buf().reset();
+		sys_api::thread_sleep(500);
+	};
+	EXPECT_TRUE(server.bind(Address(0, true), false));
+	EXPECT_TRUE(server.start(1));
+	sys_api::thread_sleep(100);
+
+	socket_t first = socket_api::create_socket();
+	EXPECT_TRUE(socket_api::connect(first, server.get_bind_address(0).get_sockaddr_in()));
+	for (int32_t i = 0; i < 100 && data.connected_counts.load() < 1; i++) {
+		sys_api::thread_sleep(10);
+	}
+	EXPECT_EQ(1u, server.get_max_accept_batch());
+	EXPECT_EQ(0u, server.get_accept_queue_full_counts());
+	EXPECT_EQ(1, socket_api::write(first, "x", 1));
+	sys_api::thread_sleep(50);
+
+	std::vector<socket_t> clients;
+	for (int32_t i = 0; i < client_counts; i++) {
+		socket_t sfd = socket_api::create_socket();
+		socket_api::set_nonblock(sfd, true);
+		socket_api::connect(sfd, server.get_bind_address(0).get_sockaddr_in());
+		clients.push_back(sfd);
+	}
+
+	//the whole queue is drained in one wake up
+	for (int32_t i = 0; i < 200 && data.connected_counts.load() < backlog + 1; i++) {
+		sys_api::thread_sleep(10);
+	}
+	EXPECT_LE(1u, server.get_accept_queue_full_counts());
+	EXPECT_LE((uint32_t)backlog, server.get_max_accept_batch());
+	EXPECT_EQ(0u, server.get_accept_error_counts());
+
+	socket_api::close_socket(first);
+	for (socket_t sfd : clients) socket_api::close_socket(sfd);
+
+	server.stop();
+	server.join();
+}
+
+//-------------------------------------------------------------------------------------
+TEST(TcpServer, AcceptTooManyFiles)
+{
+	EchoServerData data;
+
+	TcpServer server("emfile", nullptr);
+	_startEchoServer(server, data);
+	EXPECT_TRUE(server.bind(Address(0, true), false));
+	EXPECT_TRUE(server.start(1));
+	sys_api::thread_sleep(100);
+
+	//all fds below the soft limit are used, so the accept thread can't get a new one
+	socket_t client = socket_api::create_socket();
+	socket_t lowest_free = ::dup(client);
+	::close(lowest_free);
+
+	struct rlimit old_limit, limit;
+	EXPECT_EQ(0, ::getrlimit(RLIMIT_NOFILE, &old_limit));
+	limit = old_limit;
+	limit.rlim_cur = (rlim_t)lowest_free;
+	EXPECT_EQ(0, ::setrlimit(RLIMIT_NOFILE, &limit));
+
+	EXPECT_TRUE(socket_api::connect(client, server.get_bind_address(0).get_sockaddr_in()));
+	for (int32_t i = 0; i < 100 && server.get_accept_error_counts() == 0; i++) {
+		sys_api::thread_sleep(10);
+	}
+	EXPECT_EQ(0, ::setrlimit(RLIMIT_NOFILE, &old_limit));
+
+	//the pending connection is dropped, and the accept thread doesn't spin on it
+	EXPECT_EQ(1u, server.get_accept_error_counts());
+	if (server.get_accept_error_counts() > 0) {
+		char temp[8];
+		EXPECT_GE(0, socket_api::read(client, temp, sizeof(temp)));
+	}
+	socket_api::close_socket(client);
+	EXPECT_EQ(0, data.connected_counts.load());
+
+	//the server still works
+	EXPECT_TRUE(_echoClient(server.get_bind_address(0)));
+	EXPECT_EQ(1u, server.get_accept_error_counts());
+
+	server.stop();
+	server.join();
+}
+#endif
+
+}
@@ -0,0 +1,131 @@
+#include <cy_core.h>
+#include <cy_event.h>
+#include <cy_network.h>
+
+#include <gtest/gtest.h>
+
+using namespace cyclone;
+
+namespace {
+
+//-------------------------------------------------------------------------------------
+static socket_t _createClient(void)
+{
+	socket_t sfd = socket_api::create_udp_socket(AF_INET);
+	socket_api::set_nonblock(sfd, true);
+	return sfd;
+}
+
+//-------------------------------------------------------------------------------------
+static int32_t _receiveAll(socket_t sfd, int32_t max_counts, size_t* total_size)
+{
+	//wait 1 second at most
+	int32_t counts = 0;
+	char temp[2048];
+	for (int32_t i = 0; i < 100 && counts < max_counts; i++) {
+		ssize_t len;
+		while ((len = socket_api::recvfrom(sfd, temp, sizeof(temp), nullptr, nullptr)) >= 0) {
+			counts++;
+			if (total_size) *total_size += (size_t)len;
+		}
+		if (counts < max_counts) sys_api::thread_sleep(10);
+	}
+	return counts;
+}
+
+//-------------------------------------------------------------------------------------
+TEST(UdpServer, Echo)
+{
+	const int32_t thread_counts = 4;
+	const int32_t client_counts = 8;
+	const int32_t datagram_counts = 50;
+
+	atomic_int32_t thread_mask(0);
+
+	UdpServer server("udp_echo", nullptr);
+	server.m_listener.onMessage = [&thread_mask](UdpServer*, int32_t thread_index, UdpSocket* udp, const char* buf, size_t len, const Address& peer) {
+		thread_mask |= (1 << thread_index);
+		udp->send_to(peer, buf, len);
+	};
+	EXPECT_FALSE(server.start(thread_counts));
+	EXPECT_TRUE(server.bind(Address(0, true)));
+	EXPECT_FALSE(server.bind(Address(0, true)));
+	EXPECT_TRUE(server.start(thread_counts));
+	EXPECT_FALSE(server.set_max_datagram_size(4096));
+	sys_api::thread_sleep(50);
+
+	Address address = server.get_bind_address();
+	EXPECT_NE(0, address.get_port());
+
+	socket_t clients[client_counts];
+	for (int32_t i = 0; i < client_counts; i++) {
+		clients[i] = _createClient();
+		for (int32_t j = 0; j < datagram_counts; j++) {
+			char temp[32];
+			int len = std::snprintf(temp, sizeof(temp), "hello,%d,%d", i, j);
+			EXPECT_EQ(len, socket_api::sendto(clients[i], temp, (size_t)len, address.get_sockaddr(), address.get_sockaddr_len()));
+		}
+	}
+
+	for (int32_t i = 0; i < client_counts; i++) {
+		EXPECT_EQ(datagram_counts, _receiveAll(clients[i], datagram_counts, nullptr));
+		socket_api::close_socket(clients[i]);
+	}
+
+	EXPECT_EQ((uint64_t)(client_counts*datagram_counts), server.get_received_counts());
+	EXPECT_EQ((uint64_t)(client_counts*datagram_counts), server.get_sent_counts());
+	EXPECT_EQ(0u, server.get_dropped_counts());
+	EXPECT_NE(0, thread_mask.load());
+
+	server.stop();
+	server.join();
+}
+
+//-------------------------------------------------------------------------------------
+TEST(UdpServer, Segments)
+{
+	const size_t max_datagram_size = 1024;
+	const size_t segment_size = 1000;
+	const size_t total_size = 10 * segment_size + 500;
+
+	UdpServer server("udp_segments", nullptr);
+	EXPECT_TRUE(server.set_max_datagram_size(max_datagram_size));
+	server.m_listener.onMessage = [&](UdpServer*, int32_t, UdpSocket* udp, const char*, size_t, const Address& peer) {
+		std::vector<char> big(total_size, 'x');
+		EXPECT_TRUE(udp->send_segments(peer, &big[0], big.size(), segment_size));
+
+		//too large
+		EXPECT_FALSE(udp->send_to(peer, &big[0], max_datagram_size + 1));
+	};
+	EXPECT_TRUE(server.bind(Address(0, true)));
+	EXPECT_TRUE(server.start(1));
+	sys_api::thread_sleep(50);
+
+	Address address = server.get_bind_address();
+	socket_t sfd = _createClient();
+	EXPECT_EQ(1, socket_api::sendto(sfd, "s", 1, address.get_sockaddr(), address.get_sockaddr_len()));
+
+	//11 datagrams, by gso or not
+	size_t received_size = 0;
+	EXPECT_EQ(11, _receiveAll(sfd, 11, &received_size));
+	EXPECT_EQ(total_size, received_size);
+	EXPECT_EQ(11u, server.get_sent_counts());
+	EXPECT_EQ(1u, server.get_dropped_counts());
+
+	//the datagram larger than max datagram size is truncated and dropped
+	std::vector<char> big(max_datagram_size * 2, 'y');
+	EXPECT_EQ((ssize_t)big.size(), socket_api::sendto(sfd, &big[0], big.size(), address.get_sockaddr(), address.get_sockaddr_len()));
+	for (int32_t i = 0; i < 100 && server.get_received_counts() < 2; i++) {
+		sys_api::thread_sleep(10);
+	}
+	EXPECT_EQ(2u, server.get_received_counts());
+#ifdef CY_HAVE_RECVMMSG
+	EXPECT_EQ(2u, server.get_dropped_counts());
+#endif
+
+	socket_api::close_socket(sfd);
+	server.stop();
+	server.join();
+}
+
+}